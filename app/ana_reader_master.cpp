@@ -1,4 +1,6 @@
+#include <algorithm>
 #include <climits>
+#include <cstring>
 #include <string>
 #include <vector>
 #include <set>
@@ -7,10 +9,43 @@
 #include <numeric>
 #include <unistd.h>
 #include <stdint.h>
+#include <thread>
+#include <exception>
+#include <functional>
 
 #include "lc2daq.h"
 #include "DaqBase.h"
-#include "hdf5_hl.h"
+
+
+// A block of events read by the hdf5 thread. The values that go
+// into each event checksum are packed in data, event idx owns
+// data[data_start[idx], data_start[idx+1]).
+struct EventBlock {
+  int64_t first, count;
+  std::vector<int64_t> events;
+  std::vector<size_t> data_start;
+  std::vector<int64_t> data;
+  std::vector<int64_t> checksums;
+  std::vector<int64_t> processed_times;
+
+  // hdf5 thread time spent waiting for and reading the block
+  int64_t read_micro;
+  // hdf5 thread time waiting for the analysis to free up a buffer
+  int64_t read_stall_micro;
+  // analysis time waiting for the hdf5 thread, and computing
+  int64_t io_wait_micro;
+  int64_t compute_micro;
+
+  // analyzed, but the results are not written yet - only the hdf5 thread writes them
+  bool results_pending;
+
+  EventBlock();
+  void clear(int64_t _first, int64_t _count);
+};
+
+
+// the hdf5 thread fills block N+1 while block N is analyzed
+typedef BlockPipeline<EventBlock> EventBlockPipeline;
 
 
 class AnaReaderMaster : public DaqBase {
@@ -25,7 +60,9 @@ class AnaReaderMaster : public DaqBase {
   int m_vlen_max_per_shot;
   int m_wait_for_dsets_microsecond_pause;
   int m_wait_for_dsets_timeout;
+  std::unique_ptr<WaitStrategy> m_wait_strategy;
   int m_wait_master_seconds_max;
+  size_t m_chunk_cache_budget_bytes;
   std::string m_master_fname, m_output_fname;
   hid_t m_master_fid;
   hid_t m_output_fid;
@@ -34,22 +71,82 @@ class AnaReaderMaster : public DaqBase {
 
   std::map<std::string, int> m_top_group_2_num_subgroups;
 
+  // values in an event row of each dataset in a subgroup, the small wide
+  // table layout has a column per stream, everything else 1. Stream
+  // sub * columns + column is the one in column of subgroup sub.
+  std::map<std::string, int> m_top_group_2_columns;
+
   // map "small" -> 1 if they appear on every shot, etc
   std::map<std::string, int> m_rates;
 
-  // map "small" -> N where N will be in terms of number of events
+  // map "small" -> N where N will be in terms of number of events, 
+  // for each source dataset behind the master
   std::map<std::string, int> m_events_per_dataset_chunkcache;
 
-  std::vector<int64_t> m_event_data;
-
+  // number of int64 values that go into the checksum of one event
+  size_t m_max_event_data_count;
+
+  bool m_prefetch;
+  int m_analysis_threads;
+  int64_t m_next_block_start;
+
+  // per stream, nanoseconds from a writer's nano to this reader seeing the
+  // event. An upper bound when we fall behind and find events already there.
+  // A nano that is not set, is after we saw the event, or is for an event
+  // whose fiducial check failed is skipped and counted instead.
+  // Written to /visibility_latency/<top>/<sub>/{counts,summary,skipped} at the end.
+  struct VisibilityLatency {
+    LatencyHistogram hist;
+    int64_t skipped;
+    hid_t counts_dset, summary_dset, skipped_dset;
+    VisibilityLatency() : skipped(0), counts_dset(-1), summary_dset(-1), skipped_dset(-1) {}
+  };
+  std::map<std::string, std::vector<VisibilityLatency> > m_visibility_latency;
+
+  // the hdf5 thread reads the values of an event in here, a row per dataset,
+  // as one batch
+  struct PendingRead {
+    Dset *dset;
+    int64_t event_idx_in_master;
+    bool check_event_number;
+    const std::string *top_name, *dset_name;
+    size_t sub;
+    // values in the row, and where they start in the scratch buffer
+    size_t columns, offset;
+    // for nano, the stream of column 0, the other columns' streams follow
+    // it, and when we saw the event
+    VisibilityLatency *latency;
+    int64_t observed_nano;
+  };
+  std::vector<PendingRead> m_pending_reads;
+  // (top name, stream) whose fiducial check failed for the current event
+  std::vector<std::pair<const std::string *, size_t> > m_failed_fiducials;
+  DsetBatch m_batch;
+  AlignedBuffer m_read_scratch;
+
+  // results are appended to SWMR datasets in the output file as we go
+  DsetAppendBuffer m_event_checksums, m_event_numbers, m_event_processed_times, m_block_timing;
+  int64_t m_num_blocks, m_num_events, m_total_io_wait_micro, m_total_compute_micro;
 
 protected:
   void wait_for_SWMR_access_to_master();
   void analysis_loop();
   void initialize_dsets();
   void close_dsets();
-  void wait_for_event_to_be_available(int64_t event);
-  int64_t calc_event_checksum(int64_t event_number);
+  void wait_for_event_to_be_available(int64_t event, const std::function<bool()> &cancelled);
+  bool next_block(int64_t &first, int64_t &count);
+  void read_block(EventBlock &block, const EventBlockPipeline *pipeline = NULL);
+  void read_event_data(int64_t event_number, std::vector<int64_t> &data, const std::function<bool()> &cancelled);
+  void analyze_block(EventBlock &block);
+  int64_t calc_event_checksum(const int64_t *data, size_t len);
+  void report_block(const EventBlock &block);
+  void prefetch_loop(EventBlockPipeline &pipeline);
+  void create_results_dsets();
+  void write_results(EventBlock &block);
+  void close_results_dsets();
+  void create_visibility_latency_dsets();
+  void write_visibility_latency();
+  void create_wait_strategy();
   
 public:
   AnaReaderMaster(int argc, char *argv[]);
@@ -74,16 +171,30 @@ AnaReaderMaster::AnaReaderMaster(int argc, char *argv[])
     m_wait_for_dsets_microsecond_pause(m_config["ana_reader_master"]["wait_for_dsets_microsecond_pause"].as<int>()),
     m_wait_for_dsets_timeout(m_config["ana_reader_master"]["wait_for_dsets_timeout"].as<int>()),
     m_wait_master_seconds_max(m_config["ana_reader_master"]["wait_master_seconds_max"].as<int>()),
+    m_chunk_cache_budget_bytes(m_config["ana_reader_master"]["chunk_cache_budget_mb"].as<size_t>() << 20),
     m_master_fid(-1),
-    m_output_fid(-1)
+    m_output_fid(-1),
+    m_max_event_data_count(0),
+    m_prefetch(m_config["ana_reader_master"]["prefetch"].as<bool>()),
+    m_analysis_threads(std::max(1, m_config["ana_reader_master"]["analysis_threads"].as<int>())),
+    m_next_block_start(0),
+    m_num_blocks(0),
+    m_num_events(0),
+    m_total_io_wait_micro(0),
+    m_total_compute_micro(0)
 {  
   m_master_fname = DaqBase::form_fullpath("daq_master", 0, HDF5);
   m_output_fname = DaqBase::form_fullpath("ana_reader_master", m_id, HDF5);
 
-  m_top_group_2_num_subgroups[std::string("small")] = m_num_small_per_writer * m_num_writers;
+  bool small_wide = DaqBase::small_layout_wide();
+  m_top_group_2_num_subgroups[std::string("small")] = small_wide ? m_num_writers : m_num_small_per_writer * m_num_writers;
   m_top_group_2_num_subgroups[std::string("vlen")] = m_num_vlen_per_writer * m_num_writers;
   m_top_group_2_num_subgroups[std::string("cspad")] = size_t(m_num_cspad);
 
+  m_top_group_2_columns[std::string("small")] = small_wide ? m_num_small_per_writer : 1;
+  m_top_group_2_columns[std::string("vlen")] = 1;
+  m_top_group_2_columns[std::string("cspad")] = 1;
+
   m_rates[std::string("small")] = m_small_rate;
   m_rates[std::string("vlen")] = m_vlen_rate;
   m_rates[std::string("cspad")] = m_cspad_rate;  
@@ -101,6 +212,7 @@ AnaReaderMaster::AnaReaderMaster(int argc, char *argv[])
 
 void AnaReaderMaster::run() {
   wait_for_SWMR_access_to_master();
+  create_wait_strategy();
 
   hid_t fapl = NONNEG( H5Pcreate(H5P_FILE_ACCESS) );
   NONNEG( H5Pset_libver_bounds(fapl, H5F_LIBVER_LATEST, H5F_LIBVER_LATEST) );
@@ -110,13 +222,157 @@ void AnaReaderMaster::run() {
   }
   NONNEG( H5Pclose(fapl) );
 
+  create_results_dsets();
+  create_visibility_latency_dsets();
+  NONNEG( H5Fstart_swmr_write(m_output_fid) );
+
   analysis_loop();
 
+  close_results_dsets();
+  write_visibility_latency();
+  m_read_scratch.release();
   NONNEG( H5Fclose(m_master_fid) );
   NONNEG( H5Fclose(m_output_fid) );
 }
 
 
+void AnaReaderMaster::create_results_dsets() {
+  size_t chunksize = m_config["ana_reader_master"]["results_chunksize"].as<size_t>();
+  std::vector<hsize_t> chunk(1, chunksize);
+  m_event_checksums = DsetAppendBuffer(Dset::create(m_output_fid, "event_checksums", H5T_NATIVE_INT64, chunk), chunksize);
+  m_event_numbers = DsetAppendBuffer(Dset::create(m_output_fid, "event_numbers", H5T_NATIVE_INT64, chunk), chunksize);
+  m_event_processed_times = DsetAppendBuffer(Dset::create(m_output_fid, "event_processed_times", H5T_NATIVE_INT64, chunk), chunksize);
+
+  // one row per block: first, num_events, read, read_stall, io_wait, compute - times in microseconds
+  size_t timing_chunksize = std::max(size_t(1), chunksize / 6);
+  std::vector<hsize_t> timing_chunk = {timing_chunksize, 6};
+  m_block_timing = DsetAppendBuffer(Dset::create(m_output_fid, "block_timing", H5T_NATIVE_INT64, timing_chunk), timing_chunksize);
+}
+
+
+void AnaReaderMaster::create_visibility_latency_dsets() {
+  // nothing can be created once SWMR writing starts, so the datasets are
+  // made now at their final size, and written at the end
+  static const char *summary_columns = "count,min,p50,p90,p99,p999,max,mean - nanoseconds";
+  hsize_t num_buckets = LatencyHistogram::NUM_BUCKETS, num_summary = 8;
+  hid_t counts_space = NONNEG( H5Screate_simple(1, &num_buckets, NULL) );
+  hid_t summary_space = NONNEG( H5Screate_simple(1, &num_summary, NULL) );
+  hid_t scalar_space = NONNEG( H5Screate(H5S_SCALAR) );
+  hid_t str_type = NONNEG( H5Tcopy(H5T_C_S1) );
+  NONNEG( H5Tset_size(str_type, strlen(summary_columns) + 1) );
+
+  hid_t latency_group = NONNEG( H5Gcreate2(m_output_fid, "visibility_latency", H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT) );
+  std::vector<int64_t> bucket_lower(num_buckets);
+  for (size_t bucket = 0; bucket < num_buckets; ++bucket) bucket_lower[bucket] = LatencyHistogram::bucket_lower(int(bucket));
+  hid_t lower_dset = NONNEG( H5Dcreate2(latency_group, "bucket_lower_ns", H5T_NATIVE_INT64, counts_space, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT) );
+  NONNEG( H5Dwrite(lower_dset, H5T_NATIVE_INT64, H5S_ALL, H5S_ALL, H5P_DEFAULT, &bucket_lower.at(0)) );
+  NONNEG( H5Dclose(lower_dset) );
+
+  for (auto topIter = m_top_group_2_num_subgroups.begin();
+       topIter != m_top_group_2_num_subgroups.end(); ++topIter) {
+    const std::string &topName = topIter->first;
+    // one histogram per stream, whatever the layout
+    size_t numSub = size_t(topIter->second) * m_top_group_2_columns[topName];
+    hid_t top_group = NONNEG( H5Gcreate2(latency_group, topName.c_str(), H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT) );
+    std::vector<VisibilityLatency> &streams = m_visibility_latency[topName];
+    streams.resize(numSub);
+    for (size_t sub = 0; sub < numSub; ++sub) {
+      char sub_name[128];
+      sprintf(sub_name, "%5.5ld", sub);
+      hid_t sub_group = NONNEG( H5Gcreate2(top_group, sub_name, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT) );
+      streams[sub].counts_dset = NONNEG( H5Dcreate2(sub_group, "counts", H5T_NATIVE_INT64, counts_space, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT) );
+      streams[sub].summary_dset = NONNEG( H5Dcreate2(sub_group, "summary", H5T_NATIVE_INT64, summary_space, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT) );
+      streams[sub].skipped_dset = NONNEG( H5Dcreate2(sub_group, "skipped", H5T_NATIVE_INT64, scalar_space, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT) );
+      hid_t attr = NONNEG( H5Acreate2(streams[sub].summary_dset, "columns", str_type, scalar_space, H5P_DEFAULT, H5P_DEFAULT) );
+      NONNEG( H5Awrite(attr, str_type, summary_columns) );
+      NONNEG( H5Aclose(attr) );
+      NONNEG( H5Gclose(sub_group) );
+    }
+    NONNEG( H5Gclose(top_group) );
+  }
+
+  NONNEG( H5Gclose(latency_group) );
+  NONNEG( H5Tclose(str_type) );
+  NONNEG( H5Sclose(scalar_space) );
+  NONNEG( H5Sclose(summary_space) );
+  NONNEG( H5Sclose(counts_space) );
+}
+
+
+void AnaReaderMaster::write_visibility_latency() {
+  LatencyHistogram all;
+  int64_t all_skipped = 0;
+  for (auto topIter = m_visibility_latency.begin(); topIter != m_visibility_latency.end(); ++topIter) {
+    std::vector<VisibilityLatency> &streams = topIter->second;
+    for (size_t sub = 0; sub < streams.size(); ++sub) {
+      const LatencyHistogram &hist = streams[sub].hist;
+      int64_t summary[8] = {hist.count(), hist.min(), hist.percentile(50), hist.percentile(90),
+                            hist.percentile(99), hist.percentile(99.9), hist.max(), int64_t(hist.mean())};
+      NONNEG( H5Dwrite(streams[sub].counts_dset, H5T_NATIVE_INT64, H5S_ALL, H5S_ALL, H5P_DEFAULT, &hist.counts().at(0)) );
+      NONNEG( H5Dwrite(streams[sub].summary_dset, H5T_NATIVE_INT64, H5S_ALL, H5S_ALL, H5P_DEFAULT, summary) );
+      NONNEG( H5Dwrite(streams[sub].skipped_dset, H5T_NATIVE_INT64, H5S_ALL, H5S_ALL, H5P_DEFAULT, &streams[sub].skipped) );
+      NONNEG( H5Dclose(streams[sub].counts_dset) );
+      NONNEG( H5Dclose(streams[sub].summary_dset) );
+      NONNEG( H5Dclose(streams[sub].skipped_dset) );
+      all.merge(hist);
+      all_skipped += streams[sub].skipped;
+      if (m_config["verbose"].as<int>() >= 1) {
+        std::cout << logHdr() << "visibility latency " << topIter->first << "/" << sub
+                  << " events=" << hist.count()
+                  << " skipped=" << streams[sub].skipped
+                  << " p50_us=" << hist.percentile(50) / 1000
+                  << " p99_us=" << hist.percentile(99) / 1000
+                  << " p999_us=" << hist.percentile(99.9) / 1000 
+                  << " max_us=" << hist.max() / 1000 << std::endl;
+      }
+    }
+  }
+  std::cout << logHdr() << "visibility latency: observations=" << all.count()
+            << " skipped=" << all_skipped
+            << " p50_us=" << all.percentile(50) / 1000
+            << " p99_us=" << all.percentile(99) / 1000
+            << " p999_us=" << all.percentile(99.9) / 1000 
+            << " max_us=" << all.max() / 1000 << std::endl;
+}
+
+
+void AnaReaderMaster::write_results(EventBlock &block) {
+  if (not block.results_pending) return;
+  for (size_t idx = 0; idx < block.events.size(); ++idx) {
+    m_event_checksums.push(block.checksums.at(idx));
+    m_event_numbers.push(block.events.at(idx));
+    m_event_processed_times.push(block.processed_times.at(idx));
+  }
+  int64_t timing[6] = {block.first, int64_t(block.events.size()), 
+                       block.read_micro, block.read_stall_micro,
+                       block.io_wait_micro, block.compute_micro};
+  m_block_timing.push(timing);
+  block.results_pending = false;
+}
+
+
+void AnaReaderMaster::close_results_dsets() {
+  m_event_checksums.close();
+  m_event_numbers.close();
+  m_event_processed_times.close();
+  m_block_timing.close();
+}
+
+
+void AnaReaderMaster::create_wait_strategy() {
+  YAML::Node node = m_config["ana_reader_master"];
+  std::string kind = node["wait_strategy"].as<std::string>();
+  int min_micro = node["wait_backoff_min_microseconds"].as<int>();
+  if (kind == "fixed") min_micro = m_wait_for_dsets_microsecond_pause;
+  // the daq_master extends avail_events in the master file as writers make progress
+  m_wait_strategy = WaitStrategy::create(kind,
+                                         node["wait_spin_iterations"].as<int>(),
+                                         min_micro,
+                                         node["wait_backoff_max_microseconds"].as<int>(),
+                                         std::vector<std::string>(1, m_master_fname));
+}
+
+
 void AnaReaderMaster::wait_for_SWMR_access_to_master() {
   bool verbose = m_config["verbose"].as<int>() > 0;
   m_master_fid = H5Fopen_with_polling(m_master_fname, 
@@ -126,71 +382,198 @@ void AnaReaderMaster::wait_for_SWMR_access_to_master() {
 
 
 void AnaReaderMaster::analysis_loop() {    
-  std::vector<int64_t> event_checksums;
-  std::vector<int64_t> event_numbers;
-  std::vector<int64_t> event_processed_times;
-
-  size_t max_event_data_bytes = 0;
-  max_event_data_bytes += sizeof(int64_t) * 
-    m_top_group_2_num_subgroups[std::string("small")] * 
-    m_group2dsets[std::string("small")].size();
-  max_event_data_bytes += sizeof(int64_t) * 
-    m_top_group_2_num_subgroups[std::string("vlen")] * 
+  // fiducials are checked and milli is skipped, the cspad data is not copied
+  m_max_event_data_count = 0;
+  m_max_event_data_count += m_top_group_2_num_subgroups[std::string("small")] * 
+    m_top_group_2_columns[std::string("small")] * m_group2dsets[std::string("small")].size();
+  m_max_event_data_count += m_top_group_2_num_subgroups[std::string("vlen")] * 
     m_group2dsets[std::string("vlen")].size();
-  max_event_data_bytes += sizeof(int64_t) * m_vlen_max_per_shot * 
-    m_top_group_2_num_subgroups[std::string("vlen")]; // blobdata
-  max_event_data_bytes += m_num_cspad * sizeof(int64_t) * 
-    m_group2dsets[std::string("cspad")].size();
-  max_event_data_bytes += sizeof(short) * m_num_cspad * 32l * 185 * 388;
-  max_event_data_bytes *= 2; // just to be sure
-  size_t max_event_data_count = max_event_data_bytes / sizeof(int64_t);
-  m_event_data.resize(max_event_data_count);
+  m_max_event_data_count += m_num_cspad * m_group2dsets[std::string("cspad")].size();
   
   initialize_dsets();
 
-  int64_t event_block_start = m_id * m_event_block_size;
+  m_next_block_start = m_id * m_event_block_size;
+
+  std::cout << logHdr() << " starting loop, prefetch=" << m_prefetch 
+            << " analysis_threads=" << m_analysis_threads << std::endl;
+
+  if (m_prefetch) {
+    EventBlockPipeline pipeline;
+    // from here until the join, only hdf5_thread makes hdf5 calls
+    std::thread hdf5_thread(&AnaReaderMaster::prefetch_loop, this, std::ref(pipeline));
+    auto t0 = Clock::now();
+    pipeline.consume(hdf5_thread, [this, &t0](EventBlock &block) {
+      auto t1 = Clock::now();
+      analyze_block(block);
+      auto t2 = Clock::now();
+      block.io_wait_micro = std::chrono::duration_cast<std::chrono::microseconds>(t1 - t0).count();
+      block.compute_micro = std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1).count();
+      report_block(block);
+      // the hdf5 thread writes the results when it reuses the slot
+      block.results_pending = true;
+      t0 = Clock::now();
+    });
+    // whatever the hdf5 thread didn't get to, in event order
+    EventBlock *first = pipeline.block(0), *second = pipeline.block(1);
+    if (second->first < first->first) std::swap(first, second);
+    write_results(*first);
+    write_results(*second);
+  } else {
+    EventBlock block;
+    int64_t first, count;
+    while (next_block(first, count)) {
+      block.clear(first, count);
+      read_block(block);
+      auto t1 = Clock::now();
+      analyze_block(block);
+      block.compute_micro = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - t1).count();
+      // reading is all waiting when it is not overlapped
+      block.io_wait_micro = block.read_micro;
+      report_block(block);
+      block.results_pending = true;
+      write_results(block);
+    }
+  }
 
-  bool verbose2 = m_config["verbose"].as<int>()>=2;
-  int64_t report_interval = 50;
-  if (verbose2) report_interval = 1;
+  close_dsets();
 
-  int64_t last_report = 0;
+  std::cout << logHdr() << "analysis_loop: blocks=" << m_num_blocks
+            << " events=" << m_num_events
+            << " io_wait_ms=" << m_total_io_wait_micro / 1000 
+            << " compute_ms=" << m_total_compute_micro / 1000 << std::endl;
+
+  const WaitStats &wait_stats = m_wait_strategy->stats();
+  std::cout << logHdr() << "wait stats: waits=" << wait_stats.waits
+            << " immediate=" << wait_stats.immediate
+            << " refreshes=" << wait_stats.refreshes
+            << " sleeps=" << wait_stats.sleeps
+            << " notifications=" << wait_stats.notifications
+            << " timeouts=" << wait_stats.timeouts
+            << " cancels=" << wait_stats.cancels
+            << " wakeup_latency_mean_us=" << wait_stats.mean_wakeup_latency_micro()
+            << " wakeup_latency_max_us=" << wait_stats.wakeup_latency_max_micro << std::endl;
+}
 
-  std::cout << logHdr() << " starting loop" << std::endl;
-  while (event_block_start < m_num_samples) {
-    int64_t first = event_block_start;
-    int64_t count = std::min(m_event_block_size, m_num_samples - first);
-    event_block_start += (m_num_readers * m_event_block_size);
 
-    for (int64_t event_in_block = 0; event_in_block < count; ++event_in_block) {
-      int64_t event = first + event_in_block;
-      if ( not (small_writes(event) or vlen_writes(event) or cspad_roundrobin_writes(event))) {
-        if (verbose2) {
-          std::cout << logHdr() << " no data recorded for event " << event << " skipping" << std::endl; 
-        }
-        continue;
-      }
-      wait_for_event_to_be_available(event);
-      if (event - last_report >= report_interval) {
-        last_report = event;
-        std::cout << logHdr() << " starting to process " << event << std::endl;
-      }
+bool AnaReaderMaster::next_block(int64_t &first, int64_t &count) {
+  if (m_next_block_start >= m_num_samples) return false;
+  first = m_next_block_start;
+  count = std::min(m_event_block_size, m_num_samples - first);
+  m_next_block_start += (m_num_readers * m_event_block_size);
+  return true;
+}
+
 
-      event_checksums.push_back(calc_event_checksum(event));
-      event_numbers.push_back(event);
-      auto milli = std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now().time_since_epoch()).count();
-      event_processed_times.push_back(milli);
+void AnaReaderMaster::prefetch_loop(EventBlockPipeline &pipeline) {
+  try {
+    int64_t first, count;
+    for (int slot = 0; next_block(first, count); slot = 1 - slot) {
+      auto t0 = Clock::now();
+      EventBlock *block = pipeline.wait_for_empty(slot);
+      // the analysis failed, nobody is waiting for more blocks
+      if (block == NULL) break;
+      auto t1 = Clock::now();
+      write_results(*block);
+      block->clear(first, count);
+      read_block(*block, &pipeline);
+      block->read_stall_micro = std::chrono::duration_cast<std::chrono::microseconds>(t1 - t0).count();
+      pipeline.publish(slot);
     }
+    pipeline.reader_done(std::exception_ptr());
+  } catch (...) {
+    pipeline.reader_done(std::current_exception());
   }
+}
 
-  close_dsets();
 
-  int rank1=1;
-  hsize_t dim=event_numbers.size();
+void AnaReaderMaster::read_block(EventBlock &block, const EventBlockPipeline *pipeline) {
+  static bool verbose2 = m_config["verbose"].as<int>()>=2;
+  static int64_t report_interval = verbose2 ? 1 : 50;
+  static int64_t last_report = 0;
+
+  // once the analysis stops, waits for data that may never come give up
+  std::function<bool()> cancelled;
+  if (pipeline != NULL) cancelled = [pipeline] { return pipeline->stopped(); };
+
+  auto t0 = Clock::now();
+  block.data.reserve(m_max_event_data_count * size_t(block.count));
+  for (int64_t event = block.first; event < block.first + block.count; ++event) {
+    if (cancelled and cancelled()) break;
+    if ( not (small_writes(event) or vlen_writes(event) or cspad_roundrobin_writes(event))) {
+      if (verbose2) {
+        std::cout << logHdr() << " no data recorded for event " << event << " skipping" << std::endl; 
+      }
+      continue;
+    }
+    wait_for_event_to_be_available(event, cancelled);
+    if (event - last_report >= report_interval) {
+      last_report = event;
+      std::cout << logHdr() << " starting to process " << event << std::endl;
+    }
+    block.events.push_back(event);
+    read_event_data(event, block.data, cancelled);
+    block.data_start.push_back(block.data.size());
+  }
+  block.read_micro = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - t0).count();
+}
 
-  H5LTmake_dataset(m_output_fid, "/event_checksums", rank1, &dim, H5T_NATIVE_INT64, &event_checksums.at(0));
-  H5LTmake_dataset(m_output_fid, "/event_numbers", rank1, &dim, H5T_NATIVE_INT64, &event_numbers.at(0));
-  H5LTmake_dataset(m_output_fid, "/event_processed_times", rank1, &dim, H5T_NATIVE_INT64, &event_processed_times.at(0));
+
+void AnaReaderMaster::analyze_block(EventBlock &block) {
+  size_t num_events = block.events.size();
+  block.checksums.resize(num_events);
+  block.processed_times.resize(num_events);
+
+  auto analyze = [this, &block](size_t begin, size_t end) {
+    for (size_t idx = begin; idx < end; ++idx) {
+      size_t start = block.data_start.at(idx);
+      size_t len = block.data_start.at(idx+1) - start;
+      const int64_t *data = len > 0 ? &block.data.at(start) : NULL;
+      block.checksums[idx] = calc_event_checksum(data, len);
+      block.processed_times[idx] = std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now().time_since_epoch()).count();
+    }
+  };
+
+  // the analysis threads get contiguous slices of the block. Errors are
+  // kept per slice and the first rethrown once every thread is joined.
+  size_t num_threads = std::min(size_t(m_analysis_threads), std::max(size_t(1), num_events));
+  size_t per_thread = (num_events + num_threads - 1) / num_threads;
+  std::vector<std::exception_ptr> errors(num_threads);
+  auto analyze_slice = [&analyze, &errors, num_events, per_thread](size_t thread) {
+    try {
+      size_t begin = std::min(num_events, thread * per_thread);
+      analyze(begin, std::min(num_events, begin + per_thread));
+    } catch (...) {
+      errors.at(thread) = std::current_exception();
+    }
+  };
+  std::vector<std::thread> threads;
+  for (size_t thread = 1; thread < num_threads; ++thread) {
+    threads.push_back(std::thread(analyze_slice, thread));
+  }
+  analyze_slice(0);
+  for (auto iter = threads.begin(); iter != threads.end(); ++iter) {
+    iter->join();
+  }
+  for (auto iter = errors.begin(); iter != errors.end(); ++iter) {
+    if (*iter) std::rethrow_exception(*iter);
+  }
+}
+
+
+void AnaReaderMaster::report_block(const EventBlock &block) {
+  static bool verbose1 = m_config["verbose"].as<int>()>=1;
+  m_num_blocks += 1;
+  m_num_events += int64_t(block.events.size());
+  m_total_io_wait_micro += block.io_wait_micro;
+  m_total_compute_micro += block.compute_micro;
+  if (verbose1) {
+    std::cout << logHdr() << "block first=" << block.first
+              << " events=" << block.events.size()
+              << " read_us=" << block.read_micro
+              << " read_stall_us=" << block.read_stall_micro
+              << " io_wait_us=" << block.io_wait_micro
+              << " compute_us=" << block.compute_micro << std::endl;
+  }
 }
 
 
@@ -198,6 +581,15 @@ void AnaReaderMaster::initialize_dsets() {
   char dset_path[512];
   bool verbose1 = m_config["verbose"].as<int>()>=1;
   bool verbose2 = m_config["verbose"].as<int>()>=2;
+  auto t0 = Clock::now();
+
+  // split the chunk cache budget evenly over the datasets, the policy
+  // will usually want much less than its share for the small datasets
+  size_t num_dsets = 1;
+  for (auto iter = m_group2dsets.begin(); iter != m_group2dsets.end(); ++iter) {
+    num_dsets += iter->second.size() * m_top_group_2_num_subgroups[iter->first];
+  }
+  size_t max_cache_bytes_per_dset = m_chunk_cache_budget_bytes / num_dsets;
 
   for (auto iter = m_group2dsets.begin(); iter != m_group2dsets.end(); ++iter) {
     auto &topGroup = iter->first;  
@@ -205,6 +597,11 @@ void AnaReaderMaster::initialize_dsets() {
     m_topGroups[topGroup] = Number2Dsets();
     size_t num_sub_groups = m_top_group_2_num_subgroups[topGroup];
 
+    // we read one event at a time, working through blocks of events
+    ChunkCachePolicy cache_policy = ChunkCachePolicy::for_reader(1, m_event_block_size, m_num_readers,
+                                                                 m_events_per_dataset_chunkcache[topGroup],
+                                                                 max_cache_bytes_per_dset);
+
     if (verbose2) {
       std::cout << logHdr()  << "initialize_dsets: " << topGroup << std::endl;
     }
@@ -216,15 +613,24 @@ void AnaReaderMaster::initialize_dsets() {
         if (verbose2) {
           std::cout << logHdr()  << "about to open dset: " << dset_path << std::endl;
         }
-        m_topGroups[topGroup][sub_group][dsetName] = Dset::open(m_master_fid, dset_path, Dset::if_vds_first_missing);
+        m_topGroups[topGroup][sub_group][dsetName] = Dset::open(m_master_fid, dset_path, Dset::if_vds_first_missing, cache_policy);
       }
     }
   }
 
   m_avail_events = Dset::open(m_master_fid, "avail_events", Dset::if_vds_first_missing);
 
+  // the VDS sources were described through the layout cache, the
+  // files it opened to do that are no longer needed
+  DsetLayoutCache &layout_cache = DsetLayoutCache::instance();
+  layout_cache.release_files();
+
   if (verbose1) {
-    std::cout << logHdr()  << "initialized dsets" << std::endl;
+    auto milli = std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - t0).count();
+    std::cout << logHdr()  << "initialized dsets in " << milli << " ms, layout cache:"
+              << " hits=" << layout_cache.hits()
+              << " misses=" << layout_cache.misses()
+              << " file_opens=" << layout_cache.file_opens() << std::endl;
   }
 }
 
@@ -246,27 +652,27 @@ void AnaReaderMaster::close_dsets() {
 }
 
 
-int64_t AnaReaderMaster::calc_event_checksum(int64_t event_number) {
+void AnaReaderMaster::read_event_data(int64_t event_number, std::vector<int64_t> &data,
+                                      const std::function<bool()> &cancelled) {
   static const std::string fiducials_str("fiducials"), 
-    milli_str("milli"), cspad_str("cspad"), 
+    milli_str("milli"), nano_str("nano"), cspad_str("cspad"), 
     data_str("data"), blobdata_str("blobdata"), vlen_str("vlen");
   static bool verbose2 = m_config["verbose"].as<int>()>=2;
-  size_t next_idx = 0;
-  
-  typedef enum {unknown, check_event_number, copy_cspad, copy_vlen_blob, copy_int64_t} Action;
   
-  hsize_t count = 1;
-  hsize_t bigger_buffer_to_be_safe = 10*count;
-  std::vector<int64_t> value(bigger_buffer_to_be_safe);
+  typedef enum {unknown, check_event_number, copy_cspad, copy_vlen_blob, copy_int64_t, visibility_latency} Action;
   
+  // wait on every dataset the event is in, then read one value from each
+  // of them as one batch
+  m_pending_reads.clear();
   for (auto topIter = m_top_group_2_num_subgroups.begin();
        topIter != m_top_group_2_num_subgroups.end(); ++topIter) {
     
-    std::string topName = topIter->first;
+    const std::string &topName = topIter->first;
     int64_t event_idx_in_master = get_event_idx_in_master(topName, event_number);
     if (event_idx_in_master == -1) continue;
     
     size_t numSub = topIter->second;
+    size_t columns = size_t(m_top_group_2_columns[topName]);
     auto & dsetNameList = m_group2dsets[topName];
     auto &num2dsetNameList = m_topGroups[topName];
     
@@ -280,6 +686,8 @@ int64_t AnaReaderMaster::calc_event_checksum(int64_t event_number) {
         action = check_event_number;
       } else if (dsetName == milli_str) {
         continue;
+      } else if (dsetName == nano_str) {
+        action = visibility_latency;
       } else if ((topName == cspad_str) and (dsetName == data_str)) {
         action = copy_cspad;
       } else if  ((topName == vlen_str) and (dsetName == blobdata_str)) {
@@ -289,29 +697,32 @@ int64_t AnaReaderMaster::calc_event_checksum(int64_t event_number) {
       for (size_t sub = 0; sub < numSub; ++sub) {
         auto &dsetnameList = num2dsetNameList[sub];
         auto &dset = dsetnameList[dsetName];
-        dset.wait(event_idx_in_master+1, m_wait_for_dsets_microsecond_pause, 
-                  m_wait_for_dsets_timeout, verbose2);
+        dset.wait(event_idx_in_master+1, *m_wait_strategy, 
+                  m_wait_for_dsets_timeout, verbose2, cancelled);
+        if (cancelled and cancelled()) throw std::runtime_error("read_event_data - cancelled, the analysis stopped");
+        PendingRead pending;
+        pending.dset = &dset;
+        pending.event_idx_in_master = event_idx_in_master;
+        pending.check_event_number = false;
+        pending.top_name = &topName;
+        pending.dset_name = &dsetName;
+        pending.sub = sub;
+        pending.columns = columns;
+        pending.offset = 0;
+        pending.latency = NULL;
+        pending.observed_nano = 0;
         switch (action) {
         case check_event_number:
-          dset.read(event_idx_in_master, count, value, true);
-          if (value.at(0) != event_number) {
-            std::cerr << "ERROR: check_event_number failure: " << topName 
-                      << "/" << sub << "/" << dsetName << "["
-                      << event_idx_in_master << "]=" << value.at(0) 
-                      << " != event_number=" << event_number << std::endl;
-            //            throw std::runtime_error("check_event_number failed");
-          }
+          pending.check_event_number = true;
+          m_pending_reads.push_back(pending);
+          break;
+        case visibility_latency:
+          pending.latency = &m_visibility_latency[topName].at(sub * columns);
+          pending.observed_nano = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+          m_pending_reads.push_back(pending);
           break;
         case copy_int64_t:
-          dset.read(event_idx_in_master, count, value);
-          if (next_idx + 1 >= m_event_data.size()) {
-            std::cerr << "ERROR: copy_int64_t: m_event_data too short - it is " 
-                      << m_event_data.size() << " but need " 
-                      <<  (next_idx + 1) << " len." << std::endl;
-            throw std::runtime_error("copy_int64_t failed");
-          }
-          m_event_data.at(next_idx) = value.at(0);
-          next_idx += 1;
+          m_pending_reads.push_back(pending);
           break;
         case copy_cspad:
           break;
@@ -324,18 +735,109 @@ int64_t AnaReaderMaster::calc_event_checksum(int64_t event_number) {
     }
   }
 
-  size_t event_len_in_int64_ts = next_idx;
-  int64_t checksum = 0;
-  for (size_t idx = 0; idx < event_len_in_int64_ts; ++idx) {
-    checksum += m_event_data.at(idx);
+  size_t num_reads = m_pending_reads.size();
+  size_t num_values = 0;
+  for (size_t idx = 0; idx < num_reads; ++idx) {
+    m_pending_reads[idx].offset = num_values;
+    num_values += m_pending_reads[idx].columns;
+  }
+  if (m_read_scratch.len<int64_t>() < num_values) {
+    m_read_scratch = m_buffer_pool->acquire_for<int64_t>(num_values);
+  }
+  int64_t *values = m_read_scratch.as<int64_t>();
+
+  const hsize_t count = 1;
+  m_batch.clear();
+  for (size_t idx = 0; idx < num_reads; ++idx) {
+    PendingRead &pending = m_pending_reads[idx];
+    m_batch.add(*pending.dset, pending.event_idx_in_master, count, values + pending.offset, pending.columns);
+  }
+  m_batch.read();
+
+  m_failed_fiducials.clear();
+  for (size_t idx = 0; idx < num_reads; ++idx) {
+    const PendingRead &pending = m_pending_reads[idx];
+    for (size_t column = 0; column < pending.columns; ++column) {
+      int64_t value = values[pending.offset + column];
+      size_t stream = pending.sub * pending.columns + column;
+      if (verbose2) {
+        std::cout << logHdr() << *pending.top_name << "/" << stream << "/" << *pending.dset_name
+                  << "[" << pending.event_idx_in_master << "]=" << value << std::endl;
+      }
+      if (pending.latency != NULL) {
+        // not part of the checksum, recorded below once the fiducials are checked
+        continue;
+      } else if (not pending.check_event_number) {
+        data.push_back(value);
+      } else if (value != event_number) {
+        std::cerr << "ERROR: check_event_number failure: " << *pending.top_name 
+                  << "/" << stream << "/" << *pending.dset_name << "["
+                  << pending.event_idx_in_master << "]=" << value 
+                  << " != event_number=" << event_number << std::endl;
+        //            throw std::runtime_error("check_event_number failed");
+        m_failed_fiducials.push_back(std::make_pair(pending.top_name, stream));
+      }
+    }
+  }
+
+  for (size_t idx = 0; idx < num_reads; ++idx) {
+    const PendingRead &pending = m_pending_reads[idx];
+    if (pending.latency == NULL) continue;
+    for (size_t column = 0; column < pending.columns; ++column) {
+      int64_t nano = values[pending.offset + column];
+      size_t stream = pending.sub * pending.columns + column;
+      bool fiducial_ok = std::find(m_failed_fiducials.begin(), m_failed_fiducials.end(),
+                                   std::make_pair(pending.top_name, stream)) == m_failed_fiducials.end();
+      if ((nano <= 0) or (nano > pending.observed_nano) or (not fiducial_ok)) {
+        pending.latency[column].skipped += 1;
+      } else {
+        pending.latency[column].hist.record(pending.observed_nano - nano);
+      }
+    }
   }
+}
 
+
+int64_t AnaReaderMaster::calc_event_checksum(const int64_t *data, size_t len) {
+  int64_t checksum = 0;
+  for (size_t idx = 0; idx < len; ++idx) {
+    checksum += data[idx];
+  }
   return checksum;
 }
 
 
-void AnaReaderMaster::wait_for_event_to_be_available(int64_t event) {
-  m_avail_events.wait(event+1, m_wait_for_dsets_microsecond_pause, m_wait_for_dsets_timeout, true);
+void AnaReaderMaster::wait_for_event_to_be_available(int64_t event, const std::function<bool()> &cancelled) {
+  m_avail_events.wait(event+1, *m_wait_strategy, m_wait_for_dsets_timeout, true, cancelled);
+  if (cancelled and cancelled()) throw std::runtime_error("wait_for_event_to_be_available - cancelled, the analysis stopped");
+}
+
+
+EventBlock::EventBlock() :
+  first(-1),
+  count(0),
+  read_micro(0),
+  read_stall_micro(0),
+  io_wait_micro(0),
+  compute_micro(0),
+  results_pending(false)
+{}
+
+
+void EventBlock::clear(int64_t _first, int64_t _count) {
+  first = _first;
+  count = _count;
+  events.clear();
+  data_start.clear();
+  data_start.push_back(0);
+  data.clear();
+  checksums.clear();
+  processed_times.clear();
+  read_micro = 0;
+  read_stall_micro = 0;
+  io_wait_micro = 0;
+  compute_micro = 0;
+  results_pending = false;
 }
 
 
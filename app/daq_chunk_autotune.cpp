@@ -0,0 +1,471 @@
+// Picks chunk shapes for the writer streams from short trials instead of
+// guesswork. For each stream - small, vlen and cspad - and each candidate
+// chunk shape, writes a trial file the way daq_writer does (one event at a
+// time, H5Dflush every flush_interval events, SWMR), then reads it back the
+// way one ana_reader_master does (blocks of event_block_size, every
+// num'th block, with the reader's chunk cache policy). cspad candidates
+// include per panel chunks, chunk_panels of the 32 panels in one chunk.
+//
+// Each trial reports writer MB/s, reader MB/s and the file size. A stream's
+// recommendation maximizes the product of its writer and reader throughput
+// and file size, each relative to the best trial of that stream, and is
+// printed as a config block to paste into config.yaml.
+//
+// usage: daq_chunk_autotune config.yaml [--dir D] [--events N]
+//          [--cspad_events N] [--keep] [--json]
+//
+// A trial file is one writer's source dataset, not the master's round robin
+// VDS, and it is read back right after it is written, so reads mostly come
+// from the page cache. Point --dir at the filesystem the run will use.
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "yaml-cpp/yaml.h"
+#include "hdf5.h"
+
+#include "check_macros.h"
+#include "Dset.h"
+
+typedef std::chrono::steady_clock Clock;
+
+const hsize_t CSPAD_DIMS[3] = {32, 185, 388};
+
+
+struct Trial {
+  std::string stream;
+  // events per chunk, and for cspad panels per chunk
+  hsize_t chunk_events, chunk_panels;
+  double write_seconds, read_seconds;
+  // payload bytes, what the datasets hold
+  double write_bytes, read_bytes;
+  size_t file_bytes;
+
+  Trial() : chunk_events(0), chunk_panels(0), write_seconds(0), read_seconds(0),
+            write_bytes(0), read_bytes(0), file_bytes(0) {}
+
+  double write_mbps() const { return write_seconds > 0 ? write_bytes / write_seconds / 1e6 : 0; }
+  double read_mbps() const { return read_seconds > 0 ? read_bytes / read_seconds / 1e6 : 0; }
+};
+
+
+double seconds_since(Clock::time_point t0) {
+  return std::chrono::duration<double>(Clock::now() - t0).count();
+}
+
+
+class ChunkAutotune {
+  YAML::Node m_config;
+  std::string m_dir;
+  hsize_t m_events, m_cspad_events;
+  bool m_keep, m_json;
+
+  int m_flush_interval;
+  int m_small_num, m_vlen_num;
+  int m_vlen_min_per_shot, m_vlen_max_per_shot;
+  hsize_t m_event_block_size;
+  int m_num_readers;
+  int m_writer_chunks_cached;
+  size_t m_cache_budget_bytes;
+
+  std::vector<Trial> m_trials;
+
+  void parse_args(int argc, char *argv[]);
+  std::string trial_fname(const Trial &trial) const;
+  hid_t create_file(const std::string &fname) const;
+  ChunkCachePolicy reader_policy(hsize_t chunk_events, size_t num_dsets) const;
+  void flush(const std::vector<Dset> &dsets) const;
+  void finish(Trial &trial, const std::string &fname);
+
+  void small_trial(Trial &trial);
+  void vlen_trial(Trial &trial);
+  void cspad_trial(Trial &trial);
+
+  const Trial & recommend(const std::string &stream) const;
+  void report() const;
+
+public:
+  ChunkAutotune(int argc, char *argv[]);
+  int run();
+};
+
+
+ChunkAutotune::ChunkAutotune(int argc, char *argv[]) :
+  m_dir("."),
+  m_events(10000),
+  m_cspad_events(64),
+  m_keep(false),
+  m_json(false)
+{
+  parse_args(argc, argv);
+  YAML::Node writer = m_config["daq_writer"];
+  YAML::Node reader = m_config["ana_reader_master"];
+  m_flush_interval = std::max(1, m_config["flush_interval"].as<int>());
+  m_small_num = writer["datasets"]["single_source"]["small"]["num_per_writer"].as<int>();
+  m_vlen_num = writer["datasets"]["single_source"]["vlen"]["num_per_writer"].as<int>();
+  m_vlen_min_per_shot = writer["datasets"]["single_source"]["vlen"]["min_per_shot"].as<int>();
+  m_vlen_max_per_shot = writer["datasets"]["single_source"]["vlen"]["max_per_shot"].as<int>();
+  m_event_block_size = reader["event_block_size"].as<hsize_t>();
+  m_num_readers = std::max(1, reader["num"].as<int>());
+  m_writer_chunks_cached = reader["num_writer_chunks_per_dataset_chunk_cache"].as<int>();
+  m_cache_budget_bytes = reader["chunk_cache_budget_mb"].as<size_t>() << 20;
+}
+
+
+void ChunkAutotune::parse_args(int argc, char *argv[]) {
+  const char *usage = "usage: daq_chunk_autotune config.yaml [--dir D] [--events N] [--cspad_events N] [--keep] [--json]";
+  if (argc < 2) throw std::runtime_error(usage);
+  m_config = YAML::LoadFile(argv[1]);
+  for (int arg = 2; arg < argc; ++arg) {
+    if ((strcmp(argv[arg], "--dir") == 0) and (arg + 1 < argc)) {
+      m_dir = argv[++arg];
+    } else if ((strcmp(argv[arg], "--events") == 0) and (arg + 1 < argc)) {
+      m_events = hsize_t(atol(argv[++arg]));
+    } else if ((strcmp(argv[arg], "--cspad_events") == 0) and (arg + 1 < argc)) {
+      m_cspad_events = hsize_t(atol(argv[++arg]));
+    } else if (strcmp(argv[arg], "--keep") == 0) {
+      m_keep = true;
+    } else if (strcmp(argv[arg], "--json") == 0) {
+      m_json = true;
+    } else {
+      throw std::runtime_error(usage);
+    }
+  }
+  if ((m_events == 0) or (m_cspad_events == 0)) throw std::runtime_error("--events and --cspad_events must be positive");
+}
+
+
+std::string ChunkAutotune::trial_fname(const Trial &trial) const {
+  std::ostringstream fname;
+  fname << m_dir << "/chunk_autotune_" << trial.stream << "_" << trial.chunk_events;
+  if (trial.stream == "cspad") fname << "x" << trial.chunk_panels;
+  fname << ".h5";
+  return fname.str();
+}
+
+
+hid_t ChunkAutotune::create_file(const std::string &fname) const {
+  hid_t fapl = NONNEG(H5Pcreate(H5P_FILE_ACCESS));
+  NONNEG(H5Pset_libver_bounds(fapl, H5F_LIBVER_LATEST, H5F_LIBVER_LATEST));
+  hid_t fid = NONNEG(H5Fcreate(fname.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, fapl));
+  NONNEG(H5Pclose(fapl));
+  return fid;
+}
+
+
+// what ana_reader_master gives a dataset of this stream
+ChunkCachePolicy ChunkAutotune::reader_policy(hsize_t chunk_events, size_t num_dsets) const {
+  return ChunkCachePolicy::for_reader(m_event_block_size, m_event_block_size, m_num_readers,
+                                      hsize_t(m_writer_chunks_cached) * chunk_events,
+                                      m_cache_budget_bytes / std::max(size_t(1), num_dsets));
+}
+
+
+void ChunkAutotune::flush(const std::vector<Dset> &dsets) const {
+  for (auto iter = dsets.begin(); iter != dsets.end(); ++iter) {
+    NONNEG(H5Dflush(iter->id()));
+  }
+}
+
+
+void ChunkAutotune::finish(Trial &trial, const std::string &fname) {
+  struct stat st;
+  if (stat(fname.c_str(), &st) == 0) trial.file_bytes = size_t(st.st_size);
+  if (not m_keep) unlink(fname.c_str());
+  m_trials.push_back(trial);
+  if (not m_json) {
+    std::cerr << "daq_chunk_autotune: " << trial.stream << " chunk " << trial.chunk_events;
+    if (trial.stream == "cspad") std::cerr << "x" << trial.chunk_panels;
+    std::cerr << " write " << trial.write_mbps() << " MB/s read " << trial.read_mbps() << " MB/s" << std::endl;
+  }
+}
+
+
+// fiducials, milli, nano and data per small dataset group, as daq_writer
+void ChunkAutotune::small_trial(Trial &trial) {
+  const char *names[] = {"fiducials", "milli", "nano", "data"};
+  const size_t num_names = sizeof(names) / sizeof(names[0]);
+  std::string fname = trial_fname(trial);
+  std::vector<hsize_t> chunk(1, trial.chunk_events);
+
+  auto t0 = Clock::now();
+  hid_t fid = create_file(fname);
+  std::vector<Dset> dsets;
+  for (int group = 0; group < m_small_num; ++group) {
+    for (size_t name = 0; name < num_names; ++name) {
+      std::string path = std::string("/g") + std::to_string(group) + "_" + names[name];
+      dsets.push_back(Dset::create(fid, path.c_str(), H5T_NATIVE_INT64, chunk));
+    }
+  }
+  NONNEG(H5Fstart_swmr_write(fid));
+  for (hsize_t event = 0; event < m_events; ++event) {
+    int64_t value = int64_t(event);
+    for (auto iter = dsets.begin(); iter != dsets.end(); ++iter) {
+      iter->append(1, &value, 1);
+    }
+    if ((event > 0) and (event % m_flush_interval == 0)) flush(dsets);
+  }
+  for (auto iter = dsets.begin(); iter != dsets.end(); ++iter) iter->close();
+  NONNEG(H5Fclose(fid));
+  trial.write_seconds = seconds_since(t0);
+  trial.write_bytes = double(m_events) * dsets.size() * sizeof(int64_t);
+
+  std::vector<int64_t> data(m_event_block_size);
+  t0 = Clock::now();
+  fid = NONNEG(H5Fopen(fname.c_str(), H5F_ACC_RDONLY | H5F_ACC_SWMR_READ, H5P_DEFAULT));
+  ChunkCachePolicy policy = reader_policy(trial.chunk_events, dsets.size());
+  dsets.clear();
+  for (int group = 0; group < m_small_num; ++group) {
+    for (size_t name = 0; name < num_names; ++name) {
+      std::string path = std::string("/g") + std::to_string(group) + "_" + names[name];
+      dsets.push_back(Dset::open(fid, path.c_str(), Dset::if_vds_first_missing, policy));
+    }
+  }
+  hsize_t stride = m_event_block_size * hsize_t(m_num_readers);
+  for (hsize_t start = 0; start < m_events; start += stride) {
+    hsize_t count = std::min(m_event_block_size, m_events - start);
+    for (auto iter = dsets.begin(); iter != dsets.end(); ++iter) {
+      iter->read(start, count, &data.at(0), data.size());
+    }
+    trial.read_bytes += double(count) * dsets.size() * sizeof(int64_t);
+  }
+  for (auto iter = dsets.begin(); iter != dsets.end(); ++iter) iter->close();
+  NONNEG(H5Fclose(fid));
+  trial.read_seconds = seconds_since(t0);
+  finish(trial, fname);
+}
+
+
+// blobstart and blobcount per event, blob gets min to max_per_shot values
+void ChunkAutotune::vlen_trial(Trial &trial) {
+  std::string fname = trial_fname(trial);
+  std::vector<hsize_t> chunk(1, trial.chunk_events);
+  std::mt19937 rng(1234);
+  std::uniform_int_distribution<int> per_shot(m_vlen_min_per_shot, m_vlen_max_per_shot);
+  std::vector<int64_t> blob(m_vlen_max_per_shot);
+  for (size_t idx = 0; idx < blob.size(); ++idx) blob.at(idx) = int64_t(idx);
+
+  auto t0 = Clock::now();
+  hid_t fid = create_file(fname);
+  std::vector<Dset> dsets;
+  for (int group = 0; group < m_vlen_num; ++group) {
+    std::string prefix = std::string("/g") + std::to_string(group) + "_";
+    dsets.push_back(Dset::create(fid, (prefix + "blobstart").c_str(), H5T_NATIVE_INT64, chunk));
+    dsets.push_back(Dset::create(fid, (prefix + "blobcount").c_str(), H5T_NATIVE_INT64, chunk));
+    dsets.push_back(Dset::create(fid, (prefix + "blob").c_str(), H5T_NATIVE_INT64, chunk));
+  }
+  NONNEG(H5Fstart_swmr_write(fid));
+  std::vector<int64_t> next_start(m_vlen_num, 0);
+  for (hsize_t event = 0; event < m_events; ++event) {
+    for (int group = 0; group < m_vlen_num; ++group) {
+      int64_t count = per_shot(rng);
+      dsets.at(3 * group).append(1, &next_start.at(group), 1);
+      dsets.at(3 * group + 1).append(1, &count, 1);
+      dsets.at(3 * group + 2).append(hsize_t(count), &blob.at(0), blob.size());
+      next_start.at(group) += count;
+      trial.write_bytes += double(2 + count) * sizeof(int64_t);
+    }
+    if ((event > 0) and (event % m_flush_interval == 0)) flush(dsets);
+  }
+  for (auto iter = dsets.begin(); iter != dsets.end(); ++iter) iter->close();
+  NONNEG(H5Fclose(fid));
+  trial.write_seconds = seconds_since(t0);
+
+  std::vector<int64_t> starts(m_event_block_size), counts(m_event_block_size);
+  std::vector<int64_t> data(m_event_block_size * m_vlen_max_per_shot);
+  t0 = Clock::now();
+  fid = NONNEG(H5Fopen(fname.c_str(), H5F_ACC_RDONLY | H5F_ACC_SWMR_READ, H5P_DEFAULT));
+  ChunkCachePolicy policy = reader_policy(trial.chunk_events, dsets.size());
+  dsets.clear();
+  for (int group = 0; group < m_vlen_num; ++group) {
+    std::string prefix = std::string("/g") + std::to_string(group) + "_";
+    dsets.push_back(Dset::open(fid, (prefix + "blobstart").c_str(), Dset::if_vds_first_missing, policy));
+    dsets.push_back(Dset::open(fid, (prefix + "blobcount").c_str(), Dset::if_vds_first_missing, policy));
+    dsets.push_back(Dset::open(fid, (prefix + "blob").c_str(), Dset::if_vds_first_missing, policy));
+  }
+  hsize_t stride = m_event_block_size * hsize_t(m_num_readers);
+  for (hsize_t start = 0; start < m_events; start += stride) {
+    hsize_t count = std::min(m_event_block_size, m_events - start);
+    for (int group = 0; group < m_vlen_num; ++group) {
+      dsets.at(3 * group).read(start, count, &starts.at(0), starts.size());
+      dsets.at(3 * group + 1).read(start, count, &counts.at(0), counts.size());
+      hsize_t blob_count = hsize_t(starts.at(count - 1) + counts.at(count - 1) - starts.at(0));
+      dsets.at(3 * group + 2).read(hsize_t(starts.at(0)), blob_count, &data.at(0), data.size());
+      trial.read_bytes += double(2 * count + blob_count) * sizeof(int64_t);
+    }
+  }
+  for (auto iter = dsets.begin(); iter != dsets.end(); ++iter) iter->close();
+  NONNEG(H5Fclose(fid));
+  trial.read_seconds = seconds_since(t0);
+  finish(trial, fname);
+}
+
+
+// one cspad data dataset, int16 [events, 32, 185, 388]
+void ChunkAutotune::cspad_trial(Trial &trial) {
+  std::string fname = trial_fname(trial);
+  std::vector<hsize_t> dims = {0, CSPAD_DIMS[0], CSPAD_DIMS[1], CSPAD_DIMS[2]};
+  std::vector<hsize_t> chunk = {trial.chunk_events, trial.chunk_panels, CSPAD_DIMS[1], CSPAD_DIMS[2]};
+  const size_t frame_len = size_t(CSPAD_DIMS[0] * CSPAD_DIMS[1] * CSPAD_DIMS[2]);
+  std::vector<int16_t> frame(frame_len);
+  std::mt19937 rng(1234);
+  for (size_t idx = 0; idx < frame_len; ++idx) frame.at(idx) = int16_t(rng() & 0x3fff);
+
+  auto t0 = Clock::now();
+  hid_t fid = create_file(fname);
+  Dset dset = Dset::create(fid, "/data", H5T_NATIVE_INT16, chunk, dims);
+  NONNEG(H5Fstart_swmr_write(fid));
+  for (hsize_t event = 0; event < m_cspad_events; ++event) {
+    dset.append(1, &frame.at(0), frame.size());
+    if ((event > 0) and (event % m_flush_interval == 0)) NONNEG(H5Dflush(dset.id()));
+  }
+  dset.close();
+  NONNEG(H5Fclose(fid));
+  trial.write_seconds = seconds_since(t0);
+  trial.write_bytes = double(m_cspad_events) * frame_len * sizeof(int16_t);
+
+  // the reader reads cspad one event at a time
+  t0 = Clock::now();
+  fid = NONNEG(H5Fopen(fname.c_str(), H5F_ACC_RDONLY | H5F_ACC_SWMR_READ, H5P_DEFAULT));
+  dset = Dset::open(fid, "/data", Dset::if_vds_first_missing, reader_policy(trial.chunk_events, 1));
+  hsize_t stride = m_event_block_size * hsize_t(m_num_readers);
+  for (hsize_t start = 0; start < m_cspad_events; start += stride) {
+    hsize_t end = std::min(start + m_event_block_size, m_cspad_events);
+    for (hsize_t event = start; event < end; ++event) {
+      dset.read(event, 1, &frame.at(0), frame.size());
+      trial.read_bytes += double(frame_len) * sizeof(int16_t);
+    }
+  }
+  dset.close();
+  NONNEG(H5Fclose(fid));
+  trial.read_seconds = seconds_since(t0);
+  finish(trial, fname);
+}
+
+
+const Trial & ChunkAutotune::recommend(const std::string &stream) const {
+  double best_write = 0, best_read = 0;
+  size_t smallest = 0;
+  for (auto iter = m_trials.begin(); iter != m_trials.end(); ++iter) {
+    if (iter->stream != stream) continue;
+    best_write = std::max(best_write, iter->write_mbps());
+    best_read = std::max(best_read, iter->read_mbps());
+    if ((smallest == 0) or (iter->file_bytes < smallest)) smallest = iter->file_bytes;
+  }
+  const Trial *best = NULL;
+  double best_score = -1;
+  for (auto iter = m_trials.begin(); iter != m_trials.end(); ++iter) {
+    if (iter->stream != stream) continue;
+    double score = (best_write > 0 ? iter->write_mbps() / best_write : 1) *
+      (best_read > 0 ? iter->read_mbps() / best_read : 1) *
+      (iter->file_bytes > 0 ? double(smallest) / iter->file_bytes : 1);
+    if (score > best_score) {
+      best_score = score;
+      best = &*iter;
+    }
+  }
+  if (best == NULL) throw std::runtime_error("no trials for " + stream);
+  return *best;
+}
+
+
+void ChunkAutotune::report() const {
+  const Trial &small = recommend("small");
+  const Trial &vlen = recommend("vlen");
+  const Trial &cspad = recommend("cspad");
+
+  if (m_json) {
+    std::cout << "{\n  \"trials\": [";
+    for (size_t idx = 0; idx < m_trials.size(); ++idx) {
+      const Trial &trial = m_trials.at(idx);
+      std::cout << (idx == 0 ? "\n" : ",\n")
+                << "    {\"stream\": \"" << trial.stream << "\", \"chunk_events\": " << trial.chunk_events
+                << ", \"chunk_panels\": " << trial.chunk_panels
+                << ", \"write_mbps\": " << trial.write_mbps() << ", \"read_mbps\": " << trial.read_mbps()
+                << ", \"file_bytes\": " << trial.file_bytes << "}";
+    }
+    std::cout << "\n  ],\n  \"recommended\": {\"small_chunksize\": " << small.chunk_events
+              << ", \"vlen_chunksize\": " << vlen.chunk_events
+              << ", \"cspad_chunksize\": " << cspad.chunk_events
+              << ", \"cspad_chunk_panels\": " << cspad.chunk_panels << "}\n}" << std::endl;
+    return;
+  }
+
+  std::cout << "stream,chunk_events,chunk_panels,write_mbps,read_mbps,file_bytes" << std::endl;
+  for (auto iter = m_trials.begin(); iter != m_trials.end(); ++iter) {
+    std::cout << iter->stream << "," << iter->chunk_events << "," << iter->chunk_panels << ","
+              << iter->write_mbps() << "," << iter->read_mbps() << "," << iter->file_bytes << std::endl;
+  }
+
+  YAML::Emitter out;
+  out << YAML::BeginMap << YAML::Key << "daq_writer" << YAML::Value
+      << YAML::BeginMap << YAML::Key << "datasets" << YAML::Value << YAML::BeginMap
+      << YAML::Key << "round_robin" << YAML::Value << YAML::BeginMap
+      << YAML::Key << "cspad" << YAML::Value << YAML::BeginMap
+      << YAML::Key << "chunksize" << YAML::Value << cspad.chunk_events
+      << YAML::Key << "chunk_panels" << YAML::Value << cspad.chunk_panels
+      << YAML::EndMap << YAML::EndMap
+      << YAML::Key << "single_source" << YAML::Value << YAML::BeginMap
+      << YAML::Key << "small" << YAML::Value << YAML::BeginMap
+      << YAML::Key << "chunksize" << YAML::Value << small.chunk_events << YAML::EndMap
+      << YAML::Key << "vlen" << YAML::Value << YAML::BeginMap
+      << YAML::Key << "chunksize" << YAML::Value << vlen.chunk_events << YAML::EndMap
+      << YAML::EndMap << YAML::EndMap << YAML::EndMap << YAML::EndMap;
+  std::cout << "\n# recommended by daq_chunk_autotune, " << m_events << " events, "
+            << m_cspad_events << " cspad events\n" << out.c_str() << std::endl;
+}
+
+
+int ChunkAutotune::run() {
+  const hsize_t small_chunks[] = {1, 10, 100, 600, 1000, 4096};
+  const hsize_t vlen_chunks[] = {10, 100, 600, 1000, 4096};
+  const hsize_t cspad_chunks[] = {1, 2, 4};
+  const hsize_t cspad_panels[] = {32, 8, 4, 1};
+
+  for (auto chunk : small_chunks) {
+    Trial trial;
+    trial.stream = "small";
+    trial.chunk_events = chunk;
+    small_trial(trial);
+  }
+  for (auto chunk : vlen_chunks) {
+    Trial trial;
+    trial.stream = "vlen";
+    trial.chunk_events = chunk;
+    vlen_trial(trial);
+  }
+  for (auto chunk : cspad_chunks) {
+    if (chunk > m_cspad_events) continue;
+    for (auto panels : cspad_panels) {
+      Trial trial;
+      trial.stream = "cspad";
+      trial.chunk_events = chunk;
+      trial.chunk_panels = panels;
+      cspad_trial(trial);
+    }
+  }
+  report();
+  return 0;
+}
+
+
+int main(int argc, char *argv[]) {
+  try {
+    ChunkAutotune autotune(argc, argv);
+    return autotune.run();
+  } catch (const std::exception &ex) {
+    std::cerr << "daq_chunk_autotune: Caught exception: " << ex.what() << std::endl;
+    return 1;
+  }
+}
@@ -0,0 +1,647 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <stdexcept>
+#include <unistd.h>
+#include <vector>
+#include <map>
+
+#include "lc2daq.h"
+#include "DaqBase.h"
+
+// The alternative to the master's VDS and external links. Tails every
+// daq_writer file over SWMR, reads the new rows of each stream by their
+// fiducials, assembles whole events in a ReorderBuffer and appends them, in
+// fiducial order, to one SWMR file, daq_event_builder-sNNNN.h5, with the
+// master's paths:
+//
+//   /small/NNNNN/*, /vlen/NNNNN/*, /cspad/NNNNN/*   as in the master, cspad
+//                                                  in event order
+//   /avail_events                                  1 per event built
+//   /missing_parts                                 parts of the event filled in
+//
+// A reader goes through one file in large chunks, sequentially, rather than
+// through a VDS onto N writer files.
+//
+// The buffer holds reorder_buffer_events fiducials. A writer that is ahead
+// is not read past the end of the window, its rows wait in its file. When
+// the streams the oldest event is missing have had nothing new for
+// late_writer_seconds, and parts of it or of later events are in, it is
+// written without them, as is every event after it while they stay idle. A
+// missing part is a row with fiducial, milli and nano -1, data 0 and a vlen
+// count of 0, so every stream keeps its rows for the events it samples.
+// Parts that turn up after their event was written are dropped.
+class DaqEventBuilder : public DaqBase {
+
+  enum Kind {SMALL, VLEN, CSPAD};
+
+  // an output group, and the values of its events in the reorder buffer
+  struct Stream {
+    Kind kind;
+    int number;
+    // int64 values in a row of fiducials, milli, nano and small data, more
+    // than 1 for the wide small layout
+    size_t width;
+    // int16 in a cspad frame
+    size_t frame_len;
+    std::vector<size_t> sources;
+
+    Dset fiducials, milli, nano, data, blobstart, blobcount;
+    hsize_t blob_len;
+
+    // by reorder buffer slot
+    std::vector<int64_t> slot_fiducials, slot_milli, slot_nano, slot_data;
+    std::vector<std::vector<int64_t> > slot_blobs;
+    std::vector<int16_t> slot_frames;
+
+    // rows built but not appended yet, cspad frames are appended as built
+    std::vector<int64_t> out_fiducials, out_milli, out_nano, out_data;
+    std::vector<int64_t> out_blob, out_blobstart, out_blobcount;
+  };
+
+  // one stream in one writer file, a part of the events it samples
+  struct Source {
+    size_t stream;
+    int writer;
+    Dset fiducials, milli, nano, data, blobstart, blobcount;
+    hsize_t rows_read;
+  };
+
+  bool m_verbose, m_verbose2;
+  int m_num_writers;
+  int m_small_groups_per_writer, m_vlen_num_per_writer, m_cspad_num;
+  int64_t m_num_samples;
+  size_t m_reorder_buffer_events;
+  double m_late_writer_seconds;
+  hsize_t m_small_chunksize, m_vlen_chunksize, m_vlen_blob_chunksize, m_cspad_chunksize;
+  size_t m_flush_events;
+  size_t m_micro_wait, m_micro_timeout;
+
+  hid_t m_builder_fid;
+  std::vector<hid_t> m_writer_fids;
+  std::vector<Stream> m_streams;
+  std::vector<Source> m_sources;
+  ReorderBuffer m_buffer;
+  // the latest fiducial any part has arrived for
+  int64_t m_max_arrived;
+
+  Dset m_avail_events, m_missing_parts;
+  std::vector<int64_t> m_out_avail, m_out_missing;
+
+  int64_t m_events_built, m_events_incomplete;
+
+  // scratch for reading rows
+  std::vector<int64_t> m_fids, m_milli, m_nano, m_values, m_starts, m_counts;
+
+public:
+  DaqEventBuilder(int argc, char *argv[]);
+  ~DaqEventBuilder();
+
+  void run();
+  void open_writer_files();
+  void create_builder_file();
+  void build_loop();
+  void close_files_and_objects();
+
+private:
+  bool expects(const Source &source, int64_t fiducial);
+  size_t num_expected_parts(int64_t fiducial);
+  bool read_source(size_t part);
+  bool front_waits_for_writers();
+  size_t emit_ready_events();
+  void emit(int64_t fiducial);
+  void write_built_events();
+  void create_stream_dsets(Stream &stream, hid_t group);
+};
+
+
+DaqEventBuilder::DaqEventBuilder(int argc, char *argv[])
+  : DaqBase(argc, argv, "daq_event_builder"),
+    m_verbose(m_config["verbose"].as<int>()>=1),
+    m_verbose2(m_config["verbose"].as<int>()>=2),
+    m_num_writers(m_config["daq_writer"]["num"].as<int>()),
+    m_small_groups_per_writer(0),
+    m_vlen_num_per_writer(m_config["daq_writer"]["datasets"]["single_source"]["vlen"]["num_per_writer"].as<int>()),
+    m_cspad_num(m_config["daq_writer"]["datasets"]["round_robin"]["cspad"]["num"].as<int>()),
+    m_num_samples(m_config["num_samples"].as<int64_t>()),
+    m_reorder_buffer_events(m_process_config["reorder_buffer_events"].as<size_t>()),
+    m_late_writer_seconds(m_process_config["late_writer_seconds"].as<double>()),
+    m_small_chunksize(m_process_config["small_chunksize"].as<hsize_t>()),
+    m_vlen_chunksize(m_process_config["vlen_chunksize"].as<hsize_t>()),
+    m_vlen_blob_chunksize(m_process_config["vlen_blob_chunksize"].as<hsize_t>()),
+    m_cspad_chunksize(m_process_config["cspad_chunksize"].as<hsize_t>()),
+    m_flush_events(std::max(size_t(1), m_process_config["flush_events"].as<size_t>())),
+    m_micro_wait(m_process_config["wait_microseconds"].as<size_t>()),
+    m_micro_timeout(m_process_config["time_out_seconds"].as<size_t>() * 1000000),
+    m_builder_fid(-1),
+    m_max_arrived(-1),
+    m_events_built(0),
+    m_events_incomplete(0)
+{
+  if (m_cspad_num != 1) {
+    throw std::runtime_error("only 1 cspad is supported");
+  }
+  int small_num_per_writer = m_config["daq_writer"]["datasets"]["single_source"]["small"]["num_per_writer"].as<int>();
+  m_small_groups_per_writer = DaqBase::small_layout_wide() ? 1 : small_num_per_writer;
+
+  // streams in output order, then a source per stream and writer
+  for (int small = 0; small < m_num_writers * m_small_groups_per_writer; ++small) {
+    Stream stream = Stream();
+    stream.kind = SMALL;
+    stream.number = small;
+    m_streams.push_back(stream);
+    Source source = Source();
+    source.stream = m_streams.size() - 1;
+    source.writer = small / m_small_groups_per_writer;
+    m_sources.push_back(source);
+  }
+  for (int vlen = 0; vlen < m_num_writers * m_vlen_num_per_writer; ++vlen) {
+    Stream stream = Stream();
+    stream.kind = VLEN;
+    stream.number = vlen;
+    m_streams.push_back(stream);
+    Source source = Source();
+    source.stream = m_streams.size() - 1;
+    source.writer = vlen / m_vlen_num_per_writer;
+    m_sources.push_back(source);
+  }
+  for (int cspad = 0; cspad < m_cspad_num; ++cspad) {
+    Stream stream = Stream();
+    stream.kind = CSPAD;
+    stream.number = cspad;
+    m_streams.push_back(stream);
+    // round robin, every writer has some of the frames
+    for (int writer = 0; writer < m_num_writers; ++writer) {
+      Source source = Source();
+      source.stream = m_streams.size() - 1;
+      source.writer = writer;
+      m_sources.push_back(source);
+    }
+  }
+  for (size_t part = 0; part < m_sources.size(); ++part) {
+    m_streams.at(m_sources.at(part).stream).sources.push_back(part);
+  }
+  m_buffer = ReorderBuffer(0, m_reorder_buffer_events, m_sources.size());
+}
+
+
+DaqEventBuilder::~DaqEventBuilder() {
+  std::cout << logHdr() << "done" << std::endl;
+}
+
+
+void DaqEventBuilder::run() {
+  DaqBase::run_setup();
+  open_writer_files();
+  create_builder_file();
+  NONNEG( H5Fstart_swmr_write(m_builder_fid) );
+  if (m_verbose) {
+    std::cout << logHdr() << "started SWMR access to event builder file" << std::endl;
+  }
+  build_loop();
+  close_files_and_objects();
+  m_t1 = Clock::now();
+
+  auto total_diff = m_t1 - m_t0;
+  auto seconds = std::chrono::duration_cast<std::chrono::seconds>(total_diff);
+  std::cout << logHdr() << "finished - num seconds=" << seconds.count()
+            << " num events=" << m_events_built
+            << " incomplete=" << m_events_incomplete
+            << " late parts dropped=" << m_buffer.num_late() << std::endl;
+}
+
+
+void DaqEventBuilder::open_writer_files() {
+  for (int writer = 0; writer < m_num_writers; ++writer) {
+    std::string fname = form_fullpath("daq_writer", writer, HDF5);
+    m_writer_fids.push_back(H5Fopen_with_polling(fname, H5F_ACC_RDONLY | H5F_ACC_SWMR_READ, H5P_DEFAULT, m_verbose));
+  }
+
+  char path[256];
+  for (auto source = m_sources.begin(); source != m_sources.end(); ++source) {
+    Stream &stream = m_streams.at(source->stream);
+    const char *top = (stream.kind == SMALL) ? "small" : ((stream.kind == VLEN) ? "vlen" : "cspad");
+    sprintf(path, "/%s/%5.5d", top, stream.number);
+    hid_t group = NONNEG( H5Gopen2(m_writer_fids.at(source->writer), path, H5P_DEFAULT) );
+    source->fiducials = Dset::open(group, "fiducials", Dset::if_vds_first_missing);
+    source->milli = Dset::open(group, "milli", Dset::if_vds_first_missing);
+    source->nano = Dset::open(group, "nano", Dset::if_vds_first_missing);
+    source->data = Dset::open(group, (stream.kind == VLEN) ? "blob" : "data", Dset::if_vds_first_missing);
+    if (stream.kind == VLEN) {
+      source->blobstart = Dset::open(group, "blobstart", Dset::if_vds_first_missing);
+      source->blobcount = Dset::open(group, "blobcount", Dset::if_vds_first_missing);
+    }
+    source->rows_read = 0;
+    NONNEG( H5Gclose(group) );
+
+    if (stream.kind == CSPAD) {
+      stream.width = 1;
+      stream.frame_len = source->data.event_len();
+    } else {
+      stream.width = source->fiducials.event_len();
+      stream.frame_len = 0;
+    }
+  }
+}
+
+
+void DaqEventBuilder::create_builder_file() {
+  hid_t fapl = NONNEG( H5Pcreate(H5P_FILE_ACCESS) );
+  NONNEG( H5Pset_libver_bounds(fapl, H5F_LIBVER_LATEST, H5F_LIBVER_LATEST) );
+  m_builder_fid = NONNEG( H5Fcreate(m_fname_h5.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, fapl) );
+  if (m_verbose) {
+    std::cout << logHdr() << "created file: " << m_fname_h5 << std::endl;
+  }
+  NONNEG( H5Pclose(fapl) );
+
+  DaqBase::create_standard_groups(m_builder_fid);
+  DaqBase::create_number_groups(m_small_group, m_small_map, 0, m_num_writers * m_small_groups_per_writer);
+  DaqBase::create_number_groups(m_vlen_group, m_vlen_map, 0, m_num_writers * m_vlen_num_per_writer);
+  DaqBase::create_number_groups(m_cspad_group, m_cspad_map, 0, m_cspad_num);
+
+  for (auto stream = m_streams.begin(); stream != m_streams.end(); ++stream) {
+    TSubMap &sub_map = (stream->kind == SMALL) ? m_small_map : ((stream->kind == VLEN) ? m_vlen_map : m_cspad_map);
+    create_stream_dsets(*stream, sub_map.at(stream->number));
+  }
+
+  std::vector<hsize_t> chunk = {m_small_chunksize};
+  m_avail_events = Dset::create(m_builder_fid, "avail_events", H5T_NATIVE_INT64, chunk,
+                                ChunkCachePolicy::for_writer(m_flush_events));
+  m_missing_parts = Dset::create(m_builder_fid, "missing_parts", H5T_NATIVE_INT64, chunk,
+                                 ChunkCachePolicy::for_writer(m_flush_events));
+}
+
+
+void DaqEventBuilder::create_stream_dsets(Stream &stream, hid_t group) {
+  YAML::Node datasets = m_config["daq_writer"]["datasets"];
+  const size_t slots = m_buffer.capacity();
+
+  // fiducials, milli and nano are chunked like the small data
+  std::vector<hsize_t> chunk = {m_small_chunksize};
+  if ((stream.kind == SMALL) and DaqBase::small_layout_wide()) chunk.push_back(hsize_t(stream.width));
+  ChunkCachePolicy policy = ChunkCachePolicy::for_writer(m_flush_events);
+  stream.fiducials = Dset::create(group, "fiducials", H5T_NATIVE_INT64, chunk, chunk, policy);
+  stream.milli = Dset::create(group, "milli", H5T_NATIVE_INT64, chunk, chunk, policy);
+  stream.nano = Dset::create(group, "nano", H5T_NATIVE_INT64, chunk, chunk, policy);
+  stream.slot_fiducials.resize(slots * stream.width);
+  stream.slot_milli.resize(slots * stream.width);
+  stream.slot_nano.resize(slots * stream.width);
+  stream.blob_len = 0;
+
+  if (stream.kind == SMALL) {
+    DsetFilter filter = dset_filter_from_name(datasets["single_source"]["small"]["filter"].as<std::string>());
+    stream.data = Dset::create(group, "data", H5T_NATIVE_INT64, chunk, chunk, policy, filter);
+    stream.slot_data.resize(slots * stream.width);
+  } else if (stream.kind == VLEN) {
+    DsetFilter filter = dset_filter_from_name(datasets["single_source"]["vlen"]["filter"].as<std::string>());
+    std::vector<hsize_t> blob_chunk = {m_vlen_blob_chunksize}, index_chunk = {m_vlen_chunksize};
+    stream.data = Dset::create(group, "blob", H5T_NATIVE_INT64, blob_chunk, blob_chunk,
+                               ChunkCachePolicy::for_writer(m_vlen_blob_chunksize), filter);
+    stream.blobstart = Dset::create(group, "blobstart", H5T_NATIVE_INT64, index_chunk, index_chunk, policy);
+    stream.blobcount = Dset::create(group, "blobcount", H5T_NATIVE_INT64, index_chunk, index_chunk, policy);
+    stream.slot_blobs.resize(slots);
+  } else {
+    YAML::Node cspad_config = datasets["round_robin"]["cspad"];
+    DsetFilter filter = dset_filter_from_name(cspad_config["filter"].as<std::string>());
+    std::vector<hsize_t> dims = {0, CSPadDim1, CSPadDim2, CSPadDim3};
+    std::vector<hsize_t> frame_chunk(dims);
+    frame_chunk.at(0) = m_cspad_chunksize;
+    stream.data = Dset::create(group, "data", H5T_NATIVE_INT16, frame_chunk, dims,
+                               ChunkCachePolicy::for_writer(), filter);
+    stream.slot_frames.resize(slots * stream.frame_len);
+    // frames are copied as stored, with the writers' pedestal subtracted
+    char path[256];
+    sprintf(path, "/cspad/%5.5d", stream.number);
+    hid_t writer_group = NONNEG( H5Gopen2(m_writer_fids.at(0), path, H5P_DEFAULT) );
+    if (Pedestal::exists(writer_group, "pedestal")) {
+      Pedestal::load(writer_group, "pedestal").write(group, "pedestal");
+    }
+    NONNEG( H5Gclose(writer_group) );
+  }
+}
+
+
+void DaqEventBuilder::close_files_and_objects() {
+  for (auto source = m_sources.begin(); source != m_sources.end(); ++source) {
+    source->fiducials.close();
+    source->milli.close();
+    source->nano.close();
+    source->data.close();
+    source->blobstart.close();
+    source->blobcount.close();
+  }
+  for (auto stream = m_streams.begin(); stream != m_streams.end(); ++stream) {
+    stream->fiducials.close();
+    stream->milli.close();
+    stream->nano.close();
+    stream->data.close();
+    stream->blobstart.close();
+    stream->blobcount.close();
+  }
+  m_avail_events.close();
+  m_missing_parts.close();
+  DaqBase::close_number_groups(m_small_map);
+  DaqBase::close_number_groups(m_vlen_map);
+  DaqBase::close_number_groups(m_cspad_map);
+  DaqBase::close_standard_groups();
+  NONNEG( H5Fclose(m_builder_fid) );
+  for (auto fid = m_writer_fids.begin(); fid != m_writer_fids.end(); ++fid) {
+    NONNEG( H5Fclose(*fid) );
+  }
+}
+
+
+bool DaqEventBuilder::expects(const Source &source, int64_t fiducial) {
+  switch (m_streams.at(source.stream).kind) {
+  case SMALL:
+    return small_writes(fiducial);
+  case VLEN:
+    return vlen_writes(fiducial);
+  case CSPAD: {
+    int writer = -1;
+    return cspad_roundrobin_writes(fiducial, &writer) and (writer == source.writer);
+  }
+  }
+  return false;
+}
+
+
+size_t DaqEventBuilder::num_expected_parts(int64_t fiducial) {
+  size_t num = 0;
+  for (auto source = m_sources.begin(); source != m_sources.end(); ++source) {
+    if (expects(*source, fiducial)) ++num;
+  }
+  return num;
+}
+
+
+void DaqEventBuilder::build_loop() {
+  size_t micro_waited = 0;
+  size_t since_write = 0;
+  while (m_buffer.first() < m_num_samples) {
+    bool progress = false;
+    for (size_t part = 0; part < m_sources.size(); ++part) {
+      progress = read_source(part) or progress;
+    }
+    size_t emitted = emit_ready_events();
+    since_write += emitted;
+    // write when there is a block of events, or when the writers are idle
+    if ((since_write >= m_flush_events) or ((since_write > 0) and (not progress))) {
+      write_built_events();
+      since_write = 0;
+    }
+    if (progress or (emitted > 0)) {
+      micro_waited = 0;
+      continue;
+    }
+    if (micro_waited > m_micro_timeout) {
+      std::cout << logHdr() << "build loop - timeout waiting for writers at fiducial "
+                << m_buffer.first() << std::endl;
+      throw std::runtime_error("daq_event_builder timeout in build loop - writer must have died");
+    }
+    usleep(m_micro_wait);
+    micro_waited += m_micro_wait;
+  }
+  write_built_events();
+}
+
+
+// reads the rows a source has that fit in the reorder buffer, true if any
+bool DaqEventBuilder::read_source(size_t part) {
+  Source &source = m_sources.at(part);
+  Stream &stream = m_streams.at(source.stream);
+
+  // the writers flush fiducials first, the rest only needs a look when it grew
+  source.fiducials.refresh();
+  hsize_t avail = source.fiducials.dim().at(0);
+  if (avail <= source.rows_read) return false;
+  source.milli.refresh();
+  source.nano.refresh();
+  source.data.refresh();
+  avail = std::min(avail, std::min(source.milli.dim().at(0), source.nano.dim().at(0)));
+  if (stream.kind == VLEN) {
+    source.blobstart.refresh();
+    source.blobcount.refresh();
+    avail = std::min(avail, std::min(source.blobstart.dim().at(0), source.blobcount.dim().at(0)));
+  } else {
+    avail = std::min(avail, source.data.dim().at(0));
+  }
+  if (avail <= source.rows_read) return false;
+
+  const size_t width = stream.width;
+  hsize_t start = source.rows_read;
+  hsize_t count = avail - start;
+  m_fids.resize(size_t(count) * width);
+  source.fiducials.read(start, count, m_fids.data(), m_fids.size());
+
+  // fiducials increase down a stream, the rows that fit are a prefix
+  hsize_t fit = 0;
+  while ((fit < count) and (m_fids.at(size_t(fit) * width) < m_buffer.end())) ++fit;
+  count = fit;
+
+  if ((count > 0) and (stream.kind == VLEN)) {
+    m_starts.resize(size_t(count));
+    m_counts.resize(size_t(count));
+    source.blobstart.read(start, count, m_starts.data(), m_starts.size());
+    source.blobcount.read(start, count, m_counts.data(), m_counts.size());
+    // the blob can lag its index
+    while ((count > 0) and (hsize_t(m_starts.at(count - 1) + m_counts.at(count - 1)) > source.data.dim().at(0))) --count;
+  }
+  if (count == 0) return false;
+
+  m_milli.resize(size_t(count) * width);
+  m_nano.resize(size_t(count) * width);
+  source.milli.read(start, count, m_milli.data(), m_milli.size());
+  source.nano.read(start, count, m_nano.data(), m_nano.size());
+  hsize_t blob_first = 0;
+  if (stream.kind == SMALL) {
+    m_values.resize(size_t(count) * width);
+    source.data.read(start, count, m_values.data(), m_values.size());
+  } else if (stream.kind == VLEN) {
+    blob_first = hsize_t(m_starts.at(0));
+    hsize_t blob_count = hsize_t(m_starts.at(count - 1) + m_counts.at(count - 1)) - blob_first;
+    m_values.resize(size_t(blob_count));
+    if (blob_count > 0) source.data.read(blob_first, blob_count, m_values.data(), m_values.size());
+  }
+
+  for (size_t row = 0; row < size_t(count); ++row) {
+    int64_t fiducial = m_fids.at(row * width);
+    if (not m_buffer.fits(fiducial)) {
+      // its event was written without it
+      m_buffer.arrive(fiducial, part);
+      continue;
+    }
+    const size_t slot = m_buffer.slot(fiducial);
+    std::copy(m_fids.begin() + row * width, m_fids.begin() + (row + 1) * width, stream.slot_fiducials.begin() + slot * width);
+    std::copy(m_milli.begin() + row * width, m_milli.begin() + (row + 1) * width, stream.slot_milli.begin() + slot * width);
+    std::copy(m_nano.begin() + row * width, m_nano.begin() + (row + 1) * width, stream.slot_nano.begin() + slot * width);
+    if (stream.kind == SMALL) {
+      std::copy(m_values.begin() + row * width, m_values.begin() + (row + 1) * width, stream.slot_data.begin() + slot * width);
+    } else if (stream.kind == VLEN) {
+      auto first = m_values.begin() + size_t(m_starts.at(row) - int64_t(blob_first));
+      stream.slot_blobs.at(slot).assign(first, first + size_t(m_counts.at(row)));
+    } else {
+      source.data.read(start + row, 1, stream.slot_frames.data() + slot * stream.frame_len, stream.frame_len);
+    }
+    m_buffer.arrive(fiducial, part);
+    m_max_arrived = std::max(m_max_arrived, fiducial);
+  }
+  source.rows_read += count;
+
+  if (m_verbose2) {
+    std::cout << logHdr() << "writer=" << source.writer << " part=" << part << " read " << count
+              << " rows, rows_read=" << source.rows_read << std::endl;
+  }
+  return true;
+}
+
+
+// true while the oldest event is missing parts that may still come
+bool DaqEventBuilder::front_waits_for_writers() {
+  const int64_t fiducial = m_buffer.first();
+  const size_t arrived = m_buffer.num_arrived(fiducial);
+  if (arrived == num_expected_parts(fiducial)) return false;
+  // nothing of this or a later event yet, no one is late
+  if ((arrived == 0) and (m_max_arrived <= fiducial)) return true;
+  for (size_t part = 0; part < m_sources.size(); ++part) {
+    if (m_buffer.arrived(fiducial, part) or (not expects(m_sources.at(part), fiducial))) continue;
+    if (m_buffer.idle_seconds(part) < m_late_writer_seconds) return true;
+  }
+  return false;
+}
+
+
+// builds events from the front of the reorder buffer, returns how many
+size_t DaqEventBuilder::emit_ready_events() {
+  size_t emitted = 0;
+  while ((m_buffer.first() < m_num_samples) and (not front_waits_for_writers())) {
+    const int64_t fiducial = m_buffer.first();
+    emit(fiducial);
+    m_buffer.pop();
+    ++emitted;
+  }
+  return emitted;
+}
+
+
+void DaqEventBuilder::emit(int64_t fiducial) {
+  const size_t slot = m_buffer.slot(fiducial);
+  int64_t missing = 0;
+  for (auto stream = m_streams.begin(); stream != m_streams.end(); ++stream) {
+    for (auto part = stream->sources.begin(); part != stream->sources.end(); ++part) {
+      if (not expects(m_sources.at(*part), fiducial)) continue;
+      const size_t width = stream->width;
+      const bool have = m_buffer.arrived(fiducial, *part);
+      if (have) {
+        auto begin = slot * width;
+        stream->out_fiducials.insert(stream->out_fiducials.end(), stream->slot_fiducials.begin() + begin,
+                                     stream->slot_fiducials.begin() + begin + width);
+        stream->out_milli.insert(stream->out_milli.end(), stream->slot_milli.begin() + begin,
+                                 stream->slot_milli.begin() + begin + width);
+        stream->out_nano.insert(stream->out_nano.end(), stream->slot_nano.begin() + begin,
+                                stream->slot_nano.begin() + begin + width);
+      } else {
+        ++missing;
+        stream->out_fiducials.insert(stream->out_fiducials.end(), width, -1);
+        stream->out_milli.insert(stream->out_milli.end(), width, -1);
+        stream->out_nano.insert(stream->out_nano.end(), width, -1);
+      }
+
+      if (stream->kind == SMALL) {
+        if (have) {
+          stream->out_data.insert(stream->out_data.end(), stream->slot_data.begin() + slot * width,
+                                  stream->slot_data.begin() + (slot + 1) * width);
+        } else {
+          stream->out_data.insert(stream->out_data.end(), width, 0);
+        }
+      } else if (stream->kind == VLEN) {
+        const std::vector<int64_t> &blob = stream->slot_blobs.at(slot);
+        size_t blob_count = have ? blob.size() : 0;
+        stream->out_blobstart.push_back(int64_t(stream->blob_len + stream->out_blob.size()));
+        stream->out_blobcount.push_back(int64_t(blob_count));
+        stream->out_blob.insert(stream->out_blob.end(), blob.begin(), blob.begin() + blob_count);
+      } else {
+        int16_t *frame = stream->slot_frames.data() + slot * stream->frame_len;
+        if (not have) std::fill(frame, frame + stream->frame_len, int16_t(0));
+        stream->data.append(1, frame, stream->frame_len);
+      }
+    }
+  }
+  m_out_avail.push_back(1);
+  m_out_missing.push_back(missing);
+  ++m_events_built;
+  if (missing > 0) {
+    ++m_events_incomplete;
+    if (m_verbose) {
+      std::cout << logHdr() << "fiducial " << fiducial << " built without " << missing << " late parts" << std::endl;
+    }
+  }
+}
+
+
+// appends the built rows and flushes them, then avail_events so readers
+// waiting on it find the rows there
+void DaqEventBuilder::write_built_events() {
+  if (m_out_avail.empty()) return;
+  for (auto stream = m_streams.begin(); stream != m_streams.end(); ++stream) {
+    hsize_t rows = stream->out_fiducials.size() / stream->width;
+    if (rows > 0) {
+      stream->fiducials.append(rows, stream->out_fiducials.data(), stream->out_fiducials.size());
+      stream->milli.append(rows, stream->out_milli.data(), stream->out_milli.size());
+      stream->nano.append(rows, stream->out_nano.data(), stream->out_nano.size());
+      if (stream->kind == SMALL) {
+        stream->data.append(rows, stream->out_data.data(), stream->out_data.size());
+      } else if (stream->kind == VLEN) {
+        if (not stream->out_blob.empty()) {
+          stream->data.append(stream->out_blob.size(), stream->out_blob.data(), stream->out_blob.size());
+        }
+        stream->blob_len += stream->out_blob.size();
+        stream->blobstart.append(rows, stream->out_blobstart.data(), stream->out_blobstart.size());
+        stream->blobcount.append(rows, stream->out_blobcount.data(), stream->out_blobcount.size());
+      }
+    }
+    stream->out_fiducials.clear();
+    stream->out_milli.clear();
+    stream->out_nano.clear();
+    stream->out_data.clear();
+    stream->out_blob.clear();
+    stream->out_blobstart.clear();
+    stream->out_blobcount.clear();
+
+    NONNEG( H5Dflush(stream->fiducials.id()) );
+    NONNEG( H5Dflush(stream->milli.id()) );
+    NONNEG( H5Dflush(stream->nano.id()) );
+    NONNEG( H5Dflush(stream->data.id()) );
+    if (stream->kind == VLEN) {
+      NONNEG( H5Dflush(stream->blobstart.id()) );
+      NONNEG( H5Dflush(stream->blobcount.id()) );
+    }
+  }
+  m_missing_parts.append(m_out_missing.size(), m_out_missing.data(), m_out_missing.size());
+  m_avail_events.append(m_out_avail.size(), m_out_avail.data(), m_out_avail.size());
+  NONNEG( H5Dflush(m_missing_parts.id()) );
+  NONNEG( H5Dflush(m_avail_events.id()) );
+  m_out_avail.clear();
+  m_out_missing.clear();
+  if (m_verbose) {
+    std::cout << logHdr() << "flushed events up to fiducial " << m_buffer.first() << std::endl;
+  }
+}
+
+
+int main(int argc, char *argv[]) {
+  H5open();
+  try {
+    DaqEventBuilder eventBuilder(argc, argv);
+    eventBuilder.run();
+  } catch (const std::exception &ex) {
+    std::cout << "daq_event_builder: Caught exception: " << ex.what() << std::endl;
+    std::cout << "daq_event_builder: trying to close library " << std::endl;
+    H5close();
+    throw ex;
+  }
+  H5close();
+  return 0;
+}
@@ -0,0 +1,487 @@
+// Runs the whole pipeline on one host - N daq_writers, the daq_master and M
+// ana_reader_masters - against a local run directory, in place of
+// ana_daq_driver.py, and summarizes it: events/s and MB/s for the writers
+// and end to end, and the latency from an event being written (the writers'
+// milli) to it being processed (the readers' event_processed_times).
+//
+// usage: daq_harness config.yaml [--rootdir D] [--rundir R] [--bindir B]
+//          [--writers N] [--readers M] [--num_samples S] [--verbose V]
+//          [--stagger_ms T] [--timeout_seconds T] [--force] [--json]
+//
+// The summary is printed and written to rundir/results/daq_harness.json.
+// lfs striping from the config is ignored, point rootdir at tmpfs or a
+// local disk.
+#include <algorithm>
+#include <chrono>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <ftw.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "yaml-cpp/yaml.h"
+#include "hdf5.h"
+
+#include "check_macros.h"
+#include "Dset.h"
+
+typedef std::chrono::steady_clock Clock;
+
+
+struct Process {
+  std::string name;
+  std::string basename;
+  pid_t pid;
+  Clock::time_point start, end;
+  int status;
+  bool done;
+};
+
+
+struct Summary {
+  int num_writers, num_readers;
+  int64_t num_samples;
+  int failed;
+  double writers_seconds, master_seconds, readers_seconds, total_seconds;
+  double writer_mb;
+  int64_t reader_events;
+  double latency_p50_ms, latency_p90_ms, latency_p99_ms, latency_max_ms;
+  size_t latency_count;
+
+  Summary() : num_writers(0), num_readers(0), num_samples(0), failed(0),
+              writers_seconds(0), master_seconds(0), readers_seconds(0), total_seconds(0),
+              writer_mb(0), reader_events(0),
+              latency_p50_ms(0), latency_p90_ms(0), latency_p99_ms(0), latency_max_ms(0),
+              latency_count(0) {}
+};
+
+
+class DaqHarness {
+  YAML::Node m_config;
+  std::string m_bindir, m_rundir;
+  bool m_force, m_json;
+  int m_stagger_ms, m_timeout_seconds;
+  std::vector<Process> m_processes;
+  Clock::time_point m_t0;
+
+  void parse_args(int argc, char *argv[]);
+  void prepare_run_directory();
+  std::string write_config();
+
+  void launch(const std::string &name, int idx, const std::string &config_fname);
+  void wait_for_all();
+  void kill_all();
+
+  // event -> latest milli any writer recorded for it
+  void writer_millis(std::map<int64_t, int64_t> &event2milli);
+  void reader_latencies(const std::map<int64_t, int64_t> &event2milli,
+                        std::vector<int64_t> &latencies, int64_t &num_events);
+  double span_seconds(const std::string &name);
+
+  Summary summarize();
+  void report(const Summary &summary);
+
+public:
+  DaqHarness(int argc, char *argv[]);
+  int run();
+};
+
+
+namespace {
+
+  std::string form_basename(const std::string &process, int idx) {
+    char idstr[128];
+    sprintf(idstr, "%4.4d", idx);
+    return process + "-s" + idstr;
+  }
+
+  void make_dir(const std::string &path) {
+    if (0 != mkdir(path.c_str(), 0755)) {
+      throw std::runtime_error("daq_harness: could not create " + path + ": " + strerror(errno));
+    }
+  }
+
+  int remove_entry(const char *path, const struct stat *, int, struct FTW *) {
+    return remove(path);
+  }
+
+  // children before their directory, symlinks removed, not followed
+  void remove_tree(const std::string &path) {
+    if (0 != nftw(path.c_str(), remove_entry, 64, FTW_DEPTH | FTW_PHYS)) {
+      throw std::runtime_error("daq_harness: could not remove " + path + ": " + strerror(errno));
+    }
+  }
+
+  bool file_exists(const std::string &path) {
+    struct stat st;
+    return 0 == stat(path.c_str(), &st);
+  }
+
+  double file_mb(const std::string &path) {
+    struct stat st;
+    if (0 != stat(path.c_str(), &st)) return 0.0;
+    return double(st.st_size) / (1 << 20);
+  }
+
+  double percentile_ms(const std::vector<int64_t> &sorted, double pct) {
+    if (sorted.size() == 0) return 0.0;
+    size_t idx = std::min(sorted.size() - 1, size_t(pct * double(sorted.size() - 1) + 0.5));
+    return double(sorted.at(idx));
+  }
+
+  herr_t collect_link_name(hid_t, const char *name, const H5L_info_t *, void *op_data) {
+    static_cast<std::vector<std::string> *>(op_data)->push_back(name);
+    return 0;
+  }
+
+  void read_all(hid_t parent, const char *name, std::vector<int64_t> &data) {
+    // small wide tables come back flattened, a row of streams per event
+    Dset dset = Dset::open(parent, name, Dset::if_vds_first_missing);
+    data.resize(dset.dim().at(0) * dset.event_len());
+    if (data.size() > 0) dset.read(0, dset.dim().at(0), &data.at(0), data.size());
+    dset.close();
+  }
+}
+
+
+DaqHarness::DaqHarness(int argc, char *argv[])
+  : m_bindir("bin"),
+    m_force(false),
+    m_json(false),
+    m_stagger_ms(1000),
+    m_timeout_seconds(600)
+{
+  parse_args(argc, argv);
+  m_rundir = m_config["rootdir"].as<std::string>() + "/" + m_config["rundir"].as<std::string>();
+}
+
+
+void DaqHarness::parse_args(int argc, char *argv[]) {
+  if (argc < 2) {
+    std::cerr << "usage: daq_harness config.yaml [--rootdir D] [--rundir R] [--bindir B]" << std::endl;
+    std::cerr << "         [--writers N] [--readers M] [--num_samples S] [--verbose V]" << std::endl;
+    std::cerr << "         [--stagger_ms T] [--timeout_seconds T] [--force] [--json]" << std::endl;
+    throw std::runtime_error("Invalid command line arguments");
+  }
+  m_config = YAML::LoadFile(argv[1]);
+  for (int arg = 2; arg < argc; ++arg) {
+    std::string flag = argv[arg];
+    if (flag == "--force") {
+      m_force = true;
+      continue;
+    }
+    if (flag == "--json") {
+      m_json = true;
+      continue;
+    }
+    if (arg + 1 >= argc) throw std::runtime_error("daq_harness: " + flag + " needs a value");
+    std::string value = argv[++arg];
+    if ((flag == "--rootdir") or (flag == "--rundir")) {
+      m_config[flag.substr(2)] = value;
+    } else if ((flag == "--num_samples") or (flag == "--verbose")) {
+      m_config[flag.substr(2)] = atoi(value.c_str());
+    } else if (flag == "--writers") {
+      m_config["daq_writer"]["num"] = atoi(value.c_str());
+    } else if (flag == "--readers") {
+      m_config["ana_reader_master"]["num"] = atoi(value.c_str());
+    } else if (flag == "--bindir") {
+      m_bindir = value;
+    } else if (flag == "--stagger_ms") {
+      m_stagger_ms = atoi(value.c_str());
+    } else if (flag == "--timeout_seconds") {
+      m_timeout_seconds = atoi(value.c_str());
+    } else {
+      throw std::runtime_error("daq_harness: unknown argument " + flag);
+    }
+  }
+}
+
+
+void DaqHarness::prepare_run_directory() {
+  if (file_exists(m_rundir)) {
+    if (not m_force) {
+      throw std::runtime_error("daq_harness: " + m_rundir + " exists, and --force was not given");
+    }
+    remove_tree(m_rundir);
+  }
+  make_dir(m_rundir);
+  make_dir(m_rundir + "/hdf5");
+  make_dir(m_rundir + "/logs");
+  make_dir(m_rundir + "/results");
+  make_dir(m_rundir + "/pids");
+}
+
+
+std::string DaqHarness::write_config() {
+  std::string fname = m_rundir + "/config.yaml";
+  YAML::Emitter out;
+  out << m_config;
+  std::ofstream file(fname.c_str());
+  file << out.c_str() << std::endl;
+  if (not file) throw std::runtime_error("daq_harness: could not write " + fname);
+  return fname;
+}
+
+
+void DaqHarness::launch(const std::string &name, int idx, const std::string &config_fname) {
+  Process process;
+  process.name = name;
+  process.basename = form_basename(name, idx);
+  process.status = 0;
+  process.done = false;
+
+  std::string exe = m_bindir + "/" + name;
+  std::string log_fname = m_rundir + "/logs/" + process.basename + ".log";
+  std::string id = std::to_string(idx);
+
+  process.start = Clock::now();
+  process.pid = fork();
+  if (process.pid < 0) throw std::runtime_error("daq_harness: fork failed");
+  if (process.pid == 0) {
+    int log_fd = open(log_fname.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (log_fd >= 0) {
+      dup2(log_fd, STDOUT_FILENO);
+      dup2(log_fd, STDERR_FILENO);
+      close(log_fd);
+    }
+    execl(exe.c_str(), exe.c_str(), config_fname.c_str(), id.c_str(), (char *)NULL);
+    fprintf(stderr, "daq_harness: exec %s failed: %s\n", exe.c_str(), strerror(errno));
+    _exit(127);
+  }
+  m_processes.push_back(process);
+}
+
+
+void DaqHarness::wait_for_all() {
+  size_t num_running = m_processes.size();
+  while (num_running > 0) {
+    int status = 0;
+    pid_t pid = waitpid(-1, &status, WNOHANG);
+    if (pid < 0) throw std::runtime_error("daq_harness: waitpid failed");
+    if (pid == 0) {
+      auto waited = std::chrono::duration_cast<std::chrono::seconds>(Clock::now() - m_t0).count();
+      if (waited > m_timeout_seconds) {
+        std::cerr << "daq_harness: timeout after " << waited << " seconds, killing processes" << std::endl;
+        kill_all();
+        continue;
+      }
+      usleep(10000);
+      continue;
+    }
+    for (auto iter = m_processes.begin(); iter != m_processes.end(); ++iter) {
+      if ((iter->pid != pid) or iter->done) continue;
+      iter->end = Clock::now();
+      iter->status = status;
+      iter->done = true;
+      --num_running;
+      if (not (WIFEXITED(status) and (WEXITSTATUS(status) == 0))) {
+        std::cerr << "daq_harness: " << iter->basename << " failed, "
+                  << (WIFSIGNALED(status) ? "signal=" : "exit=")
+                  << (WIFSIGNALED(status) ? WTERMSIG(status) : WEXITSTATUS(status))
+                  << " see " << m_rundir << "/logs/" << iter->basename << ".log" << std::endl;
+      }
+    }
+  }
+}
+
+
+void DaqHarness::kill_all() {
+  for (auto iter = m_processes.begin(); iter != m_processes.end(); ++iter) {
+    if (not iter->done) kill(iter->pid, SIGKILL);
+  }
+}
+
+
+void DaqHarness::writer_millis(std::map<int64_t, int64_t> &event2milli) {
+  const char *top_names[] = {"small", "vlen", "cspad"};
+  int num_writers = m_config["daq_writer"]["num"].as<int>();
+  std::vector<int64_t> fiducials, millis;
+  for (int writer = 0; writer < num_writers; ++writer) {
+    std::string fname = m_rundir + "/hdf5/" + form_basename("daq_writer", writer) + ".h5";
+    hid_t fid = NONNEG( H5Fopen(fname.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT) );
+    for (auto top_name : top_names) {
+      if (H5Lexists(fid, top_name, H5P_DEFAULT) <= 0) continue;
+      hid_t top = NONNEG( H5Gopen2(fid, top_name, H5P_DEFAULT) );
+      std::vector<std::string> subs;
+      NONNEG( H5Literate(top, H5_INDEX_NAME, H5_ITER_INC, NULL, collect_link_name, &subs) );
+      for (auto sub = subs.begin(); sub != subs.end(); ++sub) {
+        hid_t group = NONNEG( H5Gopen2(top, sub->c_str(), H5P_DEFAULT) );
+        read_all(group, "fiducials", fiducials);
+        read_all(group, "milli", millis);
+        size_t len = std::min(fiducials.size(), millis.size());
+        for (size_t idx = 0; idx < len; ++idx) {
+          int64_t &milli = event2milli[fiducials[idx]];
+          milli = std::max(milli, millis[idx]);
+        }
+        NONNEG( H5Gclose(group) );
+      }
+      NONNEG( H5Gclose(top) );
+    }
+    NONNEG( H5Fclose(fid) );
+  }
+}
+
+
+void DaqHarness::reader_latencies(const std::map<int64_t, int64_t> &event2milli,
+                                  std::vector<int64_t> &latencies, int64_t &num_events) {
+  int num_readers = m_config["ana_reader_master"]["num"].as<int>();
+  std::vector<int64_t> events, processed;
+  num_events = 0;
+  for (int reader = 0; reader < num_readers; ++reader) {
+    std::string fname = m_rundir + "/hdf5/" + form_basename("ana_reader_master", reader) + ".h5";
+    if (not file_exists(fname)) continue;
+    hid_t fid = NONNEG( H5Fopen(fname.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT) );
+    read_all(fid, "event_numbers", events);
+    read_all(fid, "event_processed_times", processed);
+    NONNEG( H5Fclose(fid) );
+    num_events += int64_t(events.size());
+    size_t len = std::min(events.size(), processed.size());
+    for (size_t idx = 0; idx < len; ++idx) {
+      auto written = event2milli.find(events[idx]);
+      if (written == event2milli.end()) continue;
+      latencies.push_back(processed[idx] - written->second);
+    }
+  }
+  std::sort(latencies.begin(), latencies.end());
+}
+
+
+// from the first launch of any process to the last exit of name
+double DaqHarness::span_seconds(const std::string &name) {
+  Clock::time_point last = m_t0;
+  for (auto iter = m_processes.begin(); iter != m_processes.end(); ++iter) {
+    if ((iter->name == name) and (iter->end > last)) last = iter->end;
+  }
+  return std::chrono::duration_cast<std::chrono::microseconds>(last - m_t0).count() / 1e6;
+}
+
+
+Summary DaqHarness::summarize() {
+  Summary summary;
+  summary.num_writers = m_config["daq_writer"]["num"].as<int>();
+  summary.num_readers = m_config["ana_reader_master"]["num"].as<int>();
+  summary.num_samples = m_config["num_samples"].as<int64_t>();
+  for (auto iter = m_processes.begin(); iter != m_processes.end(); ++iter) {
+    if (not (WIFEXITED(iter->status) and (WEXITSTATUS(iter->status) == 0))) ++summary.failed;
+  }
+  summary.writers_seconds = span_seconds("daq_writer");
+  summary.master_seconds = span_seconds("daq_master");
+  summary.readers_seconds = span_seconds("ana_reader_master");
+  summary.total_seconds = std::max(summary.writers_seconds, std::max(summary.master_seconds, summary.readers_seconds));
+  for (int writer = 0; writer < summary.num_writers; ++writer) {
+    summary.writer_mb += file_mb(m_rundir + "/hdf5/" + form_basename("daq_writer", writer) + ".h5");
+  }
+  if (summary.failed > 0) return summary;
+
+  std::map<int64_t, int64_t> event2milli;
+  std::vector<int64_t> latencies;
+  writer_millis(event2milli);
+  reader_latencies(event2milli, latencies, summary.reader_events);
+  summary.latency_count = latencies.size();
+  summary.latency_p50_ms = percentile_ms(latencies, 0.50);
+  summary.latency_p90_ms = percentile_ms(latencies, 0.90);
+  summary.latency_p99_ms = percentile_ms(latencies, 0.99);
+  summary.latency_max_ms = percentile_ms(latencies, 1.0);
+  return summary;
+}
+
+
+void DaqHarness::report(const Summary &summary) {
+  double writer_events_per_s = summary.writers_seconds > 0 ? summary.num_samples / summary.writers_seconds : 0.0;
+  double writer_mb_per_s = summary.writers_seconds > 0 ? summary.writer_mb / summary.writers_seconds : 0.0;
+  double reader_events_per_s = summary.readers_seconds > 0 ? summary.reader_events / summary.readers_seconds : 0.0;
+
+  std::ostringstream json;
+  json << "{\n"
+       << "  \"num_writers\": " << summary.num_writers << ",\n"
+       << "  \"num_readers\": " << summary.num_readers << ",\n"
+       << "  \"num_samples\": " << summary.num_samples << ",\n"
+       << "  \"failed_processes\": " << summary.failed << ",\n"
+       << "  \"writers_seconds\": " << summary.writers_seconds << ",\n"
+       << "  \"master_seconds\": " << summary.master_seconds << ",\n"
+       << "  \"readers_seconds\": " << summary.readers_seconds << ",\n"
+       << "  \"total_seconds\": " << summary.total_seconds << ",\n"
+       << "  \"writer_mb\": " << summary.writer_mb << ",\n"
+       << "  \"writer_events_per_s\": " << writer_events_per_s << ",\n"
+       << "  \"writer_mb_per_s\": " << writer_mb_per_s << ",\n"
+       << "  \"reader_events\": " << summary.reader_events << ",\n"
+       << "  \"end_to_end_events_per_s\": " << reader_events_per_s << ",\n"
+       << "  \"latency_events\": " << summary.latency_count << ",\n"
+       << "  \"latency_p50_ms\": " << summary.latency_p50_ms << ",\n"
+       << "  \"latency_p90_ms\": " << summary.latency_p90_ms << ",\n"
+       << "  \"latency_p99_ms\": " << summary.latency_p99_ms << ",\n"
+       << "  \"latency_max_ms\": " << summary.latency_max_ms << "\n"
+       << "}\n";
+
+  std::string fname = m_rundir + "/results/daq_harness.json";
+  std::ofstream file(fname.c_str());
+  file << json.str();
+
+  if (m_json) {
+    std::cout << json.str();
+    return;
+  }
+  std::cout << "daq_harness: writers=" << summary.num_writers
+            << " readers=" << summary.num_readers
+            << " num_samples=" << summary.num_samples
+            << " failed_processes=" << summary.failed << std::endl;
+  std::cout << "daq_harness: seconds writers=" << summary.writers_seconds
+            << " master=" << summary.master_seconds
+            << " readers=" << summary.readers_seconds << std::endl;
+  std::cout << "daq_harness: writers events/s=" << writer_events_per_s
+            << " MB/s=" << writer_mb_per_s
+            << " (" << summary.writer_mb << " MB)" << std::endl;
+  std::cout << "daq_harness: end to end events/s=" << reader_events_per_s
+            << " reader events=" << summary.reader_events << std::endl;
+  std::cout << "daq_harness: latency ms p50=" << summary.latency_p50_ms
+            << " p90=" << summary.latency_p90_ms
+            << " p99=" << summary.latency_p99_ms
+            << " max=" << summary.latency_max_ms
+            << " (" << summary.latency_count << " events)" << std::endl;
+  std::cout << "daq_harness: summary in " << fname << std::endl;
+}
+
+
+int DaqHarness::run() {
+  prepare_run_directory();
+  std::string config_fname = write_config();
+
+  m_t0 = Clock::now();
+  int num_writers = m_config["daq_writer"]["num"].as<int>();
+  int num_readers = m_config["ana_reader_master"]["num"].as<int>();
+  for (int writer = 0; writer < num_writers; ++writer) launch("daq_writer", writer, config_fname);
+  usleep(useconds_t(m_stagger_ms) * 1000);
+  launch("daq_master", 0, config_fname);
+  usleep(useconds_t(m_stagger_ms) * 1000);
+  for (int reader = 0; reader < num_readers; ++reader) launch("ana_reader_master", reader, config_fname);
+
+  wait_for_all();
+  Summary summary = summarize();
+  report(summary);
+  return summary.failed > 0 ? 1 : 0;
+}
+
+
+int main(int argc, char *argv[]) {
+  try {
+    DaqHarness harness(argc, argv);
+    return harness.run();
+  } catch (const std::exception &ex) {
+    std::cerr << "daq_harness: Caught exception: " << ex.what() << std::endl;
+    return 1;
+  }
+}
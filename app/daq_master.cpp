@@ -21,6 +21,9 @@ class DaqMaster : public DaqBase {
   int m_num_writers;
   int m_small_num_per_writer;
   int m_vlen_num_per_writer;
+  // small groups each writer has, 1 for the wide table layout, where the
+  // group is numbered by writer and has a column per stream
+  int m_small_groups_per_writer;
   int m_cspad_num;
   int m_small_count_all;
   int m_vlen_count_all;
@@ -61,6 +64,7 @@ DaqMaster::DaqMaster(int argc, char *argv[])
     m_num_writers(m_config["daq_writer"]["num"].as<int>()),
     m_small_num_per_writer(m_config["daq_writer"]["datasets"]["single_source"]["small"]["num_per_writer"].as<int>()),
     m_vlen_num_per_writer(m_config["daq_writer"]["datasets"]["single_source"]["vlen"]["num_per_writer"].as<int>()),
+    m_small_groups_per_writer(DaqBase::small_layout_wide() ? 1 : m_small_num_per_writer),
     m_cspad_num(m_config["daq_writer"]["datasets"]["round_robin"]["cspad"]["num"].as<int>()),
     m_small_count_all(0),
     m_vlen_count_all(0),
@@ -71,7 +75,7 @@ DaqMaster::DaqMaster(int argc, char *argv[])
     throw std::runtime_error("only 1 cspad is supported");
   }
 
-  m_small_count_all = m_num_writers * m_small_num_per_writer;
+  m_small_count_all = m_num_writers * m_small_groups_per_writer;
   m_vlen_count_all = m_num_writers * m_vlen_num_per_writer;
 
 
@@ -152,17 +156,26 @@ void DaqMaster::create_all_master_groups_datasets_and_attributes() {
 
   // round robin datasets
   for (int cur_cspad = 0; cur_cspad < m_cspad_num; ++cur_cspad) {
-    std::vector<std::string> src_data, src_fid, src_milli;
+    std::vector<std::string> src_data, src_fid, src_milli, src_nano;
     for (size_t idx = 0; idx < m_writer_fnames_h5.size(); ++idx) {
       char cur_cspad_str[128];
       sprintf(cur_cspad_str, "%5.5d", cur_cspad);
       src_data.push_back(std::string("/cspad/") + cur_cspad_str + "/data");
       src_fid.push_back(std::string("/cspad/") + cur_cspad_str + "/fiducials");
       src_milli.push_back(std::string("/cspad/") + cur_cspad_str + "/milli");
+      src_nano.push_back(std::string("/cspad/") + cur_cspad_str + "/nano");
     }
     VDSRoundRobin roundRobinData(m_cspad_id_to_number_group.at(cur_cspad), "data", m_writer_fnames_h5, src_data);
     VDSRoundRobin roundRobinFid(m_cspad_id_to_number_group.at(cur_cspad), "fiducials", m_writer_fnames_h5, src_fid);
     VDSRoundRobin roundRobinmilli(m_cspad_id_to_number_group.at(cur_cspad), "milli", m_writer_fnames_h5, src_milli);
+    VDSRoundRobin roundRobinnano(m_cspad_id_to_number_group.at(cur_cspad), "nano", m_writer_fnames_h5, src_nano);
+
+    // every writer stores the same pedestal, link to the first one's
+    char pedestal_path[256];
+    sprintf(pedestal_path, "/cspad/%5.5d/pedestal", cur_cspad);
+    if (Pedestal::exists(m_writer_h5.at(0), pedestal_path)) {
+      NONNEG( H5Lcreate_external(m_writer_fnames_h5.at(0).c_str(), pedestal_path, m_master_fid, pedestal_path, H5P_DEFAULT, H5P_DEFAULT) );
+    }
   }
 
   // single source datasets
@@ -170,36 +183,40 @@ void DaqMaster::create_all_master_groups_datasets_and_attributes() {
 
     const char * src_writer_fname = m_writer_fnames_h5.at(writer).c_str();
 
-    int small_num_per_writer = m_config["daq_writer"]["datasets"]["single_source"]["small"]["num_per_writer"].as<int>();
+    int small_num_per_writer = m_small_groups_per_writer;
     int vlen_num_per_writer = m_config["daq_writer"]["datasets"]["single_source"]["vlen"]["num_per_writer"].as<int>();
 
     int small_first = writer * small_num_per_writer;
     int vlen_first = writer * vlen_num_per_writer;
     
     for (int small_dset = small_first; small_dset < small_first + small_num_per_writer; ++small_dset) {
-      char data_path[256], fid_path[256], milli_path[256];
+      char data_path[256], fid_path[256], milli_path[256], nano_path[256];
       sprintf(data_path, "/small/%5.5d/data", small_dset);
       sprintf(fid_path, "/small/%5.5d/fiducials", small_dset);
       sprintf(milli_path, "/small/%5.5d/milli", small_dset);
+      sprintf(nano_path, "/small/%5.5d/nano", small_dset);
 
       H5Lcreate_external(src_writer_fname, data_path, m_master_fid, data_path, H5P_DEFAULT, H5P_DEFAULT);
       H5Lcreate_external(src_writer_fname, fid_path, m_master_fid, fid_path, H5P_DEFAULT, H5P_DEFAULT);
       H5Lcreate_external(src_writer_fname, milli_path, m_master_fid, milli_path, H5P_DEFAULT, H5P_DEFAULT);
+      H5Lcreate_external(src_writer_fname, nano_path, m_master_fid, nano_path, H5P_DEFAULT, H5P_DEFAULT);
     }
     
     for (int vlen_dset = vlen_first; vlen_dset < vlen_first + vlen_num_per_writer; ++vlen_dset) {
-      char blob_path[256], blobcount_path[256], blobstart_path[256], fid_path[256], milli_path[256];
+      char blob_path[256], blobcount_path[256], blobstart_path[256], fid_path[256], milli_path[256], nano_path[256];
       sprintf(blob_path, "/vlen/%5.5d/blob", vlen_dset);
       sprintf(blobcount_path, "/vlen/%5.5d/blobcount", vlen_dset);
       sprintf(blobstart_path, "/vlen/%5.5d/blobstart", vlen_dset);
       sprintf(fid_path, "/vlen/%5.5d/fiducials", vlen_dset);
       sprintf(milli_path, "/vlen/%5.5d/milli", vlen_dset);
+      sprintf(nano_path, "/vlen/%5.5d/nano", vlen_dset);
 
       NONNEG( H5Lcreate_external(src_writer_fname, blob_path, m_master_fid, blob_path, H5P_DEFAULT, H5P_DEFAULT) );
       NONNEG( H5Lcreate_external(src_writer_fname, blobcount_path, m_master_fid, blobcount_path, H5P_DEFAULT, H5P_DEFAULT) );
       NONNEG( H5Lcreate_external(src_writer_fname, blobstart_path, m_master_fid, blobstart_path, H5P_DEFAULT, H5P_DEFAULT) );
       NONNEG( H5Lcreate_external(src_writer_fname, fid_path, m_master_fid, fid_path, H5P_DEFAULT, H5P_DEFAULT) );
       NONNEG( H5Lcreate_external(src_writer_fname, milli_path, m_master_fid, milli_path, H5P_DEFAULT, H5P_DEFAULT) );
+      NONNEG( H5Lcreate_external(src_writer_fname, nano_path, m_master_fid, nano_path, H5P_DEFAULT, H5P_DEFAULT) );
     }
   }
 
@@ -276,9 +293,9 @@ DaqMasterTranslationLoop::DaqMasterTranslationLoop(DaqMaster *daq_master) :
     m_writer_fids.at(writer) = daq_master->H5Fopen_with_polling(m_daq_master->m_writer_fnames_h5.at(writer),
                                                                 H5F_ACC_RDONLY | H5F_ACC_SWMR_READ, 
                                                                 H5P_DEFAULT, m_daq_master->m_verbose);
-    int small_first = writer * daq_master->m_small_num_per_writer;
+    int small_first = writer * daq_master->m_small_groups_per_writer;
     int vlen_first = writer * daq_master->m_vlen_num_per_writer;
-    int small_last = (1+writer) * daq_master->m_small_num_per_writer;
+    int small_last = (1+writer) * daq_master->m_small_groups_per_writer;
     int vlen_last = (1+writer) * daq_master->m_vlen_num_per_writer;
     
     m_writer_small_dsets[writer] = TNumber2Dset();
@@ -355,9 +372,9 @@ void DaqMasterTranslationLoop::get_current_lens() {
     auto &cspad_dsets = m_writer_cspad_dsets[writer];
     auto &cspad_dims = m_writer_cspad_dims[writer];
 
-    int small_first = writer * m_daq_master->m_small_num_per_writer;
+    int small_first = writer * m_daq_master->m_small_groups_per_writer;
     int vlen_first = writer * m_daq_master->m_vlen_num_per_writer;
-    int small_last = (1+writer) * m_daq_master->m_small_num_per_writer;
+    int small_last = (1+writer) * m_daq_master->m_small_groups_per_writer;
     int vlen_last = (1+writer) * m_daq_master->m_vlen_num_per_writer;
 
     for (int small_idx = small_first; small_idx < small_last; ++small_idx) {
@@ -366,8 +383,11 @@ void DaqMasterTranslationLoop::get_current_lens() {
 
       hsize_t old_dim = dim;
 
+      // wide tables are [events, streams], we only want the events
+      hsize_t cur_dims[2] = {0, 0};
       NONNEG( H5Drefresh(dset_id) );
-      NONNEG( H5LDget_dset_dims( dset_id, &dim ) );
+      NONNEG( H5LDget_dset_dims( dset_id, cur_dims ) );
+      dim = cur_dims[0];
 
       if (m_daq_master->m_verbose2) {
         std::cout << m_daq_master->logHdr() 
@@ -435,9 +455,9 @@ hsize_t DaqMasterTranslationLoop::get_len_avail_events() {
     auto &small_dims = m_writer_small_dims[writer];
     auto &vlen_dims = m_writer_vlen_dims[writer];
 
-    int small_first = writer * m_daq_master->m_small_num_per_writer;
+    int small_first = writer * m_daq_master->m_small_groups_per_writer;
     int vlen_first = writer * m_daq_master->m_vlen_num_per_writer;
-    int small_last = (1+writer) * m_daq_master->m_small_num_per_writer;
+    int small_last = (1+writer) * m_daq_master->m_small_groups_per_writer;
     int vlen_last = (1+writer) * m_daq_master->m_vlen_num_per_writer;
 
     for (int small_idx = small_first; small_idx < small_last; ++small_idx) {
@@ -480,9 +500,9 @@ DaqMasterTranslationLoop::~DaqMasterTranslationLoop() {
 
   for (int writer = 0; writer < num_writers; ++writer) {
 
-    int small_first = writer * m_daq_master->m_small_num_per_writer;
+    int small_first = writer * m_daq_master->m_small_groups_per_writer;
     int vlen_first = writer * m_daq_master->m_vlen_num_per_writer;
-    int small_last = (1+writer) * m_daq_master->m_small_num_per_writer;
+    int small_last = (1+writer) * m_daq_master->m_small_groups_per_writer;
     int vlen_last = (1+writer) * m_daq_master->m_vlen_num_per_writer;
     
     for (int small = small_first; small < small_last; ++small) {
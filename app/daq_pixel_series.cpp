@@ -0,0 +1,224 @@
+// Offline transposed copy of the cspad frames of a finished run, for per
+// pixel analysis. Reads every /cspad/NNNNN/data through the master, in event
+// order, and writes it to the same path in the output as a PixelSeries,
+//
+//   [panels, rows, cols, events]  chunked [1, tile_y, tile_x, chunk_events]
+//
+// so the series of one pixel, or a box of pixels, reads only the chunks of
+// its tiles instead of every frame. /cspad/NNNNN/fiducials is copied next
+// to it to map series positions back to events.
+//
+// Frames are read chunk_events at a time, with the pedestal added back if
+// the writers subtracted one, and each block is transposed tile by tile in
+// cache sized blocks and written as whole chunks that bypass the chunk
+// cache. Memory is about chunk_events frames, 4.6MB each for a cspad.
+//
+// usage: daq_pixel_series config.yaml [--master F] [--output F] [--tile_y N]
+//          [--tile_x N] [--chunk_events N] [--events N] [--filter none|bitshuffle_lz4]
+//
+// master defaults to the run's daq_master-s0000.h5, output to pixel_series.h5
+// next to it. --events copies only the first N events.
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "yaml-cpp/yaml.h"
+#include "hdf5.h"
+
+#include "check_macros.h"
+#include "BitshuffleFilter.h"
+#include "Dset.h"
+#include "DsetLayoutCache.h"
+#include "Pedestal.h"
+#include "PixelSeries.h"
+
+typedef std::chrono::steady_clock Clock;
+
+
+namespace {
+
+  herr_t collect_link_name(hid_t, const char *name, const H5L_info_t *, void *op_data) {
+    static_cast<std::vector<std::string> *>(op_data)->push_back(name);
+    return 0;
+  }
+
+  double seconds_since(Clock::time_point t0) {
+    return std::chrono::duration<double>(Clock::now() - t0).count();
+  }
+
+}
+
+
+class DaqPixelSeries {
+  YAML::Node m_config;
+  std::string m_master_fname, m_output_fname;
+  hsize_t m_tile_y, m_tile_x, m_chunk_events, m_max_events;
+  DsetFilter m_filter;
+
+  void parse_args(int argc, char *argv[]);
+  // events copied
+  hsize_t transpose(hid_t master, hid_t output, const std::string &group);
+  void copy_fiducials(hid_t master, hid_t output, const std::string &group, hsize_t num_events);
+
+public:
+  DaqPixelSeries(int argc, char *argv[]);
+  int run();
+};
+
+
+DaqPixelSeries::DaqPixelSeries(int argc, char *argv[]) :
+  m_tile_y(32),
+  m_tile_x(32),
+  m_chunk_events(32),
+  m_max_events(0),
+  m_filter(filter_none)
+{
+  parse_args(argc, argv);
+  bitshuffle::register_filter();
+}
+
+
+void DaqPixelSeries::parse_args(int argc, char *argv[]) {
+  const char *usage = "usage: daq_pixel_series config.yaml [--master F] [--output F] [--tile_y N] [--tile_x N] "
+    "[--chunk_events N] [--events N] [--filter none|bitshuffle_lz4]";
+  if (argc < 2) throw std::runtime_error(usage);
+  m_config = YAML::LoadFile(argv[1]);
+  std::string hdf5_dir = m_config["rootdir"].as<std::string>() + "/" + m_config["rundir"].as<std::string>() + "/hdf5/";
+  m_master_fname = hdf5_dir + "daq_master-s0000.h5";
+  m_output_fname = hdf5_dir + "pixel_series.h5";
+  for (int arg = 2; arg < argc; ++arg) {
+    if ((strcmp(argv[arg], "--master") == 0) and (arg + 1 < argc)) {
+      m_master_fname = argv[++arg];
+    } else if ((strcmp(argv[arg], "--output") == 0) and (arg + 1 < argc)) {
+      m_output_fname = argv[++arg];
+    } else if ((strcmp(argv[arg], "--tile_y") == 0) and (arg + 1 < argc)) {
+      m_tile_y = hsize_t(std::max(1, atoi(argv[++arg])));
+    } else if ((strcmp(argv[arg], "--tile_x") == 0) and (arg + 1 < argc)) {
+      m_tile_x = hsize_t(std::max(1, atoi(argv[++arg])));
+    } else if ((strcmp(argv[arg], "--chunk_events") == 0) and (arg + 1 < argc)) {
+      m_chunk_events = hsize_t(std::max(1, atoi(argv[++arg])));
+    } else if ((strcmp(argv[arg], "--events") == 0) and (arg + 1 < argc)) {
+      m_max_events = hsize_t(std::max(0L, atol(argv[++arg])));
+    } else if ((strcmp(argv[arg], "--filter") == 0) and (arg + 1 < argc)) {
+      m_filter = dset_filter_from_name(argv[++arg]);
+    } else {
+      throw std::runtime_error(usage);
+    }
+  }
+}
+
+
+hsize_t DaqPixelSeries::transpose(hid_t master, hid_t output, const std::string &group) {
+  const std::string path = group + "/data";
+  Dset source = Dset::open(master, path.c_str(), Dset::if_vds_first_missing);
+  Pedestal pedestal = Pedestal::load(master, (group + "/pedestal").c_str());
+  std::vector<hsize_t> dims = source.dim();
+  if (dims.size() != 4) throw std::runtime_error("daq_pixel_series: " + path + " is not [events, panels, rows, cols]");
+  hsize_t num_events = dims.at(0);
+  if (m_max_events > 0) num_events = std::min(num_events, m_max_events);
+  if (num_events == 0) {
+    source.close();
+    return 0;
+  }
+  // a VDS read spanning several chunks of a filtered source is many times
+  // slower in hdf5 1.10 than reading chunk by chunk
+  const hsize_t read_events = Dset::get_chunk(source.id()).at(0);
+
+  std::vector<hsize_t> frame_dims(dims.begin() + 1, dims.end());
+  PixelSeries series = PixelSeries::create(output, path.c_str(), frame_dims, num_events,
+                                           m_tile_y, m_tile_x, m_chunk_events, m_filter);
+  const hsize_t block_events = series.chunk_events();
+  const size_t frame_len = series.frame_len();
+  std::vector<int16_t> frames(size_t(block_events) * frame_len);
+
+  double read_seconds = 0, write_seconds = 0;
+  for (hsize_t start = 0; start < num_events; start += block_events) {
+    const hsize_t count = std::min(block_events, num_events - start);
+    auto t0 = Clock::now();
+    for (hsize_t done = 0; done < count; done += read_events) {
+      const hsize_t read_count = std::min(read_events, count - done);
+      pedestal.read(source, start + done, read_count, frames.data() + done * frame_len, size_t(read_count) * frame_len);
+    }
+    read_seconds += seconds_since(t0);
+    auto t1 = Clock::now();
+    series.write_frames(start, count, frames.data());
+    write_seconds += seconds_since(t1);
+  }
+  series.close();
+  source.close();
+
+  double mb = double(num_events) * double(frame_len) * sizeof(int16_t) / 1e6;
+  std::cout << "daq_pixel_series: " << path << " events=" << num_events
+            << " tile=" << series.tile_y() << "x" << series.tile_x() << "x" << block_events
+            << " read_seconds=" << read_seconds << " transpose_write_seconds=" << write_seconds
+            << " transpose_write_mbps=" << (write_seconds > 0 ? mb / write_seconds : 0) << std::endl;
+  return num_events;
+}
+
+
+void DaqPixelSeries::copy_fiducials(hid_t master, hid_t output, const std::string &group, hsize_t num_events) {
+  const std::string path = group + "/fiducials";
+  Dset source = Dset::open(master, path.c_str(), Dset::if_vds_first_missing);
+  std::vector<int64_t> fiducials;
+  source.read(0, num_events, fiducials);
+  source.close();
+
+  hid_t space = NONNEG( H5Screate_simple(1, &num_events, NULL) );
+  hid_t dset = NONNEG( H5Dcreate2(output, path.c_str(), H5T_NATIVE_INT64, space, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT) );
+  NONNEG( H5Dwrite(dset, H5T_NATIVE_INT64, H5S_ALL, H5S_ALL, H5P_DEFAULT, fiducials.data()) );
+  NONNEG( H5Dclose(dset) );
+  NONNEG( H5Sclose(space) );
+}
+
+
+int DaqPixelSeries::run() {
+  auto t0 = Clock::now();
+  hid_t master = POS( H5Fopen(m_master_fname.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT) );
+  hid_t fapl = NONNEG( H5Pcreate(H5P_FILE_ACCESS) );
+  NONNEG( H5Pset_libver_bounds(fapl, H5F_LIBVER_LATEST, H5F_LIBVER_LATEST) );
+  hid_t output = NONNEG( H5Fcreate(m_output_fname.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, fapl) );
+  NONNEG( H5Pclose(fapl) );
+
+  std::vector<std::string> subs;
+  if (Pedestal::exists(master, "cspad")) {
+    hid_t top = NONNEG( H5Gopen2(master, "cspad", H5P_DEFAULT) );
+    NONNEG( H5Literate(top, H5_INDEX_NAME, H5_ITER_INC, NULL, collect_link_name, &subs) );
+    NONNEG( H5Gclose(top) );
+  }
+  if (subs.empty()) throw std::runtime_error("daq_pixel_series: no cspad in " + m_master_fname);
+  hid_t cspad = NONNEG( H5Gcreate2(output, "cspad", H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT) );
+  NONNEG( H5Gclose(cspad) );
+
+  for (auto sub = subs.begin(); sub != subs.end(); ++sub) {
+    std::string group = "/cspad/" + *sub;
+    hid_t group_id = NONNEG( H5Gcreate2(output, group.c_str(), H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT) );
+    NONNEG( H5Gclose(group_id) );
+    hsize_t num_events = transpose(master, output, group);
+    if (num_events > 0) copy_fiducials(master, output, group, num_events);
+  }
+
+  NONNEG( H5Fclose(output) );
+  // the layout cache holds the VDS source files open
+  DsetLayoutCache::instance().clear();
+  NONNEG( H5Fclose(master) );
+  std::cout << "daq_pixel_series: " << m_master_fname << " -> " << m_output_fname
+            << " seconds=" << seconds_since(t0) << std::endl;
+  return 0;
+}
+
+
+int main(int argc, char *argv[]) {
+  try {
+    DaqPixelSeries pixel_series(argc, argv);
+    return pixel_series.run();
+  } catch (const std::exception &ex) {
+    std::cerr << "daq_pixel_series: Caught exception: " << ex.what() << std::endl;
+    return 1;
+  }
+}
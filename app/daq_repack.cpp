@@ -0,0 +1,423 @@
+// Offline repack of a finished run into one file laid out for readers. Goes
+// through the master - its round robin VDS and external links into the
+// writer files - and writes every dataset, in event order, to a contiguous
+// dataset at the same path in the output:
+//
+//   /small/NNNNN/*, /vlen/NNNNN/*, /cspad/NNNNN/*, /avail_events
+//
+// The output datasets are created contiguous with early allocation, so each
+// has a fixed file offset (H5Dget_offset) before any data is copied. The
+// output is then closed and --procs processes each read a disjoint range of
+// events of every dataset through hdf5 and pwrite them straight to those
+// offsets. Serial hdf5 cannot have several processes writing one file, but
+// with the layout fixed up front the copies do not need hdf5 to write.
+//
+// The VDS are read with the first missing view, events every writer has.
+// The output opens with Dset::open and reads with no chunk index or cache,
+// or with Dset::read_mmap straight from a mapping of the file. Allocations
+// are aligned to 64 bytes so every dataset can be mapped.
+//
+// usage: daq_repack config.yaml [--master F] [--output F] [--procs N]
+//          [--block_mb N] [--dsets P[,P...]] [--verify]
+//
+// master defaults to the run's daq_master-s0000.h5, output to repack.h5 next
+// to it. --dsets finalizes only the datasets under the listed paths, like
+// --dsets /small,/vlen,/avail_events for the small data of a run.
+// --verify reads every dataset back from both and compares them.
+#include <algorithm>
+#include <chrono>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "yaml-cpp/yaml.h"
+#include "hdf5.h"
+
+#include "check_macros.h"
+#include "BitshuffleFilter.h"
+#include "Dset.h"
+#include "DsetLayoutCache.h"
+
+typedef std::chrono::steady_clock Clock;
+
+
+namespace {
+
+  herr_t collect_link_name(hid_t, const char *name, const H5L_info_t *, void *op_data) {
+    static_cast<std::vector<std::string> *>(op_data)->push_back(name);
+    return 0;
+  }
+
+  // an external link whose file is not there does not resolve
+  bool resolves(hid_t loc, const std::string &name) {
+    if (NONNEG( H5Lexists(loc, name.c_str(), H5P_DEFAULT) ) == 0) return false;
+    return H5Oexists_by_name(loc, name.c_str(), H5P_DEFAULT) > 0;
+  }
+
+  double seconds_since(Clock::time_point t0) {
+    return std::chrono::duration<double>(Clock::now() - t0).count();
+  }
+
+  hid_t open_source(hid_t master, const std::string &path) {
+    hid_t access = NONNEG( H5Pcreate(H5P_DATASET_ACCESS) );
+    NONNEG( H5Pset_virtual_view(access, H5D_VDS_FIRST_MISSING) );
+    hid_t dset = NONNEG( H5Dopen2(master, path.c_str(), access) );
+    NONNEG( H5Pclose(access) );
+    return dset;
+  }
+
+  // count events from start of dset into data
+  void read_range(hid_t dset, hid_t mem_type, const std::vector<hsize_t> &dims,
+                  hsize_t start, hsize_t count, void *data) {
+    std::vector<hsize_t> offset(dims.size(), 0), counts(dims);
+    offset.at(0) = start;
+    counts.at(0) = count;
+    hid_t file_space = NONNEG( H5Dget_space(dset) );
+    NONNEG( H5Sselect_hyperslab(file_space, H5S_SELECT_SET, offset.data(), NULL, counts.data(), NULL) );
+    hid_t mem_space = NONNEG( H5Screate_simple(int(counts.size()), counts.data(), NULL) );
+    NONNEG( H5Dread(dset, mem_type, mem_space, file_space, H5P_DEFAULT, data) );
+    NONNEG( H5Sclose(mem_space) );
+    NONNEG( H5Sclose(file_space) );
+  }
+
+  void pwrite_all(int fd, const char *data, size_t len, off_t offset) {
+    while (len > 0) {
+      ssize_t written = ::pwrite(fd, data, len, offset);
+      if (written < 0) {
+        if (errno == EINTR) continue;
+        throw std::runtime_error(std::string("daq_repack: pwrite failed: ") + strerror(errno));
+      }
+      data += written;
+      offset += written;
+      len -= size_t(written);
+    }
+  }
+
+}
+
+
+// a dataset to copy, and where it goes in the output
+struct RepackDset {
+  std::string path;
+  std::vector<hsize_t> dims;
+  size_t event_bytes;
+  // events in one H5Dread
+  hsize_t read_events;
+  haddr_t offset;
+
+  size_t bytes() const { return dims.empty() ? 0 : size_t(dims.at(0)) * event_bytes; }
+};
+
+
+class DaqRepack {
+  YAML::Node m_config;
+  std::string m_master_fname, m_output_fname;
+  int m_procs;
+  size_t m_block_bytes;
+  bool m_verify;
+  // path prefixes to repack, empty for everything
+  std::vector<std::string> m_selected;
+
+  std::vector<RepackDset> m_dsets;
+
+  void parse_args(int argc, char *argv[]);
+  bool selected(const std::string &path) const;
+  void find_dsets(hid_t master);
+  void create_output(hid_t master);
+  void copy(int proc);
+  void run_copies();
+  void verify();
+
+public:
+  DaqRepack(int argc, char *argv[]);
+  int run();
+};
+
+
+DaqRepack::DaqRepack(int argc, char *argv[]) :
+  m_procs(4),
+  m_block_bytes(size_t(64) << 20),
+  m_verify(false)
+{
+  parse_args(argc, argv);
+  // writer chunks may have our filter, the copies inherit the registration
+  bitshuffle::register_filter();
+}
+
+
+void DaqRepack::parse_args(int argc, char *argv[]) {
+  const char *usage = "usage: daq_repack config.yaml [--master F] [--output F] [--procs N] [--block_mb N] "
+    "[--dsets P[,P...]] [--verify]";
+  if (argc < 2) throw std::runtime_error(usage);
+  m_config = YAML::LoadFile(argv[1]);
+  std::string hdf5_dir = m_config["rootdir"].as<std::string>() + "/" + m_config["rundir"].as<std::string>() + "/hdf5/";
+  m_master_fname = hdf5_dir + "daq_master-s0000.h5";
+  m_output_fname = hdf5_dir + "repack.h5";
+  for (int arg = 2; arg < argc; ++arg) {
+    if ((strcmp(argv[arg], "--master") == 0) and (arg + 1 < argc)) {
+      m_master_fname = argv[++arg];
+    } else if ((strcmp(argv[arg], "--output") == 0) and (arg + 1 < argc)) {
+      m_output_fname = argv[++arg];
+    } else if ((strcmp(argv[arg], "--procs") == 0) and (arg + 1 < argc)) {
+      m_procs = std::max(1, atoi(argv[++arg]));
+    } else if ((strcmp(argv[arg], "--block_mb") == 0) and (arg + 1 < argc)) {
+      m_block_bytes = std::max(size_t(1), size_t(atol(argv[++arg]))) << 20;
+    } else if ((strcmp(argv[arg], "--dsets") == 0) and (arg + 1 < argc)) {
+      std::string paths = argv[++arg];
+      for (size_t begin = 0, end = 0; begin < paths.size(); begin = end + 1) {
+        end = std::min(paths.find(',', begin), paths.size());
+        if (end > begin) m_selected.push_back(paths.substr(begin, end - begin));
+      }
+    } else if (strcmp(argv[arg], "--verify") == 0) {
+      m_verify = true;
+    } else {
+      throw std::runtime_error(usage);
+    }
+  }
+}
+
+
+// path is one of the --dsets paths or under one of them
+bool DaqRepack::selected(const std::string &path) const {
+  if (m_selected.empty()) return true;
+  for (auto prefix = m_selected.begin(); prefix != m_selected.end(); ++prefix) {
+    if (path.compare(0, prefix->size(), *prefix) != 0) continue;
+    if ((path.size() == prefix->size()) or (path.at(prefix->size()) == '/') or (prefix->back() == '/')) return true;
+  }
+  return false;
+}
+
+
+// every selected dataset under the numbered small, vlen and cspad groups, and avail_events
+void DaqRepack::find_dsets(hid_t master) {
+  const char *top_names[] = {"small", "vlen", "cspad"};
+  std::vector<std::string> paths;
+  for (auto top_name : top_names) {
+    if (not resolves(master, top_name)) continue;
+    hid_t top = NONNEG( H5Gopen2(master, top_name, H5P_DEFAULT) );
+    std::vector<std::string> subs;
+    NONNEG( H5Literate(top, H5_INDEX_NAME, H5_ITER_INC, NULL, collect_link_name, &subs) );
+    for (auto sub = subs.begin(); sub != subs.end(); ++sub) {
+      hid_t group = NONNEG( H5Gopen2(top, sub->c_str(), H5P_DEFAULT) );
+      std::vector<std::string> names;
+      NONNEG( H5Literate(group, H5_INDEX_NAME, H5_ITER_INC, NULL, collect_link_name, &names) );
+      for (auto name = names.begin(); name != names.end(); ++name) {
+        if (resolves(group, *name)) paths.push_back(std::string("/") + top_name + "/" + *sub + "/" + *name);
+      }
+      NONNEG( H5Gclose(group) );
+    }
+    NONNEG( H5Gclose(top) );
+  }
+  if (resolves(master, "avail_events")) paths.push_back("/avail_events");
+
+  for (auto path = paths.begin(); path != paths.end(); ++path) {
+    if (not selected(*path)) continue;
+    RepackDset repack;
+    repack.path = *path;
+    hid_t dset = open_source(master, *path);
+    hid_t space = NONNEG( H5Dget_space(dset) );
+    int rank = NONNEG( H5Sget_simple_extent_ndims(space) );
+    repack.dims.resize(rank);
+    if (rank > 0) NONNEG( H5Sget_simple_extent_dims(space, repack.dims.data(), NULL) );
+    hid_t type = NONNEG( H5Dget_type(dset) );
+    repack.event_bytes = NONNEG( H5Tget_size(type) );
+    for (int dim = 1; dim < rank; ++dim) repack.event_bytes *= size_t(repack.dims.at(dim));
+    repack.offset = HADDR_UNDEF;
+    // a VDS read spanning several chunks of a filtered source is many times
+    // slower in hdf5 1.10 than reading chunk by chunk, so read a VDS a
+    // chunk of each source at a time
+    hid_t dcpl = NONNEG( H5Dget_create_plist(dset) );
+    if (H5Pget_layout(dcpl) == H5D_VIRTUAL) {
+      repack.read_events = Dset::get_chunk(dset).at(0);
+    } else {
+      repack.read_events = std::max(hsize_t(1), hsize_t(m_block_bytes / std::max(size_t(1), repack.event_bytes)));
+    }
+    NONNEG( H5Pclose(dcpl) );
+    NONNEG( H5Tclose(type) );
+    NONNEG( H5Sclose(space) );
+    NONNEG( H5Dclose(dset) );
+    if (rank > 0) m_dsets.push_back(repack);
+  }
+  // the layout cache holds the VDS source files open
+  DsetLayoutCache::instance().clear();
+  if (m_dsets.empty()) throw std::runtime_error("daq_repack: no datasets selected in " + m_master_fname);
+}
+
+
+void DaqRepack::create_output(hid_t master) {
+  hid_t fapl = NONNEG( H5Pcreate(H5P_FILE_ACCESS) );
+  NONNEG( H5Pset_libver_bounds(fapl, H5F_LIBVER_LATEST, H5F_LIBVER_LATEST) );
+  // Dset::read_mmap only maps data aligned to its elements
+  NONNEG( H5Pset_alignment(fapl, 0, 64) );
+  hid_t output = NONNEG( H5Fcreate(m_output_fname.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, fapl) );
+  NONNEG( H5Pclose(fapl) );
+
+  hid_t lcpl = NONNEG( H5Pcreate(H5P_LINK_CREATE) );
+  NONNEG( H5Pset_create_intermediate_group(lcpl, 1) );
+  // allocated now, so the offset is known, and never filled, the copies write every byte
+  hid_t dcpl = NONNEG( H5Pcreate(H5P_DATASET_CREATE) );
+  NONNEG( H5Pset_layout(dcpl, H5D_CONTIGUOUS) );
+  NONNEG( H5Pset_alloc_time(dcpl, H5D_ALLOC_TIME_EARLY) );
+  NONNEG( H5Pset_fill_time(dcpl, H5D_FILL_TIME_NEVER) );
+
+  for (auto repack = m_dsets.begin(); repack != m_dsets.end(); ++repack) {
+    hid_t source = open_source(master, repack->path);
+    hid_t file_type = NONNEG( H5Dget_type(source) );
+    hid_t native = NONNEG( H5Tget_native_type(file_type, H5T_DIR_ASCEND) );
+    hid_t space = NONNEG( H5Screate_simple(int(repack->dims.size()), repack->dims.data(), NULL) );
+    hid_t dset = NONNEG( H5Dcreate2(output, repack->path.c_str(), native, space, lcpl, dcpl, H5P_DEFAULT) );
+    repack->offset = H5Dget_offset(dset);
+    if ((repack->bytes() > 0) and (repack->offset == HADDR_UNDEF)) {
+      throw std::runtime_error("daq_repack: no file offset for " + repack->path);
+    }
+    NONNEG( H5Dclose(dset) );
+    NONNEG( H5Sclose(space) );
+    NONNEG( H5Tclose(native) );
+    NONNEG( H5Tclose(file_type) );
+    NONNEG( H5Dclose(source) );
+  }
+  NONNEG( H5Pclose(dcpl) );
+  NONNEG( H5Pclose(lcpl) );
+  NONNEG( H5Fclose(output) );
+}
+
+
+// the proc'th of procs disjoint event ranges of every dataset
+void DaqRepack::copy(int proc) {
+  hid_t master = NONNEG( H5Fopen(m_master_fname.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT) );
+  int fd = ::open(m_output_fname.c_str(), O_WRONLY);
+  if (fd < 0) throw std::runtime_error("daq_repack: could not open " + m_output_fname + " for writing");
+  std::vector<char> buffer;
+  for (auto repack = m_dsets.begin(); repack != m_dsets.end(); ++repack) {
+    // split on read boundaries, so no read spans two copies
+    const hsize_t num_events = repack->dims.at(0);
+    const hsize_t block_events = repack->read_events;
+    const hsize_t num_blocks = (num_events + block_events - 1) / block_events;
+    hsize_t first = std::min(num_events, block_events * (num_blocks * hsize_t(proc) / hsize_t(m_procs)));
+    hsize_t end = std::min(num_events, block_events * (num_blocks * hsize_t(proc + 1) / hsize_t(m_procs)));
+    if ((first == end) or (repack->event_bytes == 0)) continue;
+    buffer.resize(std::min(end - first, block_events) * repack->event_bytes);
+
+    hid_t source = open_source(master, repack->path);
+    hid_t file_type = NONNEG( H5Dget_type(source) );
+    hid_t native = NONNEG( H5Tget_native_type(file_type, H5T_DIR_ASCEND) );
+    for (hsize_t start = first; start < end; start += block_events) {
+      hsize_t count = std::min(block_events, end - start);
+      read_range(source, native, repack->dims, start, count, buffer.data());
+      pwrite_all(fd, buffer.data(), size_t(count) * repack->event_bytes,
+                 off_t(repack->offset + start * repack->event_bytes));
+    }
+    NONNEG( H5Tclose(native) );
+    NONNEG( H5Tclose(file_type) );
+    NONNEG( H5Dclose(source) );
+  }
+  if (::close(fd) != 0) throw std::runtime_error("daq_repack: close failed for " + m_output_fname);
+  NONNEG( H5Fclose(master) );
+}
+
+
+void DaqRepack::run_copies() {
+  std::vector<pid_t> pids;
+  for (int proc = 0; proc < m_procs; ++proc) {
+    pid_t pid = fork();
+    if (pid < 0) throw std::runtime_error("daq_repack: fork failed");
+    if (pid == 0) {
+      int status = 0;
+      try {
+        copy(proc);
+      } catch (const std::exception &ex) {
+        std::cerr << "daq_repack: copy " << proc << " caught exception: " << ex.what() << std::endl;
+        status = 1;
+      }
+      H5close();
+      _exit(status);
+    }
+    pids.push_back(pid);
+  }
+  int failed = 0;
+  for (auto pid : pids) {
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0) {
+      if (errno != EINTR) throw std::runtime_error("daq_repack: waitpid failed");
+    }
+    if (not (WIFEXITED(status) and (WEXITSTATUS(status) == 0))) ++failed;
+  }
+  if (failed > 0) throw std::runtime_error("daq_repack: " + std::to_string(failed) + " copies failed");
+}
+
+
+void DaqRepack::verify() {
+  hid_t master = NONNEG( H5Fopen(m_master_fname.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT) );
+  hid_t output = NONNEG( H5Fopen(m_output_fname.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT) );
+  std::vector<char> expected, repacked;
+  for (auto repack = m_dsets.begin(); repack != m_dsets.end(); ++repack) {
+    hid_t source = open_source(master, repack->path);
+    hid_t dset = NONNEG( H5Dopen2(output, repack->path.c_str(), H5P_DEFAULT) );
+    hid_t file_type = NONNEG( H5Dget_type(source) );
+    hid_t native = NONNEG( H5Tget_native_type(file_type, H5T_DIR_ASCEND) );
+    hsize_t block_events = repack->read_events;
+    for (hsize_t start = 0; start < repack->dims.at(0); start += block_events) {
+      hsize_t count = std::min(block_events, repack->dims.at(0) - start);
+      expected.resize(size_t(count) * repack->event_bytes);
+      repacked.resize(expected.size());
+      read_range(source, native, repack->dims, start, count, expected.data());
+      read_range(dset, native, repack->dims, start, count, repacked.data());
+      if (expected != repacked) throw std::runtime_error("daq_repack: verify failed for " + repack->path);
+    }
+    NONNEG( H5Tclose(native) );
+    NONNEG( H5Tclose(file_type) );
+    NONNEG( H5Dclose(dset) );
+    NONNEG( H5Dclose(source) );
+  }
+  NONNEG( H5Fclose(output) );
+  NONNEG( H5Fclose(master) );
+}
+
+
+int DaqRepack::run() {
+  auto t0 = Clock::now();
+  hid_t master = POS( H5Fopen(m_master_fname.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT) );
+  find_dsets(master);
+  create_output(master);
+  // no open files across the fork, each copy opens its own
+  NONNEG( H5Fclose(master) );
+  double create_seconds = seconds_since(t0);
+
+  auto t1 = Clock::now();
+  run_copies();
+  double copy_seconds = seconds_since(t1);
+
+  size_t total_bytes = 0;
+  for (auto repack = m_dsets.begin(); repack != m_dsets.end(); ++repack) total_bytes += repack->bytes();
+  std::cout << "daq_repack: " << m_master_fname << " -> " << m_output_fname << std::endl;
+  std::cout << "daq_repack: datasets=" << m_dsets.size() << " bytes=" << total_bytes
+            << " procs=" << m_procs << " create_seconds=" << create_seconds
+            << " copy_seconds=" << copy_seconds
+            << " copy_mbps=" << (copy_seconds > 0 ? double(total_bytes) / copy_seconds / 1e6 : 0) << std::endl;
+  if (m_verify) {
+    verify();
+    std::cout << "daq_repack: verified" << std::endl;
+  }
+  return 0;
+}
+
+
+int main(int argc, char *argv[]) {
+  try {
+    DaqRepack repack(argc, argv);
+    return repack.run();
+  } catch (const std::exception &ex) {
+    std::cerr << "daq_repack: Caught exception: " << ex.what() << std::endl;
+    return 1;
+  }
+}
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <cstdio>
 #include <cstdlib>
 #include <iostream>
@@ -15,11 +16,17 @@ class DaqWriter : public DaqBase {
   
   hid_t m_writer_fid;
   int m_small_chunksize;
+  int m_vlen_chunksize;
   int m_next_small, m_next_vlen, m_next_cspad;
   int m_small_shot_stride, m_vlen_shot_stride, m_cspad_shot_stride;
 
   int m_small_first, m_vlen_first, m_cspad_first;
   int m_small_count, m_vlen_count, m_cspad_count;
+
+  // small wide table layout, the small maps below have one entry, m_id,
+  // and each event is a row of m_small_count values
+  bool m_small_wide;
+  std::vector<int64_t> m_small_fid_row, m_small_milli_row, m_small_nano_row;
   
   int m_next_vlen_count;
   int m_vlen_max_per_shot;
@@ -39,6 +46,11 @@ class DaqWriter : public DaqBase {
     m_vlen_id_to_milli_dset,
     m_cspad_id_to_milli_dset;
 
+  // write time in nanoseconds, for the readers visibility latency
+  std::map<int, Dset> m_small_id_to_nano_dset,
+    m_vlen_id_to_nano_dset,
+    m_cspad_id_to_nano_dset;
+
   std::map<int, Dset> m_small_id_to_data_dset,
     m_vlen_id_to_blob_dset,
     m_cspad_id_to_data_dset;
@@ -47,7 +59,12 @@ class DaqWriter : public DaqBase {
     m_vlen_id_to_blob_count_dset;
   
   std::vector<int64_t> m_vlen_data;
-  std::vector<int16_t> m_cspad_source;
+  AlignedBuffer m_cspad_source;
+  int m_number_cspad_in_source;
+  // subtracted from every cspad frame before it is written when not empty,
+  // m_cspad_frame holds the subtracted frame
+  Pedestal m_cspad_pedestal;
+  AlignedBuffer m_cspad_frame;
   
 public:
   DaqWriter(int argc, char *argv[]);
@@ -63,20 +80,23 @@ public:
 
 protected:
   void create_fiducials_dsets(const std::map<int, hid_t> &id_to_number_group, 
-                              std::map<int, Dset> &id_to_dset);
-  void create_milli_dsets(const std::map<int, hid_t> &, std::map<int, Dset> &);
+                              std::map<int, Dset> &id_to_dset, int columns = 0);
+  void create_milli_dsets(const std::map<int, hid_t> &, std::map<int, Dset> &, int columns = 0);
+  void create_nano_dsets(const std::map<int, hid_t> &, std::map<int, Dset> &, int columns = 0);
 
   void create_small_data_dsets();
   void create_cspad_data_dsets();
   void create_vlen_blob_and_index_dsets();
 
   void write_small(int64_t fiducial);
+  void write_small_wide(int64_t fiducial);
   void write_vlen(int64_t fiducial);
   void write_cspad(int64_t fiducial);
 
   void create_small_dsets_helper(const std::map<int, hid_t> &,
                                  std::map<int, Dset> &,
-                                 const char *, int);
+                                 const char *, int, DsetFilter filter = filter_none,
+                                 int columns = 0);
 
   void flush_helper(const std::map<int, Dset> &);
 
@@ -87,6 +107,7 @@ DaqWriter::DaqWriter(int argc, char *argv[])
   : DaqBase(argc, argv, "daq_writer"),
     m_writer_fid(-1),
     m_small_chunksize(-1),
+    m_vlen_chunksize(-1),
     m_next_small(0),
     m_next_vlen(0),
     m_next_cspad(0),
@@ -103,17 +124,30 @@ DaqWriter::DaqWriter(int argc, char *argv[])
     m_vlen_count(0),
     m_cspad_count(0),
 
+    m_small_wide(false),
+
     m_next_vlen_count(0),
     m_vlen_max_per_shot(0),
     m_next_cspad_in_source(0),
-    m_last_cspad_written(-1)
+    m_last_cspad_written(-1),
+    m_number_cspad_in_source(0)
 {
   YAML::Node cspad_config = m_process_config["datasets"]["round_robin"]["cspad"]["source"];
   std::string h5_filename = cspad_config["filename"].as<std::string>();
   std::string h5_dataset = cspad_config["dataset"].as<std::string>();
   int number_cspad_in_source = cspad_config["length"].as<int>();
   DaqBase::load_cspad(h5_filename, h5_dataset, number_cspad_in_source, m_cspad_source);
+  m_number_cspad_in_source = number_cspad_in_source;
+  std::string pedestal = m_process_config["datasets"]["round_robin"]["cspad"]["pedestal"].as<std::string>();
+  if (pedestal == "source_mean") {
+    std::vector<hsize_t> frame_dims = {CSPadDim1, CSPadDim2, CSPadDim3};
+    m_cspad_pedestal = Pedestal::from_frames(m_cspad_source.as<int16_t>(), m_number_cspad_in_source, frame_dims);
+    m_cspad_frame = m_buffer_pool->acquire_for<int16_t>(CSPadNumElem);
+  } else if (pedestal != "none") {
+    throw std::runtime_error("cspad pedestal must be none or source_mean, not " + pedestal);
+  }
   m_small_chunksize = m_process_config["datasets"]["single_source"]["small"]["chunksize"].as<int>();
+  m_vlen_chunksize = m_process_config["datasets"]["single_source"]["vlen"]["chunksize"].as<int>();
   m_small_shot_stride = m_process_config["datasets"]["single_source"]["small"]["shots_per_sample"].as<int>();
   m_vlen_shot_stride = m_process_config["datasets"]["single_source"]["vlen"]["shots_per_sample"].as<int>();
   
@@ -123,6 +157,12 @@ DaqWriter::DaqWriter(int argc, char *argv[])
 
   m_small_count = m_process_config["datasets"]["single_source"]["small"]["num_per_writer"].as<int>();
   m_small_first = m_id * m_small_count;
+  m_small_wide = DaqBase::small_layout_wide();
+  if (m_small_wide) {
+    m_small_fid_row.resize(m_small_count);
+    m_small_milli_row.resize(m_small_count);
+    m_small_nano_row.resize(m_small_count);
+  }
     
   m_vlen_count = m_process_config["datasets"]["single_source"]["vlen"]["num_per_writer"].as<int>();
   m_vlen_first = m_id * m_vlen_count;
@@ -188,21 +228,31 @@ void DaqWriter::close_all_groups_datasets() {
 void DaqWriter::create_all_groups_datasets_and_attributes() {
   DaqBase::create_standard_groups(m_writer_fid);
 
-  DaqBase::create_number_groups(m_small_group, m_small_id_to_number_group,
-                                m_small_first, m_small_count);
+  if (m_small_wide) {
+    // one group for all our small streams, numbered by writer
+    DaqBase::create_number_groups(m_small_group, m_small_id_to_number_group, m_id, 1);
+  } else {
+    DaqBase::create_number_groups(m_small_group, m_small_id_to_number_group,
+                                  m_small_first, m_small_count);
+  }
   DaqBase::create_number_groups(m_vlen_group, m_vlen_id_to_number_group, 
                                 m_vlen_first, m_vlen_count);
   DaqBase::create_number_groups(m_cspad_group, m_cspad_id_to_number_group, 
                                 m_cspad_first, m_cspad_count);
 
-  create_fiducials_dsets(m_small_id_to_number_group, m_small_id_to_fiducials_dset);
+  int small_columns = m_small_wide ? m_small_count : 0;
+  create_fiducials_dsets(m_small_id_to_number_group, m_small_id_to_fiducials_dset, small_columns);
   create_fiducials_dsets(m_vlen_id_to_number_group, m_vlen_id_to_fiducials_dset);
   create_fiducials_dsets(m_cspad_id_to_number_group, m_cspad_id_to_fiducials_dset);
 
-  create_milli_dsets(m_small_id_to_number_group, m_small_id_to_milli_dset);
+  create_milli_dsets(m_small_id_to_number_group, m_small_id_to_milli_dset, small_columns);
   create_milli_dsets(m_vlen_id_to_number_group, m_vlen_id_to_milli_dset);
   create_milli_dsets(m_cspad_id_to_number_group, m_cspad_id_to_milli_dset);
 
+  create_nano_dsets(m_small_id_to_number_group, m_small_id_to_nano_dset, small_columns);
+  create_nano_dsets(m_vlen_id_to_number_group, m_vlen_id_to_nano_dset);
+  create_nano_dsets(m_cspad_id_to_number_group, m_cspad_id_to_nano_dset);
+
   create_small_data_dsets();
   create_cspad_data_dsets();
   create_vlen_blob_and_index_dsets();
@@ -216,47 +266,66 @@ void DaqWriter::create_all_groups_datasets_and_attributes() {
 void DaqWriter::create_small_dsets_helper(const std::map<int, hid_t> &id_to_parent,
                                           std::map<int, Dset> &id_to_dset,
                                           const char *dset_name,
-                                          int chunksize)
+                                          int chunksize,
+                                          DsetFilter filter,
+                                          int columns)
 {
   std::vector<hsize_t> chunk_dims(1);
   chunk_dims.at(0)=chunksize;
+  // a wide table, [events, columns], chunks hold whole rows
+  if (columns > 0) chunk_dims.push_back(hsize_t(columns));
   for (auto iter = id_to_parent.begin(); iter != id_to_parent.end(); ++iter) {
     int group_id = iter->first;
     hid_t h5_group = iter->second;
     if (id_to_dset.find(group_id) != id_to_dset.end()) {
       throw std::runtime_error("create_small_dsets_helper, id already in map");
     }
-    Dset dset =  Dset::create(h5_group, dset_name, H5T_NATIVE_INT64, chunk_dims);
+    Dset dset =  Dset::create(h5_group, dset_name, H5T_NATIVE_INT64, chunk_dims, chunk_dims,
+                              ChunkCachePolicy::for_writer(), filter);
     id_to_dset[group_id] = dset;
   }
 }
 
 
 void DaqWriter::create_fiducials_dsets(const std::map<int, hid_t> &id_to_number_group, 
-                                       std::map<int, Dset> &id_to_dset) {
+                                       std::map<int, Dset> &id_to_dset, int columns) {
+  create_small_dsets_helper(id_to_number_group, id_to_dset,
+                            "fiducials", m_small_chunksize, filter_none, columns);
+}
+  
+
+void DaqWriter::create_milli_dsets(const std::map<int, hid_t> &id_to_number_group, std::map<int, Dset> &id_to_dset,
+                                   int columns) {
   create_small_dsets_helper(id_to_number_group, id_to_dset,
-                            "fiducials", m_small_chunksize);
+                            "milli", m_small_chunksize, filter_none, columns);
 }
   
 
-void DaqWriter::create_milli_dsets(const std::map<int, hid_t> &id_to_number_group, std::map<int, Dset> &id_to_dset) {
+void DaqWriter::create_nano_dsets(const std::map<int, hid_t> &id_to_number_group, std::map<int, Dset> &id_to_dset,
+                                  int columns) {
   create_small_dsets_helper(id_to_number_group, id_to_dset,
-                            "milli", m_small_chunksize);
+                            "nano", m_small_chunksize, filter_none, columns);
 }
   
 
 void DaqWriter::create_small_data_dsets() {
+  DsetFilter filter = dset_filter_from_name(m_process_config["datasets"]["single_source"]["small"]["filter"].as<std::string>());
   create_small_dsets_helper(m_small_id_to_number_group, m_small_id_to_data_dset,
-                            "data", m_small_chunksize);
+                            "data", m_small_chunksize, filter, m_small_wide ? m_small_count : 0);
 }
   
 
 void DaqWriter::create_cspad_data_dsets() {
-  std::vector<hsize_t> chunk(4);
-  chunk.at(0) = m_process_config["datasets"]["round_robin"]["cspad"]["chunksize"].as<int>();
-  chunk.at(1) = CSPadDim1;
-  chunk.at(2) = CSPadDim2;
-  chunk.at(3) = CSPadDim3;
+  YAML::Node cspad_config = m_process_config["datasets"]["round_robin"]["cspad"];
+  std::vector<hsize_t> dims = {0, CSPadDim1, CSPadDim2, CSPadDim3};
+  std::vector<hsize_t> chunk(dims);
+  chunk.at(0) = cspad_config["chunksize"].as<int>();
+  // panels per chunk, less than CSPadDim1 splits an event over several chunks
+  chunk.at(1) = cspad_config["chunk_panels"].as<int>();
+  if ((chunk.at(1) < 1) or (chunk.at(1) > hsize_t(CSPadDim1))) {
+    throw std::runtime_error("cspad chunk_panels must be from 1 to 32");
+  }
+  DsetFilter filter = dset_filter_from_name(cspad_config["filter"].as<std::string>());
   for (auto iter = m_cspad_id_to_number_group.begin(); 
        iter != m_cspad_id_to_number_group.end(); ++iter) {
     int group_id = iter->first;
@@ -265,19 +334,24 @@ void DaqWriter::create_cspad_data_dsets() {
       throw std::runtime_error("create_cspad_data_dsets, id already in map");
     }
     
-    Dset info = Dset::create(h5_group, "data", H5T_NATIVE_INT16, chunk);
+    Dset info = Dset::create(h5_group, "data", H5T_NATIVE_INT16, chunk, dims,
+                             ChunkCachePolicy::for_writer(), filter);
     m_cspad_id_to_data_dset[group_id] = info;
+    if (not m_cspad_pedestal.empty()) {
+      m_cspad_pedestal.write(h5_group, "pedestal");
+    }
   }
 }
 
 
 void DaqWriter::create_vlen_blob_and_index_dsets() {
+  DsetFilter filter = dset_filter_from_name(m_process_config["datasets"]["single_source"]["vlen"]["filter"].as<std::string>());
   create_small_dsets_helper(m_vlen_id_to_number_group, m_vlen_id_to_blob_dset,
-                            "blob", m_small_chunksize);
+                            "blob", m_vlen_chunksize, filter);
   create_small_dsets_helper(m_vlen_id_to_number_group, m_vlen_id_to_blob_start_dset,
-                            "blobstart", m_small_chunksize);
+                            "blobstart", m_vlen_chunksize);
   create_small_dsets_helper(m_vlen_id_to_number_group, m_vlen_id_to_blob_count_dset,
-                            "blobcount", m_small_chunksize);
+                            "blobcount", m_vlen_chunksize);
 }
     
 
@@ -300,9 +374,13 @@ void DaqWriter::write(int64_t fiducial) {
 
 
 void DaqWriter::write_small(int64_t fiducial) {
+  if (m_small_wide) {
+    write_small_wide(fiducial);
+    return;
+  }
   const hsize_t start = 0;
   const hsize_t count = 1;
-  std::vector<int64_t> fid_data(count), milli_data(count);
+  std::vector<int64_t> fid_data(count), milli_data(count), nano_data(count);
   fid_data.at(0)=fiducial;
 
   if (m_config["verbose"].as<int>()>= 2) {
@@ -310,28 +388,55 @@ void DaqWriter::write_small(int64_t fiducial) {
   }
   if (fiducial == m_next_small) {
     m_next_small += std::max(1, m_small_shot_stride);
-    auto milli = std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now().time_since_epoch()).count();
-    milli_data[0]=milli;
+    auto now = Clock::now().time_since_epoch();
+    milli_data[0]=std::chrono::duration_cast<std::chrono::milliseconds>(now).count();
+    nano_data[0]=std::chrono::duration_cast<std::chrono::nanoseconds>(now).count();
     for (int small_id = m_small_first;
          small_id < m_small_first + m_small_count;
          ++small_id)
       {
         Dset & fid_dset = m_small_id_to_fiducials_dset[small_id];
         Dset & milli_dset = m_small_id_to_milli_dset[small_id];
+        Dset & nano_dset = m_small_id_to_nano_dset[small_id];
         Dset & data_dset = m_small_id_to_data_dset[small_id];
 
         fid_dset.append(start, count, fid_data);
         milli_dset.append(start, count, milli_data);
+        nano_dset.append(start, count, nano_data);
         data_dset.append(start, count, fid_data);        
       }
   }
 }
 
 
+// one row per event in each of our four wide datasets, in place of four
+// appends per stream
+void DaqWriter::write_small_wide(int64_t fiducial) {
+  if (m_config["verbose"].as<int>()>= 2) {
+    std::cout << logHdr() << "  small wide " << fiducial << std::endl;
+  }
+  if (fiducial != m_next_small) return;
+  m_next_small += std::max(1, m_small_shot_stride);
+  auto now = Clock::now().time_since_epoch();
+  int64_t milli = std::chrono::duration_cast<std::chrono::milliseconds>(now).count();
+  int64_t nano = std::chrono::duration_cast<std::chrono::nanoseconds>(now).count();
+  std::fill(m_small_fid_row.begin(), m_small_fid_row.end(), fiducial);
+  std::fill(m_small_milli_row.begin(), m_small_milli_row.end(), milli);
+  std::fill(m_small_nano_row.begin(), m_small_nano_row.end(), nano);
+
+  const hsize_t count = 1;
+  m_small_id_to_fiducials_dset[m_id].append(count, m_small_fid_row.data(), m_small_fid_row.size());
+  m_small_id_to_milli_dset[m_id].append(count, m_small_milli_row.data(), m_small_milli_row.size());
+  m_small_id_to_nano_dset[m_id].append(count, m_small_nano_row.data(), m_small_nano_row.size());
+  // the data is the fiducial, as for the per stream layout
+  m_small_id_to_data_dset[m_id].append(count, m_small_fid_row.data(), m_small_fid_row.size());
+}
+
+
 void DaqWriter::write_vlen(int64_t fiducial) {
   const hsize_t start = 0;
   const hsize_t count = 1;
-  std::vector<int64_t> fid_data(count), milli_data(count), blob_start_data(1), blob_count_data(1);
+  std::vector<int64_t> fid_data(count), milli_data(count), nano_data(count), blob_start_data(1), blob_count_data(1);
   fid_data.at(0)=fiducial;
 
   if (m_config["verbose"].as<int>()>= 2) {
@@ -340,8 +445,9 @@ void DaqWriter::write_vlen(int64_t fiducial) {
 
   if (fiducial == m_next_vlen) {
     m_next_vlen += std::max(1, m_vlen_shot_stride);
-    auto milli = std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now().time_since_epoch()).count();
-    milli_data[0]=milli;
+    auto now = Clock::now().time_since_epoch();
+    milli_data[0]=std::chrono::duration_cast<std::chrono::milliseconds>(now).count();
+    nano_data[0]=std::chrono::duration_cast<std::chrono::nanoseconds>(now).count();
 
     YAML::Node vlen = m_process_config["datasets"]["single_source"]["vlen"];
     m_next_vlen_count += 1;
@@ -355,6 +461,7 @@ void DaqWriter::write_vlen(int64_t fiducial) {
       {
         Dset & fid_dset = m_vlen_id_to_fiducials_dset[vlen_id];
         Dset & milli_dset = m_vlen_id_to_milli_dset[vlen_id];
+        Dset & nano_dset = m_vlen_id_to_nano_dset[vlen_id];
         Dset & blobdata_dset = m_vlen_id_to_blob_dset[vlen_id];
         Dset & blobstart_dset = m_vlen_id_to_blob_start_dset[vlen_id];
         Dset & blobcount_dset = m_vlen_id_to_blob_count_dset[vlen_id];
@@ -366,6 +473,7 @@ void DaqWriter::write_vlen(int64_t fiducial) {
         }
         fid_dset.append(start, count, fid_data);
         milli_dset.append(start, count, milli_data);
+        nano_dset.append(start, count, nano_data);
         blob_start_data[0] = blobdata_dset.dim().at(0);
         blob_count_data[0] = m_next_vlen_count;
         blobstart_dset.append(start, count, blob_start_data);
@@ -387,16 +495,24 @@ void DaqWriter::write_cspad(int64_t fiducial) {
   m_next_cspad += std::max(1, m_cspad_shot_stride);
   m_next_cspad_in_source += 1;
   
-  if (size_t(m_next_cspad_in_source) >= m_cspad_source.size()/size_t(CSPadNumElem)) {
+  if (m_next_cspad_in_source >= m_number_cspad_in_source) {
     m_next_cspad_in_source = 0;
   }
     
-  auto milli = std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now().time_since_epoch()).count();
+  auto now = Clock::now().time_since_epoch();
 
   const hsize_t count = 1;
-  std::vector<int64_t> fid_data(count), milli_data(count);
+  std::vector<int64_t> fid_data(count), milli_data(count), nano_data(count);
   fid_data.at(0)=fiducial;
-  milli_data[0]=milli;
+  milli_data[0]=std::chrono::duration_cast<std::chrono::milliseconds>(now).count();
+  nano_data[0]=std::chrono::duration_cast<std::chrono::nanoseconds>(now).count();
+
+  // the frame we write, with the pedestal taken off if there is one
+  const int16_t *frame = m_cspad_source.as<int16_t>() + size_t(CSPadNumElem) * size_t(m_next_cspad_in_source);
+  if (not m_cspad_pedestal.empty()) {
+    m_cspad_pedestal.subtract(frame, m_cspad_frame.as<int16_t>(), count);
+    frame = m_cspad_frame.as<int16_t>();
+  }
 
   for (int cspad_id = m_cspad_first;
        cspad_id < m_cspad_first + m_cspad_count;
@@ -404,13 +520,14 @@ void DaqWriter::write_cspad(int64_t fiducial) {
 
       Dset & fid_dset = m_cspad_id_to_fiducials_dset[cspad_id];
       Dset & milli_dset = m_cspad_id_to_milli_dset[cspad_id];
+      Dset & nano_dset = m_cspad_id_to_nano_dset[cspad_id];
       Dset & data_dset = m_cspad_id_to_data_dset[cspad_id];
       
-      size_t cspad_start = size_t(CSPadNumElem) * size_t(m_next_cspad_in_source);
       const hsize_t start=0;
       fid_dset.append(start, count, fid_data);
       milli_dset.append(start, count, milli_data);
-      data_dset.append(cspad_start, count, m_cspad_source);
+      nano_dset.append(start, count, nano_data);
+      data_dset.append(count, frame, size_t(CSPadNumElem) * count);
   }  
 };
 
@@ -427,16 +544,19 @@ void DaqWriter::flush_helper(const std::map<int, Dset> &id_to_dset) {
 void DaqWriter::flush_data(int64_t fiducial) {
   flush_helper(m_small_id_to_fiducials_dset);
   flush_helper(m_small_id_to_milli_dset);
+  flush_helper(m_small_id_to_nano_dset);
   flush_helper(m_small_id_to_data_dset);
   
   flush_helper(m_vlen_id_to_fiducials_dset);
   flush_helper(m_vlen_id_to_milli_dset);
+  flush_helper(m_vlen_id_to_nano_dset);
   flush_helper(m_vlen_id_to_blob_dset);
   flush_helper(m_vlen_id_to_blob_count_dset);
   flush_helper(m_vlen_id_to_blob_start_dset);
   
   flush_helper(m_cspad_id_to_fiducials_dset);
   flush_helper(m_cspad_id_to_milli_dset);
+  flush_helper(m_cspad_id_to_nano_dset);
   flush_helper(m_cspad_id_to_data_dset);
   if (m_config["verbose"].as<int>() > 0 ) {
     std::cout << logHdr() << "flush_data: fiducial=" << fiducial << " last_cspad_written:" << m_last_cspad_written << std::endl;
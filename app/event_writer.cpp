@@ -0,0 +1,180 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <stdexcept>
+#include <vector>
+
+#include "lc2daq.h"
+#include "DaqBase.h"
+
+// The event major alternative to daq_writer. Writes the same small and vlen
+// streams as daq_writer with the same id, but as one EventTable row per
+// event rather than a group of datasets per stream:
+//
+//   /events   fiducial, milli, nano, small[num_per_writer],
+//             vlen_start[num_per_writer], vlen_count[num_per_writer]
+//   /blob     the values of all the vlen streams, event then stream order
+//
+// small column k is small stream m_id * num_per_writer + k, the vlen columns
+// likewise. The small values are the fiducial, like daq_writer, or -1 in an
+// event the small streams do not sample. A vlen stream not sampled in an
+// event has a count of 0. Stream counts, strides and vlen lengths come from
+// the daq_writer section, the table chunking from the event_writer section.
+class EventWriter : public DaqBase {
+
+  hid_t m_writer_fid;
+  EventTable m_table;
+
+  int m_small_count, m_vlen_count;
+  int m_small_shot_stride, m_vlen_shot_stride;
+  int m_vlen_min_per_shot, m_vlen_max_per_shot;
+  int m_next_vlen_count;
+  hsize_t m_rows_per_chunk, m_blob_chunksize;
+
+  std::vector<int64_t> m_row, m_blob;
+
+public:
+  EventWriter(int argc, char *argv[]);
+  ~EventWriter();
+
+  void run();
+  void create_file();
+  void write(int64_t fiducial);
+  void flush_data(int64_t fiducial);
+};
+
+
+EventWriter::EventWriter(int argc, char *argv[])
+  : DaqBase(argc, argv, "event_writer"),
+    m_writer_fid(-1),
+    m_small_count(0),
+    m_vlen_count(0),
+    m_small_shot_stride(0),
+    m_vlen_shot_stride(0),
+    m_vlen_min_per_shot(0),
+    m_vlen_max_per_shot(0),
+    m_next_vlen_count(0),
+    m_rows_per_chunk(0),
+    m_blob_chunksize(0)
+{
+  YAML::Node single_source = m_config["daq_writer"]["datasets"]["single_source"];
+  m_small_count = single_source["small"]["num_per_writer"].as<int>();
+  m_small_shot_stride = std::max(1, single_source["small"]["shots_per_sample"].as<int>());
+  m_vlen_count = single_source["vlen"]["num_per_writer"].as<int>();
+  m_vlen_shot_stride = std::max(1, single_source["vlen"]["shots_per_sample"].as<int>());
+  m_vlen_min_per_shot = single_source["vlen"]["min_per_shot"].as<int>();
+  m_vlen_max_per_shot = single_source["vlen"]["max_per_shot"].as<int>();
+
+  m_rows_per_chunk = m_process_config["rows_per_chunk"].as<hsize_t>();
+  m_blob_chunksize = m_process_config["blob_chunksize"].as<hsize_t>();
+
+  m_row.resize(EventTable::SMALL + m_small_count + 2 * m_vlen_count);
+  m_blob.resize(size_t(m_vlen_count) * size_t(std::max(1, m_vlen_max_per_shot)));
+}
+
+
+EventWriter::~EventWriter() {
+  std::cout << logHdr() << "done" << std::endl;
+}
+
+
+void EventWriter::run() {
+  DaqBase::run_setup();
+  create_file();
+  m_table = EventTable::create(m_writer_fid, m_small_count, m_vlen_count, m_rows_per_chunk, m_blob_chunksize);
+  NONNEG( H5Fstart_swmr_write(m_writer_fid) );
+  if (m_config["verbose"].as<int>() > 0) {
+    std::cout << logHdr() << "started SWMR access to writer file" << std::endl;
+  }
+  int64_t fiducial = -1;
+  std::cout << logHdr() << "about to loop through " << m_config["num_samples"].as<int64_t>() << " fiducials" << std::endl;
+  for (fiducial = 0; fiducial < m_config["num_samples"].as<int64_t>(); ++fiducial) {
+    write(fiducial);
+    if ((fiducial > 0) and (0 == (fiducial % m_config["flush_interval"].as<int64_t>()))) {
+      flush_data(fiducial);
+    }
+  }
+  if (m_config["writers_hang"].as<bool>()) {
+    std::cout << logHdr() << "MSG: hanging\n";
+    fflush(::stdout);
+    while (true) {}
+  }
+  m_table.close();
+  NONNEG( H5Fclose(m_writer_fid) );
+  m_t1 = Clock::now();
+
+  auto total_diff = m_t1 - m_t0;
+  auto seconds = std::chrono::duration_cast<std::chrono::seconds>(total_diff);
+  std::cout << logHdr() << "finished - num seconds=" << seconds.count() << " num events=" << fiducial << std::endl;
+}
+
+
+void EventWriter::create_file() {
+  hid_t fapl = NONNEG( H5Pcreate(H5P_FILE_ACCESS) );
+  NONNEG( H5Pset_libver_bounds(fapl, H5F_LIBVER_LATEST, H5F_LIBVER_LATEST) );
+  m_writer_fid = NONNEG( H5Fcreate(m_fname_h5.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, fapl) );
+  if (m_config["verbose"].as<int>() > 0) {
+    std::cout << logHdr() << "created file: " << m_fname_h5 << std::endl;
+  }
+  NONNEG( H5Pclose(fapl) );
+}
+
+
+// one row for any event the small or vlen streams sample, with the vlen
+// values going to the blob in the same append
+void EventWriter::write(int64_t fiducial) {
+  bool small = (0 == (fiducial % m_small_shot_stride));
+  bool vlen = (0 == (fiducial % m_vlen_shot_stride));
+  if (not (small or vlen)) return;
+
+  if (m_config["verbose"].as<int>()>= 2) {
+    std::cout << logHdr() << "event " << fiducial << std::endl;
+  }
+  auto now = Clock::now().time_since_epoch();
+  m_row.at(EventTable::FIDUCIAL) = fiducial;
+  m_row.at(EventTable::MILLI) = std::chrono::duration_cast<std::chrono::milliseconds>(now).count();
+  m_row.at(EventTable::NANO) = std::chrono::duration_cast<std::chrono::nanoseconds>(now).count();
+  std::fill(m_row.begin() + EventTable::SMALL, m_row.begin() + EventTable::SMALL + m_small_count,
+            small ? fiducial : int64_t(-1));
+
+  // same per shot vlen lengths as daq_writer
+  int per_stream = 0;
+  if (vlen) {
+    m_next_vlen_count += 1;
+    m_next_vlen_count %= m_vlen_max_per_shot;
+    m_next_vlen_count = std::max(m_vlen_min_per_shot, m_next_vlen_count);
+    per_stream = m_next_vlen_count;
+  }
+  size_t count_column = EventTable::SMALL + m_small_count + m_vlen_count;
+  std::fill(m_row.begin() + count_column, m_row.begin() + count_column + m_vlen_count, int64_t(per_stream));
+  size_t blob_len = size_t(per_stream) * size_t(m_vlen_count);
+  std::fill(m_blob.begin(), m_blob.begin() + blob_len, fiducial);
+
+  m_table.append(1, m_row.data(), m_blob.data(), blob_len);
+}
+
+
+void EventWriter::flush_data(int64_t fiducial) {
+  m_table.flush();
+  if (m_config["verbose"].as<int>() > 0 ) {
+    std::cout << logHdr() << "flush_data: fiducial=" << fiducial << std::endl;
+  }
+}
+
+
+int main(int argc, char *argv[]) {
+  H5open();
+  try {
+    EventWriter eventWriter(argc, argv);
+    eventWriter.run();
+  } catch (const std::exception &ex) {
+    std::cout << "Caught exception: " << ex.what() << std::endl;
+    std::cout << "trying to close library " << std::endl;
+    H5close();
+    throw ex;
+  }
+  H5close();
+  return 0;
+}
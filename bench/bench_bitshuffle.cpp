@@ -0,0 +1,282 @@
+// Bitshuffle/LZ4 filter on cspad frames. For synthetic frames - a pedestal
+// plus gaussian noise of a few widths - or frames from a file, reports:
+//
+//   transpose    - bit transpose MB/s, scalar and SIMD
+//   pedestal     - Pedestal subtract and restore MB/s, scalar and SIMD, with
+//                  the per pixel mean of the frames as the pedestal
+//   compress     - bitshuffle::compress and decompress MB/s, and the ratio,
+//                  of the frames and of the frames less the pedestal
+//   hdf5         - writing and reading frames as [events, 32, 185, 388]
+//                  int16 chunked one frame per chunk, with no filter, with
+//                  the filter, and with the pedestal subtracted before the
+//                  filter and restored after reading: MB/s of frame data
+//                  and file size
+//
+// Prints one CSV line, or JSON object, per (source, measurement).
+//
+// usage: bench_bitshuffle [--json] [--frames N] [--dir D]
+//          [--source file.h5 dataset]
+#include <iostream>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+
+#include "check_macros.h"
+#include "BitshuffleFilter.h"
+#include "Dset.h"
+#include "Pedestal.h"
+
+typedef std::chrono::steady_clock Clock;
+
+const hsize_t PANELS = 32, ROWS = 185, COLS = 388;
+const size_t FRAME_LEN = PANELS * ROWS * COLS;
+
+
+struct Result {
+  std::string source, measure, variant;
+  double mbps, ratio;
+};
+
+
+double seconds_since(Clock::time_point t0) {
+  return std::chrono::duration<double>(Clock::now() - t0).count();
+}
+
+
+std::vector<int16_t> synthetic_frames(size_t num_frames, double sigma) {
+  std::mt19937 rng(1234);
+  std::normal_distribution<double> noise(0.0, sigma);
+  std::uniform_int_distribution<int> pedestal(1000, 1400);
+  std::vector<int16_t> pedestals(FRAME_LEN);
+  for (size_t idx = 0; idx < FRAME_LEN; ++idx) pedestals.at(idx) = int16_t(pedestal(rng));
+  std::vector<int16_t> frames(num_frames * FRAME_LEN);
+  for (size_t idx = 0; idx < frames.size(); ++idx) {
+    frames.at(idx) = int16_t(pedestals.at(idx % FRAME_LEN) + int(noise(rng)));
+  }
+  return frames;
+}
+
+
+// the first num_frames of an int16 [n, 32, 185, 388] dataset, repeated if short
+std::vector<int16_t> file_frames(const std::string &fname, const std::string &dset_path, size_t num_frames) {
+  hid_t fid = POS(H5Fopen(fname.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT));
+  hid_t dset = NONNEG(H5Dopen2(fid, dset_path.c_str(), H5P_DEFAULT));
+  hid_t space = NONNEG(H5Dget_space(dset));
+  hsize_t dims[4] = {0, 0, 0, 0};
+  if ((NONNEG(H5Sget_simple_extent_ndims(space)) != 4) or (H5Sget_simple_extent_dims(space, dims, NULL) != 4) or
+      (dims[1] * dims[2] * dims[3] != FRAME_LEN) or (dims[0] == 0)) {
+    throw std::runtime_error("--source dataset is not [n, 32, 185, 388]");
+  }
+  std::vector<int16_t> source(dims[0] * FRAME_LEN);
+  NONNEG(H5Dread(dset, H5T_NATIVE_INT16, H5S_ALL, H5S_ALL, H5P_DEFAULT, source.data()));
+  NONNEG(H5Sclose(space));
+  NONNEG(H5Dclose(dset));
+  NONNEG(H5Fclose(fid));
+  std::vector<int16_t> frames(num_frames * FRAME_LEN);
+  for (size_t frame = 0; frame < num_frames; ++frame) {
+    memcpy(&frames.at(frame * FRAME_LEN), &source.at((frame % dims[0]) * FRAME_LEN), FRAME_LEN * sizeof(int16_t));
+  }
+  return frames;
+}
+
+
+void transpose_bench(const std::string &source, const std::vector<int16_t> &frames, std::vector<Result> &results) {
+  const size_t block = bitshuffle::default_block_elements(sizeof(int16_t));
+  std::vector<uint8_t> out(block * sizeof(int16_t)), scratch(block * sizeof(int16_t));
+  const size_t num_blocks = frames.size() / block;
+  for (int simd = 0; simd < 2; ++simd) {
+    auto t0 = Clock::now();
+    for (size_t idx = 0; idx < num_blocks; ++idx) {
+      if (simd) {
+        bitshuffle::bit_transpose(&frames.at(idx * block), out.data(), block, sizeof(int16_t), scratch.data());
+      } else {
+        bitshuffle::bit_transpose_scalar(&frames.at(idx * block), out.data(), block, sizeof(int16_t), scratch.data());
+      }
+    }
+    double mb = double(num_blocks * block * sizeof(int16_t)) / 1e6;
+    const char *variant = simd ? (bitshuffle::simd_enabled() ? "simd" : "simd_fallback") : "scalar";
+    results.push_back(Result{source, "transpose", variant, mb / seconds_since(t0), 1.0});
+  }
+}
+
+
+void pedestal_bench(const std::string &source, const std::vector<int16_t> &frames, const Pedestal &pedestal,
+                    std::vector<Result> &results) {
+  const size_t num_frames = frames.size() / FRAME_LEN;
+  const double mb = double(frames.size() * sizeof(int16_t)) / 1e6;
+  std::vector<int16_t> out(frames.size());
+  for (int simd = 0; simd < 2; ++simd) {
+    const char *variant = simd ? (Pedestal::simd_enabled() ? "simd" : "simd_fallback") : "scalar";
+    auto t0 = Clock::now();
+    pedestal.subtract(frames.data(), out.data(), num_frames, simd != 0);
+    results.push_back(Result{source, "pedestal_subtract", variant, mb / seconds_since(t0), 1.0});
+    t0 = Clock::now();
+    pedestal.restore(out.data(), num_frames, simd != 0);
+    results.push_back(Result{source, "pedestal_restore", variant, mb / seconds_since(t0), 1.0});
+    if (out != frames) throw std::runtime_error("bench_bitshuffle - pedestal roundtrip mismatch");
+  }
+}
+
+
+void compress_bench(const std::string &source, const std::vector<int16_t> &frames, const char *variant,
+                    std::vector<Result> &results) {
+  const size_t frame_bytes = FRAME_LEN * sizeof(int16_t);
+  const size_t num_frames = frames.size() / FRAME_LEN;
+  std::vector<std::vector<uint8_t> > packed(num_frames);
+  size_t packed_bytes = 0;
+  auto t0 = Clock::now();
+  for (size_t frame = 0; frame < num_frames; ++frame) {
+    packed.at(frame).resize(bitshuffle::compress_bound(frame_bytes, sizeof(int16_t), 0));
+    size_t len = bitshuffle::compress(&frames.at(frame * FRAME_LEN), frame_bytes, sizeof(int16_t), 0, packed.at(frame).data());
+    packed.at(frame).resize(len);
+    packed_bytes += len;
+  }
+  double compress_seconds = seconds_since(t0);
+
+  std::vector<int16_t> out(FRAME_LEN);
+  t0 = Clock::now();
+  for (size_t frame = 0; frame < num_frames; ++frame) {
+    bitshuffle::decompress(packed.at(frame).data(), packed.at(frame).size(), out.data(), frame_bytes);
+  }
+  double decompress_seconds = seconds_since(t0);
+  if (memcmp(out.data(), &frames.at((num_frames - 1) * FRAME_LEN), frame_bytes) != 0) {
+    throw std::runtime_error("bench_bitshuffle - roundtrip mismatch");
+  }
+
+  double mb = double(num_frames * frame_bytes) / 1e6;
+  double ratio = double(num_frames * frame_bytes) / double(packed_bytes);
+  results.push_back(Result{source, "compress", variant, mb / compress_seconds, ratio});
+  results.push_back(Result{source, "decompress", variant, mb / decompress_seconds, ratio});
+}
+
+
+void hdf5_bench(const std::string &source, const std::vector<int16_t> &frames, const Pedestal &frames_pedestal,
+                const std::string &dir, std::vector<Result> &results) {
+  const size_t num_frames = frames.size() / FRAME_LEN;
+  const double mb = double(frames.size() * sizeof(int16_t)) / 1e6;
+  std::vector<hsize_t> chunk = {1, PANELS, ROWS, COLS};
+  std::vector<int16_t> out(FRAME_LEN), subtracted(FRAME_LEN);
+  const char *variants[] = {"none", "bitshuffle_lz4", "pedestal_bitshuffle_lz4"};
+  for (int variant_idx = 0; variant_idx < 3; ++variant_idx) {
+    const char *variant = variants[variant_idx];
+    DsetFilter filter = (variant_idx == 0) ? filter_none : filter_bitshuffle_lz4;
+    Pedestal pedestal = (variant_idx == 2) ? frames_pedestal : Pedestal();
+    std::string fname = dir + "/bench_bitshuffle_" + variant + ".h5";
+
+    auto t0 = Clock::now();
+    hid_t fapl = NONNEG(H5Pcreate(H5P_FILE_ACCESS));
+    NONNEG(H5Pset_libver_bounds(fapl, H5F_LIBVER_LATEST, H5F_LIBVER_LATEST));
+    hid_t fid = NONNEG(H5Fcreate(fname.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, fapl));
+    NONNEG(H5Pclose(fapl));
+    Dset dset = Dset::create(fid, "data", H5T_NATIVE_INT16, chunk, chunk, ChunkCachePolicy::for_writer(), filter);
+    if (not pedestal.empty()) pedestal.write(fid, "pedestal");
+    NONNEG(H5Fstart_swmr_write(fid));
+    for (size_t frame = 0; frame < num_frames; ++frame) {
+      const int16_t *data = &frames.at(frame * FRAME_LEN);
+      if (not pedestal.empty()) {
+        pedestal.subtract(data, subtracted.data(), 1);
+        data = subtracted.data();
+      }
+      dset.append(1, data, FRAME_LEN);
+    }
+    dset.close();
+    NONNEG(H5Fclose(fid));
+    double write_seconds = seconds_since(t0);
+
+    struct stat st;
+    double file_bytes = (stat(fname.c_str(), &st) == 0) ? double(st.st_size) : 0;
+    double ratio = file_bytes > 0 ? double(frames.size() * sizeof(int16_t)) / file_bytes : 0;
+
+    t0 = Clock::now();
+    fid = NONNEG(H5Fopen(fname.c_str(), H5F_ACC_RDONLY | H5F_ACC_SWMR_READ, H5P_DEFAULT));
+    dset = Dset::open(fid, "data", Dset::if_vds_first_missing);
+    Pedestal stored = Pedestal::load(fid, "pedestal");
+    for (size_t frame = 0; frame < num_frames; ++frame) {
+      stored.read(dset, frame, 1, out.data(), out.size());
+    }
+    if (memcmp(out.data(), &frames.at((num_frames - 1) * FRAME_LEN), FRAME_LEN * sizeof(int16_t)) != 0) {
+      throw std::runtime_error("bench_bitshuffle - hdf5 roundtrip mismatch");
+    }
+    dset.close();
+    NONNEG(H5Fclose(fid));
+    double read_seconds = seconds_since(t0);
+    remove(fname.c_str());
+
+    results.push_back(Result{source, "hdf5_write", variant, mb / write_seconds, ratio});
+    results.push_back(Result{source, "hdf5_read", variant, mb / read_seconds, ratio});
+  }
+}
+
+
+void report(const std::vector<Result> &results, size_t num_frames, bool json) {
+  if (json) {
+    std::cout << "[";
+    for (size_t idx = 0; idx < results.size(); ++idx) {
+      const Result &result = results.at(idx);
+      std::cout << (idx == 0 ? "\n" : ",\n")
+                << "  {\"source\": \"" << result.source << "\", \"measure\": \"" << result.measure
+                << "\", \"variant\": \"" << result.variant << "\", \"frames\": " << num_frames
+                << ", \"mbps\": " << result.mbps << ", \"ratio\": " << result.ratio << "}";
+    }
+    std::cout << "\n]" << std::endl;
+    return;
+  }
+  std::cout << "source,measure,variant,frames,mbps,ratio" << std::endl;
+  for (auto iter = results.begin(); iter != results.end(); ++iter) {
+    std::cout << iter->source << "," << iter->measure << "," << iter->variant << ","
+              << num_frames << "," << iter->mbps << "," << iter->ratio << std::endl;
+  }
+}
+
+
+int main(int argc, char *argv[]) {
+  bool json = false;
+  size_t num_frames = 20;
+  std::string dir = ".", source_fname, source_dset;
+  for (int arg = 1; arg < argc; ++arg) {
+    if (strcmp(argv[arg], "--json") == 0) {
+      json = true;
+    } else if ((strcmp(argv[arg], "--frames") == 0) and (arg + 1 < argc)) {
+      num_frames = std::max(size_t(1), size_t(atol(argv[++arg])));
+    } else if ((strcmp(argv[arg], "--dir") == 0) and (arg + 1 < argc)) {
+      dir = argv[++arg];
+    } else if ((strcmp(argv[arg], "--source") == 0) and (arg + 2 < argc)) {
+      source_fname = argv[++arg];
+      source_dset = argv[++arg];
+    } else {
+      std::cerr << "usage: bench_bitshuffle [--json] [--frames N] [--dir D] [--source file.h5 dataset]" << std::endl;
+      return 1;
+    }
+  }
+
+  bitshuffle::register_filter();
+  std::vector<Result> results;
+  std::vector<std::pair<std::string, std::vector<int16_t> > > sources;
+  if (source_fname.size() > 0) {
+    sources.push_back(std::make_pair(std::string("file"), file_frames(source_fname, source_dset, num_frames)));
+  } else {
+    const double sigmas[] = {2, 8, 32};
+    for (auto sigma : sigmas) {
+      sources.push_back(std::make_pair("noise" + std::to_string(int(sigma)), synthetic_frames(num_frames, sigma)));
+    }
+  }
+  std::vector<hsize_t> frame_dims = {PANELS, ROWS, COLS};
+  for (auto iter = sources.begin(); iter != sources.end(); ++iter) {
+    const std::vector<int16_t> &frames = iter->second;
+    Pedestal pedestal = Pedestal::from_frames(frames.data(), num_frames, frame_dims);
+    std::vector<int16_t> subtracted(frames.size());
+    pedestal.subtract(frames.data(), subtracted.data(), num_frames);
+    transpose_bench(iter->first, frames, results);
+    pedestal_bench(iter->first, frames, pedestal, results);
+    compress_bench(iter->first, frames, "bitshuffle_lz4", results);
+    compress_bench(iter->first, subtracted, "pedestal_bitshuffle_lz4", results);
+    hdf5_bench(iter->first, frames, pedestal, dir, results);
+  }
+  report(results, num_frames, json);
+  return 0;
+}
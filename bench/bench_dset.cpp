@@ -0,0 +1,269 @@
+// Dset::append and Dset::read over a sweep of chunk size, element type,
+// rank, events per call, SWMR on/off and plain vs round robin VDS. Prints
+// one CSV line, or JSON object, per (op, configuration) with ns per call,
+// MB/s and C++ heap allocations per call - hdf5 itself uses malloc, which
+// is not counted. Meant as a baseline to compare hot path changes against.
+//
+// usage: bench_dset [--json] [--events N] [--dir D]
+#include <iostream>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "check_macros.h"
+#include "Dset.h"
+#include "DsetLayoutCache.h"
+#include "VDSRoundRobin.h"
+
+typedef std::chrono::steady_clock Clock;
+
+namespace {
+  size_t num_allocations = 0;
+}
+
+void * operator new(size_t bytes) {
+  ++num_allocations;
+  void *ptr = malloc(bytes == 0 ? 1 : bytes);
+  if (ptr == NULL) throw std::bad_alloc();
+  return ptr;
+}
+
+void operator delete(void *ptr) noexcept {
+  free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept {
+  free(ptr);
+}
+
+
+const int NUM_VDS_SRC = 3;
+
+
+struct BenchConfig {
+  std::string layout;
+  std::string type_name;
+  int rank;
+  hsize_t chunk_events;
+  hsize_t count;
+  bool swmr;
+};
+
+
+struct BenchResult {
+  std::string op;
+  size_t calls;
+  double ns_per_call;
+  double mb_per_s;
+  double allocs_per_call;
+};
+
+
+class Timer {
+  Clock::time_point m_t0;
+  size_t m_allocs0;
+public:
+  Timer() : m_t0(Clock::now()), m_allocs0(num_allocations) {}
+
+  BenchResult result(const std::string &op, size_t calls, size_t bytes) const {
+    double ns = double(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - m_t0).count());
+    size_t allocs = num_allocations - m_allocs0;
+    BenchResult res;
+    res.op = op;
+    res.calls = calls;
+    res.ns_per_call = ns / double(std::max(size_t(1), calls));
+    res.mb_per_s = (ns > 0) ? (double(bytes) / (1 << 20)) / (ns * 1e-9) : 0.0;
+    res.allocs_per_call = double(allocs) / double(std::max(size_t(1), calls));
+    return res;
+  }
+};
+
+
+hid_t create_file(const std::string &fname) {
+  hid_t fapl =  NONNEG(H5Pcreate(H5P_FILE_ACCESS));
+  NONNEG(H5Pset_libver_bounds(fapl, H5F_LIBVER_LATEST, H5F_LIBVER_LATEST));
+  hid_t fid =  NONNEG(H5Fcreate(fname.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, fapl));
+  NONNEG(H5Pclose(fapl));
+  return fid;
+}
+
+
+std::vector<hsize_t> event_dims(int rank) {
+  // rank 1 is one value per event, rank 4 a small 3D frame per event
+  if (rank == 1) return std::vector<hsize_t>();
+  return std::vector<hsize_t>{4, 16, 32};
+}
+
+
+template <class T>
+BenchResult bench_append(const BenchConfig &config, hid_t h5type,
+                         const std::vector<std::string> &fnames, hsize_t num_events) {
+  std::vector<hsize_t> chunk(1, config.chunk_events);
+  std::vector<hsize_t> frame = event_dims(config.rank);
+  chunk.insert(chunk.end(), frame.begin(), frame.end());
+  size_t event_len = 1;
+  for (size_t idx = 0; idx < frame.size(); ++idx) event_len *= frame.at(idx);
+
+  std::vector<T> data(event_len * config.count, T(7));
+  hsize_t events_per_file = num_events / fnames.size();
+  size_t calls = 0;
+
+  std::vector<hid_t> fids;
+  std::vector<Dset> dsets;
+  for (size_t idx = 0; idx < fnames.size(); ++idx) {
+    fids.push_back(create_file(fnames.at(idx)));
+    dsets.push_back(Dset::create(fids.back(), "data", h5type, chunk));
+    if (config.swmr) NONNEG(H5Fstart_swmr_write(fids.back()));
+  }
+
+  // round robin over the files, like the writers
+  Timer timer;
+  for (hsize_t written = 0; written < events_per_file; written += config.count) {
+    for (size_t idx = 0; idx < dsets.size(); ++idx) {
+      dsets.at(idx).append(config.count, &data.at(0), data.size());
+      ++calls;
+    }
+  }
+  BenchResult result = timer.result("append", calls, calls * data.size() * sizeof(T));
+
+  for (size_t idx = 0; idx < fnames.size(); ++idx) {
+    dsets.at(idx).close();
+    NONNEG(H5Fclose(fids.at(idx)));
+  }
+  return result;
+}
+
+
+template <class T>
+BenchResult bench_read(const BenchConfig &config, const std::string &fname) {
+  unsigned flags = H5F_ACC_RDONLY;
+  if (config.swmr) flags |= H5F_ACC_SWMR_READ;
+  hid_t fid = NONNEG(H5Fopen(fname.c_str(), flags, H5P_DEFAULT));
+  Dset dset = Dset::open(fid, "data", Dset::if_vds_first_missing);
+  hsize_t num_events = dset.dim().at(0);
+  std::vector<T> data(dset.event_len() * config.count);
+  size_t calls = 0;
+
+  Timer timer;
+  for (hsize_t start = 0; start + config.count <= num_events; start += config.count) {
+    dset.read(start, config.count, &data.at(0), data.size());
+    ++calls;
+  }
+  BenchResult result = timer.result("read", calls, calls * data.size() * sizeof(T));
+
+  dset.close();
+  NONNEG(H5Fclose(fid));
+  // the layout cache keeps the VDS source files open, close them before they are rewritten
+  DsetLayoutCache::instance().release_files();
+  return result;
+}
+
+
+template <class T>
+void bench(const BenchConfig &config, hid_t h5type, const std::string &dir,
+           hsize_t num_events, std::vector<BenchResult> &results) {
+  std::vector<std::string> src_fnames;
+  if (config.layout == "plain") {
+    src_fnames.push_back(dir + "/bench_dset_plain.h5");
+  } else {
+    for (int src = 0; src < NUM_VDS_SRC; ++src) {
+      src_fnames.push_back(dir + "/bench_dset_src" + std::to_string(src) + ".h5");
+    }
+  }
+  results.push_back(bench_append<T>(config, h5type, src_fnames, num_events));
+
+  std::string read_fname = src_fnames.at(0);
+  if (config.layout == "vds") {
+    read_fname = dir + "/bench_dset_vds.h5";
+    hid_t fid = create_file(read_fname);
+    std::vector<std::string> paths(src_fnames.size(), "/data");
+    VDSRoundRobin vds(fid, "data", src_fnames, paths);
+    NONNEG(H5Dclose(vds.get_and_transfer_ownership_of_VDS()));
+    NONNEG(H5Fclose(fid));
+  }
+  results.push_back(bench_read<T>(config, read_fname));
+}
+
+
+void report(const BenchConfig &config, const BenchResult &result, bool json, bool first) {
+  if (json) {
+    std::cout << (first ? "[\n" : ",\n")
+              << "  {\"op\": \"" << result.op << "\", \"layout\": \"" << config.layout
+              << "\", \"type\": \"" << config.type_name << "\", \"rank\": " << config.rank
+              << ", \"chunk_events\": " << config.chunk_events << ", \"count\": " << config.count
+              << ", \"swmr\": " << (config.swmr ? "true" : "false") << ", \"calls\": " << result.calls
+              << ", \"ns_per_call\": " << result.ns_per_call << ", \"mb_per_s\": " << result.mb_per_s
+              << ", \"allocs_per_call\": " << result.allocs_per_call << "}";
+    return;
+  }
+  if (first) {
+    std::cout << "op,layout,type,rank,chunk_events,count,swmr,calls,ns_per_call,mb_per_s,allocs_per_call" << std::endl;
+  }
+  std::cout << result.op << "," << config.layout << "," << config.type_name << ","
+            << config.rank << "," << config.chunk_events << "," << config.count << ","
+            << int(config.swmr) << "," << result.calls << "," << result.ns_per_call << ","
+            << result.mb_per_s << "," << result.allocs_per_call << std::endl;
+}
+
+
+int main(int argc, char *argv[]) {
+  bool json = false;
+  hsize_t num_events = 3000;
+  std::string dir = ".";
+  for (int arg = 1; arg < argc; ++arg) {
+    if (strcmp(argv[arg], "--json") == 0) {
+      json = true;
+    } else if ((strcmp(argv[arg], "--events") == 0) and (arg + 1 < argc)) {
+      num_events = hsize_t(atol(argv[++arg]));
+    } else if ((strcmp(argv[arg], "--dir") == 0) and (arg + 1 < argc)) {
+      dir = argv[++arg];
+    } else {
+      std::cerr << "usage: bench_dset [--json] [--events N] [--dir D]" << std::endl;
+      return 1;
+    }
+  }
+
+  const char *layouts[] = {"plain", "vds"};
+  const char *types[] = {"int16", "int64"};
+  const int ranks[] = {1, 4};
+  const hsize_t chunks[] = {1, 16, 256};
+  const hsize_t counts[] = {1, 16};
+  const bool swmrs[] = {false, true};
+
+  bool first = true;
+  for (auto layout : layouts) {
+    for (auto type_name : types) {
+      for (auto rank : ranks) {
+        for (auto chunk_events : chunks) {
+          for (auto count : counts) {
+            for (auto swmr : swmrs) {
+              BenchConfig config;
+              config.layout = layout;
+              config.type_name = type_name;
+              config.rank = rank;
+              config.chunk_events = chunk_events;
+              config.count = count;
+              config.swmr = swmr;
+              std::vector<BenchResult> results;
+              if (config.type_name == "int16") {
+                bench<int16_t>(config, H5T_NATIVE_INT16, dir, num_events, results);
+              } else {
+                bench<int64_t>(config, H5T_NATIVE_INT64, dir, num_events, results);
+              }
+              for (auto iter = results.begin(); iter != results.end(); ++iter) {
+                report(config, *iter, json, first);
+                first = false;
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+  if (json) std::cout << "\n]" << std::endl;
+  return 0;
+}
@@ -0,0 +1,89 @@
+// per call overhead of appending and reading one event, Dset vs TypedDset,
+// for a rank 1 int64 and a rank 4 int16 dataset with small events, so the
+// time is mostly our bookkeeping and hdf5 selection, not moving data.
+//
+// usage: bench_dset_overhead [num_calls] [fname]
+#include <iostream>
+#include <chrono>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "check_macros.h"
+#include "Dset.h"
+#include "TypedDset.h"
+
+typedef std::chrono::steady_clock Clock;
+
+
+hid_t create_file(const char *fname) {
+  hid_t fapl =  NONNEG(H5Pcreate(H5P_FILE_ACCESS));
+  NONNEG(H5Pset_libver_bounds(fapl, H5F_LIBVER_LATEST, H5F_LIBVER_LATEST));
+  hid_t fid =  NONNEG(H5Fcreate(fname, H5F_ACC_TRUNC, H5P_DEFAULT, fapl));
+  NONNEG(H5Pclose(fapl));
+  return fid;
+}
+
+
+double ns_per_call(Clock::time_point t0, Clock::time_point t1, size_t num_calls) {
+  return double(std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count()) / double(num_calls);
+}
+
+
+void report(int rank, const char *api, const char *op, double ns) {
+  std::cout << "rank=" << rank << " api=" << api << " op=" << op
+            << " ns_per_call=" << ns << std::endl;
+}
+
+
+template <class T, int Rank>
+void bench(hid_t fid, const std::vector<hsize_t> &chunk, size_t num_calls) {
+  std::string name = "rank" + std::to_string(Rank);
+  size_t event_len = 1;
+  for (size_t idx = 1; idx < chunk.size(); ++idx) event_len *= chunk.at(idx);
+  std::vector<T> event(event_len, T(3));
+
+  // Dset, vectors, runtime type and rank
+  Dset dset = Dset::create(fid, (name + "_dset").c_str(), H5TypeOf<T>::get(), chunk);
+  auto t0 = Clock::now();
+  for (size_t call = 0; call < num_calls; ++call) dset.append(0, 1, event);
+  auto t1 = Clock::now();
+  report(Rank, "Dset", "append", ns_per_call(t0, t1, num_calls));
+
+  std::vector<T> read_back;
+  t0 = Clock::now();
+  for (size_t call = 0; call < num_calls; ++call) dset.read(call, 1, read_back);
+  t1 = Clock::now();
+  report(Rank, "Dset", "read", ns_per_call(t0, t1, num_calls));
+  dset.close();
+
+  // TypedDset, pointers, compile time type and rank
+  typename TypedDset<T, Rank>::Dims typed_chunk;
+  for (int idx = 0; idx < Rank; ++idx) typed_chunk[idx] = chunk.at(idx);
+  TypedDset<T, Rank> typed = TypedDset<T, Rank>::create(fid, (name + "_typed").c_str(), typed_chunk);
+  t0 = Clock::now();
+  for (size_t call = 0; call < num_calls; ++call) typed.append(&event.at(0), event.size(), 1);
+  t1 = Clock::now();
+  report(Rank, "TypedDset", "append", ns_per_call(t0, t1, num_calls));
+
+  std::vector<T> typed_read_back(event_len);
+  t0 = Clock::now();
+  for (size_t call = 0; call < num_calls; ++call) typed.read(call, 1, &typed_read_back.at(0), typed_read_back.size());
+  t1 = Clock::now();
+  report(Rank, "TypedDset", "read", ns_per_call(t0, t1, num_calls));
+  typed.close();
+}
+
+
+int main(int argc, char *argv[]) {
+  size_t num_calls = 20000;
+  std::string fname = "bench_dset_overhead.h5";
+  if (argc > 1) num_calls = size_t(atol(argv[1]));
+  if (argc > 2) fname = argv[2];
+
+  hid_t fid = create_file(fname.c_str());
+  bench<int64_t, 1>(fid, std::vector<hsize_t>{4096}, num_calls);
+  bench<int16_t, 4>(fid, std::vector<hsize_t>{64, 4, 8, 8}, num_calls);
+  NONNEG(H5Fclose(fid));
+  return 0;
+}
@@ -0,0 +1,481 @@
+// Stream major against event major layouts for the small and vlen streams.
+// Writes the same events three ways, like the writers do, one event at a
+// time as SWMR appends with a flush every FLUSH_INTERVAL events:
+//
+//   groups - daq_writer: a group per stream, small fiducials/milli/nano/data
+//            and vlen fiducials/milli/nano/blob/blobstart/blobcount
+//   wide   - daq_writer small layout wide: [events, num_small] small
+//            datasets, vlen as for groups
+//   event  - event_writer: an EventTable, one compound row per event and
+//            one blob heap for all the vlen streams
+//
+// then reports for each:
+//
+//   write   - events/s and MB/s of stream values appended
+//   read    - events/s reading every stream, event_block events at a time,
+//             as ana_reader_master does
+//   column  - events/s reading one small and one vlen stream for all events,
+//             as an analysis of a single stream does
+//
+// with the file size. Reads are from the page cache, use --dir on a disk
+// after dropping caches to include the device. Prints one CSV line, or JSON
+// object, per (layout, measurement).
+//
+// usage: bench_event_layout [--json] [--events N] [--small N] [--vlen N]
+//          [--chunk N] [--block N] [--dir D]
+#include <algorithm>
+#include <iostream>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+
+#include "check_macros.h"
+#include "Dset.h"
+#include "EventTable.h"
+
+typedef std::chrono::steady_clock Clock;
+
+// as config.yaml, flush_interval and the vlen per shot range
+const int64_t FLUSH_INTERVAL = 71;
+const int64_t VLEN_MIN_PER_SHOT = 5, VLEN_MAX_PER_SHOT = 15;
+
+
+struct Options {
+  int64_t events;
+  size_t num_small, num_vlen;
+  hsize_t chunk, block;
+  std::string dir;
+};
+
+
+struct Result {
+  std::string layout, measure;
+  double seconds, events_per_second, mbps, file_mb;
+};
+
+
+double seconds_since(Clock::time_point t0) {
+  return std::chrono::duration<double>(Clock::now() - t0).count();
+}
+
+
+// what daq_writer writes: small stream k has event * 1000 + k, every vlen
+// stream has the same count in an event, cycling like daq_writer
+struct Workload {
+  std::vector<int64_t> vlen_counts;
+  int64_t total_vlen;
+
+  explicit Workload(int64_t events) : total_vlen(0) {
+    int64_t next = 0;
+    for (int64_t event = 0; event < events; ++event) {
+      next = std::max(VLEN_MIN_PER_SHOT, (next + 1) % VLEN_MAX_PER_SHOT);
+      vlen_counts.push_back(next);
+      total_vlen += next;
+    }
+  }
+
+  static int64_t value(int64_t event, size_t stream) { return event * 1000 + int64_t(stream); }
+};
+
+
+hid_t create_file(const std::string &fname) {
+  hid_t fapl = NONNEG(H5Pcreate(H5P_FILE_ACCESS));
+  NONNEG(H5Pset_libver_bounds(fapl, H5F_LIBVER_LATEST, H5F_LIBVER_LATEST));
+  hid_t fid = NONNEG(H5Fcreate(fname.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, fapl));
+  NONNEG(H5Pclose(fapl));
+  return fid;
+}
+
+
+hid_t create_group(hid_t parent, const std::string &name) {
+  return NONNEG(H5Gcreate2(parent, name.c_str(), H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT));
+}
+
+
+std::string number(size_t idx) {
+  char strname[32];
+  sprintf(strname, "%5.5d", int(idx));
+  return strname;
+}
+
+
+class Layout {
+public:
+  virtual ~Layout() {}
+  virtual void create(hid_t fid) = 0;
+  virtual void append(int64_t event, int64_t milli, int64_t nano) = 0;
+  virtual void flush() = 0;
+  virtual void open(hid_t fid) = 0;
+  // sum of every stream's values in the events
+  virtual int64_t read_events(hsize_t start, hsize_t count) = 0;
+  // sum of small stream 0 and vlen stream 0 over all events
+  virtual int64_t read_column() = 0;
+  virtual void close() = 0;
+};
+
+
+// groups and wide, the vlen streams are the same for both
+class StreamLayout : public Layout {
+  const Options &m_options;
+  const Workload &m_workload;
+  bool m_wide;
+  std::vector<Dset> m_small_fiducials, m_small_milli, m_small_nano, m_small_data;
+  std::vector<Dset> m_vlen_fiducials, m_vlen_milli, m_vlen_nano, m_vlen_blob, m_vlen_start, m_vlen_count;
+  std::vector<int64_t> m_row, m_values, m_buffer;
+
+  std::vector<std::vector<Dset> *> all() {
+    return {&m_small_fiducials, &m_small_milli, &m_small_nano, &m_small_data,
+        &m_vlen_fiducials, &m_vlen_milli, &m_vlen_nano, &m_vlen_blob, &m_vlen_start, &m_vlen_count};
+  }
+
+  Dset create_dset(hid_t group, const char *name, hsize_t chunk, hsize_t columns = 0) {
+    std::vector<hsize_t> chunk_dims(1, chunk);
+    if (columns > 0) chunk_dims.push_back(columns);
+    return Dset::create(group, name, H5T_NATIVE_INT64, chunk_dims);
+  }
+
+  void append_one(Dset &dset, int64_t value) {
+    m_values.assign(1, value);
+    dset.append(1, m_values.data(), 1);
+  }
+
+public:
+  StreamLayout(const Options &options, const Workload &workload, bool wide)
+    : m_options(options), m_workload(workload), m_wide(wide) {}
+
+  void create(hid_t fid) {
+    hid_t small = create_group(fid, "small"), vlen = create_group(fid, "vlen");
+    size_t small_groups = m_wide ? 1 : m_options.num_small;
+    hsize_t columns = m_wide ? m_options.num_small : 0;
+    for (size_t idx = 0; idx < small_groups; ++idx) {
+      hid_t group = create_group(small, number(idx));
+      m_small_fiducials.push_back(create_dset(group, "fiducials", m_options.chunk, columns));
+      m_small_milli.push_back(create_dset(group, "milli", m_options.chunk, columns));
+      m_small_nano.push_back(create_dset(group, "nano", m_options.chunk, columns));
+      m_small_data.push_back(create_dset(group, "data", m_options.chunk, columns));
+      NONNEG(H5Gclose(group));
+    }
+    for (size_t idx = 0; idx < m_options.num_vlen; ++idx) {
+      hid_t group = create_group(vlen, number(idx));
+      m_vlen_fiducials.push_back(create_dset(group, "fiducials", m_options.chunk));
+      m_vlen_milli.push_back(create_dset(group, "milli", m_options.chunk));
+      m_vlen_nano.push_back(create_dset(group, "nano", m_options.chunk));
+      m_vlen_blob.push_back(create_dset(group, "blob", m_options.chunk * VLEN_MAX_PER_SHOT));
+      m_vlen_start.push_back(create_dset(group, "blobstart", m_options.chunk));
+      m_vlen_count.push_back(create_dset(group, "blobcount", m_options.chunk));
+      NONNEG(H5Gclose(group));
+    }
+    NONNEG(H5Gclose(vlen));
+    NONNEG(H5Gclose(small));
+  }
+
+  void append(int64_t event, int64_t milli, int64_t nano) {
+    if (m_wide) {
+      const size_t len = m_options.num_small;
+      m_row.assign(len, event);
+      m_small_fiducials.at(0).append(1, m_row.data(), len);
+      m_row.assign(len, milli);
+      m_small_milli.at(0).append(1, m_row.data(), len);
+      m_row.assign(len, nano);
+      m_small_nano.at(0).append(1, m_row.data(), len);
+      for (size_t small = 0; small < len; ++small) m_row.at(small) = Workload::value(event, small);
+      m_small_data.at(0).append(1, m_row.data(), len);
+    } else {
+      for (size_t small = 0; small < m_options.num_small; ++small) {
+        append_one(m_small_fiducials.at(small), event);
+        append_one(m_small_milli.at(small), milli);
+        append_one(m_small_nano.at(small), nano);
+        append_one(m_small_data.at(small), Workload::value(event, small));
+      }
+    }
+    int64_t count = m_workload.vlen_counts.at(event);
+    for (size_t vlen = 0; vlen < m_options.num_vlen; ++vlen) {
+      append_one(m_vlen_fiducials.at(vlen), event);
+      append_one(m_vlen_milli.at(vlen), milli);
+      append_one(m_vlen_nano.at(vlen), nano);
+      append_one(m_vlen_start.at(vlen), int64_t(m_vlen_blob.at(vlen).dim().at(0)));
+      append_one(m_vlen_count.at(vlen), count);
+      m_buffer.assign(count, Workload::value(event, vlen));
+      m_vlen_blob.at(vlen).append(hsize_t(count), m_buffer.data(), m_buffer.size());
+    }
+  }
+
+  void flush() {
+    auto dsets = all();
+    for (auto list : dsets) {
+      for (auto &dset : *list) NONNEG(H5Dflush(dset.id()));
+    }
+  }
+
+  void open(hid_t fid) {
+    size_t small_groups = m_wide ? 1 : m_options.num_small;
+    for (size_t idx = 0; idx < small_groups; ++idx) {
+      std::string path = "small/" + number(idx) + "/data";
+      m_small_data.push_back(Dset::open(fid, path.c_str(), Dset::if_vds_first_missing));
+    }
+    for (size_t idx = 0; idx < m_options.num_vlen; ++idx) {
+      std::string group = "vlen/" + number(idx) + "/";
+      m_vlen_blob.push_back(Dset::open(fid, (group + "blob").c_str(), Dset::if_vds_first_missing));
+      m_vlen_start.push_back(Dset::open(fid, (group + "blobstart").c_str(), Dset::if_vds_first_missing));
+      m_vlen_count.push_back(Dset::open(fid, (group + "blobcount").c_str(), Dset::if_vds_first_missing));
+    }
+  }
+
+  int64_t read_vlen(size_t vlen, hsize_t start, hsize_t count) {
+    std::vector<int64_t> starts(count), counts(count);
+    m_vlen_start.at(vlen).read(start, count, starts.data(), starts.size());
+    m_vlen_count.at(vlen).read(start, count, counts.data(), counts.size());
+    hsize_t first = hsize_t(starts.front()), len = hsize_t(starts.back() + counts.back()) - first;
+    m_buffer.resize(len);
+    m_vlen_blob.at(vlen).read(first, len, m_buffer.data(), m_buffer.size());
+    int64_t sum = 0;
+    for (auto value : m_buffer) sum += value;
+    return sum;
+  }
+
+  int64_t read_events(hsize_t start, hsize_t count) {
+    int64_t sum = 0;
+    for (auto &dset : m_small_data) {
+      m_buffer.resize(count * dset.event_len());
+      dset.read(start, count, m_buffer.data(), m_buffer.size());
+      for (auto value : m_buffer) sum += value;
+    }
+    for (size_t vlen = 0; vlen < m_options.num_vlen; ++vlen) sum += read_vlen(vlen, start, count);
+    return sum;
+  }
+
+  int64_t read_column() {
+    const hsize_t events = m_small_data.at(0).dim().at(0);
+    m_buffer.resize(events);
+    if (m_wide) {
+      // column 0 of [events, num_small]
+      hsize_t start[2] = {0, 0}, count[2] = {events, 1};
+      hid_t file_space = NONNEG(H5Dget_space(m_small_data.at(0).id()));
+      NONNEG(H5Sselect_hyperslab(file_space, H5S_SELECT_SET, start, NULL, count, NULL));
+      hid_t mem_space = NONNEG(H5Screate_simple(1, &events, NULL));
+      NONNEG(H5Dread(m_small_data.at(0).id(), H5T_NATIVE_INT64, mem_space, file_space, H5P_DEFAULT, m_buffer.data()));
+      NONNEG(H5Sclose(mem_space));
+      NONNEG(H5Sclose(file_space));
+    } else {
+      m_small_data.at(0).read(0, events, m_buffer.data(), m_buffer.size());
+    }
+    int64_t sum = 0;
+    for (auto value : m_buffer) sum += value;
+    return sum + read_vlen(0, 0, events);
+  }
+
+  void close() {
+    auto dsets = all();
+    for (auto list : dsets) {
+      for (auto &dset : *list) dset.close();
+      list->clear();
+    }
+  }
+};
+
+
+class EventLayout : public Layout {
+  const Options &m_options;
+  const Workload &m_workload;
+  EventTable m_table;
+  std::vector<int64_t> m_rows, m_blob;
+
+public:
+  EventLayout(const Options &options, const Workload &workload)
+    : m_options(options), m_workload(workload) {}
+
+  void create(hid_t fid) {
+    m_table = EventTable::create(fid, m_options.num_small, m_options.num_vlen, m_options.chunk,
+                                 m_options.chunk * VLEN_MAX_PER_SHOT * std::max(size_t(1), m_options.num_vlen));
+    m_rows.resize(m_table.row_len());
+  }
+
+  void append(int64_t event, int64_t milli, int64_t nano) {
+    m_rows.at(EventTable::FIDUCIAL) = event;
+    m_rows.at(EventTable::MILLI) = milli;
+    m_rows.at(EventTable::NANO) = nano;
+    for (size_t small = 0; small < m_options.num_small; ++small) {
+      m_rows.at(EventTable::SMALL + small) = Workload::value(event, small);
+    }
+    int64_t count = m_workload.vlen_counts.at(event);
+    m_blob.clear();
+    for (size_t vlen = 0; vlen < m_options.num_vlen; ++vlen) {
+      m_rows.at(m_table.vlen_count_column() + vlen) = count;
+      m_blob.insert(m_blob.end(), count, Workload::value(event, vlen));
+    }
+    m_table.append(1, m_rows.data(), m_blob.data(), m_blob.size());
+  }
+
+  void flush() { m_table.flush(); }
+
+  void open(hid_t fid) { m_table = EventTable::open(fid); }
+
+  int64_t read_events(hsize_t start, hsize_t count) {
+    const size_t len = m_table.row_len();
+    m_rows.resize(count * len);
+    m_table.read(start, count, m_rows.data());
+    int64_t sum = 0;
+    for (hsize_t row = 0; row < count; ++row) {
+      const int64_t *values = &m_rows.at(row * len);
+      for (size_t small = 0; small < m_table.num_small(); ++small) sum += values[EventTable::SMALL + small];
+    }
+    if (m_table.num_vlen() > 0) {
+      const int64_t *last = &m_rows.at((count - 1) * len);
+      hsize_t first = hsize_t(m_rows.at(m_table.vlen_start_column()));
+      hsize_t end = hsize_t(last[m_table.vlen_start_column() + m_table.num_vlen() - 1] +
+                            last[m_table.vlen_count_column() + m_table.num_vlen() - 1]);
+      m_blob.resize(end - first);
+      m_table.read_blob(first, end - first, m_blob.data());
+      for (auto value : m_blob) sum += value;
+    }
+    return sum;
+  }
+
+  // every row, a block at a time, and all the blob - a stream's values are
+  // spread through both
+  int64_t read_column() {
+    const size_t len = m_table.row_len();
+    const hsize_t events = m_table.num_rows();
+    m_blob.resize(m_table.blob_len());
+    m_table.read_blob(0, m_table.blob_len(), m_blob.data());
+    int64_t sum = 0;
+    for (hsize_t start = 0; start < events; start += m_options.block) {
+      hsize_t count = std::min(m_options.block, events - start);
+      m_rows.resize(count * len);
+      m_table.read(start, count, m_rows.data());
+      for (hsize_t row = 0; row < count; ++row) {
+        const int64_t *values = &m_rows.at(row * len);
+        sum += values[EventTable::SMALL];
+        int64_t first = values[m_table.vlen_start_column()];
+        for (int64_t idx = first; idx < first + values[m_table.vlen_count_column()]; ++idx) sum += m_blob.at(idx);
+      }
+    }
+    return sum;
+  }
+
+  void close() { m_table.close(); }
+};
+
+
+std::unique_ptr<Layout> make_layout(const std::string &name, const Options &options, const Workload &workload) {
+  if (name == "event") return std::unique_ptr<Layout>(new EventLayout(options, workload));
+  return std::unique_ptr<Layout>(new StreamLayout(options, workload, name == "wide"));
+}
+
+
+void bench_layout(const std::string &name, const Options &options, const Workload &workload,
+                  int64_t &read_sum, int64_t &column_sum, std::vector<Result> &results) {
+  const std::string fname = options.dir + "/bench_event_layout_" + name + ".h5";
+  const double events = double(options.events);
+  const double mb = double(options.events * int64_t(3 + options.num_small) +
+                           workload.total_vlen * int64_t(options.num_vlen)) * sizeof(int64_t) / 1e6;
+
+  std::unique_ptr<Layout> layout = make_layout(name, options, workload);
+  auto t0 = Clock::now();
+  hid_t fid = create_file(fname);
+  layout->create(fid);
+  NONNEG(H5Fstart_swmr_write(fid));
+  for (int64_t event = 0; event < options.events; ++event) {
+    auto now = std::chrono::system_clock::now().time_since_epoch();
+    layout->append(event, std::chrono::duration_cast<std::chrono::milliseconds>(now).count(),
+                   std::chrono::duration_cast<std::chrono::nanoseconds>(now).count());
+    if ((event > 0) and (0 == event % FLUSH_INTERVAL)) layout->flush();
+  }
+  layout->close();
+  NONNEG(H5Fclose(fid));
+  double write_seconds = seconds_since(t0);
+  struct stat st;
+  double file_mb = (stat(fname.c_str(), &st) == 0) ? double(st.st_size) / 1e6 : 0;
+  results.push_back(Result{name, "write", write_seconds, events / write_seconds, mb / write_seconds, file_mb});
+
+  layout = make_layout(name, options, workload);
+  t0 = Clock::now();
+  fid = NONNEG(H5Fopen(fname.c_str(), H5F_ACC_RDONLY | H5F_ACC_SWMR_READ, H5P_DEFAULT));
+  layout->open(fid);
+  int64_t sum = 0;
+  for (hsize_t start = 0; start < hsize_t(options.events); start += options.block) {
+    sum += layout->read_events(start, std::min(options.block, hsize_t(options.events) - start));
+  }
+  double read_seconds = seconds_since(t0);
+  results.push_back(Result{name, "read", read_seconds, events / read_seconds, mb / read_seconds, file_mb});
+
+  t0 = Clock::now();
+  int64_t column = layout->read_column();
+  double column_seconds = seconds_since(t0);
+  results.push_back(Result{name, "column", column_seconds, events / column_seconds, 0, file_mb});
+  layout->close();
+  NONNEG(H5Fclose(fid));
+  remove(fname.c_str());
+
+  // every layout must read the same values
+  if (read_sum < 0) {
+    read_sum = sum;
+    column_sum = column;
+  } else if ((sum != read_sum) or (column != column_sum)) {
+    throw std::runtime_error("bench_event_layout - " + name + " read different values");
+  }
+}
+
+
+void report(const std::vector<Result> &results, const Options &options, bool json) {
+  if (json) {
+    std::cout << "[";
+    for (size_t idx = 0; idx < results.size(); ++idx) {
+      const Result &result = results.at(idx);
+      std::cout << (idx == 0 ? "\n" : ",\n")
+                << "  {\"layout\": \"" << result.layout << "\", \"measure\": \"" << result.measure
+                << "\", \"events\": " << options.events << ", \"small\": " << options.num_small
+                << ", \"vlen\": " << options.num_vlen << ", \"seconds\": " << result.seconds
+                << ", \"events_per_second\": " << result.events_per_second << ", \"mbps\": " << result.mbps
+                << ", \"file_mb\": " << result.file_mb << "}";
+    }
+    std::cout << "\n]" << std::endl;
+    return;
+  }
+  std::cout << "layout,measure,events,small,vlen,seconds,events_per_second,mbps,file_mb" << std::endl;
+  for (auto iter = results.begin(); iter != results.end(); ++iter) {
+    std::cout << iter->layout << "," << iter->measure << "," << options.events << ","
+              << options.num_small << "," << options.num_vlen << "," << iter->seconds << ","
+              << iter->events_per_second << "," << iter->mbps << "," << iter->file_mb << std::endl;
+  }
+}
+
+
+int main(int argc, char *argv[]) {
+  bool json = false;
+  Options options = {300, 32, 4, 100, 100, "."};
+  for (int arg = 1; arg < argc; ++arg) {
+    if (strcmp(argv[arg], "--json") == 0) {
+      json = true;
+    } else if ((strcmp(argv[arg], "--events") == 0) and (arg + 1 < argc)) {
+      options.events = std::max(int64_t(1), int64_t(atol(argv[++arg])));
+    } else if ((strcmp(argv[arg], "--small") == 0) and (arg + 1 < argc)) {
+      options.num_small = std::max(size_t(1), size_t(atol(argv[++arg])));
+    } else if ((strcmp(argv[arg], "--vlen") == 0) and (arg + 1 < argc)) {
+      options.num_vlen = std::max(size_t(1), size_t(atol(argv[++arg])));
+    } else if ((strcmp(argv[arg], "--chunk") == 0) and (arg + 1 < argc)) {
+      options.chunk = std::max(hsize_t(1), hsize_t(atol(argv[++arg])));
+    } else if ((strcmp(argv[arg], "--block") == 0) and (arg + 1 < argc)) {
+      options.block = std::max(hsize_t(1), hsize_t(atol(argv[++arg])));
+    } else if ((strcmp(argv[arg], "--dir") == 0) and (arg + 1 < argc)) {
+      options.dir = argv[++arg];
+    } else {
+      std::cerr << "usage: bench_event_layout [--json] [--events N] [--small N] [--vlen N]"
+                << " [--chunk N] [--block N] [--dir D]" << std::endl;
+      return 1;
+    }
+  }
+
+  Workload workload(options.events);
+  std::vector<Result> results;
+  int64_t read_sum = -1, column_sum = -1;
+  const char *layouts[] = {"groups", "wide", "event"};
+  for (auto name : layouts) bench_layout(name, options, workload, read_sum, column_sum, results);
+  report(results, options, json);
+  return 0;
+}
@@ -0,0 +1,187 @@
+// Repeated scans of small data, the way an offline analysis goes over a
+// finalized run again and again. Writes one int64 [events, width] dataset
+// chunked as the writers do, and the same values contiguous as daq_repack
+// does, then times scans through every event, block events at a time:
+//
+//   chunked - Dset::read of the chunked dataset, chunk index and cache
+//   hdf5    - Dset::read of the contiguous dataset through hdf5
+//   mmap    - Dset::read with Dset::read_mmap, a memcpy from the mapping
+//   pointer - Dset::mapped_int64, summing in place with no copy
+//
+// The first scan of each pays the page faults, the rest are reported as
+// the best of --scans. Reads are from the page cache. Prints one CSV line,
+// or JSON object, per read mode.
+//
+// usage: bench_mapped_read [--json] [--events N] [--width N] [--chunk N]
+//          [--block N] [--scans N] [--dir D]
+#include <algorithm>
+#include <iostream>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "check_macros.h"
+#include "Dset.h"
+
+typedef std::chrono::steady_clock Clock;
+
+
+struct Options {
+  hsize_t events, width, chunk, block;
+  int scans;
+  std::string dir;
+};
+
+
+struct Result {
+  std::string mode;
+  double first_seconds, seconds, mbps;
+};
+
+
+double seconds_since(Clock::time_point t0) {
+  return std::chrono::duration<double>(Clock::now() - t0).count();
+}
+
+
+void write_files(const Options &options, const std::string &chunked_fname, const std::string &contiguous_fname) {
+  std::vector<int64_t> values(size_t(options.events * options.width));
+  for (size_t idx = 0; idx < values.size(); ++idx) values[idx] = int64_t(idx % 1000003);
+
+  hid_t fapl = NONNEG(H5Pcreate(H5P_FILE_ACCESS));
+  NONNEG(H5Pset_libver_bounds(fapl, H5F_LIBVER_LATEST, H5F_LIBVER_LATEST));
+  hid_t fid = NONNEG(H5Fcreate(chunked_fname.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, fapl));
+  Dset dset = Dset::create(fid, "data", H5T_NATIVE_INT64, {options.chunk, options.width});
+  dset.append(options.events, values.data(), values.size());
+  dset.close();
+  NONNEG(H5Fclose(fid));
+
+  // as daq_repack writes it
+  NONNEG(H5Pset_alignment(fapl, 0, 64));
+  fid = NONNEG(H5Fcreate(contiguous_fname.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, fapl));
+  NONNEG(H5Pclose(fapl));
+  hsize_t dims[2] = {options.events, options.width};
+  hid_t space = NONNEG(H5Screate_simple(2, dims, NULL));
+  hid_t id = NONNEG(H5Dcreate2(fid, "data", H5T_NATIVE_INT64, space, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT));
+  NONNEG(H5Dwrite(id, H5T_NATIVE_INT64, H5S_ALL, H5S_ALL, H5P_DEFAULT, values.data()));
+  NONNEG(H5Dclose(id));
+  NONNEG(H5Sclose(space));
+  NONNEG(H5Fclose(fid));
+}
+
+
+// one pass over every event, the sum of the values
+int64_t scan(Dset &dset, const Options &options, bool pointer, std::vector<int64_t> &buffer) {
+  int64_t sum = 0;
+  for (hsize_t start = 0; start < options.events; start += options.block) {
+    hsize_t count = std::min(options.block, options.events - start);
+    const size_t len = size_t(count * options.width);
+    const int64_t *values = NULL;
+    if (pointer) {
+      values = dset.mapped_int64(start, count);
+    } else {
+      dset.read(start, count, buffer.data(), buffer.size());
+      values = buffer.data();
+    }
+    for (size_t idx = 0; idx < len; ++idx) sum += values[idx];
+  }
+  return sum;
+}
+
+
+void bench_mode(const std::string &mode, const std::string &fname, const Options &options,
+                int64_t &expected_sum, std::vector<Result> &results) {
+  const bool pointer = (mode == "pointer");
+  const Dset::ReadMode read_mode = ((mode == "mmap") or pointer) ? Dset::read_mmap : Dset::read_hdf5;
+  const double mb = double(options.events * options.width * sizeof(int64_t)) / 1e6;
+  std::vector<int64_t> buffer(size_t(options.block * options.width));
+
+  hid_t fid = NONNEG(H5Fopen(fname.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT));
+  Dset dset = Dset::open(fid, "data", Dset::if_vds_first_missing, ChunkCachePolicy(), read_mode);
+  if ((read_mode == Dset::read_mmap) and (not dset.mapped())) throw std::runtime_error("bench_mapped_read - not mapped");
+  Result result = {mode, 0, 0, 0};
+  for (int pass = 0; pass <= options.scans; ++pass) {
+    auto t0 = Clock::now();
+    int64_t sum = scan(dset, options, pointer, buffer);
+    double seconds = seconds_since(t0);
+    if (pass == 0) {
+      result.first_seconds = seconds;
+    } else if ((pass == 1) or (seconds < result.seconds)) {
+      result.seconds = seconds;
+    }
+    if (expected_sum < 0) expected_sum = sum;
+    if (sum != expected_sum) throw std::runtime_error("bench_mapped_read - " + mode + " read different values");
+  }
+  result.mbps = result.seconds > 0 ? mb / result.seconds : 0;
+  results.push_back(result);
+  dset.close();
+  NONNEG(H5Fclose(fid));
+}
+
+
+void report(const std::vector<Result> &results, const Options &options, bool json) {
+  if (json) {
+    std::cout << "[";
+    for (size_t idx = 0; idx < results.size(); ++idx) {
+      const Result &result = results.at(idx);
+      std::cout << (idx == 0 ? "\n" : ",\n")
+                << "  {\"mode\": \"" << result.mode << "\", \"events\": " << options.events
+                << ", \"width\": " << options.width << ", \"chunk\": " << options.chunk
+                << ", \"block\": " << options.block << ", \"first_seconds\": " << result.first_seconds
+                << ", \"seconds\": " << result.seconds << ", \"mbps\": " << result.mbps << "}";
+    }
+    std::cout << "\n]" << std::endl;
+    return;
+  }
+  std::cout << "mode,events,width,chunk,block,first_seconds,seconds,mbps" << std::endl;
+  for (auto iter = results.begin(); iter != results.end(); ++iter) {
+    std::cout << iter->mode << "," << options.events << "," << options.width << "," << options.chunk << ","
+              << options.block << "," << iter->first_seconds << "," << iter->seconds << ","
+              << iter->mbps << std::endl;
+  }
+}
+
+
+int main(int argc, char *argv[]) {
+  bool json = false;
+  Options options = {1000000, 4, 600, 100, 5, "."};
+  for (int arg = 1; arg < argc; ++arg) {
+    if (strcmp(argv[arg], "--json") == 0) {
+      json = true;
+    } else if ((strcmp(argv[arg], "--events") == 0) and (arg + 1 < argc)) {
+      options.events = std::max(hsize_t(1), hsize_t(atol(argv[++arg])));
+    } else if ((strcmp(argv[arg], "--width") == 0) and (arg + 1 < argc)) {
+      options.width = std::max(hsize_t(1), hsize_t(atol(argv[++arg])));
+    } else if ((strcmp(argv[arg], "--chunk") == 0) and (arg + 1 < argc)) {
+      options.chunk = std::max(hsize_t(1), hsize_t(atol(argv[++arg])));
+    } else if ((strcmp(argv[arg], "--block") == 0) and (arg + 1 < argc)) {
+      options.block = std::max(hsize_t(1), hsize_t(atol(argv[++arg])));
+    } else if ((strcmp(argv[arg], "--scans") == 0) and (arg + 1 < argc)) {
+      options.scans = std::max(1, atoi(argv[++arg]));
+    } else if ((strcmp(argv[arg], "--dir") == 0) and (arg + 1 < argc)) {
+      options.dir = argv[++arg];
+    } else {
+      std::cerr << "usage: bench_mapped_read [--json] [--events N] [--width N] [--chunk N]"
+                << " [--block N] [--scans N] [--dir D]" << std::endl;
+      return 1;
+    }
+  }
+
+  const std::string chunked_fname = options.dir + "/bench_mapped_read_chunked.h5";
+  const std::string contiguous_fname = options.dir + "/bench_mapped_read_contiguous.h5";
+  write_files(options, chunked_fname, contiguous_fname);
+  std::vector<Result> results;
+  int64_t expected_sum = -1;
+  bench_mode("chunked", chunked_fname, options, expected_sum, results);
+  bench_mode("hdf5", contiguous_fname, options, expected_sum, results);
+  bench_mode("mmap", contiguous_fname, options, expected_sum, results);
+  bench_mode("pointer", contiguous_fname, options, expected_sum, results);
+  remove(chunked_fname.c_str());
+  remove(contiguous_fname.c_str());
+  report(results, options, json);
+  return 0;
+}
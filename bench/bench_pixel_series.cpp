@@ -0,0 +1,286 @@
+// Frame major against the PixelSeries transposed layout for per pixel scans.
+// Writes the same synthetic int16 frames two ways:
+//
+//   frames - the daq_writer cspad layout: [events, panels, rows, cols]
+//            chunked a whole frame per event
+//   series - PixelSeries: [panels, rows, cols, events] chunked
+//            [1, tile_y, tile_x, chunk_events]
+//
+// then reports for each:
+//
+//   write     - MB/s of frames written, for series including the transpose
+//   pixel     - reading one pixel over all events, MB/s of values returned
+//   tile      - reading a tile_y x tile_x box of pixels over all events
+//
+// and, in memory with no hdf5, the transpose of a block of chunk_events
+// frames tile by tile:
+//
+//   transpose_blocked - PixelSeries::transpose_tile, cache blocked
+//   transpose_naive   - the same pixel by pixel, a frame stride per value
+//
+// with the file sizes. Every read opens the file again, reads are from the
+// page cache, use --dir on a disk after dropping caches to include the
+// device. Prints one CSV line, or JSON object, per (layout, measurement).
+//
+// --filter bitshuffle_lz4 compresses the chunks of both layouts, then a
+// pixel read of the frame major file decompresses every frame.
+//
+// usage: bench_pixel_series [--json] [--events N] [--panels N] [--tile N]
+//          [--chunk_events N] [--filter none|bitshuffle_lz4] [--dir D]
+#include <algorithm>
+#include <iostream>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+
+#include "check_macros.h"
+#include "Dset.h"
+#include "PixelSeries.h"
+
+typedef std::chrono::steady_clock Clock;
+
+// a cspad panel
+const hsize_t ROWS = 185, COLS = 388;
+
+
+struct Options {
+  hsize_t events, panels, tile, chunk_events;
+  DsetFilter filter;
+  std::string dir;
+};
+
+
+struct Result {
+  std::string layout, measure;
+  double seconds, mbps, file_mb;
+};
+
+
+double seconds_since(Clock::time_point t0) {
+  return std::chrono::duration<double>(Clock::now() - t0).count();
+}
+
+
+const char *filter_name(DsetFilter filter) {
+  return (filter == filter_bitshuffle_lz4) ? "bitshuffle_lz4" : "none";
+}
+
+
+double file_mb(const std::string &fname) {
+  struct stat st;
+  return (stat(fname.c_str(), &st) == 0) ? double(st.st_size) / 1e6 : 0;
+}
+
+
+// count frames from event start, pixel idx of event has (event * 31 + idx) % 4093
+void make_frames(hsize_t start, hsize_t count, size_t frame_len, std::vector<int16_t> &frames) {
+  frames.resize(size_t(count) * frame_len);
+  for (size_t event = 0; event < count; ++event) {
+    int16_t *frame = frames.data() + event * frame_len;
+    for (size_t idx = 0; idx < frame_len; ++idx) frame[idx] = int16_t(((start + event) * 31 + idx) % 4093);
+  }
+}
+
+
+hid_t create_file(const std::string &fname) {
+  hid_t fapl = NONNEG(H5Pcreate(H5P_FILE_ACCESS));
+  NONNEG(H5Pset_libver_bounds(fapl, H5F_LIBVER_LATEST, H5F_LIBVER_LATEST));
+  hid_t fid = NONNEG(H5Fcreate(fname.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, fapl));
+  NONNEG(H5Pclose(fapl));
+  return fid;
+}
+
+
+// a box of the frame major dataset over all events, as [ny, nx, events]
+int64_t read_frames_box(const std::string &fname, const Options &options, hsize_t ny, hsize_t nx,
+                        std::vector<int16_t> &values) {
+  hid_t fid = NONNEG(H5Fopen(fname.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT));
+  hid_t dset = NONNEG(H5Dopen2(fid, "data", H5P_DEFAULT));
+  hid_t file_space = NONNEG(H5Dget_space(dset));
+  hsize_t offset[4] = {0, 0, 0, 0}, counts[4] = {options.events, 1, ny, nx};
+  NONNEG(H5Sselect_hyperslab(file_space, H5S_SELECT_SET, offset, NULL, counts, NULL));
+  std::vector<int16_t> frames(size_t(options.events * ny * nx));
+  hid_t mem_space = NONNEG(H5Screate_simple(4, counts, NULL));
+  NONNEG(H5Dread(dset, H5T_NATIVE_INT16, mem_space, file_space, H5P_DEFAULT, frames.data()));
+  NONNEG(H5Sclose(mem_space));
+  NONNEG(H5Sclose(file_space));
+  NONNEG(H5Dclose(dset));
+  NONNEG(H5Fclose(fid));
+  // to the series order, to compare
+  values.resize(frames.size());
+  std::vector<hsize_t> box_dims = {1, ny, nx};
+  PixelSeries::transpose_tile(frames.data(), size_t(options.events), box_dims, 0, 0, 0, ny, nx, values.data());
+  int64_t sum = 0;
+  for (auto value : values) sum += value;
+  return sum;
+}
+
+
+int64_t read_series_box(const std::string &fname, hsize_t ny, hsize_t nx, std::vector<int16_t> &values) {
+  hid_t fid = NONNEG(H5Fopen(fname.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT));
+  PixelSeries series = PixelSeries::open(fid, "data");
+  values.resize(size_t(ny * nx * series.num_events()));
+  series.read_pixels(0, 0, 0, ny, nx, 0, series.num_events(), values.data());
+  series.close();
+  NONNEG(H5Fclose(fid));
+  int64_t sum = 0;
+  for (auto value : values) sum += value;
+  return sum;
+}
+
+
+void bench_transpose(const Options &options, std::vector<Result> &results) {
+  const std::vector<hsize_t> frame_dims = {options.panels, ROWS, COLS};
+  const size_t frame_len = size_t(options.panels * ROWS * COLS);
+  std::vector<int16_t> frames, tile(size_t(options.tile * options.tile * options.chunk_events));
+  make_frames(0, options.chunk_events, frame_len, frames);
+  const double mb = double(frames.size() * sizeof(int16_t)) / 1e6;
+  for (int blocked = 1; blocked >= 0; --blocked) {
+    auto t0 = Clock::now();
+    for (hsize_t panel = 0; panel < options.panels; ++panel) {
+      for (hsize_t y0 = 0; y0 < ROWS; y0 += options.tile) {
+        for (hsize_t x0 = 0; x0 < COLS; x0 += options.tile) {
+          PixelSeries::transpose_tile(frames.data(), size_t(options.chunk_events), frame_dims, panel, y0, x0,
+                                      std::min(options.tile, ROWS - y0), std::min(options.tile, COLS - x0),
+                                      tile.data(), blocked != 0);
+        }
+      }
+    }
+    double seconds = seconds_since(t0);
+    results.push_back(Result{"memory", blocked ? "transpose_blocked" : "transpose_naive", seconds, mb / seconds, 0});
+  }
+}
+
+
+void bench_layouts(const Options &options, std::vector<Result> &results) {
+  const std::vector<hsize_t> frame_dims = {options.panels, ROWS, COLS};
+  const size_t frame_len = size_t(options.panels * ROWS * COLS);
+  const double mb = double(options.events * frame_len * sizeof(int16_t)) / 1e6;
+  const std::string frames_fname = options.dir + "/bench_pixel_series_frames.h5";
+  const std::string series_fname = options.dir + "/bench_pixel_series_series.h5";
+  std::vector<int16_t> frames;
+  // making the frames is not part of the write times
+  double make_seconds = 0;
+
+  auto t0 = Clock::now();
+  hid_t fid = create_file(frames_fname);
+  Dset dset = Dset::create(fid, "data", H5T_NATIVE_INT16, {1, options.panels, ROWS, COLS},
+                           {1, options.panels, ROWS, COLS}, ChunkCachePolicy::for_writer(), options.filter);
+  for (hsize_t start = 0; start < options.events; start += options.chunk_events) {
+    hsize_t count = std::min(options.chunk_events, options.events - start);
+    auto t_make = Clock::now();
+    make_frames(start, count, frame_len, frames);
+    make_seconds += seconds_since(t_make);
+    dset.append(count, frames.data(), frames.size());
+  }
+  dset.close();
+  NONNEG(H5Fclose(fid));
+  double seconds = seconds_since(t0) - make_seconds;
+  const double frames_mb = file_mb(frames_fname);
+  results.push_back(Result{"frames", "write", seconds, mb / seconds, frames_mb});
+
+  make_seconds = 0;
+  t0 = Clock::now();
+  fid = create_file(series_fname);
+  PixelSeries series = PixelSeries::create(fid, "data", frame_dims, options.events, options.tile, options.tile,
+                                           options.chunk_events, options.filter);
+  for (hsize_t start = 0; start < options.events; start += series.chunk_events()) {
+    hsize_t count = std::min(series.chunk_events(), options.events - start);
+    auto t_make = Clock::now();
+    make_frames(start, count, frame_len, frames);
+    make_seconds += seconds_since(t_make);
+    series.write_frames(start, count, frames.data());
+  }
+  series.close();
+  NONNEG(H5Fclose(fid));
+  seconds = seconds_since(t0) - make_seconds;
+  const double series_mb = file_mb(series_fname);
+  results.push_back(Result{"series", "write", seconds, mb / seconds, series_mb});
+
+  // one pixel, then a tile, from each
+  const hsize_t tile = std::min(options.tile, ROWS);
+  const hsize_t sides[2] = {1, tile};
+  const char *measures[2] = {"pixel", "tile"};
+  for (int box = 0; box < 2; ++box) {
+    const hsize_t side = sides[box];
+    const double box_mb = double(options.events * side * side * sizeof(int16_t)) / 1e6;
+    std::vector<int16_t> from_frames, from_series;
+    t0 = Clock::now();
+    int64_t frames_sum = read_frames_box(frames_fname, options, side, side, from_frames);
+    seconds = seconds_since(t0);
+    results.push_back(Result{"frames", measures[box], seconds, box_mb / seconds, frames_mb});
+    t0 = Clock::now();
+    int64_t series_sum = read_series_box(series_fname, side, side, from_series);
+    seconds = seconds_since(t0);
+    results.push_back(Result{"series", measures[box], seconds, box_mb / seconds, series_mb});
+    if ((frames_sum != series_sum) or (from_frames != from_series)) {
+      throw std::runtime_error(std::string("bench_pixel_series - layouts read different values for ") + measures[box]);
+    }
+  }
+  remove(frames_fname.c_str());
+  remove(series_fname.c_str());
+}
+
+
+void report(const std::vector<Result> &results, const Options &options, bool json) {
+  if (json) {
+    std::cout << "[";
+    for (size_t idx = 0; idx < results.size(); ++idx) {
+      const Result &result = results.at(idx);
+      std::cout << (idx == 0 ? "\n" : ",\n")
+                << "  {\"layout\": \"" << result.layout << "\", \"measure\": \"" << result.measure
+                << "\", \"events\": " << options.events << ", \"panels\": " << options.panels
+                << ", \"tile\": " << options.tile << ", \"chunk_events\": " << options.chunk_events
+                << ", \"filter\": \"" << filter_name(options.filter) << "\""
+                << ", \"seconds\": " << result.seconds << ", \"mbps\": " << result.mbps
+                << ", \"file_mb\": " << result.file_mb << "}";
+    }
+    std::cout << "\n]" << std::endl;
+    return;
+  }
+  std::cout << "layout,measure,events,panels,tile,chunk_events,filter,seconds,mbps,file_mb" << std::endl;
+  for (auto iter = results.begin(); iter != results.end(); ++iter) {
+    std::cout << iter->layout << "," << iter->measure << "," << options.events << ","
+              << options.panels << "," << options.tile << "," << options.chunk_events << ","
+              << filter_name(options.filter) << ","
+              << iter->seconds << "," << iter->mbps << "," << iter->file_mb << std::endl;
+  }
+}
+
+
+int main(int argc, char *argv[]) {
+  bool json = false;
+  Options options = {256, 32, 32, 32, filter_none, "."};
+  for (int arg = 1; arg < argc; ++arg) {
+    if (strcmp(argv[arg], "--json") == 0) {
+      json = true;
+    } else if ((strcmp(argv[arg], "--events") == 0) and (arg + 1 < argc)) {
+      options.events = std::max(hsize_t(1), hsize_t(atol(argv[++arg])));
+    } else if ((strcmp(argv[arg], "--panels") == 0) and (arg + 1 < argc)) {
+      options.panels = std::max(hsize_t(1), hsize_t(atol(argv[++arg])));
+    } else if ((strcmp(argv[arg], "--tile") == 0) and (arg + 1 < argc)) {
+      options.tile = std::max(hsize_t(1), hsize_t(atol(argv[++arg])));
+    } else if ((strcmp(argv[arg], "--chunk_events") == 0) and (arg + 1 < argc)) {
+      options.chunk_events = std::max(hsize_t(1), hsize_t(atol(argv[++arg])));
+    } else if ((strcmp(argv[arg], "--filter") == 0) and (arg + 1 < argc)) {
+      options.filter = dset_filter_from_name(argv[++arg]);
+    } else if ((strcmp(argv[arg], "--dir") == 0) and (arg + 1 < argc)) {
+      options.dir = argv[++arg];
+    } else {
+      std::cerr << "usage: bench_pixel_series [--json] [--events N] [--panels N] [--tile N]"
+                << " [--chunk_events N] [--filter none|bitshuffle_lz4] [--dir D]" << std::endl;
+      return 1;
+    }
+  }
+
+  std::vector<Result> results;
+  bench_transpose(options, results);
+  bench_layouts(options, results);
+  report(results, options, json);
+  return 0;
+}
@@ -0,0 +1,142 @@
+// reading a list of events, one H5Dread per event vs one Dset::read_events,
+// from a plain dataset and from a round robin VDS over 3 source files, for
+// every Nth event and a random subset.
+//
+// usage: bench_read_events [num_events] [dir]
+#include <iostream>
+#include <chrono>
+#include <cstdlib>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "check_macros.h"
+#include "Dset.h"
+#include "VDSRoundRobin.h"
+
+typedef std::chrono::steady_clock Clock;
+
+const int NUM_SRC = 3;
+const hsize_t FRAME_DIM1 = 16, FRAME_DIM2 = 64;
+
+
+hid_t create_file(const std::string &fname) {
+  hid_t fapl =  NONNEG(H5Pcreate(H5P_FILE_ACCESS));
+  NONNEG(H5Pset_libver_bounds(fapl, H5F_LIBVER_LATEST, H5F_LIBVER_LATEST));
+  hid_t fid =  NONNEG(H5Fcreate(fname.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, fapl));
+  NONNEG(H5Pclose(fapl));
+  return fid;
+}
+
+
+// small[i] = event, every value of frames[i] = event % 32768
+void write_events(hid_t fid, const std::vector<int64_t> &events) {
+  Dset small = Dset::create(fid, "small", H5T_NATIVE_INT64, std::vector<hsize_t>{100});
+  Dset frames = Dset::create(fid, "frames", H5T_NATIVE_INT16, std::vector<hsize_t>{1, FRAME_DIM1, FRAME_DIM2});
+  std::vector<int16_t> frame(FRAME_DIM1 * FRAME_DIM2);
+  for (size_t idx = 0; idx < events.size(); ++idx) {
+    small.append(1, &events.at(idx), 1);
+    for (size_t pix = 0; pix < frame.size(); ++pix) frame.at(pix) = int16_t(events.at(idx) % 32768);
+    frames.append(1, &frame.at(0), frame.size());
+  }
+  small.close();
+  frames.close();
+}
+
+
+void make_files(const std::string &dir, int64_t num_events) {
+  std::vector<int64_t> all;
+  for (int64_t event = 0; event < num_events; ++event) all.push_back(event);
+  hid_t fid = create_file(dir + "/plain.h5");
+  write_events(fid, all);
+  NONNEG(H5Fclose(fid));
+
+  std::vector<std::string> src_fnames, small_paths, frames_paths;
+  for (int src = 0; src < NUM_SRC; ++src) {
+    std::vector<int64_t> mine;
+    for (int64_t event = src; event < num_events; event += NUM_SRC) mine.push_back(event);
+    std::string fname = dir + "/src" + std::to_string(src) + ".h5";
+    fid = create_file(fname);
+    write_events(fid, mine);
+    NONNEG(H5Fclose(fid));
+    src_fnames.push_back(fname);
+    small_paths.push_back("/small");
+    frames_paths.push_back("/frames");
+  }
+
+  fid = create_file(dir + "/vds.h5");
+  {
+    VDSRoundRobin small_vds(fid, "small", src_fnames, small_paths);
+    NONNEG(H5Dclose(small_vds.get_and_transfer_ownership_of_VDS()));
+    VDSRoundRobin frames_vds(fid, "frames", src_fnames, frames_paths);
+    NONNEG(H5Dclose(frames_vds.get_and_transfer_ownership_of_VDS()));
+  }
+  NONNEG(H5Fclose(fid));
+}
+
+
+template <class T>
+void bench(const char *layout, const char *dset_name, const char *pattern,
+           Dset &dset, const std::vector<hsize_t> &events) {
+  size_t event_len = dset.event_len();
+  std::vector<T> one_at_a_time(events.size() * event_len), together(events.size() * event_len);
+
+  auto t0 = Clock::now();
+  for (size_t idx = 0; idx < events.size(); ++idx) {
+    dset.read(events.at(idx), 1, &one_at_a_time.at(idx * event_len), event_len);
+  }
+  auto t1 = Clock::now();
+  dset.read_events(events, &together.at(0), together.size());
+  auto t2 = Clock::now();
+
+  if (one_at_a_time != together) throw std::runtime_error("read_events does not match per event reads");
+  for (size_t idx = 0; idx < events.size(); ++idx) {
+    if (int64_t(together.at(idx * event_len)) % 32768 != int64_t(events.at(idx) % 32768)) {
+      throw std::runtime_error("read_events read the wrong event");
+    }
+  }
+
+  double per_event_ns = double(std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count()) / events.size();
+  double list_ns = double(std::chrono::duration_cast<std::chrono::nanoseconds>(t2 - t1).count()) / events.size();
+  std::cout << "layout=" << layout << " dset=" << dset_name << " pattern=" << pattern
+            << " num_events=" << events.size()
+            << " per_event_read_ns=" << per_event_ns
+            << " read_events_ns=" << list_ns
+            << " speedup=" << per_event_ns / list_ns << std::endl;
+}
+
+
+int main(int argc, char *argv[]) {
+  int64_t num_events = 3000;
+  std::string dir = ".";
+  if (argc > 1) num_events = atol(argv[1]);
+  if (argc > 2) dir = argv[2];
+
+  make_files(dir, num_events);
+
+  std::vector<hsize_t> every_nth, random_subset;
+  for (int64_t event = 0; event < num_events; event += 10) every_nth.push_back(hsize_t(event));
+  std::mt19937 rng(1);
+  std::uniform_real_distribution<double> uniform(0.0, 1.0);
+  for (int64_t event = 0; event < num_events; ++event) {
+    if (uniform(rng) < 0.1) random_subset.push_back(hsize_t(event));
+  }
+
+  const char *layouts[2] = {"plain", "vds"};
+  for (int which = 0; which < 2; ++which) {
+    // SWMR read like the daq readers, so the VDS sources are opened the same way
+    hid_t fid = NONNEG(H5Fopen((dir + "/" + layouts[which] + ".h5").c_str(), 
+                               H5F_ACC_RDONLY | H5F_ACC_SWMR_READ, H5P_DEFAULT));
+    Dset small = Dset::open(fid, "small", Dset::if_vds_first_missing);
+    Dset frames = Dset::open(fid, "frames", Dset::if_vds_first_missing);
+    bench<int64_t>(layouts[which], "small", "every_10th", small, every_nth);
+    bench<int64_t>(layouts[which], "small", "random_10pct", small, random_subset);
+    bench<int16_t>(layouts[which], "frames", "every_10th", frames, every_nth);
+    bench<int16_t>(layouts[which], "frames", "random_10pct", frames, random_subset);
+    small.close();
+    frames.close();
+    NONNEG(H5Fclose(fid));
+  }
+  return 0;
+}
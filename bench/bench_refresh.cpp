@@ -0,0 +1,203 @@
+// Cost of refreshing datasets opened SWMR read, the way Dset::wait and the
+// daq_master translation loop keep up with the writers. Grown from
+// questions/refresh. Sweeps the number of datasets, the number of writer
+// files behind them, plain datasets (external links to the writer files,
+// like /small in the master) vs round robin VDSs over every writer (like
+// /cspad), and for VDSs the FIRST_MISSING vs LAST_AVAILABLE views.
+//
+// Every dataset is refreshed once per round. Prints one CSV line, or JSON
+// object, per (op, configuration) with the mean and p50/p99/max latency of
+// one refresh, and the time for a whole round. op is H5Drefresh alone, or
+// Dset::refresh which also reads back the new extent. The writer files are
+// finished before reading, so this is the cost with nothing changing.
+//
+// usage: bench_refresh [--json] [--max_datasets N] [--max_writers N] [--dir D]
+#include <iostream>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "check_macros.h"
+#include "Dset.h"
+#include "DsetLayoutCache.h"
+#include "LatencyHistogram.h"
+#include "VDSRoundRobin.h"
+
+typedef std::chrono::steady_clock Clock;
+
+const hsize_t EVENTS_PER_SOURCE = 100;
+const hsize_t CHUNK_EVENTS = 10;
+// refreshes per configuration, at least MIN_ROUNDS rounds
+const size_t TARGET_REFRESHES = 5000;
+const size_t MIN_ROUNDS = 3;
+
+
+struct BenchConfig {
+  std::string layout;
+  std::string view;
+  size_t num_datasets;
+  size_t num_writers;
+};
+
+
+hid_t create_file(const std::string &fname) {
+  hid_t fapl =  NONNEG(H5Pcreate(H5P_FILE_ACCESS));
+  NONNEG(H5Pset_libver_bounds(fapl, H5F_LIBVER_LATEST, H5F_LIBVER_LATEST));
+  hid_t fid =  NONNEG(H5Fcreate(fname.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, fapl));
+  NONNEG(H5Pclose(fapl));
+  return fid;
+}
+
+
+std::string dset_name(size_t idx) {
+  char name[128];
+  sprintf(name, "/d%5.5ld", idx);
+  return name;
+}
+
+
+std::string writer_fname(const std::string &dir, size_t writer) {
+  return dir + "/bench_refresh_w" + std::to_string(writer) + ".h5";
+}
+
+
+// plain: dataset idx lives in writer idx % num_writers
+// vds:   every writer has every dataset, the master maps them round robin
+void make_files(const BenchConfig &config, const std::string &dir, const std::string &master_fname) {
+  std::vector<int64_t> values(EVENTS_PER_SOURCE);
+  for (size_t idx = 0; idx < values.size(); ++idx) values.at(idx) = int64_t(idx);
+  std::vector<std::string> fnames;
+  for (size_t writer = 0; writer < config.num_writers; ++writer) {
+    fnames.push_back(writer_fname(dir, writer));
+    hid_t fid = create_file(fnames.back());
+    for (size_t idx = 0; idx < config.num_datasets; ++idx) {
+      if ((config.layout == "plain") and (idx % config.num_writers != writer)) continue;
+      Dset dset = Dset::create(fid, dset_name(idx).c_str(), H5T_NATIVE_INT64, std::vector<hsize_t>(1, CHUNK_EVENTS));
+      dset.append(values.size(), &values.at(0), values.size());
+      dset.close();
+    }
+    NONNEG(H5Fclose(fid));
+  }
+
+  hid_t fid = create_file(master_fname);
+  for (size_t idx = 0; idx < config.num_datasets; ++idx) {
+    std::string name = dset_name(idx);
+    if (config.layout == "plain") {
+      NONNEG(H5Lcreate_external(fnames.at(idx % config.num_writers).c_str(), name.c_str(),
+                                fid, name.c_str(), H5P_DEFAULT, H5P_DEFAULT));
+    } else {
+      std::vector<std::string> paths(fnames.size(), name);
+      VDSRoundRobin vds(fid, name.substr(1).c_str(), fnames, paths);
+      NONNEG(H5Dclose(vds.get_and_transfer_ownership_of_VDS()));
+    }
+  }
+  NONNEG(H5Fclose(fid));
+}
+
+
+void report(const BenchConfig &config, const char *op, size_t rounds,
+            const LatencyHistogram &hist, double ns_per_round, bool json, bool first) {
+  if (json) {
+    std::cout << (first ? "[\n" : ",\n")
+              << "  {\"op\": \"" << op << "\", \"layout\": \"" << config.layout
+              << "\", \"view\": \"" << config.view << "\", \"num_datasets\": " << config.num_datasets
+              << ", \"num_writers\": " << config.num_writers << ", \"rounds\": " << rounds
+              << ", \"refreshes\": " << hist.count() << ", \"ns_per_refresh\": " << hist.mean()
+              << ", \"p50_ns\": " << hist.percentile(50) << ", \"p99_ns\": " << hist.percentile(99)
+              << ", \"max_ns\": " << hist.max() << ", \"ns_per_round\": " << ns_per_round << "}";
+    return;
+  }
+  if (first) {
+    std::cout << "op,layout,view,num_datasets,num_writers,rounds,refreshes,ns_per_refresh,p50_ns,p99_ns,max_ns,ns_per_round" << std::endl;
+  }
+  std::cout << op << "," << config.layout << "," << config.view << ","
+            << config.num_datasets << "," << config.num_writers << "," << rounds << ","
+            << hist.count() << "," << hist.mean() << "," << hist.percentile(50) << ","
+            << hist.percentile(99) << "," << hist.max() << "," << ns_per_round << std::endl;
+}
+
+
+void bench(const BenchConfig &config, const std::string &dir, bool json, bool &first) {
+  std::string master_fname = dir + "/bench_refresh_master.h5";
+  make_files(config, dir, master_fname);
+
+  hid_t fid = NONNEG(H5Fopen(master_fname.c_str(), H5F_ACC_RDONLY | H5F_ACC_SWMR_READ, H5P_DEFAULT));
+  Dset::VDS_access access = (config.view == "last_available") ? Dset::if_vds_last_available : Dset::if_vds_first_missing;
+  std::vector<Dset> dsets;
+  for (size_t idx = 0; idx < config.num_datasets; ++idx) {
+    dsets.push_back(Dset::open(fid, dset_name(idx).c_str(), access));
+  }
+  size_t rounds = std::max(MIN_ROUNDS, TARGET_REFRESHES / config.num_datasets);
+
+  for (int which = 0; which < 2; ++which) {
+    const char *op = (which == 0) ? "H5Drefresh" : "Dset::refresh";
+    LatencyHistogram hist;
+    auto t0 = Clock::now();
+    for (size_t round = 0; round < rounds; ++round) {
+      for (auto iter = dsets.begin(); iter != dsets.end(); ++iter) {
+        auto before = Clock::now();
+        if (which == 0) {
+          NONNEG(H5Drefresh(iter->id()));
+        } else {
+          iter->refresh();
+        }
+        hist.record(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - before).count());
+      }
+    }
+    double ns = double(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - t0).count());
+    report(config, op, rounds, hist, ns / double(rounds), json, first);
+    first = false;
+  }
+
+  for (auto iter = dsets.begin(); iter != dsets.end(); ++iter) iter->close();
+  NONNEG(H5Fclose(fid));
+  // the layout cache keeps the VDS source files open, close them before they are rewritten
+  DsetLayoutCache::instance().release_files();
+}
+
+
+int main(int argc, char *argv[]) {
+  bool json = false;
+  size_t max_datasets = 1000, max_writers = 16;
+  std::string dir = ".";
+  for (int arg = 1; arg < argc; ++arg) {
+    if (strcmp(argv[arg], "--json") == 0) {
+      json = true;
+    } else if ((strcmp(argv[arg], "--max_datasets") == 0) and (arg + 1 < argc)) {
+      max_datasets = size_t(atol(argv[++arg]));
+    } else if ((strcmp(argv[arg], "--max_writers") == 0) and (arg + 1 < argc)) {
+      max_writers = size_t(atol(argv[++arg]));
+    } else if ((strcmp(argv[arg], "--dir") == 0) and (arg + 1 < argc)) {
+      dir = argv[++arg];
+    } else {
+      std::cerr << "usage: bench_refresh [--json] [--max_datasets N] [--max_writers N] [--dir D]" << std::endl;
+      return 1;
+    }
+  }
+
+  const size_t datasets[] = {1, 10, 100, 1000};
+  const size_t writers[] = {1, 4, 16};
+  struct { const char *layout, *view; } kinds[] = {
+    {"plain", "none"}, {"vds", "first_missing"}, {"vds", "last_available"}
+  };
+
+  bool first = true;
+  for (auto kind : kinds) {
+    for (auto num_writers : writers) {
+      if (num_writers > max_writers) continue;
+      for (auto num_datasets : datasets) {
+        if (num_datasets > max_datasets) continue;
+        BenchConfig config;
+        config.layout = kind.layout;
+        config.view = kind.view;
+        config.num_datasets = num_datasets;
+        config.num_writers = num_writers;
+        bench(config, dir, json, first);
+      }
+    }
+  }
+  if (json) std::cout << "\n]" << std::endl;
+  return 0;
+}
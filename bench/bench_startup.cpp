@@ -0,0 +1,315 @@
+// Startup cost of the master and the readers against the number of
+// writers. Synthesizes writer files with the daq_writer schema (small and
+// vlen groups per writer, cspad groups in every writer), then times, the
+// way daq_master and ana_reader_master start up:
+//
+//   writer_open   - the master opening every writer file SWMR read
+//   master_create - the master file: groups, a VDSRoundRobin per cspad
+//                   dataset, external links for small and vlen, avail_events,
+//                   H5Fstart_swmr_write
+//   master_open   - a reader opening the master SWMR read
+//   reader_init   - AnaReaderMaster::initialize_dsets, a Dset::open per
+//                   dataset with a cold DsetLayoutCache
+//   first_event   - reading event 0 from every dataset
+//
+// master_create and master_open..first_event are separate processes in a
+// run, the master's writer files are closed before the reader phases.
+// Prints one CSV line, or JSON object, per writer count.
+//
+// usage: bench_startup [--json] [--max_writers N] [--small N] [--vlen N]
+//          [--cspad N] [--dir D]
+#include <iostream>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+#include "check_macros.h"
+#include "Dset.h"
+#include "DaqBase.h"
+#include "DsetLayoutCache.h"
+#include "VDSRoundRobin.h"
+
+// events in each small and vlen dataset, cspad gets one event in writer 0
+const hsize_t EVENTS_PER_DSET = 10;
+const hsize_t SMALL_CHUNK = 10;
+
+
+struct BenchConfig {
+  size_t num_writers;
+  // per writer for small and vlen, in every writer for cspad
+  int small_per_writer, vlen_per_writer, cspad_num;
+};
+
+
+struct Timings {
+  double writer_create, writer_open, master_create, master_open, reader_init, first_event;
+  size_t num_dsets, layout_file_opens;
+};
+
+
+double ms_since(Clock::time_point t0) {
+  return std::chrono::duration<double, std::milli>(Clock::now() - t0).count();
+}
+
+
+hid_t create_file(const std::string &fname) {
+  hid_t fapl =  NONNEG(H5Pcreate(H5P_FILE_ACCESS));
+  NONNEG(H5Pset_libver_bounds(fapl, H5F_LIBVER_LATEST, H5F_LIBVER_LATEST));
+  hid_t fid =  NONNEG(H5Fcreate(fname.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, fapl));
+  NONNEG(H5Pclose(fapl));
+  return fid;
+}
+
+
+std::string group_path(const char *top, int number) {
+  char path[128];
+  sprintf(path, "/%s/%5.5d", top, number);
+  return path;
+}
+
+
+std::string writer_fname(const std::string &dir, size_t writer) {
+  return dir + "/bench_startup_w" + std::to_string(writer) + ".h5";
+}
+
+
+hid_t create_groups(hid_t fid, const char *top, int first, int count) {
+  hid_t top_group = NONNEG(H5Gcreate2(fid, top, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT));
+  for (int number = first; number < first + count; ++number) {
+    hid_t group = NONNEG(H5Gcreate2(fid, group_path(top, number).c_str(), H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT));
+    NONNEG(H5Gclose(group));
+  }
+  return top_group;
+}
+
+
+void make_writer_file(const BenchConfig &config, const std::string &fname, size_t writer) {
+  std::map<std::string, std::vector<std::string> > group2dsets = get_top_group_to_final_dsets();
+  std::vector<int64_t> values(EVENTS_PER_DSET);
+  for (size_t idx = 0; idx < values.size(); ++idx) values.at(idx) = int64_t(idx);
+  std::vector<hsize_t> small_chunk(1, SMALL_CHUNK);
+
+  hid_t fid = create_file(fname);
+  struct { const char *top; int first, count; } tops[] = {
+    {"small", int(writer) * config.small_per_writer, config.small_per_writer},
+    {"vlen", int(writer) * config.vlen_per_writer, config.vlen_per_writer},
+    {"cspad", 0, config.cspad_num}
+  };
+  for (auto top : tops) {
+    NONNEG(H5Gclose(create_groups(fid, top.top, top.first, top.count)));
+    const std::vector<std::string> &names = group2dsets[top.top];
+    for (int number = top.first; number < top.first + top.count; ++number) {
+      hid_t group = NONNEG(H5Gopen2(fid, group_path(top.top, number).c_str(), H5P_DEFAULT));
+      for (auto name = names.begin(); name != names.end(); ++name) {
+        if ((std::string(top.top) == "cspad") and (*name == "data")) {
+          std::vector<hsize_t> chunk = {1, CSPadDim1, CSPadDim2, CSPadDim3};
+          Dset dset = Dset::create(group, "data", H5T_NATIVE_INT16, chunk);
+          if (writer == 0) {
+            std::vector<int16_t> frame(CSPadNumElem, 0);
+            dset.append(1, &frame.at(0), frame.size());
+          }
+          dset.close();
+          continue;
+        }
+        Dset dset = Dset::create(group, name->c_str(), H5T_NATIVE_INT64, small_chunk);
+        hsize_t count = (std::string(top.top) == "cspad") ? (writer == 0 ? 1 : 0) : EVENTS_PER_DSET;
+        if (count > 0) dset.append(count, &values.at(0), values.size());
+        dset.close();
+      }
+      NONNEG(H5Gclose(group));
+    }
+  }
+  NONNEG(H5Fclose(fid));
+}
+
+
+void create_master(const BenchConfig &config, const std::vector<std::string> &fnames, const std::string &master_fname) {
+  std::map<std::string, std::vector<std::string> > group2dsets = get_top_group_to_final_dsets();
+  hid_t fid = create_file(master_fname);
+  int num_writers = int(config.num_writers);
+  NONNEG(H5Gclose(create_groups(fid, "small", 0, config.small_per_writer * num_writers)));
+  NONNEG(H5Gclose(create_groups(fid, "vlen", 0, config.vlen_per_writer * num_writers)));
+  NONNEG(H5Gclose(create_groups(fid, "cspad", 0, config.cspad_num)));
+
+  const std::vector<std::string> &cspad_names = group2dsets["cspad"];
+  for (int number = 0; number < config.cspad_num; ++number) {
+    hid_t group = NONNEG(H5Gopen2(fid, group_path("cspad", number).c_str(), H5P_DEFAULT));
+    for (auto name = cspad_names.begin(); name != cspad_names.end(); ++name) {
+      std::vector<std::string> paths(fnames.size(), group_path("cspad", number) + "/" + *name);
+      VDSRoundRobin vds(group, name->c_str(), fnames, paths);
+      NONNEG(H5Dclose(vds.get_and_transfer_ownership_of_VDS()));
+    }
+    NONNEG(H5Gclose(group));
+  }
+
+  struct { const char *top; int per_writer; } singles[] = {
+    {"small", config.small_per_writer}, {"vlen", config.vlen_per_writer}
+  };
+  for (int writer = 0; writer < num_writers; ++writer) {
+    const char *src_fname = fnames.at(writer).c_str();
+    for (auto single : singles) {
+      const std::vector<std::string> &names = group2dsets[single.top];
+      for (int number = writer * single.per_writer; number < (writer + 1) * single.per_writer; ++number) {
+        for (auto name = names.begin(); name != names.end(); ++name) {
+          std::string path = group_path(single.top, number) + "/" + *name;
+          NONNEG(H5Lcreate_external(src_fname, path.c_str(), fid, path.c_str(), H5P_DEFAULT, H5P_DEFAULT));
+        }
+      }
+    }
+  }
+
+  Dset avail = Dset::create(fid, "avail_events", H5T_NATIVE_INT64, std::vector<hsize_t>(1, SMALL_CHUNK));
+  NONNEG(H5Fstart_swmr_write(fid));
+  avail.close();
+  NONNEG(H5Fclose(fid));
+}
+
+
+void report(const BenchConfig &config, const Timings &timings, bool json, bool first) {
+  if (json) {
+    std::cout << (first ? "[\n" : ",\n")
+              << "  {\"num_writers\": " << config.num_writers
+              << ", \"num_dsets\": " << timings.num_dsets
+              << ", \"writer_create_ms\": " << timings.writer_create
+              << ", \"writer_open_ms\": " << timings.writer_open
+              << ", \"master_create_ms\": " << timings.master_create
+              << ", \"master_open_ms\": " << timings.master_open
+              << ", \"reader_init_ms\": " << timings.reader_init
+              << ", \"first_event_ms\": " << timings.first_event
+              << ", \"layout_file_opens\": " << timings.layout_file_opens << "}";
+    return;
+  }
+  if (first) {
+    std::cout << "num_writers,num_dsets,writer_create_ms,writer_open_ms,master_create_ms,master_open_ms,reader_init_ms,first_event_ms,layout_file_opens" << std::endl;
+  }
+  std::cout << config.num_writers << "," << timings.num_dsets << ","
+            << timings.writer_create << "," << timings.writer_open << ","
+            << timings.master_create << "," << timings.master_open << ","
+            << timings.reader_init << "," << timings.first_event << ","
+            << timings.layout_file_opens << std::endl;
+}
+
+
+void bench(const BenchConfig &config, const std::string &dir, bool json, bool first) {
+  Timings timings;
+  std::vector<std::string> fnames;
+  auto t0 = Clock::now();
+  for (size_t writer = 0; writer < config.num_writers; ++writer) {
+    fnames.push_back(writer_fname(dir, writer));
+    make_writer_file(config, fnames.back(), writer);
+  }
+  timings.writer_create = ms_since(t0);
+  std::string master_fname = dir + "/bench_startup_master.h5";
+
+  // master process
+  t0 = Clock::now();
+  std::vector<hid_t> writer_fids;
+  for (auto fname = fnames.begin(); fname != fnames.end(); ++fname) {
+    writer_fids.push_back(POS(H5Fopen(fname->c_str(), H5F_ACC_RDONLY | H5F_ACC_SWMR_READ, H5P_DEFAULT)));
+  }
+  timings.writer_open = ms_since(t0);
+
+  t0 = Clock::now();
+  create_master(config, fnames, master_fname);
+  timings.master_create = ms_since(t0);
+  for (auto fid = writer_fids.begin(); fid != writer_fids.end(); ++fid) NONNEG(H5Fclose(*fid));
+
+  // reader process
+  DsetLayoutCache &layout_cache = DsetLayoutCache::instance();
+  layout_cache.clear();
+  t0 = Clock::now();
+  hid_t master_fid = POS(H5Fopen(master_fname.c_str(), H5F_ACC_RDONLY | H5F_ACC_SWMR_READ, H5P_DEFAULT));
+  timings.master_open = ms_since(t0);
+
+  std::map<std::string, std::vector<std::string> > group2dsets = get_top_group_to_final_dsets();
+  std::map<std::string, int> num_groups;
+  num_groups["small"] = config.small_per_writer * int(config.num_writers);
+  num_groups["vlen"] = config.vlen_per_writer * int(config.num_writers);
+  num_groups["cspad"] = config.cspad_num;
+
+  t0 = Clock::now();
+  std::vector<Dset> dsets;
+  for (auto iter = group2dsets.begin(); iter != group2dsets.end(); ++iter) {
+    ChunkCachePolicy cache_policy = ChunkCachePolicy::for_reader(1, 100, 1, 2 * SMALL_CHUNK, size_t(1) << 24);
+    for (int number = 0; number < num_groups[iter->first]; ++number) {
+      for (auto name = iter->second.begin(); name != iter->second.end(); ++name) {
+        std::string path = group_path(iter->first.c_str(), number) + "/" + *name;
+        dsets.push_back(Dset::open(master_fid, path.c_str(), Dset::if_vds_first_missing, cache_policy));
+      }
+    }
+  }
+  dsets.push_back(Dset::open(master_fid, "avail_events", Dset::if_vds_first_missing));
+  timings.layout_file_opens = layout_cache.file_opens();
+  layout_cache.release_files();
+  timings.reader_init = ms_since(t0);
+  timings.num_dsets = dsets.size();
+
+  t0 = Clock::now();
+  std::vector<int64_t> int64_data;
+  std::vector<int16_t> int16_data;
+  for (auto dset = dsets.begin(); dset != dsets.end(); ++dset) {
+    if (dset->dim().at(0) == 0) continue;
+    if (dset->type() == H5T_NATIVE_INT16) {
+      int16_data.resize(dset->event_len());
+      dset->read(0, 1, &int16_data.at(0), int16_data.size());
+    } else {
+      int64_data.resize(dset->event_len());
+      dset->read(0, 1, &int64_data.at(0), int64_data.size());
+    }
+  }
+  timings.first_event = ms_since(t0);
+
+  for (auto dset = dsets.begin(); dset != dsets.end(); ++dset) dset->close();
+  NONNEG(H5Fclose(master_fid));
+  layout_cache.clear();
+
+  report(config, timings, json, first);
+
+  unlink(master_fname.c_str());
+  for (auto fname = fnames.begin(); fname != fnames.end(); ++fname) unlink(fname->c_str());
+}
+
+
+int main(int argc, char *argv[]) {
+  bool json = false;
+  size_t max_writers = 1024;
+  BenchConfig config;
+  config.small_per_writer = 3;
+  config.vlen_per_writer = 3;
+  config.cspad_num = 1;
+  std::string dir = ".";
+  for (int arg = 1; arg < argc; ++arg) {
+    if (strcmp(argv[arg], "--json") == 0) {
+      json = true;
+    } else if ((strcmp(argv[arg], "--max_writers") == 0) and (arg + 1 < argc)) {
+      max_writers = size_t(atol(argv[++arg]));
+    } else if ((strcmp(argv[arg], "--small") == 0) and (arg + 1 < argc)) {
+      config.small_per_writer = atoi(argv[++arg]);
+    } else if ((strcmp(argv[arg], "--vlen") == 0) and (arg + 1 < argc)) {
+      config.vlen_per_writer = atoi(argv[++arg]);
+    } else if ((strcmp(argv[arg], "--cspad") == 0) and (arg + 1 < argc)) {
+      config.cspad_num = atoi(argv[++arg]);
+    } else if ((strcmp(argv[arg], "--dir") == 0) and (arg + 1 < argc)) {
+      dir = argv[++arg];
+    } else {
+      std::cerr << "usage: bench_startup [--json] [--max_writers N] [--small N] [--vlen N] [--cspad N] [--dir D]" << std::endl;
+      return 1;
+    }
+  }
+
+  const size_t writers[] = {1, 4, 16, 64, 256, 1024};
+  bool first = true;
+  for (auto num_writers : writers) {
+    if (num_writers > max_writers) continue;
+    config.num_writers = num_writers;
+    bench(config, dir, json, first);
+    first = false;
+  }
+  if (json) std::cout << "\n]" << std::endl;
+  return 0;
+}
@@ -0,0 +1,94 @@
+#ifndef ALIGNED_BUFFER_POOL_HH
+#define ALIGNED_BUFFER_POOL_HH
+
+#include <cstddef>
+#include <map>
+#include <vector>
+
+class AlignedBufferPool;
+
+struct AlignedBufferOptions {
+  // power of 2, at least sizeof(void *)
+  size_t alignment;
+  // back buffers of at least 2MB with huge pages - MAP_HUGETLB if the
+  // system has them reserved, otherwise transparent huge pages via madvise
+  bool huge_pages;
+  // mlock buffers so they are never paged out
+  bool lock;
+
+  AlignedBufferOptions();
+};
+
+
+// A block of aligned memory from an AlignedBufferPool. Move only, goes back
+// to the pool when destroyed. Not zero filled.
+class AlignedBuffer {
+  AlignedBufferPool *m_pool;
+  void *m_data;
+  size_t m_bytes;
+
+  friend class AlignedBufferPool;
+  AlignedBuffer(AlignedBufferPool *pool, void *data, size_t bytes);
+
+  AlignedBuffer(const AlignedBuffer &);
+  AlignedBuffer & operator=(const AlignedBuffer &);
+
+public:
+  AlignedBuffer();
+  AlignedBuffer(AlignedBuffer &&o);
+  AlignedBuffer & operator=(AlignedBuffer &&o);
+  ~AlignedBuffer();
+
+  void release();
+
+  size_t bytes() const { return m_bytes; }
+  void *data() { return m_data; }
+
+  template <class T>
+  T *as() { return static_cast<T *>(m_data); }
+
+  template <class T>
+  size_t len() const { return m_bytes / sizeof(T); }
+};
+
+
+// Hands out aligned buffers and keeps released ones by size, so a process
+// that needs the same scratch buffers over and over allocates them once.
+// Sizes are rounded up to a power of 2. The pool has to outlive the
+// buffers it hands out. Not thread safe.
+class AlignedBufferPool {
+  AlignedBufferOptions m_options;
+  std::map<size_t, std::vector<void *> > m_free;
+  // how each buffer we allocated has to be freed
+  std::map<void *, bool> m_mmapped;
+  size_t m_allocations, m_reuses, m_lock_failures;
+
+  AlignedBufferPool(const AlignedBufferPool &);
+  AlignedBufferPool & operator=(const AlignedBufferPool &);
+
+  void *allocate(size_t bytes);
+  void deallocate(void *data, size_t bytes);
+
+public:
+  explicit AlignedBufferPool(const AlignedBufferOptions &options = AlignedBufferOptions());
+  ~AlignedBufferPool();
+
+  AlignedBuffer acquire(size_t bytes);
+
+  template <class T>
+  AlignedBuffer acquire_for(size_t len) { return acquire(len * sizeof(T)); }
+
+  // AlignedBuffer calls this when it is destroyed or released
+  void give_back(void *data, size_t bytes);
+
+  // free the buffers kept for reuse
+  void trim();
+
+  size_t allocations() const { return m_allocations; }
+  size_t reuses() const { return m_reuses; }
+  size_t lock_failures() const { return m_lock_failures; }
+
+  static size_t round_up(size_t bytes);
+};
+
+#endif // ALIGNED_BUFFER_POOL_HH
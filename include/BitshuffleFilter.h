@@ -0,0 +1,62 @@
+#ifndef BITSHUFFLE_FILTER_HH
+#define BITSHUFFLE_FILTER_HH
+
+#include <cstddef>
+#include <cstdint>
+#include "hdf5.h"
+
+// Private hdf5 filter id, 256 to 511 are set aside for testing and
+// unregistered use. The format is ours, not the bitshuffle plugin's
+// (32008), files with it can only be read through this library.
+const H5Z_filter_t LC2_FILTER_BITSHUFFLE_LZ4 = 305;
+
+// Bitshuffle plus LZ4 block compression, for low dynamic range integer
+// data like detector pixels. Each block of elements is bit transposed, so
+// bit k of every element in the block lands together, then LZ4 compressed.
+// The high bits of pixels near a pedestal are mostly constant, so their
+// bit planes are long runs that LZ4 squeezes out.
+//
+// A compressed buffer is a 16 byte header (big endian uint64 uncompressed
+// bytes, uint32 block bytes, uint32 element size), then each block as a
+// big endian uint32 length and the LZ4 data. A length with the top bit
+// set is a block stored bit transposed but not compressed. Elements past
+// the last multiple of 8, and bytes past the last whole element, are
+// stored as is at the end.
+//
+// The transpose uses SSE2 when compiled for it, with a scalar fallback
+// that gives the same bytes.
+namespace bitshuffle {
+
+  // elements in a block when the filter is not given a block size, about 8kB
+  size_t default_block_elements(size_t elem_size);
+
+  // bit transpose, or undo it, for num_elem elements, a multiple of 8.
+  // scratch holds num_elem * elem_size bytes.
+  void bit_transpose(const void *in, void *out, size_t num_elem, size_t elem_size, void *scratch);
+  void bit_untranspose(const void *in, void *out, size_t num_elem, size_t elem_size, void *scratch);
+  void bit_transpose_scalar(const void *in, void *out, size_t num_elem, size_t elem_size, void *scratch);
+  void bit_untranspose_scalar(const void *in, void *out, size_t num_elem, size_t elem_size, void *scratch);
+
+  // true if bit_transpose uses SIMD
+  bool simd_enabled();
+
+  // LZ4 block format. compress returns the compressed length, 0 if it
+  // does not fit in out_cap. decompress returns the bytes written to out,
+  // throws std::runtime_error for corrupt input.
+  size_t lz4_bound(size_t num_bytes);
+  size_t lz4_compress(const uint8_t *in, size_t num_bytes, uint8_t *out, size_t out_cap);
+  size_t lz4_decompress(const uint8_t *in, size_t in_len, uint8_t *out, size_t out_cap);
+
+  // whole buffers in the format above. block_elements 0 is the default.
+  size_t compress_bound(size_t num_bytes, size_t elem_size, size_t block_elements);
+  size_t compress(const void *in, size_t num_bytes, size_t elem_size, size_t block_elements, void *out);
+  // uncompressed size from the header
+  size_t decompressed_size(const void *in, size_t in_len);
+  size_t decompress(const void *in, size_t in_len, void *out, size_t out_cap);
+
+  // H5Zregister LC2_FILTER_BITSHUFFLE_LZ4, once per process. Writers get it
+  // through DsetPropAccess, readers through Dset::open.
+  void register_filter();
+}
+
+#endif // BITSHUFFLE_FILTER_HH
@@ -0,0 +1,118 @@
+#ifndef BLOCK_PIPELINE_HH
+#define BLOCK_PIPELINE_HH
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <thread>
+
+// Double buffer between one thread that fills blocks, like the one thread
+// making hdf5 calls in ana_reader_master, and the thread that processes
+// them. Block N+1 is filled while block N is processed, slots are used
+// 0,1,0,1,... on both sides.
+//
+// Either side can fail. A reader error is handed to the processing side,
+// which gets it rethrown from wait_for_full. When the processing side
+// fails it calls stop(), the reader gets NULL from its next wait_for_empty
+// and can check stopped() while filling a block, and cancel its waits with
+// it, so joining the reader thread does not wait for blocks nobody will
+// process. consume() is the processing side loop that does this.
+template <class Block>
+class BlockPipeline {
+  enum State {EMPTY, FULL};
+  Block m_blocks[2];
+  State m_state[2];
+  bool m_reader_done;
+  std::exception_ptr m_reader_error;
+  std::atomic<bool> m_stopped;
+  std::mutex m_mutex;
+  std::condition_variable m_cond;
+
+public:
+  BlockPipeline() : m_reader_done(false), m_stopped(false) {
+    m_state[0] = EMPTY;
+    m_state[1] = EMPTY;
+  }
+
+  // reader side, NULL once the processing side has stopped
+  Block * wait_for_empty(int slot) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_cond.wait(lock, [this, slot] { return (m_state[slot] == EMPTY) or m_stopped; });
+    if (m_stopped) return NULL;
+    return &m_blocks[slot];
+  }
+
+  void publish(int slot) {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_state[slot] = FULL;
+    }
+    m_cond.notify_all();
+  }
+
+  // error is empty when the reader ran out of blocks
+  void reader_done(std::exception_ptr error) {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_reader_done = true;
+      m_reader_error = error;
+    }
+    m_cond.notify_all();
+  }
+
+  // processing side, NULL when there are no more blocks, rethrows a
+  // reader error once the blocks published before it are processed
+  Block * wait_for_full(int slot) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_cond.wait(lock, [this, slot] { return (m_state[slot] == FULL) or m_reader_done; });
+    if (m_state[slot] == FULL) return &m_blocks[slot];
+    if (m_reader_error) std::rethrow_exception(m_reader_error);
+    return NULL;
+  }
+
+  void release(int slot) {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_state[slot] = EMPTY;
+    }
+    m_cond.notify_all();
+  }
+
+  // the processing side gives up, the reader should finish quickly
+  void stop() {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_stopped = true;
+    }
+    m_cond.notify_all();
+  }
+
+  bool stopped() const { return m_stopped; }
+
+  // the processing side, process(block) for every block in slot order until
+  // the reader is done, then joins the reader. A joinable thread must not be
+  // destroyed, so when process or the reader fails, the reader is stopped
+  // and joined before the error goes up.
+  template <class Process>
+  void consume(std::thread &reader, Process process) {
+    try {
+      for (int slot = 0; true; slot = 1 - slot) {
+        Block *block = wait_for_full(slot);
+        if (block == NULL) break;
+        process(*block);
+        release(slot);
+      }
+    } catch (...) {
+      stop();
+      reader.join();
+      throw;
+    }
+    reader.join();
+  }
+
+  // only once the reader thread is joined
+  Block * block(int slot) { return &m_blocks[slot]; }
+};
+
+#endif // BLOCK_PIPELINE_HH
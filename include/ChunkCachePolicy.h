@@ -0,0 +1,76 @@
+#ifndef CHUNK_CACHE_POLICY_HH
+#define CHUNK_CACHE_POLICY_HH
+
+#include <vector>
+#include <cstddef>
+#include "hdf5.h"
+
+// what H5Pset_chunk_cache gets
+struct ChunkCacheSize {
+  size_t nslots;
+  size_t nbytes;
+  double w0;
+  // whole chunks that fit in nbytes, 0 means chunks bypass the cache
+  size_t num_chunks;
+};
+
+
+// Sizes a dataset chunk cache from the chunk layout, the number of VDS
+// mappings and the access pattern, instead of a fixed number of chunks.
+// For a VDS, every source dataset gets its own cache from the access plist
+// the VDS was opened with, so the sizing is per source dataset. A round
+// robin VDS over M sources gives each source 1/M of the events. When the
+// chunk does not span a whole event, like a per panel cspad chunk, one
+// event touches chunks_per_event chunks and the cache holds that many
+// times as many.
+struct ChunkCachePolicy {
+  // events (slow dimension) in one read or append call
+  hsize_t events_per_read;
+
+  // events the process works through, in order, before jumping ahead
+  hsize_t block_events;
+
+  // events between the starts of consecutive blocks. A reader with
+  // event_block_size B, out of R readers, has a stride of B*R.
+  hsize_t event_stride;
+
+  // keep at least this many events of each source dataset resident
+  hsize_t min_source_events_cached;
+
+  // upper bound on nbytes for the dataset, 0 means no bound
+  size_t max_bytes;
+
+  double w0;
+
+  ChunkCachePolicy();
+
+  // writers append events_per_append events at a time, at the end
+  static ChunkCachePolicy for_writer(hsize_t events_per_append = 1);
+
+  static ChunkCachePolicy for_reader(hsize_t events_per_read,
+                                     hsize_t event_block_size,
+                                     int num_readers,
+                                     hsize_t min_source_events_cached,
+                                     size_t max_bytes);
+
+  ChunkCacheSize size_for(size_t type_size_bytes,
+                          const std::vector<hsize_t> &chunk,
+                          size_t num_vds_mappings = 1,
+                          size_t chunks_per_event = 1) const;
+
+  // sizes the cache and calls H5Pset_chunk_cache on a dataset access plist
+  ChunkCacheSize apply(hid_t access,
+                       hid_t h5type,
+                       const std::vector<hsize_t> &chunk,
+                       size_t num_vds_mappings = 1,
+                       size_t chunks_per_event = 1) const;
+
+  // chunks tiling one event of a dataset with dims (the first dim is
+  // ignored) chunked by chunk
+  static size_t chunks_per_event(const std::vector<hsize_t> &dims,
+                                 const std::vector<hsize_t> &chunk);
+
+  static size_t next_prime(size_t n);
+};
+
+#endif // CHUNK_CACHE_POLICY_HH
@@ -4,10 +4,12 @@
 #include <cstdio>
 #include <string>
 #include <chrono>
+#include <memory>
 
 #include "yaml-cpp/yaml.h"
 #include "hdf5.h"
 #include "Dset.h"
+#include "AlignedBufferPool.h"
 
 typedef std::chrono::high_resolution_clock Clock;
 
@@ -24,21 +26,23 @@ const int CSPadNumElem = CSPadDim1*CSPadDim2*CSPadDim3;
 
 
 //-----------------------------------------------------
-// returns { 'small':[f,d,n],
-//           'cspad':[f,d,n],
-//           'vlen':[f,b,bc,n]}
+// returns { 'small':[f,d,m,n],
+//           'cspad':[f,d,m,n],
+//           'vlen':[f,b,bc,bs,m,n]}
 std::map<std::string, std::vector<std::string> > get_top_group_to_final_dsets() {
   std::map<std::string, std::vector<std::string> > group2dsets;
   std::vector<std::string> not_vlen, vlen;
   not_vlen.push_back(std::string("fiducials"));
   not_vlen.push_back(std::string("data"));
   not_vlen.push_back(std::string("milli"));
+  not_vlen.push_back(std::string("nano"));
   
   vlen.push_back(std::string("fiducials"));
   vlen.push_back(std::string("blob"));
   vlen.push_back(std::string("blobcount"));
   vlen.push_back(std::string("blobstart"));
   vlen.push_back(std::string("milli"));
+  vlen.push_back(std::string("nano"));
   
   group2dsets[std::string("small")] = not_vlen;
   group2dsets[std::string("cspad")] = not_vlen;
@@ -52,7 +56,7 @@ std::map<std::string, std::vector<std::string> > get_top_group_to_final_dsets()
 class DaqBase {
   
  public:
-  enum Location {HDF5, PID, LOG, FINISHED};
+  enum Location {HDF5, PID, LOG, FINISHED, RESULTS};
   enum DsetAccess {CREATE_DSETS, OPEN_DSETS};
 
  protected:
@@ -119,6 +123,11 @@ class DaqBase {
   void close_number_groups(TSubMap &sub_map);
   void close_standard_groups();
 
+  // true for the small wide table layout: each writer has one group,
+  // numbered by writer, whose datasets are [events, num_per_writer] with a
+  // column per small stream. Otherwise one group per stream.
+  bool small_layout_wide();
+
   bool small_writes(int64_t event);
   bool vlen_writes(int64_t event);
   bool cspad_roundrobin_writes(int64_t event, int *writerOutput=NULL);
@@ -138,10 +147,14 @@ class DaqBase {
 
   hid_t H5Fopen_with_polling(const std::string &fname, unsigned flags, hid_t fapl_id, bool verbose, int max_seconds=120);
 
+  // scratch and data buffers, configured by the buffers section
+  std::unique_ptr<AlignedBufferPool> m_buffer_pool;
+
+  // reads length frames into cspad_buffer, from m_buffer_pool
   void load_cspad(const std::string &h5_filename,
                   const std::string &dataset,
                   int length,
-                  std::vector<int16_t> &cspad_buffer);
+                  AlignedBuffer &cspad_buffer);
  public:
 
   /**
@@ -1,8 +1,15 @@
 #ifndef LC2_DSET_HH
 #define LC2_DSET_HH
 
+#include <functional>
 #include <vector>
+#include <map>
+#include <memory>
+#include <string>
 #include "hdf5.h"
+#include "ChunkCachePolicy.h"
+#include "DsetPropAccess.h"
+#include "WaitStrategy.h"
 
 // utility functions:
 template <class T>
@@ -15,14 +22,112 @@ std::ostream & operator<<(std::ostream &ostr, const std::vector<T> &vec) {
 
 void print_h5space(std::ostream &ostr, const char *header, hid_t space);
 
+// File and memory dataspaces kept across reads/appends of one dataset.
+// The file space is made once and its extent only updated when the
+// extent changes. For a chunked dataset the selection of count events is
+// made once and moved with H5Soffset_simple; for a VDS we reselect in
+// place, the VDS code maps the selection onto the sources without the
+// offset. One memory space is kept per count. Copies of a Dset share one
+// DsetSpaces through a shared_ptr, each checks the extent against its dims.
+class DsetSpaces {
+  int m_rank;
+  bool m_shift_selection;
+  hid_t m_file_space;
+  hsize_t m_file_extent[H5S_MAX_RANK];
+  // count of the selection at offset 0 in m_file_space, 0 for none
+  hsize_t m_selected_count;
+  std::map<hsize_t, hid_t> m_mem_spaces;
+
+  DsetSpaces(const DsetSpaces &);
+  DsetSpaces & operator=(const DsetSpaces &);
+
+  void set_extent(const hsize_t *dims);
+
+public:
+  // keep this many memory spaces before starting over
+  static const size_t MAX_MEM_SPACES = 16;
+
+  DsetSpaces(int rank, bool is_virtual);
+  ~DsetSpaces();
+
+  // file space for extent dims with count events from start selected
+  hid_t file_space(const hsize_t *dims, hsize_t start, hsize_t count);
+  // memory space for count events of the dims after the first
+  hid_t mem_space(const hsize_t *dims, hsize_t count);
+  // file space for extent dims, for the caller to select in
+  hid_t extent_space(const hsize_t *dims);
+
+  void close();
+};
+
+
+// The event I/O that Dset and TypedDset share. Events are along the first
+// dim, an event is everything in the other dims. Arguments are in fixed
+// size arrays on the stack, nothing is allocated per call.
+namespace dset_io {
+  // select count events starting at start
+  void select_events(hid_t space, int rank, const hsize_t *dims, hsize_t start, hsize_t count);
+
+  // extend dims[0] by count and write the new events. Spaces come from
+  // spaces if given, otherwise they are made and closed for the call.
+  void append_events(hid_t dset, hid_t mem_type, int rank, hsize_t *dims, hsize_t count, const void *data,
+                     DsetSpaces *spaces = NULL);
+
+  void read_events(hid_t dset, hid_t mem_type, int rank, const hsize_t *dims, 
+                   hsize_t start, hsize_t count, void *data, DsetSpaces *spaces = NULL);
+
+  // select the listed events, which must be increasing. Evenly spaced
+  // events are one strided hyperslab, otherwise a rank 1 dataset gets a
+  // point selection and higher ranks or together runs of consecutive events.
+  void select_event_list(hid_t space, int rank, const hsize_t *dims, 
+                         const hsize_t *events, size_t num_events);
+
+  // one H5Dread for all the listed events, packed into data in order
+  void read_event_list(hid_t dset, hid_t mem_type, int rank, const hsize_t *dims,
+                       const hsize_t *events, size_t num_events, void *data, DsetSpaces *spaces = NULL);
+
+  // H5Drefresh and read the current extent into dims
+  void refresh_dims(hid_t dset, int rank, hsize_t *dims);
+}
+
+// Read only mmap of the raw data of a contiguous dataset, num_events
+// events of event_bytes each from offset in fname. The page size aligned
+// start of the mapping is before the data when offset is not aligned.
+class DsetMapping {
+  void *m_base;
+  size_t m_map_bytes;
+  const char *m_data;
+  size_t m_event_bytes;
+
+  DsetMapping(const DsetMapping &);
+  DsetMapping & operator=(const DsetMapping &);
+
+public:
+  // throws std::runtime_error if the file does not open or map
+  DsetMapping(const std::string &fname, haddr_t offset, hsize_t num_events, size_t event_bytes);
+  ~DsetMapping();
+
+  const char * events(hsize_t start) const { return m_data + size_t(start) * m_event_bytes; }
+  size_t event_bytes() const { return m_event_bytes; }
+};
+
+
 // main class
 class Dset {
   // wrap pieces used for appending/reading N events to datasets. 
   // Cache some things for these operations
 
-  hid_t m_id;
-  hid_t m_type;
+  hid_t m_id = -1;
+  hid_t m_type = -1;
   std::vector<hsize_t> m_dims;
+  std::shared_ptr<DsetSpaces> m_spaces;
+  // events along the first dim one chunk spans, for a VDS the chunk of
+  // every source, 0 if not known
+  hsize_t m_chunk_events = 0;
+  // set when opened with read_mmap and the dataset could be mapped
+  std::shared_ptr<DsetMapping> m_mapping;
+
+  friend class DsetBatch;
 
 protected:
   void check_append(hid_t type, hsize_t start, hsize_t count, size_t data_len);
@@ -30,6 +135,9 @@ protected:
   void file_space_select(hid_t file_space, hsize_t start, hsize_t count);
   void generic_append(hsize_t count, const void *data);
   void generic_read(hsize_t start, hsize_t count, void *data, bool verbose=false);
+  void generic_read_events(hid_t type, size_t type_bytes, const std::vector<hsize_t> &events, 
+                           void *data, size_t data_len);
+  void map_contiguous();
   std::ostream & dbgInfo(std::ostream &o);
 
 public:
@@ -41,9 +149,19 @@ public:
   // for opening, it might be a VDS. Let user determine access.
   enum VDS_access {if_vds_first_missing, if_vds_last_available};
 
+  // read_mmap maps a contiguous dataset, like a daq_repack output, and
+  // reads copy from the mapping with no hdf5 calls. Datasets that can not
+  // be mapped - chunked, VDS, empty, external storage, data not aligned to
+  // the element size or a file driver other than sec2 - are read through
+  // hdf5 as with read_hdf5.
+  enum ReadMode {read_hdf5, read_mmap};
+
   // accessors
   hid_t id() const { return m_id; }
+  hid_t type() const { return m_type; }
+  const std::shared_ptr<DsetSpaces> & spaces() const { return m_spaces; }
   const std::vector<hsize_t> & dim() const { return m_dims; }
+  bool mapped() const { return bool(m_mapping); }
 
   // close/cleanup
   void close();
@@ -54,13 +172,60 @@ public:
 	void read(hsize_t start, hsize_t count, std::vector<int64_t> &data, bool verbose=false);
 	void read(hsize_t start, hsize_t count, std::vector<int16_t> &data, bool verbose=false);
 
+  // caller owned buffers, no resizing or copying. data_len is the number
+  // of elements data holds, or has room for, at least count * event_len()
+  void append(hsize_t count, const int64_t *data, size_t data_len);
+  void append(hsize_t count, const int16_t *data, size_t data_len);
+  void read(hsize_t start, hsize_t count, int64_t *data, size_t data_len, bool verbose=false);
+  void read(hsize_t start, hsize_t count, int16_t *data, size_t data_len, bool verbose=false);
+
+  // elements in one event, the product of the dims after the first
+  size_t event_len() const;
+
+  // count events from start in place in the mapping, for a mapped Dset.
+  // Valid until the Dset is closed, copies share the mapping.
+  const int64_t * mapped_int64(hsize_t start, hsize_t count);
+  const int16_t * mapped_int16(hsize_t start, hsize_t count);
+
+  // read a list of increasing events, data gets events.size() * event_len() 
+  // elements. Selecting all the events for one H5Dread pays when events share
+  // chunks, hdf5 1.10 spends far more per chunk in a multi chunk selection
+  // than a single chunk read costs. So with less than 2 events per chunk, each
+  // run of consecutive events is read on its own.
+  void read_events(const std::vector<hsize_t> &events, std::vector<int64_t> &data);
+  void read_events(const std::vector<hsize_t> &events, std::vector<int16_t> &data);
+  void read_events(const std::vector<hsize_t> &events, int64_t *data, size_t data_len);
+  void read_events(const std::vector<hsize_t> &events, int16_t *data, size_t data_len);
+
+  // H5Drefresh and re-read the dims
+  void refresh();
+
+  // refresh until the first dim is at least len_to_grow_to, false on timeout,
+  // or once cancelled returns true, which is checked after every pause
   bool wait(hsize_t len_to_grow_to, int microseconds_to_pause, int timeout_seconds, bool verbose);
+  bool wait(hsize_t len_to_grow_to, WaitStrategy &strategy, int timeout_seconds, bool verbose,
+            const std::function<bool()> &cancelled = std::function<bool()>());
 
-  static Dset create(hid_t parent, const char *name, hid_t h5type, const std::vector<hsize_t> &chunk);
-  static Dset open(hid_t parent, const char *name, VDS_access vds_access);
+  static Dset create(hid_t parent, const char *name, hid_t h5type, const std::vector<hsize_t> &chunk,
+                     const ChunkCachePolicy &cache_policy = ChunkCachePolicy::for_writer());
+  // dims gives the event dims (first dim ignored) when the chunk does not
+  // span a whole event, like a per panel chunk. filter compresses the chunks.
+  static Dset create(hid_t parent, const char *name, hid_t h5type, const std::vector<hsize_t> &chunk,
+                     const std::vector<hsize_t> &dims,
+                     const ChunkCachePolicy &cache_policy = ChunkCachePolicy::for_writer(),
+                     DsetFilter filter = filter_none);
+  // layouts are looked up in, or added to, the DsetLayoutCache
+  static Dset open(hid_t parent, const char *name, VDS_access vds_access,
+                   const ChunkCachePolicy &cache_policy = ChunkCachePolicy(),
+                   ReadMode read_mode = read_hdf5);
+
+  // for a VDS, the chunk of the sources with the first dim summed over all mappings
   static std::vector<hsize_t> get_chunk(const std::string & fname, const std::string &dset);
   static std::vector<hsize_t> get_chunk(hid_t parent, const std::string &dset);
-  static std::vector<hsize_t> get_chunk(hid_t parent, hid_t dset);
+  static std::vector<hsize_t> get_chunk(hid_t dset);
+
+  // for a VDS, the chunk of one source, and the number of mappings (1 if not a VDS)
+  static std::vector<hsize_t> get_source_chunk(hid_t dset, size_t &num_vds_mappings);
  
 };
 
@@ -0,0 +1,35 @@
+#ifndef DSET_APPEND_BUFFER_HH
+#define DSET_APPEND_BUFFER_HH
+
+#include <vector>
+#include "Dset.h"
+
+// Collects int64 events for a Dset and appends them a batch at a time,
+// flushing after each append so SWMR readers see the new events. Memory
+// stays at one batch no matter how long the run is.
+class DsetAppendBuffer {
+  Dset m_dset;
+  size_t m_batch_events;
+  size_t m_values_per_event;
+  std::vector<int64_t> m_buffer;
+
+public:
+  DsetAppendBuffer();
+  DsetAppendBuffer(const Dset &dset, size_t batch_events);
+
+  // one event for a 1D dataset
+  void push(int64_t value);
+  // one event, the product of the dims after the first
+  void push(const int64_t *values);
+
+  // append and flush whatever is buffered
+  void flush();
+
+  // flush and close the Dset
+  void close();
+
+  Dset & dset() { return m_dset; }
+  size_t buffered_events() const { return m_buffer.size() / m_values_per_event; }
+};
+
+#endif // DSET_APPEND_BUFFER_HH
@@ -0,0 +1,47 @@
+#ifndef LC2_DSET_BATCH_HH
+#define LC2_DSET_BATCH_HH
+
+#include <unordered_set>
+#include <vector>
+#include "hdf5.h"
+#include "Dset.h"
+
+// Gathers reads from many datasets and does them together. With hdf5 1.14
+// or later that is one H5Dread_multi, before that a loop over H5Dread with
+// each Dset's cached spaces. Each dataset can be in a batch once, its
+// cached file space holds one selection. The Dsets and buffers must stay
+// around until read() returns. Reuse a batch with clear() to keep its
+// capacity.
+class DsetBatch {
+  struct Request {
+    hid_t dset;
+    hid_t mem_type;
+    int rank;
+    const hsize_t *dims;
+    DsetSpaces *spaces;
+    hsize_t start, count;
+    void *data;
+  };
+  std::vector<Request> m_requests;
+  // spaces of the datasets in m_requests, to find a duplicate in add()
+  std::unordered_set<const DsetSpaces *> m_in_batch;
+
+  // for H5Dread_multi
+  std::vector<hid_t> m_dset_ids, m_mem_types, m_mem_spaces, m_file_spaces;
+  std::vector<void *> m_buffers;
+
+  void add(Dset &dset, hid_t type, hsize_t start, hsize_t count, void *data, size_t data_len);
+
+public:
+  void add(Dset &dset, hsize_t start, hsize_t count, int64_t *data, size_t data_len);
+  void add(Dset &dset, hsize_t start, hsize_t count, int16_t *data, size_t data_len);
+
+  void read();
+  void clear() { m_requests.clear(); m_in_batch.clear(); }
+  size_t size() const { return m_requests.size(); }
+
+  // true if read() is one H5Dread_multi
+  static bool uses_read_multi();
+};
+
+#endif // LC2_DSET_BATCH_HH
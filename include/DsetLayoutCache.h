@@ -0,0 +1,94 @@
+#ifndef DSET_LAYOUT_CACHE_HH
+#define DSET_LAYOUT_CACHE_HH
+
+#include <map>
+#include <string>
+#include <vector>
+#include <utility>
+
+#include "hdf5.h"
+
+// what we need to know about a dataset before opening it for real
+struct DsetLayout {
+  H5D_layout_t layout;
+  // H5T_NATIVE_INT64, H5T_NATIVE_INT16, or -1 for anything else
+  hid_t h5type;
+  int rank;
+  // chunk of the dataset, or for a VDS, the chunk of each of its sources
+  std::vector<hsize_t> chunk;
+  // 1 unless a VDS
+  size_t num_vds_mappings;
+  // chunks tiling one event, 1 unless the chunk is smaller than an event
+  size_t chunks_per_event;
+
+  DsetLayout();
+};
+
+
+// Per process cache of dataset layouts keyed by (open file, dataset path).
+// Layouts don't change once a dataset is created, only the extent does,
+// so Dset::create and VDSRoundRobin also store the layout with the dataset,
+// in an attribute. Dset::open reads that to size the chunk cache and opens
+// the dataset once. Datasets without it, made by other code, are probed:
+// opened once to describe, and the layout kept here. VDS sources are
+// described through here with one H5Fopen per source file, rather than
+// one per (VDS, source) pair. A file is identified by the number hdf5
+// gives each file it opens, not its name, so a file recreated under the
+// same name, as the benches do, gets new entries rather than stale ones.
+// Not thread safe, like the rest of our hdf5 calls.
+class DsetLayoutCache {
+public:
+  // (hdf5 file number, absolute dataset path)
+  typedef std::pair<unsigned long, std::string> Key;
+
+  static DsetLayoutCache & instance();
+
+  bool lookup(const Key &key, DsetLayout &layout);
+  void insert(const Key &key, const DsetLayout &layout);
+
+  // key for name relative to parent, parent can be a file or group
+  static Key key_for(hid_t parent, const char *name);
+
+  // hdf5's number for the file obj is in, new each time a file is opened
+  static unsigned long file_number(hid_t obj);
+
+  // write layout to the lc2_layout attribute of dset, before SWMR writing starts
+  static void store(hid_t dset, const DsetLayout &layout);
+
+  // the stored layout of name relative to parent, false if it has none.
+  // attr is left open, it keeps a file behind an external link open for
+  // the caller's H5Dopen, the caller closes it.
+  static bool stored(hid_t parent, const char *name, DsetLayout &layout, hid_t &attr);
+
+  // layout of an open dataset, caching any VDS sources it maps
+  DsetLayout describe(hid_t dset);
+
+  // layout of fname:dset_path, opening fname (once) with flags if not cached
+  const DsetLayout & source_layout(const std::string &fname, const std::string &dset_path,
+                                   unsigned flags = H5F_ACC_RDONLY | H5F_ACC_SWMR_READ);
+
+  // close the source files kept open for describing VDS sources, and drop
+  // the layouts of files that are no longer open
+  void release_files();
+
+  void clear();
+
+  size_t hits() const { return m_hits; }
+  size_t misses() const { return m_misses; }
+  size_t file_opens() const { return m_file_opens; }
+  size_t size() const { return m_layouts.size(); }
+
+private:
+  DsetLayoutCache();
+  DsetLayoutCache(const DsetLayoutCache &);
+  DsetLayoutCache & operator=(const DsetLayoutCache &);
+
+  hid_t source_file(const std::string &fname, unsigned flags);
+  void drop_closed_files();
+
+  std::map<Key, DsetLayout> m_layouts;
+  std::map<std::string, hid_t> m_files;
+  size_t m_hits, m_misses, m_file_opens;
+};
+
+#endif // DSET_LAYOUT_CACHE_HH
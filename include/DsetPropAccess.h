@@ -4,6 +4,13 @@
 #include <vector>
 #include <string>
 #include "hdf5.h"
+#include "ChunkCachePolicy.h"
+
+// compression filter on the chunks of a dataset
+enum DsetFilter {filter_none, filter_bitshuffle_lz4};
+
+// "none" or "bitshuffle_lz4", as written in the config
+DsetFilter dset_filter_from_name(const std::string &name);
 
 struct DsetPropAccess {
   std::string name;
@@ -11,16 +18,20 @@ struct DsetPropAccess {
   hid_t access;
   hid_t proplist;
   std::vector<hsize_t> chunk_dims;
+  DsetFilter filter;
 
   DsetPropAccess() = default;
   DsetPropAccess(const DsetPropAccess &) = default;
   DsetPropAccess & operator=(const DsetPropAccess &) = default;
 
-  DsetPropAccess(std::string _name, hid_t _h5type, const std::vector<hsize_t> & _chunk_dims);
+  DsetPropAccess(std::string _name, hid_t _h5type, const std::vector<hsize_t> & _chunk_dims,
+                 const ChunkCachePolicy &cache_policy = ChunkCachePolicy::for_writer(),
+                 size_t chunks_per_event = 1,
+                 DsetFilter _filter = filter_none);
   void close();
 
 protected:
-  hid_t create_access_for_chunk_cache();
+  hid_t create_access_for_chunk_cache(const ChunkCachePolicy &cache_policy, size_t chunks_per_event);
 
 };
 
@@ -0,0 +1,73 @@
+#ifndef EVENT_TABLE_HH
+#define EVENT_TABLE_HH
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "hdf5.h"
+#include "Dset.h"
+
+// Event major layout, the alternative to a group of datasets per stream.
+// Each event is one row of a compound "events" dataset
+//
+//   fiducial, milli, nano    int64
+//   small                    int64[num_small], a value per small stream
+//   vlen_start, vlen_count   int64[num_vlen], where each vlen stream's
+//                            values for the event are in the blob heap
+//
+// and the values of every vlen stream go in one int64 "blob" dataset.
+// The array members are left out when num_small or num_vlen is 0.
+//
+// In memory a row is row_len() int64 in the order above, so rows can be
+// built and read as plain int64 arrays - the compound is laid out to match.
+class EventTable {
+public:
+  static const size_t FIDUCIAL = 0, MILLI = 1, NANO = 2, SMALL = 3;
+
+  EventTable();
+
+  // rows_per_chunk rows in a chunk of events, blob_chunk values in a blob chunk
+  static EventTable create(hid_t parent, size_t num_small, size_t num_vlen,
+                           hsize_t rows_per_chunk, hsize_t blob_chunk);
+  // num_small and num_vlen come from the compound type
+  static EventTable open(hid_t parent);
+  void close();
+
+  size_t num_small() const { return m_num_small; }
+  size_t num_vlen() const { return m_num_vlen; }
+  size_t row_len() const { return SMALL + m_num_small + 2 * m_num_vlen; }
+  size_t vlen_start_column() const { return SMALL + m_num_small; }
+  size_t vlen_count_column() const { return SMALL + m_num_small + m_num_vlen; }
+
+  hsize_t num_rows() const { return m_rows_dims[0]; }
+  hsize_t blob_len() const { return m_blob_dims[0]; }
+  hid_t rows_id() const { return m_rows; }
+  hid_t blob_id() const { return m_blob; }
+
+  // append count rows of row_len() values, and the blob values they point
+  // at, in row then vlen stream order. The vlen_start columns are filled
+  // in here from the vlen_count columns and the length of the blob heap.
+  void append(hsize_t count, int64_t *rows, const int64_t *blob, size_t blob_len);
+
+  // count rows from start, rows holds count * row_len()
+  void read(hsize_t start, hsize_t count, int64_t *rows);
+  // count blob values from start
+  void read_blob(hsize_t start, hsize_t count, int64_t *blob);
+
+  // H5Drefresh both datasets and re-read their lengths, for SWMR readers
+  void refresh();
+  // H5Dflush both datasets
+  void flush();
+
+  // the compound type for a row, the caller closes it
+  static hid_t row_type(size_t num_small, size_t num_vlen);
+
+private:
+  size_t m_num_small, m_num_vlen;
+  hid_t m_rows, m_blob, m_row_type;
+  hsize_t m_rows_dims[1], m_blob_dims[1];
+  std::shared_ptr<DsetSpaces> m_rows_spaces, m_blob_spaces;
+};
+
+#endif // EVENT_TABLE_HH
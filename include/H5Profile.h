@@ -0,0 +1,66 @@
+#ifndef H5_PROFILE_HH
+#define H5_PROFILE_HH
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+// Latency profile of the hdf5 calls wrapped in NONNEG/POS, one entry per
+// call site. Only filled in when built with -DLC2_H5PROFILE (make
+// H5PROFILE=1), see check_macros.h. Entries are dumped at exit, to the file
+// set with set_output, or stderr if none was set. Updates are not locked,
+// we never make hdf5 calls from two threads at once. Times are self times,
+// a wrapped call made while another runs, like our filter inside H5Dread,
+// is taken out of the outer call's time.
+struct H5ProfileSite {
+  // log2 of the latency in ns, the last bucket takes everything longer
+  static const int NUM_BUCKETS = 40;
+
+  const char *expression;
+  const char *file;
+  int line;
+  uint64_t calls;
+  uint64_t total_ns;
+  uint64_t max_ns;
+  uint64_t histogram[NUM_BUCKETS];
+
+  void record(uint64_t ns);
+};
+
+
+namespace H5Profile {
+  typedef std::chrono::steady_clock Clock;
+
+  // sites are never freed, so they can be recorded into until exit
+  H5ProfileSite *site(const char *expression, const char *file, int line);
+
+  void set_output(const std::string &fname);
+
+  // writes the per function and per call site tables, called at exit
+  void dump();
+
+  // times the rest of the full expression it is created in, less the time
+  // of timers created while it runs. A timer in the arguments of another
+  // call also lasts to the end of the full expression, so wrapped calls
+  // are not nested in each other's arguments.
+  class Timer {
+    H5ProfileSite *m_site;
+    Timer *m_outer;
+    uint64_t m_nested_ns;
+    Clock::time_point m_t0;
+    static thread_local Timer *s_active;
+  public:
+    explicit Timer(H5ProfileSite *site) : m_site(site), m_outer(s_active), m_nested_ns(0), m_t0(Clock::now()) {
+      s_active = this;
+    }
+    ~Timer() {
+      uint64_t ns = uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - m_t0).count());
+      s_active = m_outer;
+      if (m_outer != NULL) m_outer->m_nested_ns += ns;
+      m_site->record(ns - std::min(ns, m_nested_ns));
+    }
+  };
+}
+
+#endif // H5_PROFILE_HH
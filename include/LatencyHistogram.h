@@ -0,0 +1,50 @@
+#ifndef LATENCY_HISTOGRAM_HH
+#define LATENCY_HISTOGRAM_HH
+
+#include <cstdint>
+#include <vector>
+
+// HDR style histogram of latencies in nanoseconds. Values below
+// SUB_BUCKETS are counted exactly, above that each power of 2 is split
+// into SUB_BUCKETS/2 linear buckets, so any recorded value is known to
+// within 1/128 (under 1%) up to MAX_VALUE, which larger values clamp to.
+// Negative values clamp to 0. Fixed size, record() never allocates.
+class LatencyHistogram {
+public:
+  static const int SUB_BUCKET_BITS = 8;
+  static const int64_t SUB_BUCKETS = int64_t(1) << SUB_BUCKET_BITS;
+  static const int64_t HALF_SUB_BUCKETS = SUB_BUCKETS / 2;
+  // about 18 minutes in ns
+  static const int MAX_VALUE_BITS = 40;
+  static const int64_t MAX_VALUE = (int64_t(1) << MAX_VALUE_BITS) - 1;
+  static const int NUM_BUCKETS = int(SUB_BUCKETS + (MAX_VALUE_BITS - SUB_BUCKET_BITS) * HALF_SUB_BUCKETS);
+
+  LatencyHistogram();
+
+  void record(int64_t value);
+  void merge(const LatencyHistogram &other);
+  void clear();
+
+  int64_t count() const { return m_count; }
+  int64_t min() const { return m_count > 0 ? m_min : 0; }
+  int64_t max() const { return m_max; }
+  double mean() const { return m_count > 0 ? double(m_total) / m_count : 0.0; }
+
+  // value at or below which pct (0 to 100) of the recorded values are,
+  // to within the bucket width
+  int64_t percentile(double pct) const;
+
+  const std::vector<int64_t> & counts() const { return m_counts; }
+
+  static int bucket(int64_t value);
+  // smallest value that lands in bucket
+  static int64_t bucket_lower(int bucket);
+  // largest value that lands in bucket
+  static int64_t bucket_upper(int bucket);
+
+private:
+  std::vector<int64_t> m_counts;
+  int64_t m_count, m_total, m_min, m_max;
+};
+
+#endif // LATENCY_HISTOGRAM_HH
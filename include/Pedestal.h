@@ -0,0 +1,54 @@
+#ifndef PEDESTAL_HH
+#define PEDESTAL_HH
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "hdf5.h"
+#include "Dset.h"
+
+// Per pixel pedestal for int16 detector frames. Writers subtract it before
+// appending, which leaves frames of small values around 0 whose high bits
+// compress away, and store it once next to the data. Readers add it back.
+//
+// The arithmetic wraps like int16 hardware does (mod 2^16) rather than
+// saturating, so restore(subtract(raw)) is raw for every value. Uses AVX2
+// or SSE2 when compiled for it, with a scalar fallback giving the same
+// values.
+class Pedestal {
+public:
+  // an empty pedestal, restore and in place subtract leave frames as they are
+  Pedestal();
+
+  // per pixel mean, rounded, of num_frames frames, each of frame_dims pixels
+  static Pedestal from_frames(const int16_t *frames, size_t num_frames, const std::vector<hsize_t> &frame_dims);
+
+  // true if loc has a link name that resolves to an object
+  static bool exists(hid_t loc, const char *name);
+  // the pedestal dataset loc/name, an empty pedestal if there is none
+  static Pedestal load(hid_t loc, const char *name);
+  // a contiguous int16 dataset of frame_dims, must be done before SWMR writing starts
+  void write(hid_t loc, const char *name) const;
+
+  bool empty() const { return m_values.empty(); }
+  size_t frame_len() const { return m_values.size(); }
+  const std::vector<hsize_t> & frame_dims() const { return m_frame_dims; }
+  const std::vector<int16_t> & values() const { return m_values; }
+
+  // out = raw - pedestal for num_frames frames, raw and out may be the same
+  void subtract(const int16_t *raw, int16_t *out, size_t num_frames, bool simd = true) const;
+  // data += pedestal for num_frames frames, undoes subtract exactly
+  void restore(int16_t *data, size_t num_frames, bool simd = true) const;
+
+  // count frames from dset starting at start, with the pedestal added back
+  void read(Dset &dset, hsize_t start, hsize_t count, int16_t *data, size_t data_len) const;
+
+  // true if subtract and restore use SIMD
+  static bool simd_enabled();
+
+private:
+  std::vector<hsize_t> m_frame_dims;
+  std::vector<int16_t> m_values;
+};
+
+#endif // PEDESTAL_HH
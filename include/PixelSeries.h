@@ -0,0 +1,76 @@
+#ifndef PIXEL_SERIES_HH
+#define PIXEL_SERIES_HH
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "hdf5.h"
+#include "DsetPropAccess.h"
+
+// Transposed copy of int16 detector frames for per pixel analysis, like
+// pedestals, noise and per pixel histograms. The frame major writer layout,
+// [events, panels, rows, cols] chunked a frame at a time, puts one pixel in
+// every chunk. Here the dataset is
+//
+//   [panels, rows, cols, events]  chunked [1, tile_y, tile_x, chunk_events]
+//
+// so a pixel's values are contiguous within a chunk, and a pixel or a box
+// of pixels over all events reads only the chunks of its tiles.
+//
+// Frames are written chunk_events at a time. Each block is transposed a
+// tile at a time, cache blocked, and written as whole chunks with
+// H5Dwrite_chunk, compressed here for filter_bitshuffle_lz4. A hyperslab
+// H5Dwrite of a tile goes through hdf5 in runs of chunk_events values,
+// which is most of the time.
+class PixelSeries {
+public:
+  PixelSeries();
+
+  // frame_dims is [panels, rows, cols], num_events is fixed at create
+  static PixelSeries create(hid_t parent, const char *name, const std::vector<hsize_t> &frame_dims,
+                            hsize_t num_events, hsize_t tile_y, hsize_t tile_x, hsize_t chunk_events,
+                            DsetFilter filter = filter_none);
+  // the chunk cache holds the chunks of one tile over all events, up to
+  // max_cache_bytes, so scanning the pixels of a tile reads each chunk once
+  static PixelSeries open(hid_t parent, const char *name, size_t max_cache_bytes = size_t(256) << 20);
+  void close();
+
+  hid_t id() const { return m_id; }
+  const std::vector<hsize_t> & frame_dims() const { return m_frame_dims; }
+  size_t frame_len() const { return size_t(m_frame_dims.at(0) * m_frame_dims.at(1) * m_frame_dims.at(2)); }
+  hsize_t num_events() const { return m_num_events; }
+  hsize_t tile_y() const { return m_tile_y; }
+  hsize_t tile_x() const { return m_tile_x; }
+  hsize_t chunk_events() const { return m_chunk_events; }
+
+  // count frames, [count, panels, rows, cols], for events start onwards.
+  // start is a multiple of chunk_events, and count is chunk_events except
+  // at the end, so every chunk is written once, whole.
+  void write_frames(hsize_t start, hsize_t count, const int16_t *frames);
+
+  // count values of one pixel from event start
+  void read_pixel(hsize_t panel, hsize_t y, hsize_t x, hsize_t start, hsize_t count, int16_t *series);
+  // a box of ny * nx pixels from y, x, as [ny, nx, count]
+  void read_pixels(hsize_t panel, hsize_t y, hsize_t x, hsize_t ny, hsize_t nx,
+                   hsize_t start, hsize_t count, int16_t *series);
+
+  // the ny x nx box at panel, y0, x0 of num_events frames of frame_dims into
+  // tile as [ny, nx, num_events]. blocked goes through blocks of events and
+  // columns that stay in cache, otherwise it is pixel by pixel.
+  static void transpose_tile(const int16_t *frames, size_t num_events, const std::vector<hsize_t> &frame_dims,
+                             hsize_t panel, hsize_t y0, hsize_t x0, hsize_t ny, hsize_t nx,
+                             int16_t *tile, bool blocked = true);
+
+private:
+  hid_t m_id;
+  std::vector<hsize_t> m_frame_dims;
+  hsize_t m_num_events, m_tile_y, m_tile_x, m_chunk_events;
+  DsetFilter m_filter;
+  std::vector<int16_t> m_tile, m_chunk;
+  std::vector<uint8_t> m_compressed;
+
+  void select_box(hid_t space, hsize_t panel, hsize_t y, hsize_t x, hsize_t ny, hsize_t nx,
+                  hsize_t start, hsize_t count) const;
+};
+
+#endif // PIXEL_SERIES_HH
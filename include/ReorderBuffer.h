@@ -0,0 +1,64 @@
+#ifndef REORDER_BUFFER_HH
+#define REORDER_BUFFER_HH
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Bookkeeping for assembling events from parts that arrive out of order,
+// like the streams of several writer files tailed at different speeds. It
+// holds a window of capacity fiducials, [first(), end()), and tracks which
+// parts of each have arrived. Fiducial f lives in slot f % capacity, so the
+// caller keeps the values of an event in its own arrays, indexed by slot,
+// with no allocation as the window moves.
+//
+// Parts for a fiducial at or past end() do not fit, the caller leaves them
+// where they are (in the writer file) until the front is popped. Parts for
+// a fiducial before first() arrive after their event was popped and are
+// dropped. The caller decides when the front event is done - it knows how
+// many parts each event has - and pops it, complete or not, for instance
+// once the parts it is missing have been idle for a while.
+class ReorderBuffer {
+public:
+  typedef std::chrono::steady_clock Clock;
+
+  ReorderBuffer();
+  ReorderBuffer(int64_t first, size_t capacity, size_t num_parts);
+
+  int64_t first() const { return m_first; }
+  int64_t end() const { return m_first + int64_t(m_capacity); }
+  size_t capacity() const { return m_capacity; }
+  size_t num_parts() const { return m_num_parts; }
+
+  bool fits(int64_t fiducial) const { return (fiducial >= m_first) and (fiducial < end()); }
+  // throws if the fiducial is not in the window
+  size_t slot(int64_t fiducial) const;
+
+  // false for a late part, one whose event was popped, which is counted and
+  // dropped. Throws past end() or for a part that already arrived.
+  bool arrive(int64_t fiducial, size_t part);
+  bool arrived(int64_t fiducial, size_t part) const;
+  size_t num_arrived(int64_t fiducial) const;
+
+  // time since anything of the part arrived, or since the buffer was made.
+  // A writer that stalls goes idle, one that is only behind does not.
+  double idle_seconds(size_t part) const;
+
+  // done with the front, the window moves on by one fiducial
+  void pop();
+
+  size_t num_late() const { return m_num_late; }
+
+private:
+  int64_t m_first;
+  size_t m_capacity, m_num_parts;
+  // capacity x num_parts, by slot
+  std::vector<uint8_t> m_arrived;
+  std::vector<size_t> m_num_arrived;
+  // by part
+  std::vector<Clock::time_point> m_last_arrival;
+  size_t m_num_late;
+};
+
+#endif // REORDER_BUFFER_HH
@@ -0,0 +1,122 @@
+#ifndef LC2_TYPED_DSET_HH
+#define LC2_TYPED_DSET_HH
+
+#include <array>
+#include <cstdint>
+#include <stdexcept>
+#include "hdf5.h"
+#include "Dset.h"
+#include "check_macros.h"
+
+// compile time mapping from the element type to the hdf5 memory type,
+// only the types the daq writes have one
+template <class T> struct H5TypeOf;
+
+template <> struct H5TypeOf<int16_t> {
+  static hid_t get() { return H5T_NATIVE_INT16; }
+};
+
+template <> struct H5TypeOf<int64_t> {
+  static hid_t get() { return H5T_NATIVE_INT64; }
+};
+
+
+// A Dset whose element type and rank are known at compile time. Dims live
+// in a std::array and the hyperslab arguments are kept with them, so
+// appending or reading events does no allocation on our side, and there
+// is no type check per call. Shares the hdf5 handle semantics of Dset:
+// copies refer to the same dataset, close() once.
+template <class T, int Rank>
+class TypedDset {
+  static_assert(Rank >= 1, "TypedDset needs at least one dimension");
+
+  hid_t m_id = -1;
+  std::array<hsize_t, Rank> m_dims;
+  std::shared_ptr<DsetSpaces> m_spaces;
+  // values in one event, the product of the dims after the first
+  hsize_t m_event_len = 1;
+
+  void set_event_len() {
+    m_event_len = 1;
+    for (int idx = 1; idx < Rank; ++idx) m_event_len *= m_dims[idx];
+  }
+
+public:
+  typedef std::array<hsize_t, Rank> Dims;
+
+  TypedDset() { m_dims.fill(0); }
+
+  // takes over the handle of an opened or created Dset, checking the type and rank
+  explicit TypedDset(const Dset &dset) {
+    if (dset.dim().size() != size_t(Rank)) {
+      throw std::runtime_error("TypedDset - rank of Dset does not match");
+    }
+    if ((dset.type() != H5TypeOf<T>::get()) and (H5Tequal(dset.type(), H5TypeOf<T>::get()) <= 0)) {
+      throw std::runtime_error("TypedDset - type of Dset does not match");
+    }
+    m_id = dset.id();
+    m_spaces = dset.spaces();
+    for (int idx = 0; idx < Rank; ++idx) m_dims[idx] = dset.dim()[idx];
+    set_event_len();
+  }
+
+  static TypedDset create(hid_t parent, const char *name, const Dims &chunk,
+                          const ChunkCachePolicy &cache_policy = ChunkCachePolicy::for_writer()) {
+    std::vector<hsize_t> chunk_vec(chunk.begin(), chunk.end());
+    return TypedDset(Dset::create(parent, name, H5TypeOf<T>::get(), chunk_vec, cache_policy));
+  }
+
+  static TypedDset open(hid_t parent, const char *name, Dset::VDS_access vds_access,
+                        const ChunkCachePolicy &cache_policy = ChunkCachePolicy()) {
+    return TypedDset(Dset::open(parent, name, vds_access, cache_policy));
+  }
+
+  hid_t id() const { return m_id; }
+  const Dims & dim() const { return m_dims; }
+  hsize_t event_len() const { return m_event_len; }
+
+  void close() {
+    if (m_spaces) {
+      m_spaces->close();
+      m_spaces.reset();
+    }
+    if (m_id >= 0) {
+      NONNEG( H5Dclose(m_id) );
+      m_id = -1;
+    }
+  }
+
+  // data holds data_len values, at least count * event_len()
+  void append(const T *data, size_t data_len, hsize_t count) {
+    if (count * m_event_len > data_len) throw std::runtime_error("TypedDset::append - data too small");
+    dset_io::append_events(m_id, H5TypeOf<T>::get(), Rank, &m_dims[0], count, data, m_spaces.get());
+  }
+
+  // data has room for data_len values, at least count * event_len()
+  void read(hsize_t start, hsize_t count, T *data, size_t data_len) const {
+    if (start + count > m_dims[0]) {
+      throw std::runtime_error("TypedDset::read - start+count to big for dset");
+    }
+    if (count * m_event_len > data_len) throw std::runtime_error("TypedDset::read - buffer too small");
+    dset_io::read_events(m_id, H5TypeOf<T>::get(), Rank, &m_dims[0], start, count, data, m_spaces.get());
+  }
+
+  // events increasing, data has room for data_len values, at least
+  // num_events * event_len()
+  void read_events(const hsize_t *events, size_t num_events, T *data, size_t data_len) const {
+    if (num_events == 0) return;
+    if (num_events * m_event_len > data_len) throw std::runtime_error("TypedDset::read_events - buffer too small");
+    for (size_t idx = 0; idx < num_events; ++idx) {
+      if ((idx > 0) and (events[idx] <= events[idx-1])) throw std::runtime_error("TypedDset::read_events - events not increasing");
+    }
+    if (events[num_events - 1] >= m_dims[0]) throw std::runtime_error("TypedDset::read_events - event past the end of dset");
+    dset_io::read_event_list(m_id, H5TypeOf<T>::get(), Rank, &m_dims[0], 
+                             events, num_events, data, m_spaces.get());
+  }
+
+  void refresh() {
+    dset_io::refresh_dims(m_id, Rank, &m_dims[0]);
+  }
+};
+
+#endif // LC2_TYPED_DSET_HH
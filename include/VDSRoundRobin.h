@@ -33,6 +33,7 @@ class VDSRoundRobin {
   hid_t select_all_of_any_src_countOne_blockUnlimited();
   void select_unlimited_count_of_vds(hid_t space, hsize_t start, hsize_t stride);
   void add_to_virtual_mapping(hid_t vds_src, hid_t src_space, size_t which_src);
+  void store_layout() const;
   void cleanup();
 
  public:
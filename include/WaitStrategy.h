@@ -0,0 +1,100 @@
+#ifndef WAIT_STRATEGY_HH
+#define WAIT_STRATEGY_HH
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+// what Dset::wait did, accumulated over all the waits given the strategy
+struct WaitStats {
+  size_t waits;
+  // satisfied from the dims we already had, no refresh
+  size_t immediate;
+  size_t refreshes;
+  size_t timeouts;
+  // gave up because the caller cancelled the wait
+  size_t cancels;
+  size_t sleeps;
+  size_t notifications;
+  // time from the last refresh that came up short to the one that found
+  // the data, an upper bound on how late we noticed it
+  int64_t wakeup_latency_total_micro;
+  int64_t wakeup_latency_max_micro;
+  size_t wakeups;
+
+  WaitStats();
+  void clear();
+  double mean_wakeup_latency_micro() const;
+};
+
+
+// How Dset::wait passes the time between H5Drefresh calls. begin() is called
+// once per wait that the cached dims can't satisfy, pause() before each refresh.
+class WaitStrategy {
+protected:
+  WaitStats m_stats;
+
+public:
+  virtual ~WaitStrategy() {}
+
+  virtual void begin() = 0;
+  virtual void pause() = 0;
+
+  WaitStats & stats() { return m_stats; }
+  const WaitStats & stats() const { return m_stats; }
+
+  // kind is fixed, backoff or notify. fixed pauses min_micro each time (it
+  // spins when min_micro <= 0), what Dset::wait always did. notify watches
+  // watch_fnames and falls back to backoff when they can't be watched.
+  static std::unique_ptr<WaitStrategy> create(const std::string &kind,
+                                              int spin_iterations,
+                                              int min_micro,
+                                              int max_micro,
+                                              const std::vector<std::string> &watch_fnames);
+};
+
+
+// spin_iterations pauses that do nothing, then sleeps that start at
+// min_micro and double up to max_micro. spin_iterations < 0 spins forever.
+class BackoffWait : public WaitStrategy {
+  int m_spin_iterations;
+  int m_min_micro, m_max_micro;
+  int m_iteration;
+  int m_current_micro;
+
+public:
+  BackoffWait(int spin_iterations, int min_micro, int max_micro);
+  virtual void begin();
+  virtual void pause();
+};
+
+
+// Like BackoffWait, but instead of sleeping, blocks in poll() on an inotify
+// descriptor watching files another process modifies when there is new data,
+// like the master file the daq_master extends avail_events in. The backoff
+// sleep is the poll timeout, so writes inotify can't see (other hosts on a
+// network filesystem) are still picked up.
+class NotifyWait : public WaitStrategy {
+  int m_fd;
+  int m_spin_iterations;
+  int m_min_micro, m_max_micro;
+  int m_iteration;
+  int m_current_micro;
+
+  void drain();
+
+  NotifyWait(const NotifyWait &);
+  NotifyWait & operator=(const NotifyWait &);
+
+public:
+  NotifyWait(const std::vector<std::string> &watch_fnames,
+             int spin_iterations, int min_micro, int max_micro);
+  virtual ~NotifyWait();
+  virtual void begin();
+  virtual void pause();
+
+  bool watching() const { return m_fd >= 0; }
+};
+
+#endif // WAIT_STRATEGY_HH
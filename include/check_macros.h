@@ -27,7 +27,21 @@ T check_pos(T val, const char *expression, int lineno, const char *fname) {
   return val;
 }
 
+#ifdef LC2_H5PROFILE
+
+#include "H5Profile.h"
+
+// each expansion gets its own lambda, so its own static site
+#define LC2_H5PROFILE_SITE(text) ([]() { static H5ProfileSite *site = H5Profile::site(text, __FILE__, __LINE__); return site; }())
+
+#define POS(arg) check_pos((H5Profile::Timer(LC2_H5PROFILE_SITE(#arg)), (arg)), #arg, __LINE__, __FILE__)
+#define NONNEG(arg) check_nonneg((H5Profile::Timer(LC2_H5PROFILE_SITE(#arg)), (arg)), #arg, __LINE__, __FILE__)
+
+#else
+
 #define POS(arg) check_pos(arg, #arg, __LINE__, __FILE__)
 #define NONNEG(arg) check_nonneg(arg, #arg, __LINE__, __FILE__)
 
+#endif // LC2_H5PROFILE
+
 #endif // CHECK_MACROS
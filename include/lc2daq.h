@@ -6,5 +6,20 @@
 #include "DsetPropAccess.h"
 #include "H5OpenObjects.h"
 #include "VDSRoundRobin.h"
+#include "ChunkCachePolicy.h"
+#include "DsetLayoutCache.h"
+#include "DsetAppendBuffer.h"
+#include "WaitStrategy.h"
+#include "TypedDset.h"
+#include "AlignedBufferPool.h"
+#include "DsetBatch.h"
+#include "H5Profile.h"
+#include "LatencyHistogram.h"
+#include "BitshuffleFilter.h"
+#include "Pedestal.h"
+#include "EventTable.h"
+#include "PixelSeries.h"
+#include "ReorderBuffer.h"
+#include "BlockPipeline.h"
 
 #endif // LC2DAQ_HH
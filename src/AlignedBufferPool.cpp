@@ -0,0 +1,178 @@
+#include <cstdlib>
+#include <new>
+#include <stdexcept>
+#include <sys/mman.h>
+
+#include "AlignedBufferPool.h"
+
+namespace {
+
+  const size_t HUGE_PAGE_BYTES = size_t(2) << 20;
+
+}
+
+
+AlignedBufferOptions::AlignedBufferOptions() :
+  alignment(64),
+  huge_pages(false),
+  lock(false)
+{}
+
+
+AlignedBuffer::AlignedBuffer() :
+  m_pool(NULL),
+  m_data(NULL),
+  m_bytes(0)
+{}
+
+
+AlignedBuffer::AlignedBuffer(AlignedBufferPool *pool, void *data, size_t bytes) :
+  m_pool(pool),
+  m_data(data),
+  m_bytes(bytes)
+{}
+
+
+AlignedBuffer::AlignedBuffer(AlignedBuffer &&o) :
+  m_pool(o.m_pool),
+  m_data(o.m_data),
+  m_bytes(o.m_bytes)
+{
+  o.m_pool = NULL;
+  o.m_data = NULL;
+  o.m_bytes = 0;
+}
+
+
+AlignedBuffer & AlignedBuffer::operator=(AlignedBuffer &&o) {
+  if (this != &o) {
+    release();
+    m_pool = o.m_pool;
+    m_data = o.m_data;
+    m_bytes = o.m_bytes;
+    o.m_pool = NULL;
+    o.m_data = NULL;
+    o.m_bytes = 0;
+  }
+  return *this;
+}
+
+
+AlignedBuffer::~AlignedBuffer() {
+  release();
+}
+
+
+void AlignedBuffer::release() {
+  if ((m_pool != NULL) and (m_data != NULL)) {
+    m_pool->give_back(m_data, m_bytes);
+  }
+  m_pool = NULL;
+  m_data = NULL;
+  m_bytes = 0;
+}
+
+
+AlignedBufferPool::AlignedBufferPool(const AlignedBufferOptions &options) :
+  m_options(options),
+  m_allocations(0),
+  m_reuses(0),
+  m_lock_failures(0)
+{
+  if ((m_options.alignment < sizeof(void *)) or
+      ((m_options.alignment & (m_options.alignment - 1)) != 0)) {
+    throw std::runtime_error("AlignedBufferPool - alignment must be a power of 2, at least sizeof(void *)");
+  }
+}
+
+
+AlignedBufferPool::~AlignedBufferPool() {
+  trim();
+}
+
+
+size_t AlignedBufferPool::round_up(size_t bytes) {
+  size_t rounded = 64;
+  while (rounded < bytes) rounded <<= 1;
+  return rounded;
+}
+
+
+AlignedBuffer AlignedBufferPool::acquire(size_t bytes) {
+  size_t rounded = round_up(bytes);
+  std::vector<void *> &free_list = m_free[rounded];
+  void *data = NULL;
+  if (free_list.size() > 0) {
+    data = free_list.back();
+    free_list.pop_back();
+    ++m_reuses;
+  } else {
+    data = allocate(rounded);
+    ++m_allocations;
+  }
+  return AlignedBuffer(this, data, rounded);
+}
+
+
+void AlignedBufferPool::give_back(void *data, size_t bytes) {
+  m_free[bytes].push_back(data);
+}
+
+
+void AlignedBufferPool::trim() {
+  for (auto iter = m_free.begin(); iter != m_free.end(); ++iter) {
+    std::vector<void *> &free_list = iter->second;
+    for (size_t idx = 0; idx < free_list.size(); ++idx) {
+      deallocate(free_list.at(idx), iter->first);
+    }
+    free_list.clear();
+  }
+  m_free.clear();
+}
+
+
+void *AlignedBufferPool::allocate(size_t bytes) {
+  void *data = NULL;
+  bool mmapped = false;
+  bool huge = m_options.huge_pages and (bytes >= HUGE_PAGE_BYTES);
+
+  if (huge) {
+    // explicit huge pages only exist if the admin reserved some
+    data = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (data == MAP_FAILED) {
+      data = NULL;
+    } else {
+      mmapped = true;
+    }
+  }
+
+  if (data == NULL) {
+    size_t alignment = huge ? HUGE_PAGE_BYTES : m_options.alignment;
+    if (posix_memalign(&data, alignment, bytes) != 0) throw std::bad_alloc();
+#ifdef MADV_HUGEPAGE
+    if (huge) madvise(data, bytes, MADV_HUGEPAGE);
+#endif
+  }
+
+  if (m_options.lock and (mlock(data, bytes) != 0)) {
+    // usually RLIMIT_MEMLOCK, the buffer still works
+    ++m_lock_failures;
+  }
+
+  m_mmapped[data] = mmapped;
+  return data;
+}
+
+
+void AlignedBufferPool::deallocate(void *data, size_t bytes) {
+  if (m_options.lock) munlock(data, bytes);
+  auto pos = m_mmapped.find(data);
+  bool mmapped = (pos != m_mmapped.end()) and pos->second;
+  if (pos != m_mmapped.end()) m_mmapped.erase(pos);
+  if (mmapped) {
+    munmap(data, bytes);
+  } else {
+    free(data);
+  }
+}
@@ -0,0 +1,543 @@
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "BitshuffleFilter.h"
+#include "check_macros.h"
+
+namespace {
+
+  const unsigned FILTER_VERSION = 1;
+  const size_t HEADER_BYTES = 16;
+  const uint32_t RAW_BLOCK = 0x80000000u;
+
+  // LZ4 block format limits: the last 5 bytes are always literals, and the
+  // last match starts at least 12 bytes before the end
+  const size_t LZ4_MIN_MATCH = 4;
+  const size_t LZ4_LAST_LITERALS = 5;
+  const size_t LZ4_MF_LIMIT = 12;
+  const size_t LZ4_MAX_OFFSET = 65535;
+  const int LZ4_HASH_LOG = 12;
+
+  void put_be32(uint8_t *out, uint32_t value) {
+    for (int idx = 3; idx >= 0; --idx, value >>= 8) out[idx] = uint8_t(value & 0xff);
+  }
+
+  uint32_t get_be32(const uint8_t *in) {
+    return (uint32_t(in[0]) << 24) | (uint32_t(in[1]) << 16) | (uint32_t(in[2]) << 8) | uint32_t(in[3]);
+  }
+
+  void put_be64(uint8_t *out, uint64_t value) {
+    for (int idx = 7; idx >= 0; --idx, value >>= 8) out[idx] = uint8_t(value & 0xff);
+  }
+
+  uint64_t get_be64(const uint8_t *in) {
+    uint64_t value = 0;
+    for (int idx = 0; idx < 8; ++idx) value = (value << 8) | in[idx];
+    return value;
+  }
+
+  uint32_t read32(const uint8_t *in) {
+    uint32_t value;
+    memcpy(&value, in, 4);
+    return value;
+  }
+
+  uint32_t lz4_hash(uint32_t sequence) {
+    return (sequence * 2654435761u) >> (32 - LZ4_HASH_LOG);
+  }
+
+  // 8x8 bit matrix transpose, byte m bit k <-> byte k bit m
+  uint64_t transpose8(uint64_t x) {
+    uint64_t t;
+    t = (x ^ (x >> 7)) & 0x00AA00AA00AA00AAULL;
+    x = x ^ t ^ (t << 7);
+    t = (x ^ (x >> 14)) & 0x0000CCCC0000CCCCULL;
+    x = x ^ t ^ (t << 14);
+    t = (x ^ (x >> 28)) & 0x00000000F0F0F0F0ULL;
+    x = x ^ t ^ (t << 28);
+    return x;
+  }
+
+  // scratch[byte * num_elem + elem] = in[elem * elem_size + byte]
+  void byte_transpose(const uint8_t *in, uint8_t *out, size_t num_elem, size_t elem_size, bool simd) {
+    if (elem_size == 1) {
+      memcpy(out, in, num_elem);
+      return;
+    }
+    size_t first = 0;
+#ifdef __SSE2__
+    // int16, the detector case: split low and high bytes 16 elements at a time
+    if (simd and (elem_size == 2)) {
+      const __m128i low_byte = _mm_set1_epi16(0xff);
+      for (; first + 16 <= num_elem; first += 16) {
+        __m128i v0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + 2 * first));
+        __m128i v1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + 2 * first + 16));
+        __m128i lo = _mm_packus_epi16(_mm_and_si128(v0, low_byte), _mm_and_si128(v1, low_byte));
+        __m128i hi = _mm_packus_epi16(_mm_srli_epi16(v0, 8), _mm_srli_epi16(v1, 8));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + first), lo);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + num_elem + first), hi);
+      }
+    }
+#else
+    (void)simd;
+#endif
+    for (size_t elem = first; elem < num_elem; ++elem) {
+      for (size_t byte = 0; byte < elem_size; ++byte) {
+        out[byte * num_elem + elem] = in[elem * elem_size + byte];
+      }
+    }
+  }
+
+  void byte_untranspose(const uint8_t *in, uint8_t *out, size_t num_elem, size_t elem_size, bool simd) {
+    if (elem_size == 1) {
+      memcpy(out, in, num_elem);
+      return;
+    }
+    size_t first = 0;
+#ifdef __SSE2__
+    if (simd and (elem_size == 2)) {
+      for (; first + 16 <= num_elem; first += 16) {
+        __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + first));
+        __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + num_elem + first));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 2 * first), _mm_unpacklo_epi8(lo, hi));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 2 * first + 16), _mm_unpackhi_epi8(lo, hi));
+      }
+    }
+#else
+    (void)simd;
+#endif
+    for (size_t elem = first; elem < num_elem; ++elem) {
+      for (size_t byte = 0; byte < elem_size; ++byte) {
+        out[elem * elem_size + byte] = in[byte * num_elem + elem];
+      }
+    }
+  }
+
+  // one row of row_len bytes (a multiple of 8) into 8 bit planes of
+  // row_len/8 bytes, plane k byte j bit m is bit k of row[8j+m]. Starts at
+  // group first of 8 bytes, so the SIMD path can hand over the remainder.
+  void bit_rows_scalar(const uint8_t *row, uint8_t *planes, size_t row_len, size_t first) {
+    size_t plane_len = row_len / 8;
+    for (size_t group = first; group < plane_len; ++group) {
+      uint64_t x;
+      memcpy(&x, row + 8 * group, 8);
+      x = transpose8(x);
+      for (int bit = 0; bit < 8; ++bit) planes[bit * plane_len + group] = uint8_t(x >> (8 * bit));
+    }
+  }
+
+  void unbit_rows_scalar(const uint8_t *planes, uint8_t *row, size_t row_len, size_t first) {
+    size_t plane_len = row_len / 8;
+    for (size_t group = first; group < plane_len; ++group) {
+      uint64_t x = 0;
+      for (int bit = 0; bit < 8; ++bit) x |= uint64_t(planes[bit * plane_len + group]) << (8 * bit);
+      x = transpose8(x);
+      memcpy(row + 8 * group, &x, 8);
+    }
+  }
+
+#ifdef __SSE2__
+  // movemask picks bit 7 of 16 bytes, a 16 bit shift moves bit 6 of each
+  // byte into bit 7 for the next plane
+  void bit_rows_sse2(const uint8_t *row, uint8_t *planes, size_t row_len) {
+    size_t plane_len = row_len / 8;
+    size_t byte = 0;
+    for (; byte + 16 <= row_len; byte += 16) {
+      __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row + byte));
+      size_t group = byte / 8;
+      for (int bit = 7; bit >= 0; --bit) {
+        int mask = _mm_movemask_epi8(v);
+        planes[bit * plane_len + group] = uint8_t(mask);
+        planes[bit * plane_len + group + 1] = uint8_t(mask >> 8);
+        v = _mm_slli_epi16(v, 1);
+      }
+    }
+    bit_rows_scalar(row, planes, row_len, byte / 8);
+  }
+
+  // 16 bytes of each of the 8 planes are interleaved so each pair of
+  // groups has its 8 plane bytes together, then movemask rebuilds the row
+  // bytes from bit 7 down
+  void unbit_rows_sse2(const uint8_t *planes, uint8_t *row, size_t row_len) {
+    size_t plane_len = row_len / 8;
+    size_t group = 0;
+    for (; group + 16 <= plane_len; group += 16) {
+      __m128i a[8];
+      for (int bit = 0; bit < 8; ++bit) {
+        a[bit] = _mm_loadu_si128(reinterpret_cast<const __m128i *>(planes + bit * plane_len + group));
+      }
+      __m128i b01l = _mm_unpacklo_epi8(a[0], a[1]), b01h = _mm_unpackhi_epi8(a[0], a[1]);
+      __m128i b23l = _mm_unpacklo_epi8(a[2], a[3]), b23h = _mm_unpackhi_epi8(a[2], a[3]);
+      __m128i b45l = _mm_unpacklo_epi8(a[4], a[5]), b45h = _mm_unpackhi_epi8(a[4], a[5]);
+      __m128i b67l = _mm_unpacklo_epi8(a[6], a[7]), b67h = _mm_unpackhi_epi8(a[6], a[7]);
+      __m128i c[8] = {
+        _mm_unpacklo_epi16(b01l, b23l), _mm_unpackhi_epi16(b01l, b23l),
+        _mm_unpacklo_epi16(b01h, b23h), _mm_unpackhi_epi16(b01h, b23h),
+        _mm_unpacklo_epi16(b45l, b67l), _mm_unpackhi_epi16(b45l, b67l),
+        _mm_unpacklo_epi16(b45h, b67h), _mm_unpackhi_epi16(b45h, b67h)
+      };
+      for (int quad = 0; quad < 4; ++quad) {
+        // groups 4*quad .. 4*quad+3, two per vector
+        __m128i pairs[2] = {_mm_unpacklo_epi32(c[quad], c[quad + 4]),
+                            _mm_unpackhi_epi32(c[quad], c[quad + 4])};
+        for (int pair = 0; pair < 2; ++pair) {
+          uint8_t *out = row + 8 * (group + 4 * quad + 2 * pair);
+          __m128i v = pairs[pair];
+          for (int bit = 7; bit >= 0; --bit) {
+            int mask = _mm_movemask_epi8(v);
+            out[bit] = uint8_t(mask);
+            out[8 + bit] = uint8_t(mask >> 8);
+            v = _mm_slli_epi16(v, 1);
+          }
+        }
+      }
+    }
+    unbit_rows_scalar(planes, row, row_len, group);
+  }
+#endif
+
+  size_t block_elements_for(size_t elem_size, size_t block_elements) {
+    if (block_elements == 0) return bitshuffle::default_block_elements(elem_size);
+    return std::max(size_t(8), block_elements - block_elements % 8);
+  }
+
+  // hdf5 callbacks, nothing may be thrown through hdf5
+  herr_t filter_set_local(hid_t dcpl, hid_t type, hid_t) {
+    unsigned flags = 0;
+    size_t num_values = 8;
+    unsigned values[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+    if (H5Pget_filter_by_id2(dcpl, LC2_FILTER_BITSHUFFLE_LZ4, &flags, &num_values, values, 0, NULL, NULL) < 0) return -1;
+    size_t type_size = H5Tget_size(type);
+    if (type_size == 0) return -1;
+    values[0] = FILTER_VERSION;
+    values[1] = unsigned(type_size);
+    if (num_values < 3) values[2] = 0;
+    if (H5Pmodify_filter(dcpl, LC2_FILTER_BITSHUFFLE_LZ4, flags, 3, values) < 0) return -1;
+    return 1;
+  }
+
+  size_t filter_apply(unsigned flags, size_t cd_nelmts, const unsigned cd_values[],
+                      size_t nbytes, size_t *buf_size, void **buf) {
+    size_t elem_size = (cd_nelmts > 1) ? cd_values[1] : 1;
+    size_t block_elements = (cd_nelmts > 2) ? cd_values[2] : 0;
+    if (elem_size == 0) return 0;
+    void *out = NULL;
+    try {
+      size_t out_len = 0, out_cap = 0;
+      if (flags & H5Z_FLAG_REVERSE) {
+        out_cap = bitshuffle::decompressed_size(*buf, nbytes);
+        out = H5allocate_memory(std::max(size_t(1), out_cap), false);
+        if (out == NULL) return 0;
+        out_len = bitshuffle::decompress(*buf, nbytes, out, out_cap);
+      } else {
+        out_cap = bitshuffle::compress_bound(nbytes, elem_size, block_elements);
+        out = H5allocate_memory(out_cap, false);
+        if (out == NULL) return 0;
+        out_len = bitshuffle::compress(*buf, nbytes, elem_size, block_elements, out);
+      }
+      H5free_memory(*buf);
+      *buf = out;
+      *buf_size = std::max(size_t(1), out_cap);
+      return out_len;
+    } catch (const std::exception &) {
+      if (out != NULL) H5free_memory(out);
+      return 0;
+    }
+  }
+
+  const H5Z_class2_t FILTER_CLASS = {
+    H5Z_CLASS_T_VERS,
+    LC2_FILTER_BITSHUFFLE_LZ4,
+    1, 1,
+    "lc2 bitshuffle lz4",
+    NULL,
+    filter_set_local,
+    filter_apply
+  };
+}
+
+
+size_t bitshuffle::default_block_elements(size_t elem_size) {
+  size_t elements = 8192 / std::max(size_t(1), elem_size);
+  return std::max(size_t(8), elements - elements % 8);
+}
+
+
+bool bitshuffle::simd_enabled() {
+#ifdef __SSE2__
+  return true;
+#else
+  return false;
+#endif
+}
+
+
+void bitshuffle::bit_transpose_scalar(const void *in, void *out, size_t num_elem, size_t elem_size, void *scratch) {
+  if (num_elem % 8 != 0) throw std::runtime_error("bit_transpose - num_elem not a multiple of 8");
+  uint8_t *bytes = static_cast<uint8_t *>(scratch);
+  byte_transpose(static_cast<const uint8_t *>(in), bytes, num_elem, elem_size, false);
+  for (size_t byte = 0; byte < elem_size; ++byte) {
+    bit_rows_scalar(bytes + byte * num_elem, static_cast<uint8_t *>(out) + byte * num_elem, num_elem, 0);
+  }
+}
+
+
+void bitshuffle::bit_untranspose_scalar(const void *in, void *out, size_t num_elem, size_t elem_size, void *scratch) {
+  if (num_elem % 8 != 0) throw std::runtime_error("bit_untranspose - num_elem not a multiple of 8");
+  uint8_t *bytes = static_cast<uint8_t *>(scratch);
+  for (size_t byte = 0; byte < elem_size; ++byte) {
+    unbit_rows_scalar(static_cast<const uint8_t *>(in) + byte * num_elem, bytes + byte * num_elem, num_elem, 0);
+  }
+  byte_untranspose(bytes, static_cast<uint8_t *>(out), num_elem, elem_size, false);
+}
+
+
+void bitshuffle::bit_transpose(const void *in, void *out, size_t num_elem, size_t elem_size, void *scratch) {
+#ifdef __SSE2__
+  if (num_elem % 8 != 0) throw std::runtime_error("bit_transpose - num_elem not a multiple of 8");
+  uint8_t *bytes = static_cast<uint8_t *>(scratch);
+  byte_transpose(static_cast<const uint8_t *>(in), bytes, num_elem, elem_size, true);
+  for (size_t byte = 0; byte < elem_size; ++byte) {
+    bit_rows_sse2(bytes + byte * num_elem, static_cast<uint8_t *>(out) + byte * num_elem, num_elem);
+  }
+#else
+  bit_transpose_scalar(in, out, num_elem, elem_size, scratch);
+#endif
+}
+
+
+void bitshuffle::bit_untranspose(const void *in, void *out, size_t num_elem, size_t elem_size, void *scratch) {
+#ifdef __SSE2__
+  if (num_elem % 8 != 0) throw std::runtime_error("bit_untranspose - num_elem not a multiple of 8");
+  uint8_t *bytes = static_cast<uint8_t *>(scratch);
+  for (size_t byte = 0; byte < elem_size; ++byte) {
+    unbit_rows_sse2(static_cast<const uint8_t *>(in) + byte * num_elem, bytes + byte * num_elem, num_elem);
+  }
+  byte_untranspose(bytes, static_cast<uint8_t *>(out), num_elem, elem_size, true);
+#else
+  bit_untranspose_scalar(in, out, num_elem, elem_size, scratch);
+#endif
+}
+
+
+size_t bitshuffle::lz4_bound(size_t num_bytes) {
+  return num_bytes + num_bytes / 255 + 16;
+}
+
+
+// greedy single probe hash matcher, the LZ4 "fast" scheme without the
+// acceleration tricks
+size_t bitshuffle::lz4_compress(const uint8_t *in, size_t num_bytes, uint8_t *out, size_t out_cap) {
+  std::vector<uint32_t> table(size_t(1) << LZ4_HASH_LOG, 0);
+  const uint8_t *out_end = out + out_cap;
+  uint8_t *op = out;
+  size_t anchor = 0, pos = 0;
+
+  // literals from anchor to pos, then a match of match_len at offset, or
+  // no match for the last sequence
+  auto emit = [&](size_t lit_len, size_t offset, size_t match_len) -> bool {
+    size_t need = 1 + lit_len / 255 + 1 + lit_len + (match_len > 0 ? 2 + (match_len - LZ4_MIN_MATCH) / 255 + 1 : 0);
+    if (op + need > out_end) return false;
+    uint8_t *token = op++;
+    *token = uint8_t(std::min(lit_len, size_t(15)) << 4);
+    if (lit_len >= 15) {
+      size_t rest = lit_len - 15;
+      for (; rest >= 255; rest -= 255) *op++ = 255;
+      *op++ = uint8_t(rest);
+    }
+    memcpy(op, in + anchor, lit_len);
+    op += lit_len;
+    if (match_len == 0) return true;
+    *op++ = uint8_t(offset & 0xff);
+    *op++ = uint8_t(offset >> 8);
+    size_t code = match_len - LZ4_MIN_MATCH;
+    *token |= uint8_t(std::min(code, size_t(15)));
+    if (code >= 15) {
+      size_t rest = code - 15;
+      for (; rest >= 255; rest -= 255) *op++ = 255;
+      *op++ = uint8_t(rest);
+    }
+    return true;
+  };
+
+  if (num_bytes > LZ4_MF_LIMIT) {
+    const size_t match_limit = num_bytes - LZ4_MF_LIMIT;
+    const size_t extend_limit = num_bytes - LZ4_LAST_LITERALS;
+    while (pos < match_limit) {
+      uint32_t sequence = read32(in + pos);
+      uint32_t hash = lz4_hash(sequence);
+      size_t ref = table[hash];
+      table[hash] = uint32_t(pos);
+      if ((ref < pos) and (pos - ref <= LZ4_MAX_OFFSET) and (read32(in + ref) == sequence)) {
+        size_t match_len = LZ4_MIN_MATCH;
+        while ((pos + match_len < extend_limit) and (in[ref + match_len] == in[pos + match_len])) ++match_len;
+        if (not emit(pos - anchor, pos - ref, match_len)) return 0;
+        pos += match_len;
+        anchor = pos;
+        if (pos < match_limit) table[lz4_hash(read32(in + pos - 2))] = uint32_t(pos - 2);
+      } else {
+        // skip faster through data that is not matching
+        pos += 1 + ((pos - anchor) >> 6);
+      }
+    }
+  }
+  if (not emit(num_bytes - anchor, 0, 0)) return 0;
+  return size_t(op - out);
+}
+
+
+size_t bitshuffle::lz4_decompress(const uint8_t *in, size_t in_len, uint8_t *out, size_t out_cap) {
+  const uint8_t *ip = in, *in_end = in + in_len;
+  uint8_t *op = out, *out_end = out + out_cap;
+  while (ip < in_end) {
+    unsigned token = *ip++;
+    size_t lit_len = token >> 4;
+    if (lit_len == 15) {
+      unsigned more = 255;
+      while (more == 255) {
+        if (ip >= in_end) throw std::runtime_error("lz4_decompress - truncated literal length");
+        more = *ip++;
+        lit_len += more;
+      }
+    }
+    if ((size_t(in_end - ip) < lit_len) or (size_t(out_end - op) < lit_len)) {
+      throw std::runtime_error("lz4_decompress - literals overrun");
+    }
+    memcpy(op, ip, lit_len);
+    ip += lit_len;
+    op += lit_len;
+    if (ip == in_end) break;
+
+    if (in_end - ip < 2) throw std::runtime_error("lz4_decompress - truncated offset");
+    size_t offset = size_t(ip[0]) | (size_t(ip[1]) << 8);
+    ip += 2;
+    if ((offset == 0) or (offset > size_t(op - out))) throw std::runtime_error("lz4_decompress - bad offset");
+    size_t match_len = (token & 15);
+    if (match_len == 15) {
+      unsigned more = 255;
+      while (more == 255) {
+        if (ip >= in_end) throw std::runtime_error("lz4_decompress - truncated match length");
+        more = *ip++;
+        match_len += more;
+      }
+    }
+    match_len += LZ4_MIN_MATCH;
+    if (size_t(out_end - op) < match_len) throw std::runtime_error("lz4_decompress - match overrun");
+    const uint8_t *match = op - offset;
+    if (offset >= match_len) {
+      memcpy(op, match, match_len);
+      op += match_len;
+    } else {
+      // overlapping, a repeat of the last offset bytes
+      for (size_t idx = 0; idx < match_len; ++idx) *op++ = *match++;
+    }
+  }
+  return size_t(op - out);
+}
+
+
+size_t bitshuffle::compress_bound(size_t num_bytes, size_t elem_size, size_t block_elements) {
+  size_t block_bytes = block_elements_for(elem_size, block_elements) * elem_size;
+  size_t num_blocks = num_bytes / block_bytes + 1;
+  return HEADER_BYTES + num_blocks * (4 + lz4_bound(block_bytes)) + num_bytes % block_bytes;
+}
+
+
+size_t bitshuffle::compress(const void *in, size_t num_bytes, size_t elem_size, size_t block_elements, void *out) {
+  block_elements = block_elements_for(elem_size, block_elements);
+  const size_t block_bytes = block_elements * elem_size;
+  const uint8_t *src = static_cast<const uint8_t *>(in);
+  uint8_t *dst = static_cast<uint8_t *>(out);
+  put_be64(dst, uint64_t(num_bytes));
+  put_be32(dst + 8, uint32_t(block_bytes));
+  put_be32(dst + 12, uint32_t(elem_size));
+  size_t out_pos = HEADER_BYTES;
+
+  std::vector<uint8_t> shuffled(block_bytes), scratch(block_bytes);
+  const size_t num_elem = num_bytes / elem_size;
+  size_t elem = 0;
+  while (elem + 8 <= num_elem) {
+    size_t count = std::min(block_elements, num_elem - elem);
+    count -= count % 8;
+    size_t bytes = count * elem_size;
+    bit_transpose(src + elem * elem_size, &shuffled.at(0), count, elem_size, &scratch.at(0));
+    size_t len = lz4_compress(&shuffled.at(0), bytes, dst + out_pos + 4, bytes - 1);
+    if (len == 0) {
+      put_be32(dst + out_pos, uint32_t(bytes) | RAW_BLOCK);
+      memcpy(dst + out_pos + 4, &shuffled.at(0), bytes);
+      len = bytes;
+    } else {
+      put_be32(dst + out_pos, uint32_t(len));
+    }
+    out_pos += 4 + len;
+    elem += count;
+  }
+  size_t tail = num_bytes - elem * elem_size;
+  memcpy(dst + out_pos, src + elem * elem_size, tail);
+  return out_pos + tail;
+}
+
+
+size_t bitshuffle::decompressed_size(const void *in, size_t in_len) {
+  if (in_len < HEADER_BYTES) throw std::runtime_error("bitshuffle - buffer shorter than header");
+  return size_t(get_be64(static_cast<const uint8_t *>(in)));
+}
+
+
+size_t bitshuffle::decompress(const void *in, size_t in_len, void *out, size_t out_cap) {
+  const uint8_t *src = static_cast<const uint8_t *>(in);
+  uint8_t *dst = static_cast<uint8_t *>(out);
+  const size_t num_bytes = decompressed_size(in, in_len);
+  const size_t block_bytes = get_be32(src + 8);
+  const size_t elem_size = get_be32(src + 12);
+  if (num_bytes > out_cap) throw std::runtime_error("bitshuffle - output too small");
+  if ((elem_size == 0) or (block_bytes == 0) or (block_bytes % (8 * elem_size) != 0)) {
+    throw std::runtime_error("bitshuffle - bad header");
+  }
+
+  const size_t num_elem = num_bytes / elem_size;
+  const size_t block_total = (num_elem - num_elem % 8) * elem_size;
+  std::vector<uint8_t> shuffled(block_bytes), scratch(block_bytes);
+  size_t in_pos = HEADER_BYTES, out_pos = 0;
+  while (out_pos < block_total) {
+    if (in_len - in_pos < 4) throw std::runtime_error("bitshuffle - truncated block");
+    uint32_t header = get_be32(src + in_pos);
+    in_pos += 4;
+    size_t len = header & ~RAW_BLOCK;
+    if (len > in_len - in_pos) throw std::runtime_error("bitshuffle - block overruns buffer");
+    size_t bytes;
+    if (header & RAW_BLOCK) {
+      bytes = len;
+      if (bytes > block_bytes) throw std::runtime_error("bitshuffle - raw block too big");
+      memcpy(&shuffled.at(0), src + in_pos, bytes);
+    } else {
+      bytes = lz4_decompress(src + in_pos, len, &shuffled.at(0), block_bytes);
+    }
+    in_pos += len;
+    if ((bytes == 0) or (bytes % (8 * elem_size) != 0) or (bytes > block_total - out_pos)) {
+      throw std::runtime_error("bitshuffle - bad block length");
+    }
+    bit_untranspose(&shuffled.at(0), dst + out_pos, bytes / elem_size, elem_size, &scratch.at(0));
+    out_pos += bytes;
+  }
+  size_t tail = num_bytes - out_pos;
+  if (in_len - in_pos != tail) throw std::runtime_error("bitshuffle - bad tail length");
+  memcpy(dst + out_pos, src + in_pos, tail);
+  return num_bytes;
+}
+
+
+void bitshuffle::register_filter() {
+  static bool registered = false;
+  if (registered) return;
+  if (H5Zfilter_avail(LC2_FILTER_BITSHUFFLE_LZ4) <= 0) {
+    NONNEG( H5Zregister(&FILTER_CLASS) );
+  }
+  registered = true;
+}
@@ -0,0 +1,137 @@
+#include <algorithm>
+#include <stdexcept>
+
+#include "ChunkCachePolicy.h"
+#include "check_macros.h"
+
+namespace {
+
+  hsize_t ceil_div(hsize_t num, hsize_t den) {
+    if (den == 0) return 0;
+    return (num + den - 1) / den;
+  }
+
+}
+
+
+ChunkCachePolicy::ChunkCachePolicy() :
+  events_per_read(1),
+  block_events(1),
+  event_stride(1),
+  min_source_events_cached(0),
+  max_bytes(0),
+  w0(0.75)
+{}
+
+
+ChunkCachePolicy ChunkCachePolicy::for_writer(hsize_t events_per_append) {
+  ChunkCachePolicy policy;
+  policy.events_per_read = events_per_append;
+  policy.block_events = events_per_append;
+  policy.event_stride = events_per_append;
+  // a chunk that is done being appended to will not be touched again
+  policy.w0 = 1.0;
+  return policy;
+}
+
+
+ChunkCachePolicy ChunkCachePolicy::for_reader(hsize_t events_per_read,
+                                              hsize_t event_block_size,
+                                              int num_readers,
+                                              hsize_t min_source_events_cached,
+                                              size_t max_bytes) {
+  ChunkCachePolicy policy;
+  policy.events_per_read = events_per_read;
+  policy.block_events = event_block_size;
+  policy.event_stride = event_block_size * hsize_t(std::max(1, num_readers));
+  policy.min_source_events_cached = min_source_events_cached;
+  policy.max_bytes = max_bytes;
+  return policy;
+}
+
+
+ChunkCacheSize ChunkCachePolicy::size_for(size_t type_size_bytes,
+                                          const std::vector<hsize_t> &chunk,
+                                          size_t num_vds_mappings,
+                                          size_t chunks_per_event) const {
+  if (chunk.size() == 0) throw std::runtime_error("ChunkCachePolicy::size_for - empty chunk");
+  if (num_vds_mappings == 0) num_vds_mappings = 1;
+  if (chunks_per_event == 0) chunks_per_event = 1;
+
+  hsize_t chunk_bytes = type_size_bytes;
+  for (auto iter = chunk.begin(); iter != chunk.end(); ++iter) {
+    chunk_bytes *= *iter;
+  }
+
+  // what one source dataset sees
+  const hsize_t chunk_events = std::max(hsize_t(1), chunk.at(0));
+  const hsize_t read_events = ceil_div(std::max(hsize_t(1), events_per_read), num_vds_mappings);
+  const hsize_t block = ceil_div(std::max(events_per_read, block_events), num_vds_mappings);
+  const hsize_t stride = ceil_div(std::max(block_events, event_stride), num_vds_mappings);
+
+  // a chunk is worth caching if more than one call touches it - later reads
+  // in the same block, or the next block starting inside the same chunk.
+  bool reused = (chunk_events > read_events) and ((block > read_events) or (stride < chunk_events));
+
+  hsize_t num_chunks = 0;
+  if (reused) {
+    // chunks one call can straddle, the last one is picked up by the next call
+    num_chunks = ceil_div(read_events - 1, chunk_events) + 1;
+  }
+  num_chunks = std::max(num_chunks, ceil_div(min_source_events_cached, chunk_events));
+  num_chunks *= chunks_per_event;
+
+  if ((max_bytes > 0) and (num_chunks * chunk_bytes > max_bytes)) {
+    num_chunks = max_bytes / chunk_bytes;
+  }
+
+  ChunkCacheSize size;
+  size.num_chunks = size_t(num_chunks);
+  size.nbytes = size_t(num_chunks * chunk_bytes);
+  // hdf5 suggests a prime around 100 times the number of chunks in the cache
+  size.nslots = next_prime(std::max(size_t(101), 100 * size.num_chunks));
+  size.w0 = w0;
+  return size;
+}
+
+
+ChunkCacheSize ChunkCachePolicy::apply(hid_t access,
+                                       hid_t h5type,
+                                       const std::vector<hsize_t> &chunk,
+                                       size_t num_vds_mappings,
+                                       size_t chunks_per_event) const {
+  size_t type_size_bytes = NONNEG( H5Tget_size( h5type ) );
+  ChunkCacheSize size = size_for(type_size_bytes, chunk, num_vds_mappings, chunks_per_event);
+  NONNEG( H5Pset_chunk_cache(access, size.nslots, size.nbytes, size.w0) );
+  return size;
+}
+
+
+size_t ChunkCachePolicy::chunks_per_event(const std::vector<hsize_t> &dims,
+                                          const std::vector<hsize_t> &chunk) {
+  if (dims.size() != chunk.size()) {
+    throw std::runtime_error("ChunkCachePolicy::chunks_per_event - dims and chunk rank differ");
+  }
+  size_t num = 1;
+  for (size_t dim = 1; dim < dims.size(); ++dim) {
+    num *= size_t(std::max(hsize_t(1), ceil_div(dims.at(dim), chunk.at(dim))));
+  }
+  return num;
+}
+
+
+size_t ChunkCachePolicy::next_prime(size_t n) {
+  if (n <= 2) return 2;
+  if (n % 2 == 0) ++n;
+  while (true) {
+    bool prime = true;
+    for (size_t div = 3; div * div <= n; div += 2) {
+      if (n % div == 0) {
+        prime = false;
+        break;
+      }
+    }
+    if (prime) return n;
+    n += 2;
+  }
+}
@@ -6,6 +6,8 @@
 
 #include "check_macros.h"
 #include "DaqBase.h"
+#include "H5Profile.h"
+#include "BitshuffleFilter.h"
 
 
 DaqBase::DaqBase(int argc, char *argv[], const char *process) : m_process(process) {
@@ -25,9 +27,21 @@ DaqBase::DaqBase(int argc, char *argv[], const char *process) : m_process(proces
   m_fname_pid = form_fullpath(m_process, m_id, PID);
   m_fname_finished = form_fullpath(m_process, m_id, FINISHED);
 
+  // only written when built with LC2_H5PROFILE
+  H5Profile::set_output(form_fullpath(m_process, m_id, RESULTS) + ".h5profile");
+
+  // writer chunks may be compressed with our filter, see DsetPropAccess
+  bitshuffle::register_filter();
+
   // will set to "small" -> ["fiducials", "milli", "data"] ...
   m_group2dsets = get_top_group_to_final_dsets();
 
+  AlignedBufferOptions buffer_options;
+  buffer_options.alignment = m_config["buffers"]["alignment"].as<size_t>();
+  buffer_options.huge_pages = m_config["buffers"]["huge_pages"].as<bool>();
+  buffer_options.lock = m_config["buffers"]["lock_memory"].as<bool>();
+  m_buffer_pool.reset(new AlignedBufferPool(buffer_options));
+
 }
 
 
@@ -60,6 +74,10 @@ std::string DaqBase::form_fullpath(std::string process, int idx, enum Location l
   case FINISHED:
     full_path += "/logs/" + basename + ".finished";
     break;
+  case RESULTS:
+    // callers add the extension, a process can have several results files
+    full_path += "/results/" + basename;
+    break;
   }
   return full_path;
 }
@@ -166,6 +184,13 @@ void DaqBase::close_standard_groups() {
   NONNEG( H5Gclose( m_small_group ) );
 }
   
+bool DaqBase::small_layout_wide() {
+  std::string layout = m_config["daq_writer"]["datasets"]["single_source"]["small"]["layout"].as<std::string>();
+  if (layout == "wide") return true;
+  if (layout == "groups") return false;
+  throw std::runtime_error("small layout must be groups or wide, not " + layout);
+}
+
 bool DaqBase::small_writes(int64_t event) {
   static int64_t stride = m_config["daq_writer"]["datasets"]["single_source"]["small"]["shots_per_sample"].as<int64_t>();
   return (event % stride == 0);
@@ -245,12 +270,12 @@ int64_t DaqBase::get_event_idx_in_master(const std::string &topName, int64_t eve
 void DaqBase::load_cspad(const std::string &h5_filename,
                          const std::string &dataset,
                          int length,
-                         std::vector<short> &cspad_buffer) {
+                         AlignedBuffer &cspad_buffer) {
   size_t total = size_t(CSPadNumElem) * size_t(length);
-  cspad_buffer.resize(total);
+  cspad_buffer = m_buffer_pool->acquire_for<int16_t>(total);
   hid_t fid = POS( H5Fopen(h5_filename.data(), H5F_ACC_RDONLY , H5P_DEFAULT) );
   Dset dset = Dset::open(fid, dataset.data(), Dset::if_vds_first_missing);
-  dset.read(0, length, cspad_buffer);
+  dset.read(0, length, cspad_buffer.as<int16_t>(), total);
   dset.close();
   std::cout << logHdr() << "loaded cspad" << std::endl;
   NONNEG( H5Fclose( fid ) );                         
@@ -1,10 +1,14 @@
 #include <iostream>
+#include <algorithm>
+#include <cstring>
 #include <unistd.h>
 #include <chrono>
-
-#include "hdf5_hl.h"
+#include <fcntl.h>
+#include <sys/mman.h>
 
 #include "DsetPropAccess.h"
+#include "DsetLayoutCache.h"
+#include "BitshuffleFilter.h"
 #include "Dset.h"
 #include "check_macros.h"
 
@@ -32,19 +36,34 @@ void print_h5_simple(std::ostream &ostr, const char *header, hid_t space) {
   ostr.flush();
 }
 
-Dset Dset::create(hid_t parent, const char *name, hid_t h5type, const std::vector<hsize_t> & chunk) {
-  std::vector<hsize_t> start_dims(chunk);
-  std::vector<hsize_t> max_dims(chunk);
+Dset Dset::create(hid_t parent, const char *name, hid_t h5type, const std::vector<hsize_t> & chunk,
+                  const ChunkCachePolicy &cache_policy) {
+  return create(parent, name, h5type, chunk, chunk, cache_policy);
+}
+
+
+Dset Dset::create(hid_t parent, const char *name, hid_t h5type, const std::vector<hsize_t> & chunk,
+                  const std::vector<hsize_t> & dims, const ChunkCachePolicy &cache_policy,
+                  DsetFilter filter) {
+  if (dims.size() != chunk.size()) {
+    throw std::runtime_error("Dset::create - dims and chunk rank differ");
+  }
+  std::vector<hsize_t> start_dims(dims);
+  std::vector<hsize_t> max_dims(dims);
   start_dims.at(0)=0;
   max_dims.at(0) = H5S_UNLIMITED;
 
-  DsetPropAccess dsetCreate( std::string(name), h5type,  chunk);
+  DsetPropAccess dsetCreate( std::string(name), h5type,  chunk, cache_policy,
+                             ChunkCachePolicy::chunks_per_event(dims, chunk), filter);
   Dset dset;
   dset.m_type = h5type;
   hid_t space_id = NONNEG( H5Screate_simple(int(chunk.size()), &start_dims.at(0), &max_dims.at(0)) );
   dset.m_id = NONNEG( H5Dcreate2(parent, name, h5type, space_id, H5P_DEFAULT,
                                      dsetCreate.proplist, dsetCreate.access) );
   dset.m_dims = start_dims;
+  dset.m_chunk_events = chunk.at(0);
+  dset.m_spaces = std::make_shared<DsetSpaces>(int(chunk.size()), false);
+  DsetLayoutCache::store(dset.m_id, DsetLayoutCache::instance().describe(dset.m_id));
 
   dsetCreate.close();
   NONNEG( H5Sclose(space_id) );
@@ -54,110 +73,100 @@ Dset Dset::create(hid_t parent, const char *name, hid_t h5type, const std::vecto
 
 
 std::vector<hsize_t> Dset::get_chunk(const std::string & fname, const std::string &dset) {
-  hid_t parent = POS( H5Fopen(fname.c_str(), H5F_ACC_RDONLY | H5F_ACC_SWMR_READ, H5P_DEFAULT) );
-  std::vector<hsize_t> chunk = get_chunk(parent, dset);
-  NONNEG( H5Fclose( parent ) );
+  const DsetLayout &layout = DsetLayoutCache::instance().source_layout(fname, dset);
+  if ((layout.layout != H5D_CHUNKED) and (layout.layout != H5D_VIRTUAL)) {
+    throw std::runtime_error("neither VDS or chunked dataset");
+  }
+  std::vector<hsize_t> chunk = layout.chunk;
+  chunk.at(0) *= layout.num_vds_mappings;
   return chunk;
 }
 
 std::vector<hsize_t> Dset::get_chunk(hid_t parent, const std::string &dset) {
   hid_t dset_id = NONNEG(H5Dopen2(parent, dset.c_str(), H5P_DEFAULT));
-  std::vector<hsize_t> chunk = get_chunk(parent, dset_id);
+  std::vector<hsize_t> chunk = get_chunk(dset_id);
   NONNEG( H5Dclose( dset_id ) );
   return chunk;
 }
 
-std::vector<hsize_t> Dset::get_chunk(hid_t parent, hid_t dset) {
-  std::vector<hsize_t> chunk;
-  hid_t dspace_id = NONNEG(H5Dget_space(dset));
-  int rank = NONNEG(H5Sget_simple_extent_ndims(dspace_id));
-  chunk.resize(rank);
-
-  hid_t proplist = NONNEG(H5Dget_create_plist(dset));
-  H5D_layout_t layout = NONNEG( H5Pget_layout( proplist ) );
-
-  if (layout == H5D_CHUNKED) {
-    NONNEG(H5Pget_chunk(proplist, rank, &chunk.at(0)));
-  } else if (layout == H5D_VIRTUAL) {
-    size_t num_map;
-    NONNEG( H5Pget_virtual_count( proplist, &num_map) );
-
-    for (size_t ii = 0; ii < num_map; ++ii) {
-
-      ssize_t filename_len = NONNEG( H5Pget_virtual_filename( proplist, ii, NULL, 0) );
-      std::string filename; filename.resize(filename_len+1);
-      NONNEG( H5Pget_virtual_filename( proplist, ii, &filename.at(0), filename_len+1) );
-
-      ssize_t dset_len = NONNEG( H5Pget_virtual_dsetname( proplist, ii, NULL, 0) );
-      std::string dsetname; dsetname.resize(dset_len+1);
-      NONNEG( H5Pget_virtual_dsetname( proplist, ii, &dsetname.at(0), dset_len+1) );
-      
-      std::vector<hsize_t> chunk_ii = get_chunk(filename, dsetname);
+std::vector<hsize_t> Dset::get_chunk(hid_t dset) {
+  size_t num_map = 1;
+  std::vector<hsize_t> chunk = get_source_chunk(dset, num_map);
+  chunk.at(0) *= num_map;
+  return chunk;
+}
 
-      if (ii == 0) {
-        chunk = chunk_ii;
-      } else {
-        if ( chunk != chunk_ii) {
-          throw std::runtime_error("chunks across mappings in VDS not equal");
-        }
-      }
-    }
-    chunk.at(0) *= num_map;
-  } else {
+std::vector<hsize_t> Dset::get_source_chunk(hid_t dset, size_t &num_vds_mappings) {
+  DsetLayout layout = DsetLayoutCache::instance().describe(dset);
+  if ((layout.layout != H5D_CHUNKED) and (layout.layout != H5D_VIRTUAL)) {
     throw std::runtime_error("neither VDS or chunked dataset");
   }
+  num_vds_mappings = layout.num_vds_mappings;
+  return layout.chunk;
+}
 
-  NONNEG(H5Pclose(proplist));
-  NONNEG(H5Sclose(dspace_id));
-
-  return chunk;
+DsetMapping::DsetMapping(const std::string &fname, haddr_t offset, hsize_t num_events, size_t event_bytes) :
+  m_base(MAP_FAILED),
+  m_map_bytes(0),
+  m_data(NULL),
+  m_event_bytes(event_bytes)
+{
+  const size_t page = size_t(sysconf(_SC_PAGESIZE));
+  const size_t map_offset = size_t(offset) - size_t(offset) % page;
+  m_map_bytes = size_t(offset) - map_offset + size_t(num_events) * event_bytes;
+  int fd = ::open(fname.c_str(), O_RDONLY);
+  if (fd < 0) throw std::runtime_error("DsetMapping - could not open " + fname);
+  m_base = mmap(NULL, m_map_bytes, PROT_READ, MAP_SHARED, fd, off_t(map_offset));
+  // the mapping keeps the file, not the descriptor
+  ::close(fd);
+  if (m_base == MAP_FAILED) throw std::runtime_error("DsetMapping - mmap failed for " + fname);
+  m_data = static_cast<const char *>(m_base) + (size_t(offset) - map_offset);
 }
 
-Dset Dset::open(hid_t parent, const char *name, VDS_access vds_access) {
-  // open and close the dataset in order to read the
-  // dimensions, type and chunk size. We want a per
-  // dataset cache of 3 types the chunk cache.
-  // If it is a virtual dataset, we want to do sum
-  // the chunk size among all the source files.
-
-  std::vector<hsize_t> dims, chunk;
-  hid_t h5type = -1;
-  {
-    hid_t dset = NONNEG(H5Dopen2(parent, name, H5P_DEFAULT));
-    hid_t dspace_id = NONNEG(H5Dget_space(dset));
-    int rank = NONNEG(H5Sget_simple_extent_ndims(dspace_id));
-    dims.resize(rank);
-    NONNEG(H5Sget_simple_extent_dims(dspace_id, &dims.at(0), NULL));
-
-    hid_t type = NONNEG(H5Dget_type(dset));
-    if (H5Tequal(type, H5T_NATIVE_INT64) >= 1) {
-      h5type = H5T_NATIVE_INT64;
-    } else if (H5Tequal(type, H5T_NATIVE_INT16) >= 1) {
-      h5type = H5T_NATIVE_INT16;
-    } else {
-      throw std::runtime_error("this is not a int64 or int16 dataset");
-    }
 
-    chunk = get_chunk(parent, dset);
+DsetMapping::~DsetMapping() {
+  if (m_base != MAP_FAILED) munmap(m_base, m_map_bytes);
+}
+
 
-    NONNEG(H5Sclose(dspace_id));
-    NONNEG(H5Dclose(dset));
-    NONNEG(H5Tclose(type));
+Dset Dset::open(hid_t parent, const char *name, VDS_access vds_access, const ChunkCachePolicy &cache_policy,
+                ReadMode read_mode) {
+  // The chunk cache has to be set when the dataset is opened, and is
+  // sized from the type and chunk layout. Datasets we create store their
+  // layout in an attribute, so they are opened once. For others, open and
+  // close once to read the layout, which goes in the per process layout
+  // cache. For a virtual dataset, each source gets its own cache, so we
+  // size it from the source chunk and the number of mappings.
+  // Chunks may have our filter, which hdf5 cannot find as a plugin.
+  bitshuffle::register_filter();
+  DsetLayout layout;
+  hid_t layout_attr = -1;
+  if (not DsetLayoutCache::stored(parent, name, layout, layout_attr)) {
+    DsetLayoutCache &layout_cache = DsetLayoutCache::instance();
+    DsetLayoutCache::Key key = DsetLayoutCache::key_for(parent, name);
+    if (not layout_cache.lookup(key, layout)) {
+      hid_t dset = NONNEG(H5Dopen2(parent, name, H5P_DEFAULT));
+      layout = layout_cache.describe(dset);
+      NONNEG(H5Dclose(dset));
+      layout_cache.insert(key, layout);
+    }
   }
 
-  hsize_t chunk_cache_bytes = NONNEG(H5Tget_size(h5type));
-  for (auto iter = chunk.begin(); iter != chunk.end(); ++iter) {
-    chunk_cache_bytes *= *iter;
+  if (layout.h5type < 0) {
+    if (layout_attr >= 0) H5Aclose(layout_attr);
+    throw std::runtime_error("this is not a int64 or int16 dataset");
+  }
+  // contiguous is what daq_repack writes, there is no chunk cache to size
+  if ((layout.layout != H5D_CHUNKED) and (layout.layout != H5D_VIRTUAL) and (layout.layout != H5D_CONTIGUOUS)) {
+    if (layout_attr >= 0) H5Aclose(layout_attr);
+    throw std::runtime_error("neither VDS, chunked or contiguous dataset");
   }
-  chunk_cache_bytes *= 2;
 
-  // now open with a access based on dimensions
+  // now open with a access based on the layout
   hid_t access_id = NONNEG(H5Pcreate(H5P_DATASET_ACCESS));
-
-  size_t rdcc_nslots = 101;
-  size_t rdcc_nbytes = chunk_cache_bytes;
-  double rdcc_w0 = 0.75;
-  NONNEG(H5Pset_chunk_cache(access_id, rdcc_nslots, rdcc_nbytes, rdcc_w0));
+  if (layout.layout != H5D_CONTIGUOUS) {
+    cache_policy.apply(access_id, layout.h5type, layout.chunk, layout.num_vds_mappings, layout.chunks_per_event);
+  }
   
   if (vds_access == if_vds_first_missing) {
     NONNEG( H5Pset_virtual_view( access_id, H5D_VDS_FIRST_MISSING) );
@@ -167,15 +176,53 @@ Dset Dset::open(hid_t parent, const char *name, VDS_access vds_access) {
 
   hid_t dset_id = NONNEG(H5Dopen2(parent, name, access_id));
   NONNEG(H5Pclose(access_id));
+  if (layout_attr >= 0) NONNEG(H5Aclose(layout_attr));
 
   Dset dset;
   dset.m_id = dset_id;
-  dset.m_type = h5type;
-  dset.m_dims = dims;
+  dset.m_type = layout.h5type;
+  dset.m_dims.resize(layout.rank);
+  hid_t dspace_id = NONNEG(H5Dget_space(dset_id));
+  NONNEG(H5Sget_simple_extent_dims(dspace_id, &dset.m_dims.at(0), NULL));
+  NONNEG(H5Sclose(dspace_id));
+  dset.m_spaces = std::make_shared<DsetSpaces>(layout.rank, layout.layout == H5D_VIRTUAL);
+  if (layout.chunk.size() > 0) dset.m_chunk_events = layout.chunk.at(0) * layout.num_vds_mappings;
+  if ((read_mode == read_mmap) and (layout.layout == H5D_CONTIGUOUS)) dset.map_contiguous();
 
   return dset;
 }
 
+
+// the layout cache has checked the file type is m_type. H5Dget_offset is
+// the address in the file, user block included, but other file drivers,
+// like family or split, do not keep the raw data in the one file. Data not
+// aligned to the element size stays with hdf5, so the pointers handed out
+// are aligned.
+void Dset::map_contiguous() {
+  const size_t type_bytes = NONNEG( H5Tget_size(m_type) );
+  const size_t event_bytes = event_len() * type_bytes;
+  if ((m_dims.empty()) or (m_dims.at(0) == 0) or (event_bytes == 0)) return;
+
+  hid_t dcpl = NONNEG( H5Dget_create_plist(m_id) );
+  int num_external = NONNEG( H5Pget_external_count(dcpl) );
+  NONNEG( H5Pclose(dcpl) );
+  if (num_external > 0) return;
+  haddr_t offset = H5Dget_offset(m_id);
+  if ((offset == HADDR_UNDEF) or (offset % type_bytes != 0)) return;
+
+  hid_t fid = NONNEG( H5Iget_file_id(m_id) );
+  hid_t fapl = NONNEG( H5Fget_access_plist(fid) );
+  bool sec2 = (H5Pget_driver(fapl) == H5FD_SEC2);
+  ssize_t name_len = NONNEG( H5Fget_name(fid, NULL, 0) );
+  std::vector<char> fname(size_t(name_len) + 1, '\0');
+  NONNEG( H5Fget_name(fid, fname.data(), fname.size()) );
+  NONNEG( H5Pclose(fapl) );
+  NONNEG( H5Fclose(fid) );
+  if (not sec2) return;
+
+  m_mapping = std::make_shared<DsetMapping>(std::string(fname.data()), offset, m_dims.at(0), event_bytes);
+}
+
 std::ostream & Dset::dbgInfo(std::ostream &o) {
   char name[512];
   NONNEG( H5Iget_name(id(), name, 512) );
@@ -190,7 +237,7 @@ std::ostream & Dset::dbgInfo(std::ostream &o) {
 
 
 void Dset::check_read(hid_t type, hsize_t start, hsize_t count) {
-  if ( H5Tequal(m_type, type) <= 0) {
+  if ((m_type != type) and (H5Tequal(m_type, type) <= 0)) {
     dbgInfo(std::cout) << "error: check_read, type=" << type << " start=" << start << " count=" << count << std::endl;
     throw std::runtime_error("dset::read, type mismatch");
   }
@@ -205,7 +252,7 @@ void Dset::check_read(hid_t type, hsize_t start, hsize_t count) {
 }
 
 void Dset::check_append(hid_t type, hsize_t start, hsize_t count, size_t data_len) {
-  if ( H5Tequal(m_type, type) <= 0) {
+  if ((m_type != type) and (H5Tequal(m_type, type) <= 0)) {
     dbgInfo(std::cout) << "error: check_append, type=" << type << " start=" << start << " count=" << count << " data_len=" << data_len << std::endl;
     throw std::runtime_error("dset::append, type mismatch");
   }
@@ -232,24 +279,7 @@ void Dset::check_append(hid_t type, hsize_t start, hsize_t count, size_t data_le
 
 
 void Dset::generic_append(hsize_t count, const void *data) {
-  hsize_t start = m_dims.at(0);
-  m_dims.at(0) += count;
-  NONNEG( H5Dset_extent(m_id, &m_dims[0]));
-
-  hid_t filespace = NONNEG( H5Dget_space(m_id) );
-  file_space_select(filespace, start, count);
-
-  std::vector<hsize_t > mem_dims(m_dims);
-  mem_dims.at(0)=count;
-
-  hid_t memspace = NONNEG( H5Screate_simple(int(mem_dims.size()), &mem_dims.at(0), &mem_dims.at(0)));
-  NONNEG( H5Sselect_all(memspace));
-  // print_h5_hyperslab(std::cout, "filespace", filespace);
-  // print_h5_simple(std::cout, "memspace", memspace);
-  NONNEG( H5Dwrite(m_id, m_type, memspace, filespace, H5P_DEFAULT, data));
-
-  NONNEG(H5Sclose(filespace));
-  NONNEG(H5Sclose(memspace));
+  dset_io::append_events(m_id, m_type, int(m_dims.size()), &m_dims.at(0), count, data, m_spaces.get());
 }
 
 
@@ -265,33 +295,20 @@ void Dset::append(hsize_t start, hsize_t count, const std::vector<int64_t> &data
 }
 
 void Dset::generic_read(hsize_t start, hsize_t count, void *data, bool verbose) {
-  hid_t filespace = NONNEG( H5Dget_space(m_id) );
-  file_space_select(filespace, start, count);
-
-  std::vector<hsize_t > mem_dims(m_dims);
-  mem_dims.at(0)=count;
-
-  hid_t memspace = NONNEG( H5Screate_simple(int(mem_dims.size()), &mem_dims.at(0), &mem_dims.at(0)));
-  NONNEG( H5Sselect_all(memspace));
-
-  //  NONNEG( H5Drefresh( id() ) );
-
   if (verbose) {
-    dbgInfo(std::cout);
-    print_h5_hyperslab(std::cout, "filespace", filespace);
-    print_h5_simple(std::cout, "memspace", memspace);
+    dbgInfo(std::cout) << " reading start=" << start << " count=" << count << std::endl;
     std::cout << "data (before): 0x" << std::hex << *(int64_t *)data << std::dec << std::endl;
   }
 
-  NONNEG( H5Dread(m_id, m_type, memspace, filespace, H5P_DEFAULT, data));
+  if (m_mapping) {
+    memcpy(data, m_mapping->events(start), size_t(count) * m_mapping->event_bytes());
+  } else {
+    dset_io::read_events(m_id, m_type, int(m_dims.size()), &m_dims.at(0), start, count, data, m_spaces.get());
+  }
 
   if (verbose) {
     std::cout << "data (after): 0x" << std::hex << *(int64_t *)data << std::dec << std::endl;
   }
-
-  NONNEG(H5Sclose(filespace));
-  NONNEG(H5Sclose(memspace));
-
 }
 
 void Dset::read(hsize_t start, hsize_t count, std::vector<int64_t> &data, bool verbose) {
@@ -312,71 +329,475 @@ void Dset::read(hsize_t start, hsize_t count, std::vector<int16_t> &data, bool v
 }
 
 
+void Dset::append(hsize_t count, const int64_t *data, size_t data_len) {
+  check_append(H5T_NATIVE_INT64, 0, count, data_len);
+  generic_append(count, data);
+}
+
+
+void Dset::append(hsize_t count, const int16_t *data, size_t data_len) {
+  check_append(H5T_NATIVE_INT16, 0, count, data_len);
+  generic_append(count, data);
+}
+
+
+void Dset::read(hsize_t start, hsize_t count, int64_t *data, size_t data_len, bool verbose) {
+  check_read(H5T_NATIVE_INT64, start, count);
+  if (count * event_len() > data_len) throw std::runtime_error("Dset::read - buffer too small");
+  generic_read(start, count, data, verbose);
+}
+
+
+void Dset::read(hsize_t start, hsize_t count, int16_t *data, size_t data_len, bool verbose) {
+  check_read(H5T_NATIVE_INT16, start, count);
+  if (count * event_len() > data_len) throw std::runtime_error("Dset::read - buffer too small");
+  generic_read(start, count, data, verbose);
+}
+
+
+void Dset::generic_read_events(hid_t type, size_t type_bytes, const std::vector<hsize_t> &events, 
+                               void *data, size_t data_len) {
+  if ((m_type != type) and (H5Tequal(m_type, type) <= 0)) {
+    throw std::runtime_error("Dset::read_events, type mismatch");
+  }
+  const size_t len = event_len();
+  if (events.size() * len > data_len) throw std::runtime_error("Dset::read_events - buffer too small");
+  if (events.size() == 0) return;
+
+  if (m_mapping) {
+    char *dest = static_cast<char *>(data);
+    const size_t event_bytes = m_mapping->event_bytes();
+    for (size_t idx = 0; idx < events.size(); ++idx) {
+      if ((idx > 0) and (events[idx] <= events[idx-1])) throw std::runtime_error("Dset::read_events - events not increasing");
+      if (events[idx] >= m_dims.at(0)) throw std::runtime_error("Dset::read_events - event past the end of dset");
+      memcpy(dest + idx * event_bytes, m_mapping->events(events[idx]), event_bytes);
+    }
+    return;
+  }
+
+  size_t chunks_touched = 1;
+  for (size_t idx = 1; (m_chunk_events > 0) and (idx < events.size()); ++idx) {
+    if (events[idx] / m_chunk_events != events[idx-1] / m_chunk_events) ++chunks_touched;
+  }
+
+  if ((m_chunk_events == 0) or (events.size() >= 2 * chunks_touched)) {
+    dset_io::read_event_list(m_id, m_type, int(m_dims.size()), &m_dims.at(0), 
+                             &events.at(0), events.size(), data, m_spaces.get());
+    return;
+  }
+
+  char *dest = static_cast<char *>(data);
+  size_t run_start = 0;
+  for (size_t idx = 1; idx <= events.size(); ++idx) {
+    if ((idx < events.size()) and (events[idx] == events[idx-1] + 1)) continue;
+    hsize_t start = events[run_start], count = hsize_t(idx - run_start);
+    check_read(type, start, count);
+    generic_read(start, count, dest + run_start * len * type_bytes);
+    run_start = idx;
+  }
+}
+
+
+void Dset::read_events(const std::vector<hsize_t> &events, std::vector<int64_t> &data) {
+  data.resize(events.size() * event_len());
+  if (data.size() == 0) return;
+  generic_read_events(H5T_NATIVE_INT64, sizeof(int64_t), events, &data.at(0), data.size());
+}
+
+
+void Dset::read_events(const std::vector<hsize_t> &events, std::vector<int16_t> &data) {
+  data.resize(events.size() * event_len());
+  if (data.size() == 0) return;
+  generic_read_events(H5T_NATIVE_INT16, sizeof(int16_t), events, &data.at(0), data.size());
+}
+
+
+void Dset::read_events(const std::vector<hsize_t> &events, int64_t *data, size_t data_len) {
+  generic_read_events(H5T_NATIVE_INT64, sizeof(int64_t), events, data, data_len);
+}
+
+
+void Dset::read_events(const std::vector<hsize_t> &events, int16_t *data, size_t data_len) {
+  generic_read_events(H5T_NATIVE_INT16, sizeof(int16_t), events, data, data_len);
+}
+
+
+size_t Dset::event_len() const {
+  size_t len = 1;
+  for (size_t idx = 1; idx < m_dims.size(); ++idx) len *= m_dims[idx];
+  return len;
+}
+
+
 void Dset::file_space_select(hid_t file_space, hsize_t start, hsize_t count) {
-  std::vector<hsize_t> start_sel(m_dims.size(), 0), count_sel(m_dims.size(), 1);
-  std::vector<hsize_t> stride(m_dims.size(), 1);
-  std::vector<hsize_t> block(m_dims);
-  block.at(0) = 1;
-  start_sel.at(0) = start;
-  count_sel.at(0) = count;
-  NONNEG(H5Sselect_hyperslab(file_space,
-                             H5S_SELECT_SET,
-                             &start_sel.at(0),  // start,0,0,0
-                             &stride.at(0),     // 1,1,1,1
-                             &count_sel.at(0),  // count,1,1,1
-                             &block.at(0)));    // 1,dims,dims,dims
+  dset_io::select_events(file_space, int(m_dims.size()), &m_dims.at(0), start, count);
 }
 
 
 bool Dset::wait(hsize_t len_to_grow_to, int microseconds_to_pause, int timeout_seconds, bool verbose) {
-  auto t0 = std::chrono::system_clock::now();
-  
-  while (true) {
-    if (m_dims.at(0) >= len_to_grow_to) {
-      if (verbose) {
-        dbgInfo(std::cout) << "wait returning true, len_to_grow_to=" << len_to_grow_to << std::endl;
-      }
-      return true;
+  std::unique_ptr<WaitStrategy> strategy = WaitStrategy::create("fixed", 0, microseconds_to_pause, 0,
+                                                                std::vector<std::string>());
+  return wait(len_to_grow_to, *strategy, timeout_seconds, verbose);
+}
+
+
+bool Dset::wait(hsize_t len_to_grow_to, WaitStrategy &strategy, int timeout_seconds, bool verbose,
+                const std::function<bool()> &cancelled) {
+  WaitStats &stats = strategy.stats();
+  stats.waits += 1;
+  if (m_dims.at(0) >= len_to_grow_to) {
+    stats.immediate += 1;
+    if (verbose) {
+      dbgInfo(std::cout) << "wait returning true, len_to_grow_to=" << len_to_grow_to << std::endl;
     }
+    return true;
+  }
+
+  strategy.begin();
+  auto t0 = std::chrono::steady_clock::now();
+  auto last_check = t0;
 
-    if (microseconds_to_pause > 0) {
-      usleep(microseconds_to_pause);
+  while (true) {
+    strategy.pause();
+    if (cancelled and cancelled()) {
+      stats.cancels += 1;
+      return false;
     }
 
+    auto now = std::chrono::steady_clock::now();
     if (timeout_seconds > 0) {
-      auto t1 = std::chrono::system_clock::now();
-      auto diff = t1-t0;
-      auto seconds = std::chrono::duration_cast<std::chrono::seconds>(diff);
+      auto seconds = std::chrono::duration_cast<std::chrono::seconds>(now - t0);
       if (seconds.count() > timeout_seconds) {
+        stats.timeouts += 1;
         return false;
       }
     }
 
-    const hsize_t GUARD = 0xa0b0c0d0e0f0;
-    NONNEG( H5Drefresh(m_id) );
-    std::vector<hsize_t> old = m_dims;
-    std::vector<hsize_t> new_dims(old.size()+3);
-    new_dims.at(old.size()) = GUARD;
-    NONNEG( H5LDget_dset_dims(m_id, &new_dims.at(0)) );
-    if (new_dims.at(old.size()) != GUARD) {
-      dbgInfo(std::cout) << "ERROR: H5LDget_dset_dims memory corruption, at element " << old.size() 
-                         << " we have the value: 0x" << std::hex << new_dims.at(old.size())
-                         << " but we should have: 0x" << std::hex << GUARD << std::dec << std::endl; 
-    }
-    for (size_t idx=0; idx < m_dims.size(); ++idx) m_dims[idx]=new_dims[idx];
+    hsize_t old_len = m_dims.at(0);
+    refresh();
+    stats.refreshes += 1;
     if (verbose) {
-      dbgInfo(std::cout) << "called H5Drefresh/H5LDget_dset_dims - old=" << old << " new=" << m_dims << std::endl;
+      dbgInfo(std::cout) << "called H5Drefresh - old len=" << old_len << " new=" << m_dims << std::endl;
     }
 
+    if (m_dims.at(0) >= len_to_grow_to) {
+      int64_t latency = std::chrono::duration_cast<std::chrono::microseconds>(now - last_check).count();
+      stats.wakeups += 1;
+      stats.wakeup_latency_total_micro += latency;
+      stats.wakeup_latency_max_micro = std::max(stats.wakeup_latency_max_micro, latency);
+      if (verbose) {
+        dbgInfo(std::cout) << "wait returning true, len_to_grow_to=" << len_to_grow_to << std::endl;
+      }
+      return true;
+    }
+    last_check = now;
   }
 
   return false;
-  
 }
 
+
+const int64_t * Dset::mapped_int64(hsize_t start, hsize_t count) {
+  if (not m_mapping) throw std::runtime_error("Dset::mapped_int64 - dset is not mapped");
+  check_read(H5T_NATIVE_INT64, start, count);
+  return reinterpret_cast<const int64_t *>(m_mapping->events(start));
+}
+
+
+const int16_t * Dset::mapped_int16(hsize_t start, hsize_t count) {
+  if (not m_mapping) throw std::runtime_error("Dset::mapped_int16 - dset is not mapped");
+  check_read(H5T_NATIVE_INT16, start, count);
+  return reinterpret_cast<const int16_t *>(m_mapping->events(start));
+}
+
+
+void Dset::refresh() {
+  dset_io::refresh_dims(m_id, int(m_dims.size()), &m_dims.at(0));
+}
+
+
 void Dset::close() {
+  m_mapping.reset();
+  if (m_spaces) {
+    m_spaces->close();
+    m_spaces.reset();
+  }
   if (m_id >= 0) {
     NONNEG( H5Dclose( m_id) );
     m_id = -1;
   }
 }
+
+
+namespace dset_io {
+
+  void select_events(hid_t space, int rank, const hsize_t *dims, hsize_t start, hsize_t count) {
+    hsize_t start_sel[H5S_MAX_RANK], count_sel[H5S_MAX_RANK], block[H5S_MAX_RANK];
+    for (int idx = 0; idx < rank; ++idx) {
+      start_sel[idx] = 0;
+      count_sel[idx] = 1;
+      block[idx] = dims[idx];
+    }
+    start_sel[0] = start;
+    count_sel[0] = count;
+    block[0] = 1;
+    NONNEG(H5Sselect_hyperslab(space,
+                               H5S_SELECT_SET,
+                               start_sel,  // start,0,0,0
+                               NULL,       // 1,1,1,1
+                               count_sel,  // count,1,1,1
+                               block));    // 1,dims,dims,dims
+  }
+
+
+  void append_events(hid_t dset, hid_t mem_type, int rank, hsize_t *dims, hsize_t count, const void *data,
+                     DsetSpaces *spaces) {
+    if ((rank < 1) or (rank > H5S_MAX_RANK)) throw std::runtime_error("dset_io::append_events - bad rank");
+    hsize_t start = dims[0];
+    dims[0] += count;
+    NONNEG( H5Dset_extent(dset, dims) );
+
+    if (spaces) {
+      // not in the H5Dwrite arguments, their own timers would include it
+      hid_t memspace = spaces->mem_space(dims, count);
+      hid_t filespace = spaces->file_space(dims, start, count);
+      NONNEG( H5Dwrite(dset, mem_type, memspace, filespace, H5P_DEFAULT, data) );
+      return;
+    }
+
+    hid_t filespace = NONNEG( H5Dget_space(dset) );
+    select_events(filespace, rank, dims, start, count);
+
+    hsize_t mem_dims[H5S_MAX_RANK];
+    for (int idx = 0; idx < rank; ++idx) mem_dims[idx] = dims[idx];
+    mem_dims[0] = count;
+    hid_t memspace = NONNEG( H5Screate_simple(rank, mem_dims, NULL) );
+
+    NONNEG( H5Dwrite(dset, mem_type, memspace, filespace, H5P_DEFAULT, data) );
+
+    NONNEG( H5Sclose(filespace) );
+    NONNEG( H5Sclose(memspace) );
+  }
+
+
+  void read_events(hid_t dset, hid_t mem_type, int rank, const hsize_t *dims,
+                   hsize_t start, hsize_t count, void *data, DsetSpaces *spaces) {
+    if ((rank < 1) or (rank > H5S_MAX_RANK)) throw std::runtime_error("dset_io::read_events - bad rank");
+    if (spaces) {
+      hid_t memspace = spaces->mem_space(dims, count);
+      hid_t filespace = spaces->file_space(dims, start, count);
+      NONNEG( H5Dread(dset, mem_type, memspace, filespace, H5P_DEFAULT, data) );
+      return;
+    }
+
+    hid_t filespace = NONNEG( H5Dget_space(dset) );
+    select_events(filespace, rank, dims, start, count);
+
+    hsize_t mem_dims[H5S_MAX_RANK];
+    for (int idx = 0; idx < rank; ++idx) mem_dims[idx] = dims[idx];
+    mem_dims[0] = count;
+    hid_t memspace = NONNEG( H5Screate_simple(rank, mem_dims, NULL) );
+
+    NONNEG( H5Dread(dset, mem_type, memspace, filespace, H5P_DEFAULT, data) );
+
+    NONNEG( H5Sclose(filespace) );
+    NONNEG( H5Sclose(memspace) );
+  }
+
+
+  void select_event_list(hid_t space, int rank, const hsize_t *dims, 
+                         const hsize_t *events, size_t num_events) {
+    if (num_events == 0) {
+      NONNEG( H5Sselect_none(space) );
+      return;
+    }
+    for (size_t idx = 0; idx < num_events; ++idx) {
+      if (events[idx] >= dims[0]) throw std::runtime_error("dset_io::select_event_list - event past the end of the dset");
+      if ((idx > 0) and (events[idx] <= events[idx-1])) {
+        throw std::runtime_error("dset_io::select_event_list - events are not increasing");
+      }
+    }
+
+    hsize_t start[H5S_MAX_RANK], stride[H5S_MAX_RANK], count[H5S_MAX_RANK], block[H5S_MAX_RANK];
+    for (int idx = 0; idx < rank; ++idx) {
+      start[idx] = 0;
+      stride[idx] = 1;
+      count[idx] = 1;
+      block[idx] = dims[idx];
+    }
+
+    hsize_t gap = (num_events > 1) ? events[1] - events[0] : 1;
+    bool evenly_spaced = true;
+    for (size_t idx = 2; evenly_spaced and (idx < num_events); ++idx) {
+      evenly_spaced = (events[idx] - events[idx-1] == gap);
+    }
+    if (evenly_spaced) {
+      start[0] = events[0];
+      stride[0] = gap;
+      count[0] = num_events;
+      block[0] = 1;
+      NONNEG( H5Sselect_hyperslab(space, H5S_SELECT_SET, start, stride, count, block) );
+      return;
+    }
+
+    if (rank == 1) {
+      // a point per event is cheaper to build than or'ing hyperslabs
+      NONNEG( H5Sselect_elements(space, H5S_SELECT_SET, num_events, events) );
+      return;
+    }
+
+    H5S_seloper_t op = H5S_SELECT_SET;
+    size_t run_start = 0;
+    for (size_t idx = 1; idx <= num_events; ++idx) {
+      if ((idx < num_events) and (events[idx] == events[idx-1] + 1)) continue;
+      start[0] = events[run_start];
+      block[0] = hsize_t(idx - run_start);
+      NONNEG( H5Sselect_hyperslab(space, op, start, stride, count, block) );
+      op = H5S_SELECT_OR;
+      run_start = idx;
+    }
+  }
+
+
+  void read_event_list(hid_t dset, hid_t mem_type, int rank, const hsize_t *dims,
+                       const hsize_t *events, size_t num_events, void *data, DsetSpaces *spaces) {
+    if ((rank < 1) or (rank > H5S_MAX_RANK)) throw std::runtime_error("dset_io::read_event_list - bad rank");
+    if (spaces) {
+      hid_t filespace = spaces->extent_space(dims);
+      select_event_list(filespace, rank, dims, events, num_events);
+      hid_t memspace = spaces->mem_space(dims, num_events);
+      NONNEG( H5Dread(dset, mem_type, memspace, filespace, H5P_DEFAULT, data) );
+      return;
+    }
+
+    hid_t filespace = NONNEG( H5Dget_space(dset) );
+    select_event_list(filespace, rank, dims, events, num_events);
+
+    hsize_t mem_dims[H5S_MAX_RANK];
+    for (int idx = 0; idx < rank; ++idx) mem_dims[idx] = dims[idx];
+    mem_dims[0] = num_events;
+    hid_t memspace = NONNEG( H5Screate_simple(rank, mem_dims, NULL) );
+
+    NONNEG( H5Dread(dset, mem_type, memspace, filespace, H5P_DEFAULT, data) );
+
+    NONNEG( H5Sclose(filespace) );
+    NONNEG( H5Sclose(memspace) );
+  }
+
+
+  void refresh_dims(hid_t dset, int rank, hsize_t *dims) {
+    NONNEG( H5Drefresh(dset) );
+    hid_t space_id = NONNEG( H5Dget_space(dset) );
+    int space_rank = NONNEG( H5Sget_simple_extent_ndims(space_id) );
+    if (space_rank != rank) {
+      NONNEG( H5Sclose(space_id) );
+      throw std::runtime_error("dset_io::refresh_dims - rank changed");
+    }
+    NONNEG( H5Sget_simple_extent_dims(space_id, dims, NULL) );
+    NONNEG( H5Sclose(space_id) );
+  }
+
+}
+
+
+DsetSpaces::DsetSpaces(int rank, bool is_virtual) :
+  m_rank(rank),
+  m_shift_selection(not is_virtual),
+  m_file_space(-1),
+  m_selected_count(0)
+{
+  if ((rank < 1) or (rank > H5S_MAX_RANK)) throw std::runtime_error("DsetSpaces - bad rank");
+  for (int idx = 0; idx < H5S_MAX_RANK; ++idx) m_file_extent[idx] = 0;
+}
+
+
+DsetSpaces::~DsetSpaces() {
+  // no NONNEG, don't throw from a destructor
+  if (m_file_space >= 0) H5Sclose(m_file_space);
+  for (auto iter = m_mem_spaces.begin(); iter != m_mem_spaces.end(); ++iter) {
+    H5Sclose(iter->second);
+  }
+}
+
+
+void DsetSpaces::close() {
+  if (m_file_space >= 0) {
+    NONNEG( H5Sclose(m_file_space) );
+    m_file_space = -1;
+  }
+  m_selected_count = 0;
+  for (auto iter = m_mem_spaces.begin(); iter != m_mem_spaces.end(); ++iter) {
+    NONNEG( H5Sclose(iter->second) );
+  }
+  m_mem_spaces.clear();
+}
+
+
+void DsetSpaces::set_extent(const hsize_t *dims) {
+  bool same_extent = (m_file_space >= 0);
+  for (int idx = 0; same_extent and (idx < m_rank); ++idx) {
+    same_extent = (m_file_extent[idx] == dims[idx]);
+  }
+  if (same_extent) return;
+
+  if (m_file_space < 0) {
+    m_file_space = NONNEG( H5Screate_simple(m_rank, dims, NULL) );
+  } else {
+    NONNEG( H5Sset_extent_simple(m_file_space, m_rank, dims, NULL) );
+  }
+  for (int idx = 0; idx < m_rank; ++idx) m_file_extent[idx] = dims[idx];
+  m_selected_count = 0;
+}
+
+
+hid_t DsetSpaces::file_space(const hsize_t *dims, hsize_t start, hsize_t count) {
+  set_extent(dims);
+
+  if (not m_shift_selection) {
+    dset_io::select_events(m_file_space, m_rank, dims, start, count);
+    return m_file_space;
+  }
+
+  if (m_selected_count != count) {
+    dset_io::select_events(m_file_space, m_rank, dims, 0, count);
+    m_selected_count = count;
+  }
+  hssize_t offset[H5S_MAX_RANK];
+  offset[0] = hssize_t(start);
+  for (int idx = 1; idx < m_rank; ++idx) offset[idx] = 0;
+  NONNEG( H5Soffset_simple(m_file_space, offset) );
+  return m_file_space;
+}
+
+
+hid_t DsetSpaces::extent_space(const hsize_t *dims) {
+  set_extent(dims);
+  if (m_shift_selection) {
+    hssize_t offset[H5S_MAX_RANK];
+    for (int idx = 0; idx < m_rank; ++idx) offset[idx] = 0;
+    NONNEG( H5Soffset_simple(m_file_space, offset) );
+  }
+  // the caller replaces the selection
+  m_selected_count = 0;
+  return m_file_space;
+}
+
+
+hid_t DsetSpaces::mem_space(const hsize_t *dims, hsize_t count) {
+  auto pos = m_mem_spaces.find(count);
+  if (pos != m_mem_spaces.end()) return pos->second;
+
+  if (m_mem_spaces.size() >= MAX_MEM_SPACES) {
+    for (auto iter = m_mem_spaces.begin(); iter != m_mem_spaces.end(); ++iter) {
+      NONNEG( H5Sclose(iter->second) );
+    }
+    m_mem_spaces.clear();
+  }
+
+  hsize_t mem_dims[H5S_MAX_RANK];
+  for (int idx = 0; idx < m_rank; ++idx) mem_dims[idx] = dims[idx];
+  mem_dims[0] = count;
+  hid_t space = NONNEG( H5Screate_simple(m_rank, mem_dims, NULL) );
+  m_mem_spaces[count] = space;
+  return space;
+}
@@ -0,0 +1,49 @@
+#include <algorithm>
+#include <stdexcept>
+
+#include "DsetAppendBuffer.h"
+#include "check_macros.h"
+
+
+DsetAppendBuffer::DsetAppendBuffer() :
+  m_batch_events(1),
+  m_values_per_event(1)
+{}
+
+
+DsetAppendBuffer::DsetAppendBuffer(const Dset &dset, size_t batch_events) :
+  m_dset(dset),
+  m_batch_events(std::max(size_t(1), batch_events)),
+  m_values_per_event(1)
+{
+  const std::vector<hsize_t> &dims = m_dset.dim();
+  for (size_t idx = 1; idx < dims.size(); ++idx) m_values_per_event *= dims.at(idx);
+  m_buffer.reserve(m_batch_events * m_values_per_event);
+}
+
+
+void DsetAppendBuffer::push(int64_t value) {
+  if (m_values_per_event != 1) throw std::runtime_error("DsetAppendBuffer::push - dataset is not 1D");
+  m_buffer.push_back(value);
+  if (m_buffer.size() >= m_batch_events) flush();
+}
+
+
+void DsetAppendBuffer::push(const int64_t *values) {
+  m_buffer.insert(m_buffer.end(), values, values + m_values_per_event);
+  if (m_buffer.size() >= m_batch_events * m_values_per_event) flush();
+}
+
+
+void DsetAppendBuffer::flush() {
+  if (m_buffer.size() == 0) return;
+  m_dset.append(0, buffered_events(), m_buffer);
+  NONNEG( H5Dflush(m_dset.id()) );
+  m_buffer.clear();
+}
+
+
+void DsetAppendBuffer::close() {
+  flush();
+  m_dset.close();
+}
@@ -0,0 +1,73 @@
+#include <stdexcept>
+
+#include "DsetBatch.h"
+#include "check_macros.h"
+
+#if H5_VERSION_GE(1, 14, 0)
+#define LC2_HAVE_H5DREAD_MULTI 1
+#else
+#define LC2_HAVE_H5DREAD_MULTI 0
+#endif
+
+
+bool DsetBatch::uses_read_multi() {
+  return LC2_HAVE_H5DREAD_MULTI;
+}
+
+
+void DsetBatch::add(Dset &dset, hsize_t start, hsize_t count, int64_t *data, size_t data_len) {
+  add(dset, H5T_NATIVE_INT64, start, count, data, data_len);
+}
+
+
+void DsetBatch::add(Dset &dset, hsize_t start, hsize_t count, int16_t *data, size_t data_len) {
+  add(dset, H5T_NATIVE_INT16, start, count, data, data_len);
+}
+
+
+void DsetBatch::add(Dset &dset, hid_t type, hsize_t start, hsize_t count, void *data, size_t data_len) {
+  dset.check_read(type, start, count);
+  if (count * dset.event_len() > data_len) throw std::runtime_error("DsetBatch::add - buffer too small");
+  if (not dset.m_spaces) throw std::runtime_error("DsetBatch::add - dset is not open");
+  if (not m_in_batch.insert(dset.m_spaces.get()).second) {
+    throw std::runtime_error("DsetBatch::add - dset is already in the batch");
+  }
+
+  Request request;
+  request.dset = dset.m_id;
+  request.mem_type = dset.m_type;
+  request.rank = int(dset.m_dims.size());
+  request.dims = &dset.m_dims.at(0);
+  request.spaces = dset.m_spaces.get();
+  request.start = start;
+  request.count = count;
+  request.data = data;
+  m_requests.push_back(request);
+}
+
+
+void DsetBatch::read() {
+  if (m_requests.size() == 0) return;
+
+#if LC2_HAVE_H5DREAD_MULTI
+  m_dset_ids.clear();
+  m_mem_types.clear();
+  m_mem_spaces.clear();
+  m_file_spaces.clear();
+  m_buffers.clear();
+  for (auto iter = m_requests.begin(); iter != m_requests.end(); ++iter) {
+    m_dset_ids.push_back(iter->dset);
+    m_mem_types.push_back(iter->mem_type);
+    m_mem_spaces.push_back(iter->spaces->mem_space(iter->dims, iter->count));
+    m_file_spaces.push_back(iter->spaces->file_space(iter->dims, iter->start, iter->count));
+    m_buffers.push_back(iter->data);
+  }
+  NONNEG( H5Dread_multi(m_requests.size(), &m_dset_ids.at(0), &m_mem_types.at(0),
+                        &m_mem_spaces.at(0), &m_file_spaces.at(0), H5P_DEFAULT, &m_buffers.at(0)) );
+#else
+  for (auto iter = m_requests.begin(); iter != m_requests.end(); ++iter) {
+    dset_io::read_events(iter->dset, iter->mem_type, iter->rank, iter->dims,
+                         iter->start, iter->count, iter->data, iter->spaces);
+  }
+#endif
+}
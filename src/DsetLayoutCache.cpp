@@ -0,0 +1,272 @@
+#include <algorithm>
+#include <set>
+#include <stdexcept>
+
+#include "DsetLayoutCache.h"
+#include "ChunkCachePolicy.h"
+#include "check_macros.h"
+
+
+DsetLayout::DsetLayout() :
+  layout(H5D_LAYOUT_ERROR),
+  h5type(-1),
+  rank(0),
+  num_vds_mappings(1),
+  chunks_per_event(1)
+{}
+
+
+DsetLayoutCache::DsetLayoutCache() :
+  m_hits(0),
+  m_misses(0),
+  m_file_opens(0)
+{}
+
+
+DsetLayoutCache & DsetLayoutCache::instance() {
+  static DsetLayoutCache cache;
+  return cache;
+}
+
+
+bool DsetLayoutCache::lookup(const Key &key, DsetLayout &layout) {
+  auto pos = m_layouts.find(key);
+  if (pos == m_layouts.end()) {
+    ++m_misses;
+    return false;
+  }
+  ++m_hits;
+  layout = pos->second;
+  return true;
+}
+
+
+void DsetLayoutCache::insert(const Key &key, const DsetLayout &layout) {
+  m_layouts[key] = layout;
+}
+
+
+namespace {
+  const char *LAYOUT_ATTR = "lc2_layout";
+  // layout, type bits, rank, num_vds_mappings, chunks_per_event, then the chunk
+  const size_t LAYOUT_FIELDS = 5;
+}
+
+
+unsigned long DsetLayoutCache::file_number(hid_t obj) {
+#if H5_VERSION_GE(1, 12, 0)
+  H5O_info2_t info;
+  NONNEG( H5Oget_info3(obj, &info, H5O_INFO_BASIC) );
+#elif H5_VERSION_GE(1, 10, 3)
+  H5O_info_t info;
+  NONNEG( H5Oget_info2(obj, &info, H5O_INFO_BASIC) );
+#else
+  H5O_info_t info;
+  NONNEG( H5Oget_info(obj, &info) );
+#endif
+  return info.fileno;
+}
+
+
+void DsetLayoutCache::store(hid_t dset, const DsetLayout &layout) {
+  std::vector<int64_t> values(LAYOUT_FIELDS);
+  values.at(0) = int64_t(layout.layout);
+  values.at(1) = 0;
+  if (layout.h5type == H5T_NATIVE_INT64) values.at(1) = 64;
+  if (layout.h5type == H5T_NATIVE_INT16) values.at(1) = 16;
+  values.at(2) = layout.rank;
+  values.at(3) = int64_t(layout.num_vds_mappings);
+  values.at(4) = int64_t(layout.chunks_per_event);
+  for (size_t idx = 0; idx < layout.chunk.size(); ++idx) values.push_back(int64_t(layout.chunk.at(idx)));
+
+  hsize_t len = values.size();
+  hid_t space = NONNEG( H5Screate_simple(1, &len, NULL) );
+  hid_t attr = NONNEG( H5Acreate2(dset, LAYOUT_ATTR, H5T_STD_I64LE, space, H5P_DEFAULT, H5P_DEFAULT) );
+  NONNEG( H5Awrite(attr, H5T_NATIVE_INT64, &values.at(0)) );
+  NONNEG( H5Aclose(attr) );
+  NONNEG( H5Sclose(space) );
+}
+
+
+bool DsetLayoutCache::stored(hid_t parent, const char *name, DsetLayout &layout, hid_t &attr) {
+  attr = -1;
+  H5E_BEGIN_TRY {
+    attr = H5Aopen_by_name(parent, name, LAYOUT_ATTR, H5P_DEFAULT, H5P_DEFAULT);
+  } H5E_END_TRY;
+  if (attr < 0) return false;
+
+  hid_t space = NONNEG( H5Aget_space(attr) );
+  hssize_t len = NONNEG( H5Sget_simple_extent_npoints(space) );
+  NONNEG( H5Sclose(space) );
+  std::vector<int64_t> values(std::max(hssize_t(LAYOUT_FIELDS), len));
+  NONNEG( H5Aread(attr, H5T_NATIVE_INT64, &values.at(0)) );
+  const size_t rank = size_t(values.at(2));
+  if (size_t(len) != LAYOUT_FIELDS + (values.at(0) == H5D_CONTIGUOUS ? 0 : rank)) {
+    NONNEG( H5Aclose(attr) );
+    attr = -1;
+    return false;
+  }
+
+  layout = DsetLayout();
+  layout.layout = H5D_layout_t(values.at(0));
+  if (values.at(1) == 64) layout.h5type = H5T_NATIVE_INT64;
+  if (values.at(1) == 16) layout.h5type = H5T_NATIVE_INT16;
+  layout.rank = int(rank);
+  layout.num_vds_mappings = size_t(values.at(3));
+  layout.chunks_per_event = size_t(values.at(4));
+  layout.chunk.assign(values.begin() + LAYOUT_FIELDS, values.begin() + len);
+  return true;
+}
+
+
+DsetLayoutCache::Key DsetLayoutCache::key_for(hid_t parent, const char *name) {
+  std::string path(name);
+  if ((path.size() == 0) or (path.at(0) != '/')) {
+    ssize_t parent_len = NONNEG( H5Iget_name(parent, NULL, 0) );
+    std::string parent_path(parent_len + 1, '\0');
+    NONNEG( H5Iget_name(parent, &parent_path.at(0), parent_len + 1) );
+    parent_path.resize(parent_len);
+    if ((parent_path.size() == 0) or (*parent_path.rbegin() != '/')) parent_path += "/";
+    path = parent_path + path;
+  }
+  return Key(file_number(parent), path);
+}
+
+
+DsetLayout DsetLayoutCache::describe(hid_t dset) {
+  DsetLayout result;
+
+  hid_t dspace_id = NONNEG(H5Dget_space(dset));
+  result.rank = NONNEG(H5Sget_simple_extent_ndims(dspace_id));
+  // only the first dim grows, the event dims are fixed at create
+  std::vector<hsize_t> dims(result.rank);
+  if (result.rank > 0) NONNEG(H5Sget_simple_extent_dims(dspace_id, &dims.at(0), NULL));
+  NONNEG(H5Sclose(dspace_id));
+
+  hid_t type = NONNEG(H5Dget_type(dset));
+  if (H5Tequal(type, H5T_NATIVE_INT64) >= 1) {
+    result.h5type = H5T_NATIVE_INT64;
+  } else if (H5Tequal(type, H5T_NATIVE_INT16) >= 1) {
+    result.h5type = H5T_NATIVE_INT16;
+  }
+  NONNEG(H5Tclose(type));
+
+  hid_t proplist = NONNEG(H5Dget_create_plist(dset));
+  result.layout = NONNEG( H5Pget_layout( proplist ) );
+
+  if (result.layout == H5D_CHUNKED) {
+    result.chunk.resize(result.rank);
+    NONNEG(H5Pget_chunk(proplist, result.rank, &result.chunk.at(0)));
+  } else if (result.layout == H5D_VIRTUAL) {
+    // hdf5 refuses to open a file SWMR and not SWMR at the same time, so
+    // open the sources the way the VDS file was opened
+    hid_t vds_fid = NONNEG( H5Iget_file_id(dset) );
+    unsigned intent = 0;
+    NONNEG( H5Fget_intent(vds_fid, &intent) );
+    NONNEG( H5Fclose(vds_fid) );
+    unsigned flags = H5F_ACC_RDONLY;
+    if (intent & H5F_ACC_SWMR_READ) flags |= H5F_ACC_SWMR_READ;
+
+    size_t num_map;
+    NONNEG( H5Pget_virtual_count( proplist, &num_map) );
+
+    for (size_t ii = 0; ii < num_map; ++ii) {
+
+      ssize_t filename_len = NONNEG( H5Pget_virtual_filename( proplist, ii, NULL, 0) );
+      std::string filename(filename_len+1, '\0');
+      NONNEG( H5Pget_virtual_filename( proplist, ii, &filename.at(0), filename_len+1) );
+      filename.resize(filename_len);
+
+      ssize_t dset_len = NONNEG( H5Pget_virtual_dsetname( proplist, ii, NULL, 0) );
+      std::string dsetname(dset_len+1, '\0');
+      NONNEG( H5Pget_virtual_dsetname( proplist, ii, &dsetname.at(0), dset_len+1) );
+      dsetname.resize(dset_len);
+
+      const DsetLayout &src = source_layout(filename, dsetname, flags);
+      if (src.layout != H5D_CHUNKED) {
+        throw std::runtime_error("DsetLayoutCache - VDS source is not chunked");
+      }
+      if (ii == 0) {
+        result.chunk = src.chunk;
+      } else if (result.chunk != src.chunk) {
+        throw std::runtime_error("chunks across mappings in VDS not equal");
+      }
+    }
+    result.num_vds_mappings = num_map;
+  }
+  if (result.chunk.size() == dims.size()) {
+    result.chunks_per_event = ChunkCachePolicy::chunks_per_event(dims, result.chunk);
+  }
+
+  NONNEG(H5Pclose(proplist));
+  return result;
+}
+
+
+const DsetLayout & DsetLayoutCache::source_layout(const std::string &fname, const std::string &dset_path,
+                                                  unsigned flags) {
+  hid_t fid = source_file(fname, flags);
+  Key key(file_number(fid), dset_path);
+  auto pos = m_layouts.find(key);
+  if (pos != m_layouts.end()) {
+    ++m_hits;
+    return pos->second;
+  }
+  ++m_misses;
+
+  hid_t dset = NONNEG(H5Dopen2(fid, dset_path.c_str(), H5P_DEFAULT));
+  DsetLayout layout = describe(dset);
+  NONNEG(H5Dclose(dset));
+
+  m_layouts[key] = layout;
+  return m_layouts[key];
+}
+
+
+hid_t DsetLayoutCache::source_file(const std::string &fname, unsigned flags) {
+  auto pos = m_files.find(fname);
+  if (pos != m_files.end()) return pos->second;
+  hid_t fid = POS( H5Fopen(fname.c_str(), flags, H5P_DEFAULT) );
+  ++m_file_opens;
+  m_files[fname] = fid;
+  return fid;
+}
+
+
+void DsetLayoutCache::release_files() {
+  for (auto iter = m_files.begin(); iter != m_files.end(); ++iter) {
+    NONNEG( H5Fclose( iter->second ) );
+  }
+  m_files.clear();
+  drop_closed_files();
+}
+
+
+// a file number is not reused, once its file is closed its entries can
+// never be looked up again
+void DsetLayoutCache::drop_closed_files() {
+  if (m_layouts.empty()) return;
+  std::set<unsigned long> open_files;
+  ssize_t num_files = NONNEG( H5Fget_obj_count(H5F_OBJ_ALL, H5F_OBJ_FILE) );
+  if (num_files > 0) {
+    std::vector<hid_t> fids(num_files);
+    num_files = NONNEG( H5Fget_obj_ids(H5F_OBJ_ALL, H5F_OBJ_FILE, fids.size(), &fids.at(0)) );
+    for (ssize_t idx = 0; idx < num_files; ++idx) open_files.insert(file_number(fids.at(idx)));
+  }
+  for (auto iter = m_layouts.begin(); iter != m_layouts.end(); ) {
+    if (open_files.count(iter->first.first) == 0) {
+      iter = m_layouts.erase(iter);
+    } else {
+      ++iter;
+    }
+  }
+}
+
+
+void DsetLayoutCache::clear() {
+  release_files();
+  m_layouts.clear();
+  m_hits = 0;
+  m_misses = 0;
+  m_file_opens = 0;
+}
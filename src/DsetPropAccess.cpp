@@ -1,36 +1,44 @@
+#include <stdexcept>
+
 #include "DsetPropAccess.h"
+#include "BitshuffleFilter.h"
 #include "check_macros.h"
 
 
-DsetPropAccess::DsetPropAccess(std::string _name, hid_t _h5type, const std::vector<hsize_t> & _chunk_dims) :
+DsetFilter dset_filter_from_name(const std::string &name) {
+  if (name == "none") return filter_none;
+  if (name == "bitshuffle_lz4") return filter_bitshuffle_lz4;
+  throw std::runtime_error("unknown dataset filter: " + name);
+}
+
+
+DsetPropAccess::DsetPropAccess(std::string _name, hid_t _h5type, const std::vector<hsize_t> & _chunk_dims,
+                               const ChunkCachePolicy &cache_policy,
+                               size_t chunks_per_event,
+                               DsetFilter _filter) :
   name(_name),
   h5type(_h5type),
   access(H5P_DEFAULT),
   proplist(H5P_DEFAULT),
-  chunk_dims(_chunk_dims)
+  chunk_dims(_chunk_dims),
+  filter(_filter)
 {
   int rank = int(chunk_dims.size());
   hid_t new_plist = NONNEG( H5Pcreate(H5P_DATASET_CREATE) );
   NONNEG( H5Pset_chunk(new_plist, rank, &chunk_dims.at(0)) );
+  if (filter == filter_bitshuffle_lz4) {
+    // the element size is filled in from the type when the dataset is made
+    bitshuffle::register_filter();
+    NONNEG( H5Pset_filter(new_plist, LC2_FILTER_BITSHUFFLE_LZ4, H5Z_FLAG_MANDATORY, 0, NULL) );
+  }
   proplist = new_plist;
-  access = create_access_for_chunk_cache();
+  access = create_access_for_chunk_cache(cache_policy, chunks_per_event);
 }
 
 
-hid_t DsetPropAccess::create_access_for_chunk_cache() {
+hid_t DsetPropAccess::create_access_for_chunk_cache(const ChunkCachePolicy &cache_policy, size_t chunks_per_event) {
   hid_t new_access = NONNEG( H5Pcreate(H5P_DATASET_ACCESS) );
-  size_t type_size_bytes = NONNEG( H5Tget_size( h5type ) );
-
-  hsize_t num_elements_in_a_chunk = 1;
-  for (auto iter = chunk_dims.begin(); iter != chunk_dims.end(); ++iter) {
-    num_elements_in_a_chunk *= *iter;
-  }
-  hsize_t num_bytes_in_a_chunk = type_size_bytes * num_elements_in_a_chunk;
-
-  size_t rdcc_nslots = 101;
-  size_t rdcc_nbytes = num_bytes_in_a_chunk * 3;
-  double rdcc_w0 = 0.75;
-  NONNEG(H5Pset_chunk_cache(new_access, rdcc_nslots, rdcc_nbytes, rdcc_w0) );
+  cache_policy.apply(new_access, h5type, chunk_dims, 1, chunks_per_event);
   return new_access;
 }
 
@@ -0,0 +1,175 @@
+#include <stdexcept>
+
+#include "EventTable.h"
+#include "DsetPropAccess.h"
+#include "check_macros.h"
+
+const size_t EventTable::FIDUCIAL;
+const size_t EventTable::MILLI;
+const size_t EventTable::NANO;
+const size_t EventTable::SMALL;
+
+namespace {
+
+  // the length of the int64 array member name, 0 if the type does not have it
+  size_t array_member_len(hid_t compound, const char *name) {
+    int idx = H5Tget_member_index(compound, name);
+    if (idx < 0) return 0;
+    hid_t member = NONNEG( H5Tget_member_type(compound, unsigned(idx)) );
+    hsize_t len = 0;
+    if ((H5Tget_class(member) != H5T_ARRAY) or (H5Tget_array_ndims(member) != 1)) {
+      NONNEG( H5Tclose(member) );
+      throw std::runtime_error(std::string("EventTable - member is not a 1d array: ") + name);
+    }
+    NONNEG( H5Tget_array_dims2(member, &len) );
+    NONNEG( H5Tclose(member) );
+    return size_t(len);
+  }
+
+  void insert_array(hid_t compound, const char *name, size_t offset, size_t len) {
+    if (len == 0) return;
+    hsize_t dims[1] = {len};
+    hid_t array = NONNEG( H5Tarray_create2(H5T_NATIVE_INT64, 1, dims) );
+    NONNEG( H5Tinsert(compound, name, offset, array) );
+    NONNEG( H5Tclose(array) );
+  }
+
+}
+
+
+EventTable::EventTable() :
+  m_num_small(0),
+  m_num_vlen(0),
+  m_rows(-1),
+  m_blob(-1),
+  m_row_type(-1)
+{
+  m_rows_dims[0] = 0;
+  m_blob_dims[0] = 0;
+}
+
+
+hid_t EventTable::row_type(size_t num_small, size_t num_vlen) {
+  const size_t value_bytes = sizeof(int64_t);
+  hid_t compound = NONNEG( H5Tcreate(H5T_COMPOUND, (SMALL + num_small + 2 * num_vlen) * value_bytes) );
+  NONNEG( H5Tinsert(compound, "fiducial", FIDUCIAL * value_bytes, H5T_NATIVE_INT64) );
+  NONNEG( H5Tinsert(compound, "milli", MILLI * value_bytes, H5T_NATIVE_INT64) );
+  NONNEG( H5Tinsert(compound, "nano", NANO * value_bytes, H5T_NATIVE_INT64) );
+  insert_array(compound, "small", SMALL * value_bytes, num_small);
+  insert_array(compound, "vlen_start", (SMALL + num_small) * value_bytes, num_vlen);
+  insert_array(compound, "vlen_count", (SMALL + num_small + num_vlen) * value_bytes, num_vlen);
+  return compound;
+}
+
+
+EventTable EventTable::create(hid_t parent, size_t num_small, size_t num_vlen,
+                              hsize_t rows_per_chunk, hsize_t blob_chunk) {
+  EventTable table;
+  table.m_num_small = num_small;
+  table.m_num_vlen = num_vlen;
+  table.m_row_type = row_type(num_small, num_vlen);
+
+  hsize_t start_dims[1] = {0}, max_dims[1] = {H5S_UNLIMITED};
+  hid_t space = NONNEG( H5Screate_simple(1, start_dims, max_dims) );
+
+  DsetPropAccess rows_create("events", table.m_row_type, std::vector<hsize_t>(1, rows_per_chunk));
+  table.m_rows = NONNEG( H5Dcreate2(parent, "events", table.m_row_type, space, H5P_DEFAULT,
+                                    rows_create.proplist, rows_create.access) );
+  rows_create.close();
+
+  DsetPropAccess blob_create("blob", H5T_NATIVE_INT64, std::vector<hsize_t>(1, blob_chunk));
+  table.m_blob = NONNEG( H5Dcreate2(parent, "blob", H5T_NATIVE_INT64, space, H5P_DEFAULT,
+                                    blob_create.proplist, blob_create.access) );
+  blob_create.close();
+  NONNEG( H5Sclose(space) );
+
+  table.m_rows_spaces = std::make_shared<DsetSpaces>(1, false);
+  table.m_blob_spaces = std::make_shared<DsetSpaces>(1, false);
+  return table;
+}
+
+
+EventTable EventTable::open(hid_t parent) {
+  EventTable table;
+  table.m_rows = NONNEG( H5Dopen2(parent, "events", H5P_DEFAULT) );
+  table.m_blob = NONNEG( H5Dopen2(parent, "blob", H5P_DEFAULT) );
+
+  hid_t file_type = NONNEG( H5Dget_type(table.m_rows) );
+  if (H5Tget_class(file_type) != H5T_COMPOUND) {
+    NONNEG( H5Tclose(file_type) );
+    throw std::runtime_error("EventTable::open - events is not a compound dataset");
+  }
+  table.m_num_small = array_member_len(file_type, "small");
+  table.m_num_vlen = array_member_len(file_type, "vlen_start");
+  NONNEG( H5Tclose(file_type) );
+  table.m_row_type = row_type(table.m_num_small, table.m_num_vlen);
+
+  table.m_rows_spaces = std::make_shared<DsetSpaces>(1, false);
+  table.m_blob_spaces = std::make_shared<DsetSpaces>(1, false);
+  table.refresh();
+  return table;
+}
+
+
+void EventTable::close() {
+  if (m_rows_spaces) {
+    m_rows_spaces->close();
+    m_rows_spaces.reset();
+  }
+  if (m_blob_spaces) {
+    m_blob_spaces->close();
+    m_blob_spaces.reset();
+  }
+  if (m_rows >= 0) NONNEG( H5Dclose(m_rows) );
+  if (m_blob >= 0) NONNEG( H5Dclose(m_blob) );
+  if (m_row_type >= 0) NONNEG( H5Tclose(m_row_type) );
+  m_rows = m_blob = m_row_type = -1;
+}
+
+
+void EventTable::append(hsize_t count, int64_t *rows, const int64_t *blob, size_t blob_len) {
+  const size_t len = row_len();
+  const size_t start_col = vlen_start_column(), count_col = vlen_count_column();
+  int64_t next_start = int64_t(m_blob_dims[0]);
+  for (hsize_t row = 0; row < count; ++row) {
+    int64_t *values = rows + row * len;
+    for (size_t vlen = 0; vlen < m_num_vlen; ++vlen) {
+      values[start_col + vlen] = next_start;
+      next_start += values[count_col + vlen];
+    }
+  }
+  if (size_t(next_start - int64_t(m_blob_dims[0])) != blob_len) {
+    throw std::runtime_error("EventTable::append - vlen_count does not add up to blob_len");
+  }
+  if (blob_len > 0) {
+    dset_io::append_events(m_blob, H5T_NATIVE_INT64, 1, m_blob_dims, blob_len, blob, m_blob_spaces.get());
+  }
+  if (count > 0) {
+    dset_io::append_events(m_rows, m_row_type, 1, m_rows_dims, count, rows, m_rows_spaces.get());
+  }
+}
+
+
+void EventTable::read(hsize_t start, hsize_t count, int64_t *rows) {
+  if (start + count > m_rows_dims[0]) throw std::runtime_error("EventTable::read - past the end of events");
+  dset_io::read_events(m_rows, m_row_type, 1, m_rows_dims, start, count, rows, m_rows_spaces.get());
+}
+
+
+void EventTable::read_blob(hsize_t start, hsize_t count, int64_t *blob) {
+  if (start + count > m_blob_dims[0]) throw std::runtime_error("EventTable::read_blob - past the end of blob");
+  if (count == 0) return;
+  dset_io::read_events(m_blob, H5T_NATIVE_INT64, 1, m_blob_dims, start, count, blob, m_blob_spaces.get());
+}
+
+
+void EventTable::refresh() {
+  dset_io::refresh_dims(m_blob, 1, m_blob_dims);
+  dset_io::refresh_dims(m_rows, 1, m_rows_dims);
+}
+
+
+void EventTable::flush() {
+  NONNEG( H5Dflush(m_blob) );
+  NONNEG( H5Dflush(m_rows) );
+}
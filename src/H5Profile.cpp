@@ -0,0 +1,154 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <vector>
+#include <unistd.h>
+
+#include "H5Profile.h"
+
+namespace {
+
+  struct Registry {
+    std::mutex mutex;
+    std::vector<H5ProfileSite *> sites;
+    std::string output;
+  };
+
+  // never destroyed, sites can be recorded into from other static destructors
+  Registry & registry() {
+    static Registry *reg = new Registry();
+    return *reg;
+  }
+
+  void dump_at_exit() {
+    H5Profile::dump();
+  }
+
+  int bucket(uint64_t ns) {
+    int log2 = 0;
+    while ((ns >>= 1) != 0) ++log2;
+    return std::min(log2, H5ProfileSite::NUM_BUCKETS - 1);
+  }
+
+  // "H5Dread(dset, ...)" -> "H5Dread"
+  std::string function_name(const char *expression) {
+    std::string name(expression);
+    size_t paren = name.find('(');
+    if (paren != std::string::npos) name = name.substr(0, paren);
+    size_t first = name.find_first_not_of(" \t");
+    size_t last = name.find_last_not_of(" \t");
+    if (first == std::string::npos) return name;
+    return name.substr(first, last - first + 1);
+  }
+
+  struct Totals {
+    uint64_t calls, total_ns, max_ns;
+    Totals() : calls(0), total_ns(0), max_ns(0) {}
+  };
+
+  void write_totals(FILE *fp, const char *key, const std::string &value, const Totals &totals) {
+    fprintf(fp, "%s=%s calls=%llu total_us=%.1f mean_us=%.3f max_us=%.1f",
+            key, value.c_str(), (unsigned long long)totals.calls,
+            totals.total_ns / 1e3,
+            totals.calls > 0 ? totals.total_ns / 1e3 / totals.calls : 0.0,
+            totals.max_ns / 1e3);
+  }
+}
+
+
+thread_local H5Profile::Timer *H5Profile::Timer::s_active = NULL;
+
+
+void H5ProfileSite::record(uint64_t ns) {
+  ++calls;
+  total_ns += ns;
+  max_ns = std::max(max_ns, ns);
+  ++histogram[bucket(ns)];
+}
+
+
+H5ProfileSite *H5Profile::site(const char *expression, const char *file, int line) {
+  Registry &reg = registry();
+  std::lock_guard<std::mutex> lock(reg.mutex);
+  if (reg.sites.size() == 0) atexit(dump_at_exit);
+  H5ProfileSite *site = new H5ProfileSite();
+  memset(site, 0, sizeof(H5ProfileSite));
+  site->expression = expression;
+  site->file = file;
+  site->line = line;
+  reg.sites.push_back(site);
+  return site;
+}
+
+
+void H5Profile::set_output(const std::string &fname) {
+  Registry &reg = registry();
+  std::lock_guard<std::mutex> lock(reg.mutex);
+  reg.output = fname;
+}
+
+
+void H5Profile::dump() {
+  Registry &reg = registry();
+  std::lock_guard<std::mutex> lock(reg.mutex);
+  if (reg.sites.size() == 0) return;
+
+  FILE *fp = stderr;
+  if (reg.output.size() > 0) {
+    fp = fopen(reg.output.c_str(), "w");
+    if (fp == NULL) {
+      fprintf(stderr, "H5Profile: could not open %s, writing to stderr\n", reg.output.c_str());
+      fp = stderr;
+    }
+  }
+
+  std::vector<H5ProfileSite *> sites(reg.sites);
+  std::sort(sites.begin(), sites.end(), [](const H5ProfileSite *a, const H5ProfileSite *b) {
+      return a->total_ns > b->total_ns;
+    });
+
+  std::map<std::string, Totals> functions;
+  for (auto iter = sites.begin(); iter != sites.end(); ++iter) {
+    Totals &totals = functions[function_name((*iter)->expression)];
+    totals.calls += (*iter)->calls;
+    totals.total_ns += (*iter)->total_ns;
+    totals.max_ns = std::max(totals.max_ns, (*iter)->max_ns);
+  }
+  std::vector<std::pair<std::string, Totals> > by_function(functions.begin(), functions.end());
+  std::sort(by_function.begin(), by_function.end(),
+            [](const std::pair<std::string, Totals> &a, const std::pair<std::string, Totals> &b) {
+              return a.second.total_ns > b.second.total_ns;
+            });
+
+  fprintf(fp, "# hdf5 call profile pid=%d\n", int(getpid()));
+  fprintf(fp, "# by function\n");
+  for (auto iter = by_function.begin(); iter != by_function.end(); ++iter) {
+    if (iter->second.calls == 0) continue;
+    write_totals(fp, "function", iter->first, iter->second);
+    fprintf(fp, "\n");
+  }
+
+  fprintf(fp, "# by call site, hist is log2(latency ns):calls\n");
+  for (auto iter = sites.begin(); iter != sites.end(); ++iter) {
+    const H5ProfileSite &site = **iter;
+    if (site.calls == 0) continue;
+    Totals totals;
+    totals.calls = site.calls;
+    totals.total_ns = site.total_ns;
+    totals.max_ns = site.max_ns;
+    write_totals(fp, "site", std::string(site.file) + ":" + std::to_string(site.line), totals);
+    fprintf(fp, " hist=");
+    bool first = true;
+    for (int idx = 0; idx < H5ProfileSite::NUM_BUCKETS; ++idx) {
+      if (site.histogram[idx] == 0) continue;
+      fprintf(fp, "%s%d:%llu", first ? "" : ",", idx, (unsigned long long)site.histogram[idx]);
+      first = false;
+    }
+    fprintf(fp, " expression=%s\n", site.expression);
+  }
+
+  if (fp != stderr) fclose(fp);
+}
@@ -0,0 +1,83 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "LatencyHistogram.h"
+
+const int LatencyHistogram::SUB_BUCKET_BITS;
+const int64_t LatencyHistogram::SUB_BUCKETS;
+const int64_t LatencyHistogram::HALF_SUB_BUCKETS;
+const int LatencyHistogram::MAX_VALUE_BITS;
+const int64_t LatencyHistogram::MAX_VALUE;
+const int LatencyHistogram::NUM_BUCKETS;
+
+
+LatencyHistogram::LatencyHistogram() : m_counts(NUM_BUCKETS, 0) {
+  clear();
+}
+
+
+void LatencyHistogram::clear() {
+  std::fill(m_counts.begin(), m_counts.end(), 0);
+  m_count = 0;
+  m_total = 0;
+  m_min = std::numeric_limits<int64_t>::max();
+  m_max = 0;
+}
+
+
+int LatencyHistogram::bucket(int64_t value) {
+  value = std::max(int64_t(0), std::min(value, MAX_VALUE));
+  if (value < SUB_BUCKETS) return int(value);
+  int msb = 63 - __builtin_clzll(uint64_t(value));
+  int shift = msb - (SUB_BUCKET_BITS - 1);
+  return int(SUB_BUCKETS + (msb - SUB_BUCKET_BITS) * HALF_SUB_BUCKETS + ((value >> shift) - HALF_SUB_BUCKETS));
+}
+
+
+int64_t LatencyHistogram::bucket_lower(int bucket) {
+  if (bucket < SUB_BUCKETS) return bucket;
+  int64_t above = bucket - SUB_BUCKETS;
+  int msb = int(above / HALF_SUB_BUCKETS) + SUB_BUCKET_BITS;
+  int64_t sub = above % HALF_SUB_BUCKETS + HALF_SUB_BUCKETS;
+  return sub << (msb - (SUB_BUCKET_BITS - 1));
+}
+
+
+int64_t LatencyHistogram::bucket_upper(int bucket) {
+  if (bucket < SUB_BUCKETS) return bucket;
+  int msb = int((bucket - SUB_BUCKETS) / HALF_SUB_BUCKETS) + SUB_BUCKET_BITS;
+  return bucket_lower(bucket) + (int64_t(1) << (msb - (SUB_BUCKET_BITS - 1))) - 1;
+}
+
+
+void LatencyHistogram::record(int64_t value) {
+  value = std::max(int64_t(0), std::min(value, MAX_VALUE));
+  ++m_counts[bucket(value)];
+  ++m_count;
+  m_total += value;
+  m_min = std::min(m_min, value);
+  m_max = std::max(m_max, value);
+}
+
+
+void LatencyHistogram::merge(const LatencyHistogram &other) {
+  for (int idx = 0; idx < NUM_BUCKETS; ++idx) m_counts[idx] += other.m_counts[idx];
+  m_count += other.m_count;
+  m_total += other.m_total;
+  m_min = std::min(m_min, other.m_min);
+  m_max = std::max(m_max, other.m_max);
+}
+
+
+int64_t LatencyHistogram::percentile(double pct) const {
+  if (m_count == 0) return 0;
+  int64_t target = int64_t(std::ceil(std::min(100.0, std::max(0.0, pct)) / 100.0 * m_count));
+  target = std::max(int64_t(1), target);
+  int64_t seen = 0;
+  for (int idx = 0; idx < NUM_BUCKETS; ++idx) {
+    seen += m_counts[idx];
+    if (seen >= target) return std::min(bucket_upper(idx), m_max);
+  }
+  return m_max;
+}
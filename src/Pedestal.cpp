@@ -0,0 +1,164 @@
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+#include "Pedestal.h"
+#include "check_macros.h"
+
+namespace {
+
+  // wrapping int16 arithmetic through uint16, signed overflow is undefined
+  inline int16_t wrap_sub(int16_t a, int16_t b) {
+    return int16_t(uint16_t(uint16_t(a) - uint16_t(b)));
+  }
+
+  inline int16_t wrap_add(int16_t a, int16_t b) {
+    return int16_t(uint16_t(uint16_t(a) + uint16_t(b)));
+  }
+
+  void sub_frame(const int16_t *raw, const int16_t *ped, int16_t *out, size_t len, bool simd) {
+    size_t idx = 0;
+    if (simd) {
+#ifdef __AVX2__
+      for (; idx + 16 <= len; idx += 16) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(raw + idx));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(ped + idx));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + idx), _mm256_sub_epi16(a, b));
+      }
+#endif
+#ifdef __SSE2__
+      for (; idx + 8 <= len; idx += 8) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(raw + idx));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(ped + idx));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + idx), _mm_sub_epi16(a, b));
+      }
+#endif
+    }
+    for (; idx < len; ++idx) out[idx] = wrap_sub(raw[idx], ped[idx]);
+  }
+
+  void add_frame(int16_t *data, const int16_t *ped, size_t len, bool simd) {
+    size_t idx = 0;
+    if (simd) {
+#ifdef __AVX2__
+      for (; idx + 16 <= len; idx += 16) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + idx));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(ped + idx));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(data + idx), _mm256_add_epi16(a, b));
+      }
+#endif
+#ifdef __SSE2__
+      for (; idx + 8 <= len; idx += 8) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + idx));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(ped + idx));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(data + idx), _mm_add_epi16(a, b));
+      }
+#endif
+    }
+    for (; idx < len; ++idx) data[idx] = wrap_add(data[idx], ped[idx]);
+  }
+
+}
+
+
+Pedestal::Pedestal() {}
+
+
+Pedestal Pedestal::from_frames(const int16_t *frames, size_t num_frames, const std::vector<hsize_t> &frame_dims) {
+  if ((num_frames == 0) or frame_dims.empty()) {
+    throw std::runtime_error("Pedestal::from_frames - no frames");
+  }
+  size_t frame_len = 1;
+  for (auto dim : frame_dims) frame_len *= size_t(dim);
+  std::vector<int64_t> sums(frame_len, 0);
+  for (size_t frame = 0; frame < num_frames; ++frame) {
+    const int16_t *pixels = frames + frame * frame_len;
+    for (size_t idx = 0; idx < frame_len; ++idx) sums[idx] += pixels[idx];
+  }
+  Pedestal pedestal;
+  pedestal.m_frame_dims = frame_dims;
+  pedestal.m_values.resize(frame_len);
+  for (size_t idx = 0; idx < frame_len; ++idx) {
+    pedestal.m_values[idx] = int16_t(std::lround(double(sums[idx]) / double(num_frames)));
+  }
+  return pedestal;
+}
+
+
+bool Pedestal::exists(hid_t loc, const char *name) {
+  if (NONNEG( H5Lexists(loc, name, H5P_DEFAULT) ) == 0) return false;
+  // an external link whose file is not there yet does not resolve
+  return H5Oexists_by_name(loc, name, H5P_DEFAULT) > 0;
+}
+
+
+Pedestal Pedestal::load(hid_t loc, const char *name) {
+  Pedestal pedestal;
+  if (not exists(loc, name)) return pedestal;
+  hid_t dset = NONNEG( H5Dopen2(loc, name, H5P_DEFAULT) );
+  hid_t space = NONNEG( H5Dget_space(dset) );
+  int rank = NONNEG( H5Sget_simple_extent_ndims(space) );
+  pedestal.m_frame_dims.resize(rank);
+  NONNEG( H5Sget_simple_extent_dims(space, pedestal.m_frame_dims.data(), NULL) );
+  pedestal.m_values.resize(size_t(NONNEG( H5Sget_simple_extent_npoints(space) )));
+  NONNEG( H5Dread(dset, H5T_NATIVE_INT16, H5S_ALL, H5S_ALL, H5P_DEFAULT, pedestal.m_values.data()) );
+  NONNEG( H5Sclose(space) );
+  NONNEG( H5Dclose(dset) );
+  return pedestal;
+}
+
+
+void Pedestal::write(hid_t loc, const char *name) const {
+  if (empty()) throw std::runtime_error("Pedestal::write - empty pedestal");
+  hid_t space = NONNEG( H5Screate_simple(int(m_frame_dims.size()), m_frame_dims.data(), NULL) );
+  hid_t dset = NONNEG( H5Dcreate2(loc, name, H5T_NATIVE_INT16, space, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT) );
+  NONNEG( H5Dwrite(dset, H5T_NATIVE_INT16, H5S_ALL, H5S_ALL, H5P_DEFAULT, m_values.data()) );
+  NONNEG( H5Dclose(dset) );
+  NONNEG( H5Sclose(space) );
+}
+
+
+void Pedestal::subtract(const int16_t *raw, int16_t *out, size_t num_frames, bool simd) const {
+  size_t len = frame_len();
+  if (empty()) {
+    if (raw != out) throw std::runtime_error("Pedestal::subtract - empty pedestal, frame length unknown");
+    return;
+  }
+  for (size_t frame = 0; frame < num_frames; ++frame) {
+    sub_frame(raw + frame * len, m_values.data(), out + frame * len, len, simd);
+  }
+}
+
+
+void Pedestal::restore(int16_t *data, size_t num_frames, bool simd) const {
+  size_t len = frame_len();
+  for (size_t frame = 0; frame < num_frames; ++frame) {
+    add_frame(data + frame * len, m_values.data(), len, simd);
+  }
+}
+
+
+void Pedestal::read(Dset &dset, hsize_t start, hsize_t count, int16_t *data, size_t data_len) const {
+  dset.read(start, count, data, data_len);
+  if (empty()) return;
+  if (dset.event_len() != frame_len()) {
+    throw std::runtime_error("Pedestal::read - dataset frames are not the pedestal size");
+  }
+  restore(data, size_t(count));
+}
+
+
+bool Pedestal::simd_enabled() {
+#ifdef __SSE2__
+  return true;
+#else
+  return false;
+#endif
+}
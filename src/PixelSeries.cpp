@@ -0,0 +1,226 @@
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+#include "PixelSeries.h"
+#include "BitshuffleFilter.h"
+#include "ChunkCachePolicy.h"
+#include "check_macros.h"
+
+namespace {
+
+  // events and columns in one block of the blocked transpose. A block reads
+  // BLOCK rows of BLOCK int16 from BLOCK frames and writes BLOCK rows of
+  // BLOCK events, both a few cache lines.
+  const size_t BLOCK = 16;
+
+  hsize_t clamp_dim(hsize_t want, hsize_t dim) {
+    return std::max(hsize_t(1), std::min(want, dim));
+  }
+
+  void set_chunk_cache(hid_t access, size_t num_chunks, size_t chunk_bytes) {
+    size_t nslots = ChunkCachePolicy::next_prime(std::max(size_t(101), 100 * num_chunks));
+    NONNEG( H5Pset_chunk_cache(access, nslots, num_chunks * chunk_bytes, 1.0) );
+  }
+
+}
+
+
+PixelSeries::PixelSeries() :
+  m_id(-1),
+  m_num_events(0),
+  m_tile_y(0),
+  m_tile_x(0),
+  m_chunk_events(0),
+  m_filter(filter_none)
+{}
+
+
+PixelSeries PixelSeries::create(hid_t parent, const char *name, const std::vector<hsize_t> &frame_dims,
+                                hsize_t num_events, hsize_t tile_y, hsize_t tile_x, hsize_t chunk_events,
+                                DsetFilter filter) {
+  if (frame_dims.size() != 3) throw std::runtime_error("PixelSeries::create - frame_dims is not [panels, rows, cols]");
+  if (num_events == 0) throw std::runtime_error("PixelSeries::create - no events");
+
+  PixelSeries series;
+  series.m_frame_dims = frame_dims;
+  series.m_num_events = num_events;
+  // chunks of a fixed size dataset can not be bigger than it
+  series.m_tile_y = clamp_dim(tile_y, frame_dims.at(1));
+  series.m_tile_x = clamp_dim(tile_x, frame_dims.at(2));
+  series.m_chunk_events = clamp_dim(chunk_events, num_events);
+  series.m_filter = filter;
+
+  hsize_t dims[4] = {frame_dims.at(0), frame_dims.at(1), frame_dims.at(2), num_events};
+  hid_t space = NONNEG( H5Screate_simple(4, dims, NULL) );
+
+  std::vector<hsize_t> chunk = {1, series.m_tile_y, series.m_tile_x, series.m_chunk_events};
+  DsetPropAccess create_props(name, H5T_NATIVE_INT16, chunk, ChunkCachePolicy::for_writer(), 1, filter);
+
+  // write_frames writes whole chunks with H5Dwrite_chunk, the cache is not used
+  hid_t access = NONNEG( H5Pcreate(H5P_DATASET_ACCESS) );
+  set_chunk_cache(access, 0, 0);
+  series.m_id = NONNEG( H5Dcreate2(parent, name, H5T_NATIVE_INT16, space, H5P_DEFAULT,
+                                   create_props.proplist, access) );
+  NONNEG( H5Pclose(access) );
+  create_props.close();
+  NONNEG( H5Sclose(space) );
+  return series;
+}
+
+
+PixelSeries PixelSeries::open(hid_t parent, const char *name, size_t max_cache_bytes) {
+  PixelSeries series;
+  hid_t id = NONNEG( H5Dopen2(parent, name, H5P_DEFAULT) );
+
+  hid_t space = NONNEG( H5Dget_space(id) );
+  hid_t plist = NONNEG( H5Dget_create_plist(id) );
+  int rank = H5Sget_simple_extent_ndims(space);
+  bool chunked = (H5Pget_layout(plist) == H5D_CHUNKED);
+  hsize_t dims[4] = {0, 0, 0, 0}, chunk[4] = {0, 0, 0, 0};
+  if ((rank == 4) and chunked) {
+    NONNEG( H5Sget_simple_extent_dims(space, dims, NULL) );
+    NONNEG( H5Pget_chunk(plist, 4, chunk) );
+  }
+  NONNEG( H5Pclose(plist) );
+  NONNEG( H5Sclose(space) );
+  NONNEG( H5Dclose(id) );
+  if ((rank != 4) or (not chunked)) {
+    throw std::runtime_error(std::string("PixelSeries::open - not a chunked [panels, rows, cols, events] dataset: ") + name);
+  }
+
+  series.m_frame_dims = {dims[0], dims[1], dims[2]};
+  series.m_num_events = dims[3];
+  series.m_tile_y = chunk[1];
+  series.m_tile_x = chunk[2];
+  series.m_chunk_events = chunk[3];
+
+  // the chunks of one tile over all the events
+  size_t chunk_bytes = size_t(chunk[1] * chunk[2] * chunk[3]) * sizeof(int16_t);
+  size_t num_chunks = size_t((series.m_num_events + series.m_chunk_events - 1) / series.m_chunk_events);
+  if ((max_cache_bytes > 0) and (num_chunks * chunk_bytes > max_cache_bytes)) num_chunks = max_cache_bytes / chunk_bytes;
+
+  hid_t access = NONNEG( H5Pcreate(H5P_DATASET_ACCESS) );
+  set_chunk_cache(access, num_chunks, chunk_bytes);
+  series.m_id = NONNEG( H5Dopen2(parent, name, access) );
+  NONNEG( H5Pclose(access) );
+  return series;
+}
+
+
+void PixelSeries::close() {
+  if (m_id >= 0) NONNEG( H5Dclose(m_id) );
+  m_id = -1;
+  m_tile.clear();
+  m_tile.shrink_to_fit();
+  m_chunk.clear();
+  m_chunk.shrink_to_fit();
+  m_compressed.clear();
+  m_compressed.shrink_to_fit();
+}
+
+
+void PixelSeries::transpose_tile(const int16_t *frames, size_t num_events, const std::vector<hsize_t> &frame_dims,
+                                 hsize_t panel, hsize_t y0, hsize_t x0, hsize_t ny, hsize_t nx,
+                                 int16_t *tile, bool blocked) {
+  const size_t rows = size_t(frame_dims.at(1)), cols = size_t(frame_dims.at(2));
+  const size_t frame_len = size_t(frame_dims.at(0)) * rows * cols;
+  const int16_t *box = frames + size_t(panel) * rows * cols + size_t(y0) * cols + size_t(x0);
+
+  if (not blocked) {
+    for (size_t iy = 0; iy < ny; ++iy) {
+      for (size_t ix = 0; ix < nx; ++ix) {
+        int16_t *series = tile + (iy * nx + ix) * num_events;
+        const int16_t *pixel = box + iy * cols + ix;
+        for (size_t event = 0; event < num_events; ++event) series[event] = pixel[event * frame_len];
+      }
+    }
+    return;
+  }
+
+  for (size_t iy = 0; iy < ny; ++iy) {
+    for (size_t event0 = 0; event0 < num_events; event0 += BLOCK) {
+      const size_t event1 = std::min(num_events, event0 + BLOCK);
+      for (size_t ix0 = 0; ix0 < nx; ix0 += BLOCK) {
+        const size_t ix1 = std::min(size_t(nx), ix0 + BLOCK);
+        for (size_t event = event0; event < event1; ++event) {
+          const int16_t *row = box + event * frame_len + iy * cols;
+          int16_t *out = tile + (iy * nx) * num_events + event;
+          for (size_t ix = ix0; ix < ix1; ++ix) out[ix * num_events] = row[ix];
+        }
+      }
+    }
+  }
+}
+
+
+void PixelSeries::select_box(hid_t space, hsize_t panel, hsize_t y, hsize_t x, hsize_t ny, hsize_t nx,
+                             hsize_t start, hsize_t count) const {
+  if ((panel >= m_frame_dims.at(0)) or (y + ny > m_frame_dims.at(1)) or (x + nx > m_frame_dims.at(2))
+      or (start + count > m_num_events)) {
+    throw std::runtime_error("PixelSeries - pixels or events out of range");
+  }
+  hsize_t offset[4] = {panel, y, x, start};
+  hsize_t counts[4] = {1, ny, nx, count};
+  NONNEG( H5Sselect_hyperslab(space, H5S_SELECT_SET, offset, NULL, counts, NULL) );
+}
+
+
+void PixelSeries::write_frames(hsize_t start, hsize_t count, const int16_t *frames) {
+  if (m_id < 0) throw std::runtime_error("PixelSeries::write_frames - not open");
+  if ((start % m_chunk_events != 0) or ((count != m_chunk_events) and (start + count != m_num_events))) {
+    throw std::runtime_error("PixelSeries::write_frames - not a whole block of chunk_events");
+  }
+  const size_t chunk_len = size_t(m_tile_y * m_tile_x * m_chunk_events);
+  const size_t chunk_bytes = chunk_len * sizeof(int16_t);
+  m_tile.resize(chunk_len);
+  m_chunk.resize(chunk_len);
+  if (m_filter == filter_bitshuffle_lz4) m_compressed.resize(bitshuffle::compress_bound(chunk_bytes, sizeof(int16_t), 0));
+
+  for (hsize_t panel = 0; panel < m_frame_dims.at(0); ++panel) {
+    for (hsize_t y0 = 0; y0 < m_frame_dims.at(1); y0 += m_tile_y) {
+      const hsize_t ny = std::min(m_tile_y, m_frame_dims.at(1) - y0);
+      for (hsize_t x0 = 0; x0 < m_frame_dims.at(2); x0 += m_tile_x) {
+        const hsize_t nx = std::min(m_tile_x, m_frame_dims.at(2) - x0);
+        if ((ny == m_tile_y) and (nx == m_tile_x) and (count == m_chunk_events)) {
+          transpose_tile(frames, size_t(count), m_frame_dims, panel, y0, x0, ny, nx, m_chunk.data());
+        } else {
+          transpose_tile(frames, size_t(count), m_frame_dims, panel, y0, x0, ny, nx, m_tile.data());
+          // edge chunks are written whole, padded past the dataset with the
+          // fill value, not what the tile before left in m_chunk
+          std::fill(m_chunk.begin(), m_chunk.end(), int16_t(0));
+          for (size_t pixel = 0; pixel < size_t(ny * nx); ++pixel) {
+            const size_t iy = pixel / size_t(nx), ix = pixel % size_t(nx);
+            std::copy(m_tile.begin() + pixel * size_t(count), m_tile.begin() + (pixel + 1) * size_t(count),
+                      m_chunk.begin() + (iy * size_t(m_tile_x) + ix) * size_t(m_chunk_events));
+          }
+        }
+        // straight to the file, with no chunk cache or selection to go through
+        hsize_t offset[4] = {panel, y0, x0, start};
+        if (m_filter == filter_bitshuffle_lz4) {
+          size_t len = bitshuffle::compress(m_chunk.data(), chunk_bytes, sizeof(int16_t), 0, m_compressed.data());
+          NONNEG( H5Dwrite_chunk(m_id, H5P_DEFAULT, 0, offset, len, m_compressed.data()) );
+        } else {
+          NONNEG( H5Dwrite_chunk(m_id, H5P_DEFAULT, 0, offset, chunk_bytes, m_chunk.data()) );
+        }
+      }
+    }
+  }
+}
+
+
+void PixelSeries::read_pixel(hsize_t panel, hsize_t y, hsize_t x, hsize_t start, hsize_t count, int16_t *series) {
+  read_pixels(panel, y, x, 1, 1, start, count, series);
+}
+
+
+void PixelSeries::read_pixels(hsize_t panel, hsize_t y, hsize_t x, hsize_t ny, hsize_t nx,
+                              hsize_t start, hsize_t count, int16_t *series) {
+  hid_t file_space = NONNEG( H5Dget_space(m_id) );
+  select_box(file_space, panel, y, x, ny, nx, start, count);
+  hsize_t len = ny * nx * count;
+  hid_t mem_space = NONNEG( H5Screate_simple(1, &len, NULL) );
+  NONNEG( H5Dread(m_id, H5T_NATIVE_INT16, mem_space, file_space, H5P_DEFAULT, series) );
+  NONNEG( H5Sclose(mem_space) );
+  NONNEG( H5Sclose(file_space) );
+}
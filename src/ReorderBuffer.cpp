@@ -0,0 +1,77 @@
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+#include "ReorderBuffer.h"
+
+
+ReorderBuffer::ReorderBuffer() :
+  m_first(0),
+  m_capacity(0),
+  m_num_parts(0),
+  m_num_late(0)
+{}
+
+
+ReorderBuffer::ReorderBuffer(int64_t first, size_t capacity, size_t num_parts) :
+  m_first(first),
+  m_capacity(capacity),
+  m_num_parts(num_parts),
+  m_arrived(capacity * num_parts, 0),
+  m_num_arrived(capacity, 0),
+  m_last_arrival(num_parts, Clock::now()),
+  m_num_late(0)
+{
+  if (capacity == 0) throw std::runtime_error("ReorderBuffer - capacity is 0");
+  if (num_parts == 0) throw std::runtime_error("ReorderBuffer - no parts");
+}
+
+
+size_t ReorderBuffer::slot(int64_t fiducial) const {
+  if (not fits(fiducial)) {
+    throw std::runtime_error("ReorderBuffer - fiducial " + std::to_string(fiducial) + " is not in the window");
+  }
+  return size_t(fiducial % int64_t(m_capacity));
+}
+
+
+bool ReorderBuffer::arrive(int64_t fiducial, size_t part) {
+  if (part >= m_num_parts) throw std::runtime_error("ReorderBuffer::arrive - no such part");
+  m_last_arrival.at(part) = Clock::now();
+  if (fiducial < m_first) {
+    ++m_num_late;
+    return false;
+  }
+  const size_t idx = slot(fiducial);
+  uint8_t &arrived = m_arrived.at(idx * m_num_parts + part);
+  if (arrived) {
+    throw std::runtime_error("ReorderBuffer::arrive - part " + std::to_string(part) +
+                             " of fiducial " + std::to_string(fiducial) + " arrived twice");
+  }
+  arrived = 1;
+  ++m_num_arrived.at(idx);
+  return true;
+}
+
+
+bool ReorderBuffer::arrived(int64_t fiducial, size_t part) const {
+  return m_arrived.at(slot(fiducial) * m_num_parts + part) != 0;
+}
+
+
+size_t ReorderBuffer::num_arrived(int64_t fiducial) const {
+  return m_num_arrived.at(slot(fiducial));
+}
+
+
+double ReorderBuffer::idle_seconds(size_t part) const {
+  return std::chrono::duration<double>(Clock::now() - m_last_arrival.at(part)).count();
+}
+
+
+void ReorderBuffer::pop() {
+  const size_t idx = slot(m_first);
+  std::fill(m_arrived.begin() + idx * m_num_parts, m_arrived.begin() + (idx + 1) * m_num_parts, 0);
+  m_num_arrived.at(idx) = 0;
+  ++m_first;
+}
@@ -1,6 +1,7 @@
 #include <algorithm>
 
 #include "VDSRoundRobin.h"
+#include "DsetLayoutCache.h"
 #include "check_macros.h"
 
 VDSRoundRobin::VDSRoundRobin(hid_t vds_location,
@@ -35,6 +36,7 @@ VDSRoundRobin::VDSRoundRobin(hid_t vds_location,
   NONNEG( H5Pset_virtual_view( dapl_id, H5D_VDS_FIRST_MISSING) );
   m_vds_dset = H5Dcreate2(vds_location, vds_dset_name, m_h5type,
                           vds_space, H5P_DEFAULT, m_vds_dcpl, dapl_id );
+  store_layout();
   
   NONNEG( H5Pclose( dapl_id ) );
   NONNEG( H5Sclose( vds_space ) );
@@ -43,6 +45,23 @@ VDSRoundRobin::VDSRoundRobin(hid_t vds_location,
 }
 
 
+// readers size each source's chunk cache from this, without opening the
+// sources first. When the sources are not all chunked alike, readers find
+// that out the way they did before.
+void VDSRoundRobin::store_layout() const {
+  if (m_vds_dset < 0) return;
+  DsetLayoutCache &layout_cache = DsetLayoutCache::instance();
+  DsetLayout layout = layout_cache.describe(m_src_dsets.at(0));
+  for (size_t idx = 1; idx < m_src_dsets.size(); ++idx) {
+    if (layout_cache.describe(m_src_dsets.at(idx)).chunk != layout.chunk) return;
+  }
+  if (layout.layout != H5D_CHUNKED) return;
+  layout.layout = H5D_VIRTUAL;
+  layout.num_vds_mappings = m_src_dsets.size();
+  DsetLayoutCache::store(m_vds_dset, layout);
+}
+
+
 VDSRoundRobin::~VDSRoundRobin() {
   if (m_vds_dset != -1) {
     NONNEG( H5Dclose( m_vds_dset ) );
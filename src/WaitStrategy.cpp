@@ -0,0 +1,151 @@
+#include <algorithm>
+#include <stdexcept>
+#include <iostream>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/inotify.h>
+
+#include "WaitStrategy.h"
+
+
+WaitStats::WaitStats() {
+  clear();
+}
+
+
+void WaitStats::clear() {
+  waits = 0;
+  immediate = 0;
+  refreshes = 0;
+  timeouts = 0;
+  cancels = 0;
+  sleeps = 0;
+  notifications = 0;
+  wakeup_latency_total_micro = 0;
+  wakeup_latency_max_micro = 0;
+  wakeups = 0;
+}
+
+
+double WaitStats::mean_wakeup_latency_micro() const {
+  if (wakeups == 0) return 0.0;
+  return double(wakeup_latency_total_micro) / double(wakeups);
+}
+
+
+std::unique_ptr<WaitStrategy> WaitStrategy::create(const std::string &kind,
+                                                   int spin_iterations,
+                                                   int min_micro,
+                                                   int max_micro,
+                                                   const std::vector<std::string> &watch_fnames) {
+  if (kind == "fixed") {
+    if (min_micro > 0) return std::unique_ptr<WaitStrategy>(new BackoffWait(0, min_micro, min_micro));
+    return std::unique_ptr<WaitStrategy>(new BackoffWait(-1, 0, 0));
+  }
+  if (kind == "backoff") {
+    return std::unique_ptr<WaitStrategy>(new BackoffWait(spin_iterations, min_micro, max_micro));
+  }
+  if (kind == "notify") {
+    NotifyWait *notify = new NotifyWait(watch_fnames, spin_iterations, min_micro, max_micro);
+    if (not notify->watching()) {
+      std::cerr << "WARNING: WaitStrategy::create - inotify not available, using backoff" << std::endl;
+    }
+    return std::unique_ptr<WaitStrategy>(notify);
+  }
+  throw std::runtime_error("WaitStrategy::create - unknown kind: " + kind);
+}
+
+
+BackoffWait::BackoffWait(int spin_iterations, int min_micro, int max_micro) :
+  m_spin_iterations(spin_iterations),
+  m_min_micro(std::max(1, min_micro)),
+  m_max_micro(std::max(std::max(1, min_micro), max_micro)),
+  m_iteration(0),
+  m_current_micro(m_min_micro)
+{}
+
+
+void BackoffWait::begin() {
+  m_iteration = 0;
+  m_current_micro = m_min_micro;
+}
+
+
+void BackoffWait::pause() {
+  if ((m_spin_iterations < 0) or (m_iteration < m_spin_iterations)) {
+    ++m_iteration;
+    return;
+  }
+  usleep(m_current_micro);
+  m_stats.sleeps += 1;
+  m_current_micro = std::min(m_max_micro, 2 * m_current_micro);
+}
+
+
+NotifyWait::NotifyWait(const std::vector<std::string> &watch_fnames,
+                       int spin_iterations, int min_micro, int max_micro) :
+  m_fd(-1),
+  m_spin_iterations(spin_iterations),
+  m_min_micro(std::max(1, min_micro)),
+  m_max_micro(std::max(std::max(1, min_micro), max_micro)),
+  m_iteration(0),
+  m_current_micro(m_min_micro)
+{
+  m_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (m_fd < 0) return;
+  for (auto iter = watch_fnames.begin(); iter != watch_fnames.end(); ++iter) {
+    if (inotify_add_watch(m_fd, iter->c_str(), IN_MODIFY | IN_CLOSE_WRITE) < 0) {
+      close(m_fd);
+      m_fd = -1;
+      return;
+    }
+  }
+}
+
+
+NotifyWait::~NotifyWait() {
+  if (m_fd >= 0) close(m_fd);
+}
+
+
+void NotifyWait::drain() {
+  char buffer[4096];
+  while (read(m_fd, buffer, sizeof(buffer)) > 0) {}
+}
+
+
+void NotifyWait::begin() {
+  m_iteration = 0;
+  m_current_micro = m_min_micro;
+}
+
+
+void NotifyWait::pause() {
+  if ((m_spin_iterations < 0) or (m_iteration < m_spin_iterations)) {
+    ++m_iteration;
+    return;
+  }
+
+  if (m_fd < 0) {
+    usleep(m_current_micro);
+    m_stats.sleeps += 1;
+    m_current_micro = std::min(m_max_micro, 2 * m_current_micro);
+    return;
+  }
+
+  struct pollfd pfd;
+  pfd.fd = m_fd;
+  pfd.events = POLLIN;
+  pfd.revents = 0;
+  int timeout_ms = std::max(1, (m_current_micro + 999) / 1000);
+  int ready = poll(&pfd, 1, timeout_ms);
+  if ((ready > 0) and (pfd.revents & POLLIN)) {
+    drain();
+    m_stats.notifications += 1;
+    // something changed, the next quiet period starts over at the minimum
+    m_current_micro = m_min_micro;
+  } else {
+    m_stats.sleeps += 1;
+    m_current_micro = std::min(m_max_micro, 2 * m_current_micro);
+  }
+}
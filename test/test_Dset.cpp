@@ -1,6 +1,10 @@
+#include <cstdio>
 #include <iostream>
+#include <stdexcept>
 #include "check_macros.h"
 #include "Dset.h"
+#include "DsetBatch.h"
+#include "DsetLayoutCache.h"
 
 
 hid_t create_file(const char *fname) {
@@ -31,12 +35,217 @@ void read_file() {
   std::vector<int64_t> buf;
   dset.read(0,9,buf);
   std::cout << "read  back: "  << buf << std::endl;
+  // the selection for 3 events is reused, shifted to each start
+  for (hsize_t start = 0; start < 9; start += 3) {
+    dset.read(start, 3, buf);
+    if ((buf.at(0) != 3) or (buf.at(1) != 4) or (buf.at(2) != 5)) {
+      throw std::runtime_error("reading 3 events at an offset failed");
+    }
+  }
+  dset.read(4, 1, buf);
+  if (buf.at(0) != 4) throw std::runtime_error("reading 1 event at an offset failed");
   dset.close();
 }
 
 
+// contiguous, like the datasets daq_repack writes
+void read_contiguous() {
+  hid_t fid = create_file("test_Dset_contiguous.h5");
+  hsize_t dims[2] = {4, 2};
+  std::vector<int64_t> data = {0, 1, 10, 11, 20, 21, 30, 31};
+  hid_t space = NONNEG(H5Screate_simple(2, dims, NULL));
+  hid_t dset_id = NONNEG(H5Dcreate2(fid, "dsetC", H5T_NATIVE_INT64, space, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT));
+  NONNEG(H5Dwrite(dset_id, H5T_NATIVE_INT64, H5S_ALL, H5S_ALL, H5P_DEFAULT, data.data()));
+  NONNEG(H5Dclose(dset_id));
+  NONNEG(H5Sclose(space));
+  NONNEG(H5Fclose(fid));
+
+  fid = NONNEG(H5Fopen("test_Dset_contiguous.h5", H5F_ACC_RDONLY, H5P_DEFAULT));
+  Dset dset = Dset::open(fid, "dsetC", Dset::if_vds_first_missing);
+  std::vector<int64_t> buf;
+  dset.read(2, 2, buf);
+  if ((dset.dim().at(0) != 4) or (buf.size() != 4) or (buf.at(0) != 20) or (buf.at(3) != 31)) {
+    throw std::runtime_error("reading a contiguous dataset failed");
+  }
+  dset.close();
+  NONNEG(H5Fclose(fid));
+  remove("test_Dset_contiguous.h5");
+}
+
+
+// contiguous datasets mapped, chunked ones read through hdf5
+void read_mapped() {
+  hid_t fapl = NONNEG(H5Pcreate(H5P_FILE_ACCESS));
+  NONNEG(H5Pset_alignment(fapl, 0, 64));
+  hid_t fid = NONNEG(H5Fcreate("test_Dset_mapped.h5", H5F_ACC_TRUNC, H5P_DEFAULT, fapl));
+  NONNEG(H5Pclose(fapl));
+  hsize_t dims[2] = {5, 3};
+  std::vector<int16_t> data(15);
+  for (size_t idx = 0; idx < data.size(); ++idx) data.at(idx) = int16_t(100 + idx);
+  hid_t space = NONNEG(H5Screate_simple(2, dims, NULL));
+  hid_t dset_id = NONNEG(H5Dcreate2(fid, "dsetM", H5T_NATIVE_INT16, space, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT));
+  NONNEG(H5Dwrite(dset_id, H5T_NATIVE_INT16, H5S_ALL, H5S_ALL, H5P_DEFAULT, data.data()));
+  NONNEG(H5Dclose(dset_id));
+  NONNEG(H5Sclose(space));
+  Dset chunked = Dset::create(fid, "dsetA", H5T_NATIVE_INT64, {2});
+  chunked.append(0, 3, std::vector<int64_t>{3, 4, 5});
+  chunked.close();
+  NONNEG(H5Fclose(fid));
+
+  fid = NONNEG(H5Fopen("test_Dset_mapped.h5", H5F_ACC_RDONLY, H5P_DEFAULT));
+  Dset dset = Dset::open(fid, "dsetM", Dset::if_vds_first_missing, ChunkCachePolicy(), Dset::read_mmap);
+  if (not dset.mapped()) throw std::runtime_error("a contiguous dataset was not mapped");
+  const int16_t *events = dset.mapped_int16(1, 4);
+  if ((events[0] != 103) or (events[11] != 114)) throw std::runtime_error("mapped pointer has the wrong values");
+  std::vector<int16_t> buf;
+  dset.read(2, 2, buf);
+  if ((buf.size() != 6) or (buf.at(0) != 106) or (buf.at(5) != 111)) throw std::runtime_error("mapped read failed");
+  dset.read_events({0, 4}, buf);
+  if ((buf.size() != 6) or (buf.at(0) != 100) or (buf.at(3) != 112)) throw std::runtime_error("mapped read_events failed");
+  bool threw = false;
+  try {
+    dset.mapped_int16(3, 3);
+  } catch (const std::runtime_error &) {
+    threw = true;
+  }
+  if (not threw) throw std::runtime_error("mapped_int16 past the end did not throw");
+  dset.close();
+
+  Dset chunked_read = Dset::open(fid, "dsetA", Dset::if_vds_first_missing, ChunkCachePolicy(), Dset::read_mmap);
+  if (chunked_read.mapped()) throw std::runtime_error("a chunked dataset was mapped");
+  std::vector<int64_t> chunked_buf;
+  chunked_read.read(1, 2, chunked_buf);
+  if ((chunked_buf.at(0) != 4) or (chunked_buf.at(1) != 5)) throw std::runtime_error("chunked read with read_mmap failed");
+  chunked_read.close();
+  NONNEG(H5Fclose(fid));
+  remove("test_Dset_mapped.h5");
+}
+
+
+// a file recreated under the same name is not described from the layout cache
+void recreate_file() {
+  hid_t fid = create_file("test_Dset_recreate.h5");
+  Dset chunked = Dset::create(fid, "dsetR", H5T_NATIVE_INT16, {2, 3});
+  chunked.append(0, 1, std::vector<int16_t>{1, 2, 3});
+  chunked.close();
+  NONNEG(H5Fclose(fid));
+  fid = NONNEG(H5Fopen("test_Dset_recreate.h5", H5F_ACC_RDONLY, H5P_DEFAULT));
+  Dset dset = Dset::open(fid, "dsetR", Dset::if_vds_first_missing, ChunkCachePolicy(), Dset::read_mmap);
+  if (dset.mapped()) throw std::runtime_error("a chunked dataset was mapped");
+  dset.close();
+  NONNEG(H5Fclose(fid));
+
+  hid_t fapl = NONNEG(H5Pcreate(H5P_FILE_ACCESS));
+  NONNEG(H5Pset_alignment(fapl, 0, 64));
+  fid = NONNEG(H5Fcreate("test_Dset_recreate.h5", H5F_ACC_TRUNC, H5P_DEFAULT, fapl));
+  NONNEG(H5Pclose(fapl));
+  hsize_t dims[2] = {2, 3};
+  std::vector<int16_t> data = {10, 11, 12, 20, 21, 22};
+  hid_t space = NONNEG(H5Screate_simple(2, dims, NULL));
+  hid_t dset_id = NONNEG(H5Dcreate2(fid, "dsetR", H5T_NATIVE_INT16, space, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT));
+  NONNEG(H5Dwrite(dset_id, H5T_NATIVE_INT16, H5S_ALL, H5S_ALL, H5P_DEFAULT, data.data()));
+  NONNEG(H5Dclose(dset_id));
+  NONNEG(H5Sclose(space));
+  NONNEG(H5Fclose(fid));
+
+  fid = NONNEG(H5Fopen("test_Dset_recreate.h5", H5F_ACC_RDONLY, H5P_DEFAULT));
+  dset = Dset::open(fid, "dsetR", Dset::if_vds_first_missing, ChunkCachePolicy(), Dset::read_mmap);
+  if (not dset.mapped()) throw std::runtime_error("the recreated contiguous dataset got the stale chunked layout");
+  std::vector<int16_t> buf;
+  dset.read(1, 1, buf);
+  if (buf.at(0) != 20) throw std::runtime_error("reading the recreated dataset failed");
+  dset.close();
+  NONNEG(H5Fclose(fid));
+  remove("test_Dset_recreate.h5");
+}
+
+
+// datasets we create are opened without a probe, others are probed and
+// their layouts dropped from the cache once their file is closed
+void stored_layout() {
+  DsetLayoutCache &layout_cache = DsetLayoutCache::instance();
+  layout_cache.release_files();
+  hid_t fid = create_file("test_Dset_layout.h5");
+  Dset chunked = Dset::create(fid, "dsetS", H5T_NATIVE_INT16, {4, 3}, {4, 3});
+  chunked.append(0, 1, std::vector<int16_t>{1, 2, 3});
+  chunked.close();
+  hsize_t dims[1] = {2};
+  std::vector<int64_t> data = {7, 8};
+  hid_t space = NONNEG(H5Screate_simple(1, dims, NULL));
+  hid_t dset_id = NONNEG(H5Dcreate2(fid, "dsetP", H5T_NATIVE_INT64, space, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT));
+  NONNEG(H5Dwrite(dset_id, H5T_NATIVE_INT64, H5S_ALL, H5S_ALL, H5P_DEFAULT, data.data()));
+  NONNEG(H5Dclose(dset_id));
+  NONNEG(H5Sclose(space));
+  NONNEG(H5Fclose(fid));
+
+  fid = NONNEG(H5Fopen("test_Dset_layout.h5", H5F_ACC_RDONLY, H5P_DEFAULT));
+  DsetLayout layout;
+  hid_t attr = -1;
+  if (not DsetLayoutCache::stored(fid, "dsetS", layout, attr)) throw std::runtime_error("no stored layout");
+  NONNEG(H5Aclose(attr));
+  if ((layout.layout != H5D_CHUNKED) or (layout.h5type != H5T_NATIVE_INT16) or (layout.rank != 2) or
+      (layout.chunk != std::vector<hsize_t>{4, 3}) or (layout.num_vds_mappings != 1)) {
+    throw std::runtime_error("stored layout differs");
+  }
+  if (DsetLayoutCache::stored(fid, "dsetP", layout, attr)) throw std::runtime_error("a raw dataset has a stored layout");
+
+  const size_t misses = layout_cache.misses(), hits = layout_cache.hits();
+  Dset dset = Dset::open(fid, "dsetS", Dset::if_vds_first_missing);
+  std::vector<int16_t> buf;
+  dset.read(0, 1, buf);
+  if ((buf.size() != 3) or (buf.at(2) != 3)) throw std::runtime_error("reading a stored layout dataset failed");
+  dset.close();
+  if ((layout_cache.misses() != misses) or (layout_cache.hits() != hits)) {
+    throw std::runtime_error("a dataset with a stored layout was probed");
+  }
+  Dset probed = Dset::open(fid, "dsetP", Dset::if_vds_first_missing);
+  probed.close();
+  if (layout_cache.misses() != misses + 1) throw std::runtime_error("a raw dataset was not probed");
+  const size_t cached = layout_cache.size();
+  NONNEG(H5Fclose(fid));
+  layout_cache.release_files();
+  if (layout_cache.size() != cached - 1) throw std::runtime_error("layouts of a closed file were kept");
+  remove("test_Dset_layout.h5");
+}
+
+
+bool batch_add_throws(DsetBatch &batch, Dset &dset, std::vector<int64_t> &buf) {
+  try {
+    batch.add(dset, 0, 1, &buf.at(0), buf.size());
+  } catch (const std::runtime_error &) {
+    return true;
+  }
+  return false;
+}
+
+
+// a dataset is in a batch at most once, until the batch is cleared
+void batch_read() {
+  hid_t fid = H5Fopen("test_Dset.h5", H5F_ACC_RDONLY, H5P_DEFAULT);
+  Dset dset = Dset::open(fid, "dsetA", Dset::if_vds_first_missing);
+  std::vector<int64_t> buf(3), other(3);
+  DsetBatch batch, other_batch;
+  batch.add(dset, 3, 3, &buf.at(0), buf.size());
+  if (not batch_add_throws(batch, dset, buf)) throw std::runtime_error("a dataset was added to a batch twice");
+  other_batch.add(dset, 4, 1, &other.at(0), other.size());
+  batch.read();
+  if ((buf.at(0) != 3) or (buf.at(2) != 5)) throw std::runtime_error("batch read failed");
+  if (not batch_add_throws(batch, dset, buf)) throw std::runtime_error("a read batch took a dataset again");
+  batch.clear();
+  batch.add(dset, 6, 1, &buf.at(0), buf.size());
+  if (batch.size() != 1) throw std::runtime_error("a cleared batch did not take the dataset again");
+  dset.close();
+  NONNEG(H5Fclose(fid));
+}
+
+
 int main(int argc, char *argv[]) {
   write_file();
   read_file();
+  batch_read();
+  read_contiguous();
+  read_mapped();
+  recreate_file();
+  stored_layout();
   return 0;
 }
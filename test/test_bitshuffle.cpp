@@ -0,0 +1,110 @@
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <stdexcept>
+#include <vector>
+#include "hdf5.h"
+#include "check_macros.h"
+#include "BitshuffleFilter.h"
+#include "Dset.h"
+#include "test_check.h"
+
+// pixels around a pedestal, like cspad
+std::vector<int16_t> detector_data(size_t len, unsigned seed) {
+  std::mt19937 rng(seed);
+  std::normal_distribution<double> noise(0.0, 8.0);
+  std::vector<int16_t> data(len);
+  for (size_t idx = 0; idx < len; ++idx) data.at(idx) = int16_t(1200 + int(noise(rng)));
+  return data;
+}
+
+bool roundtrip(const std::vector<uint8_t> &in, size_t elem_size, size_t block_elements) {
+  std::vector<uint8_t> packed(bitshuffle::compress_bound(in.size(), elem_size, block_elements));
+  size_t len = bitshuffle::compress(in.data(), in.size(), elem_size, block_elements, packed.data());
+  if (bitshuffle::decompressed_size(packed.data(), len) != in.size()) return false;
+  std::vector<uint8_t> out(in.size() + 1);
+  size_t out_len = bitshuffle::decompress(packed.data(), len, out.data(), out.size());
+  return (out_len == in.size()) and (memcmp(out.data(), in.data(), in.size()) == 0);
+}
+
+int main() {
+  // the transpose against its definition: plane k of byte b, byte j bit m,
+  // is bit k of byte b of element 8j+m
+  const size_t num_elem = 1000 * 8, elem_size = 2;
+  std::vector<int16_t> pixels = detector_data(num_elem, 1);
+  const uint8_t *in = reinterpret_cast<const uint8_t *>(pixels.data());
+  std::vector<uint8_t> simd(num_elem * elem_size), scalar(num_elem * elem_size), scratch(num_elem * elem_size);
+  bitshuffle::bit_transpose(in, simd.data(), num_elem, elem_size, scratch.data());
+  bitshuffle::bit_transpose_scalar(in, scalar.data(), num_elem, elem_size, scratch.data());
+  bool defined_ok = true;
+  for (size_t byte = 0; byte < elem_size; ++byte) {
+    for (size_t bit = 0; bit < 8; ++bit) {
+      for (size_t elem = 0; elem < num_elem; ++elem) {
+        unsigned expected = (in[elem * elem_size + byte] >> bit) & 1;
+        unsigned got = (scalar[byte * num_elem + bit * (num_elem / 8) + elem / 8] >> (elem % 8)) & 1;
+        if (got != expected) defined_ok = false;
+      }
+    }
+  }
+  check(defined_ok, "scalar bit transpose matches the definition");
+  check(simd == scalar, bitshuffle::simd_enabled() ? "SIMD transpose matches scalar" : "no SIMD, fallback used");
+
+  std::vector<uint8_t> back(num_elem * elem_size), back_scalar(num_elem * elem_size);
+  bitshuffle::bit_untranspose(simd.data(), back.data(), num_elem, elem_size, scratch.data());
+  bitshuffle::bit_untranspose_scalar(simd.data(), back_scalar.data(), num_elem, elem_size, scratch.data());
+  check(memcmp(back.data(), in, back.size()) == 0, "untranspose inverts transpose");
+  check(back == back_scalar, "SIMD untranspose matches scalar");
+
+  // lz4 alone
+  std::vector<uint8_t> text(5000);
+  for (size_t idx = 0; idx < text.size(); ++idx) text.at(idx) = uint8_t("abcabcabd"[idx % 9]);
+  std::vector<uint8_t> packed(bitshuffle::lz4_bound(text.size())), unpacked(text.size());
+  size_t len = bitshuffle::lz4_compress(text.data(), text.size(), packed.data(), packed.size());
+  check(len > 0 and len < text.size() / 10, "lz4 compresses a repeating pattern");
+  check(bitshuffle::lz4_decompress(packed.data(), len, unpacked.data(), unpacked.size()) == text.size() and
+        unpacked == text, "lz4 roundtrip");
+  bool threw = false;
+  try {
+    bitshuffle::lz4_decompress(packed.data(), len, unpacked.data(), text.size() / 2);
+  } catch (const std::runtime_error &) {
+    threw = true;
+  }
+  check(threw, "lz4 decompress refuses to overrun its output");
+
+  // whole buffers, odd sizes leave a tail
+  std::vector<uint8_t> bytes(in, in + num_elem * elem_size);
+  check(roundtrip(bytes, 2, 0), "roundtrip int16, default blocks");
+  check(roundtrip(bytes, 2, 24), "roundtrip int16, small blocks");
+  bytes.resize(bytes.size() - 11);
+  check(roundtrip(bytes, 2, 0), "roundtrip with elements and a byte past the blocks");
+  check(roundtrip(std::vector<uint8_t>(5, 7), 8, 0), "roundtrip smaller than one element group");
+  std::vector<uint8_t> noise(40000);
+  std::mt19937 rng(3);
+  for (size_t idx = 0; idx < noise.size(); ++idx) noise.at(idx) = uint8_t(rng());
+  check(roundtrip(noise, 4, 0), "roundtrip incompressible data, stored raw");
+
+  // through hdf5
+  const char *fname = "test_bitshuffle.h5";
+  hid_t fid = NONNEG(H5Fcreate(fname, H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT));
+  std::vector<hsize_t> chunk = {2, 4, 185, 388};
+  std::vector<hsize_t> dims = {0, 8, 185, 388};
+  const size_t frame_len = 8 * 185 * 388;
+  std::vector<int16_t> frames = detector_data(3 * frame_len, 2);
+  Dset dset = Dset::create(fid, "data", H5T_NATIVE_INT16, chunk, dims, ChunkCachePolicy::for_writer(), filter_bitshuffle_lz4);
+  dset.append(3, frames.data(), frames.size());
+  dset.close();
+  NONNEG(H5Fclose(fid));
+
+  fid = NONNEG(H5Fopen(fname, H5F_ACC_RDONLY, H5P_DEFAULT));
+  dset = Dset::open(fid, "data", Dset::if_vds_first_missing);
+  std::vector<int16_t> read_back(3 * frame_len);
+  dset.read(0, 3, read_back.data(), read_back.size());
+  check(read_back == frames, "hdf5 dataset with the filter reads back");
+  hsize_t storage = H5Dget_storage_size(dset.id());
+  check(storage * 2 < frames.size() * sizeof(int16_t), "pedestal plus noise compresses better than 2x");
+  dset.close();
+  NONNEG(H5Fclose(fid));
+  remove(fname);
+  return 0;
+}
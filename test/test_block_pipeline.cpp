@@ -0,0 +1,124 @@
+#include <cstdio>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include "BlockPipeline.h"
+#include "Dset.h"
+#include "check_macros.h"
+#include "test_check.h"
+
+struct Block {
+  int value;
+  Block() : value(-1) {}
+};
+
+typedef BlockPipeline<Block> Pipeline;
+
+
+// fills blocks 0..num_blocks-1, then throws if fail is set
+void reader(Pipeline &pipeline, int num_blocks, bool fail, int &filled) {
+  filled = 0;
+  try {
+    for (int slot = 0; (num_blocks < 0) or (filled < num_blocks); slot = 1 - slot) {
+      Block *block = pipeline.wait_for_empty(slot);
+      if (block == NULL) break;
+      block->value = filled++;
+      pipeline.publish(slot);
+    }
+    if (fail) throw std::runtime_error("reader failed");
+    pipeline.reader_done(std::exception_ptr());
+  } catch (...) {
+    pipeline.reader_done(std::current_exception());
+  }
+}
+
+
+// fills one block, then waits, like ana_reader_master, for a writer that
+// never appends, with no timeout. Only stopping the pipeline ends the wait.
+void stalled_reader(Pipeline &pipeline, Dset &dset, int &filled, bool &waited) {
+  filled = 0;
+  try {
+    Block *block = pipeline.wait_for_empty(0);
+    block->value = filled++;
+    pipeline.publish(0);
+    std::unique_ptr<WaitStrategy> strategy = WaitStrategy::create("backoff", 0, 100, 10000,
+                                                                  std::vector<std::string>());
+    waited = dset.wait(1, *strategy, -1, false, [&pipeline] { return pipeline.stopped(); });
+    pipeline.reader_done(std::exception_ptr());
+  } catch (...) {
+    pipeline.reader_done(std::current_exception());
+  }
+}
+
+
+// the analysis loop of ana_reader_master, a failure stops and joins the reader
+std::string process(Pipeline &pipeline, std::thread &reader_thread, int fail_at, std::vector<int> &values) {
+  try {
+    pipeline.consume(reader_thread, [fail_at, &values](Block &block) {
+      if (block.value == fail_at) throw std::runtime_error("analysis failed");
+      values.push_back(block.value);
+    });
+  } catch (const std::runtime_error &err) {
+    return err.what();
+  }
+  return "";
+}
+
+
+int main() {
+  {
+    Pipeline pipeline;
+    int filled = 0;
+    std::vector<int> values;
+    std::thread reader_thread(reader, std::ref(pipeline), 5, false, std::ref(filled));
+    std::string error = process(pipeline, reader_thread, -1, values);
+    check(error.empty() and (values.size() == 5), "every block is processed");
+    check((values.front() == 0) and (values.back() == 4), "blocks are processed in order");
+    check(not pipeline.stopped(), "the pipeline is not stopped when nothing fails");
+  }
+
+  {
+    Pipeline pipeline;
+    int filled = 0;
+    std::vector<int> values;
+    std::thread reader_thread(reader, std::ref(pipeline), 3, true, std::ref(filled));
+    std::string error = process(pipeline, reader_thread, -1, values);
+    check(error == "reader failed", "a reader error is rethrown on the processing side");
+    check(values.size() == 3, "blocks published before the reader error are processed");
+    check(not reader_thread.joinable(), "the reader is joined after its error");
+  }
+
+  {
+    // the reader would go on forever, the analysis failing must end it
+    Pipeline pipeline;
+    int filled = 0;
+    std::vector<int> values;
+    std::thread reader_thread(reader, std::ref(pipeline), -1, false, std::ref(filled));
+    std::string error = process(pipeline, reader_thread, 4, values);
+    check(error == "analysis failed", "the analysis error is what goes up");
+    check(values.size() == 4, "blocks before the failure are processed");
+    check(not reader_thread.joinable(), "the reader is joined after the analysis fails");
+    check(pipeline.stopped() and (filled <= 6), "the reader stops once the analysis fails");
+    check(pipeline.wait_for_empty(0) == NULL, "no more empty blocks once stopped");
+  }
+
+  {
+    // no hdf5 calls from this thread while the reader runs
+    hid_t fid = NONNEG(H5Fcreate("test_block_pipeline.h5", H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT));
+    Dset dset = Dset::create(fid, "never_written", H5T_NATIVE_INT64, {4});
+    Pipeline pipeline;
+    int filled = 0;
+    bool waited = true;
+    std::vector<int> values;
+    std::thread reader_thread(stalled_reader, std::ref(pipeline), std::ref(dset), std::ref(filled), std::ref(waited));
+    std::string error = process(pipeline, reader_thread, 0, values);
+    check(error == "analysis failed", "the analysis fails while the reader waits");
+    check(not reader_thread.joinable() and not waited, "a reader blocked in a wait is cancelled and joined");
+    dset.close();
+    NONNEG(H5Fclose(fid));
+    remove("test_block_pipeline.h5");
+  }
+  return 0;
+}
@@ -0,0 +1,13 @@
+#ifndef TEST_CHECK_HH
+#define TEST_CHECK_HH
+
+#include <iostream>
+#include <stdexcept>
+
+// prints pass or FAIL for what, and stops the test at the first failure
+inline void check(bool ok, const char *what) {
+  std::cout << (ok ? "pass: " : "FAIL: ") << what << std::endl;
+  if (not ok) throw std::runtime_error(what);
+}
+
+#endif // TEST_CHECK_HH
@@ -0,0 +1,49 @@
+#include <iostream>
+#include <stdexcept>
+#include "ChunkCachePolicy.h"
+#include "test_check.h"
+
+int main() {
+  std::vector<hsize_t> small_chunk = {10};
+  std::vector<hsize_t> cspad_chunk = {1, 32, 185, 388};
+  const size_t cspad_chunk_bytes = 2 * 32 * 185 * 388;
+
+  ChunkCacheSize size = ChunkCachePolicy().size_for(8, small_chunk);
+  check(size.num_chunks == 1, "default, one event at a time, keeps the current chunk");
+  check(size.nbytes == 80, "nbytes is whole chunks");
+  check(size.nslots == 101, "nslots at least 101");
+
+  size = ChunkCachePolicy::for_writer().size_for(2, cspad_chunk);
+  check(size.num_chunks == 0, "one event chunks are written once, they bypass the cache");
+
+  // 2 readers, blocks of 100, 3 round robin sources
+  ChunkCachePolicy reader = ChunkCachePolicy::for_reader(100, 100, 2, 0, 0);
+  size = reader.size_for(8, small_chunk, 3);
+  check(size.num_chunks == 0, "reading a whole block in one call never revisits a chunk");
+
+  reader = ChunkCachePolicy::for_reader(25, 100, 2, 0, 0);
+  size = reader.size_for(8, small_chunk, 3);
+  check(size.num_chunks == 2, "9 events per source per call straddle at most 2 chunks of 10");
+  check(size.nslots == ChunkCachePolicy::next_prime(200), "nslots is a prime around 100 x chunks");
+
+  reader = ChunkCachePolicy::for_reader(1, 100, 2, 2, 0);
+  size = reader.size_for(2, cspad_chunk, 3);
+  check(size.num_chunks == 2, "min_source_events_cached keeps chunks that would bypass");
+
+  reader.max_bytes = cspad_chunk_bytes + 10;
+  size = reader.size_for(2, cspad_chunk, 3);
+  check(size.num_chunks == 1 and size.nbytes == cspad_chunk_bytes, "max_bytes caps whole chunks");
+
+  // 4 events by 4 panels, an event touches 8 chunks
+  std::vector<hsize_t> panel_chunk = {4, 4, 185, 388};
+  std::vector<hsize_t> cspad_dims = {0, 32, 185, 388};
+  size_t per_event = ChunkCachePolicy::chunks_per_event(cspad_dims, panel_chunk);
+  check(per_event == 8, "chunks_per_event for 4 panel chunks");
+  check(ChunkCachePolicy::chunks_per_event(cspad_dims, cspad_chunk) == 1, "chunks_per_event for whole events");
+  size = ChunkCachePolicy::for_writer().size_for(2, panel_chunk, 1, per_event);
+  check(size.num_chunks == 8, "writer keeps every panel chunk of the open events");
+
+  check(ChunkCachePolicy::next_prime(100) == 101, "next_prime(100)");
+  check(ChunkCachePolicy::next_prime(521) == 521, "next_prime(521)");
+  return 0;
+}
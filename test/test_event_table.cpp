@@ -0,0 +1,99 @@
+#include <algorithm>
+#include <iostream>
+#include <cstdio>
+#include <stdexcept>
+#include <vector>
+#include "hdf5.h"
+#include "check_macros.h"
+#include "EventTable.h"
+#include "test_check.h"
+
+// row for event, small values are 100 * event + stream, vlen stream k has
+// (event + k) % 3 values
+void make_row(EventTable &table, int64_t event, std::vector<int64_t> &row, std::vector<int64_t> &blob) {
+  row.assign(table.row_len(), 0);
+  row.at(EventTable::FIDUCIAL) = event;
+  row.at(EventTable::MILLI) = 1000 + event;
+  row.at(EventTable::NANO) = 2000 + event;
+  for (size_t small = 0; small < table.num_small(); ++small) row.at(EventTable::SMALL + small) = 100 * event + small;
+  for (size_t vlen = 0; vlen < table.num_vlen(); ++vlen) {
+    int64_t count = (event + vlen) % 3;
+    row.at(table.vlen_count_column() + vlen) = count;
+    for (int64_t idx = 0; idx < count; ++idx) blob.push_back(10 * event + vlen);
+  }
+}
+
+int main() {
+  const char *fname = "test_event_table.h5";
+  const int64_t num_events = 7;
+  hid_t fapl = NONNEG(H5Pcreate(H5P_FILE_ACCESS));
+  NONNEG(H5Pset_libver_bounds(fapl, H5F_LIBVER_LATEST, H5F_LIBVER_LATEST));
+  hid_t fid = NONNEG(H5Fcreate(fname, H5F_ACC_TRUNC, H5P_DEFAULT, fapl));
+  NONNEG(H5Pclose(fapl));
+  EventTable table = EventTable::create(fid, 4, 2, 3, 5);
+  check(table.row_len() == 3 + 4 + 2 * 2, "row is fiducial, milli, nano, small, vlen start and count");
+
+  hid_t type = EventTable::row_type(4, 2);
+  check(H5Tget_size(type) == table.row_len() * sizeof(int64_t), "compound is the size of an int64 row");
+  check(H5Tget_nmembers(type) == 6, "compound has 6 members");
+  NONNEG(H5Tclose(type));
+  type = EventTable::row_type(0, 0);
+  check(H5Tget_nmembers(type) == 3, "no array members for no streams");
+  NONNEG(H5Tclose(type));
+
+  // one event, then the rest in one append
+  std::vector<int64_t> row, blob;
+  make_row(table, 0, row, blob);
+  table.append(1, row.data(), blob.data(), blob.size());
+  std::vector<int64_t> rest, rest_blob;
+  for (int64_t event = 1; event < num_events; ++event) {
+    make_row(table, event, row, rest_blob);
+    rest.insert(rest.end(), row.begin(), row.end());
+  }
+  table.append(num_events - 1, rest.data(), rest_blob.data(), rest_blob.size());
+  bool threw = false;
+  try {
+    table.append(1, row.data(), rest_blob.data(), 0);
+  } catch (const std::runtime_error &) {
+    threw = true;
+  }
+  check(threw and table.num_rows() == hsize_t(num_events), "append checks the blob length against vlen_count");
+  blob.insert(blob.end(), rest_blob.begin(), rest_blob.end());
+  table.close();
+  NONNEG(H5Fclose(fid));
+
+  fid = NONNEG(H5Fopen(fname, H5F_ACC_RDONLY, H5P_DEFAULT));
+  table = EventTable::open(fid);
+  check(table.num_small() == 4 and table.num_vlen() == 2, "open gets the stream counts from the compound");
+  check(table.num_rows() == hsize_t(num_events) and table.blob_len() == blob.size(), "all rows and blob values are there");
+
+  std::vector<int64_t> read_rows(num_events * table.row_len());
+  table.read(0, num_events, read_rows.data());
+  std::vector<int64_t> read_blob(table.blob_len());
+  table.read_blob(0, table.blob_len(), read_blob.data());
+  check(read_blob == blob, "blob reads back");
+
+  bool rows_ok = true;
+  for (int64_t event = 0; event < num_events; ++event) {
+    const int64_t *values = &read_rows.at(event * table.row_len());
+    rows_ok = rows_ok and (values[EventTable::FIDUCIAL] == event) and (values[EventTable::NANO] == 2000 + event)
+      and (values[EventTable::SMALL + 3] == 100 * event + 3);
+    for (size_t vlen = 0; vlen < table.num_vlen(); ++vlen) {
+      int64_t start = values[table.vlen_start_column() + vlen];
+      int64_t count = values[table.vlen_count_column() + vlen];
+      rows_ok = rows_ok and (count == (event + int64_t(vlen)) % 3);
+      for (int64_t idx = start; idx < start + count; ++idx) {
+        rows_ok = rows_ok and (read_blob.at(idx) == 10 * event + int64_t(vlen));
+      }
+    }
+  }
+  check(rows_ok, "rows read back, vlen_start points at each stream's values");
+
+  std::vector<int64_t> one(table.row_len());
+  table.read(5, 1, one.data());
+  check(std::equal(one.begin(), one.end(), read_rows.begin() + 5 * table.row_len()), "read from the middle");
+  table.close();
+  NONNEG(H5Fclose(fid));
+  remove(fname);
+  return 0;
+}
@@ -0,0 +1,46 @@
+#include <iostream>
+#include <cstdlib>
+#include <stdexcept>
+#include "LatencyHistogram.h"
+#include "test_check.h"
+
+bool within(int64_t value, int64_t expected, double rel) {
+  return std::llabs(value - expected) <= int64_t(rel * double(expected)) + 1;
+}
+
+int main() {
+  check(LatencyHistogram::bucket(0) == 0, "0 is bucket 0");
+  check(LatencyHistogram::bucket(255) == 255, "values under 256 are exact");
+  check(LatencyHistogram::bucket(256) == 256 and LatencyHistogram::bucket(257) == 256, "256 buckets by 2");
+  check(LatencyHistogram::bucket(-5) == 0, "negative clamps to 0");
+  check(LatencyHistogram::bucket(LatencyHistogram::MAX_VALUE) == LatencyHistogram::NUM_BUCKETS - 1, "MAX_VALUE is the last bucket");
+  check(LatencyHistogram::bucket(int64_t(1) << 50) == LatencyHistogram::NUM_BUCKETS - 1, "larger values clamp");
+
+  bool bounds_ok = true;
+  for (int bucket = 0; bucket < LatencyHistogram::NUM_BUCKETS; ++bucket) {
+    int64_t lower = LatencyHistogram::bucket_lower(bucket), upper = LatencyHistogram::bucket_upper(bucket);
+    if ((LatencyHistogram::bucket(lower) != bucket) or (LatencyHistogram::bucket(upper) != bucket)) bounds_ok = false;
+    if ((bucket > 0) and (lower != LatencyHistogram::bucket_upper(bucket - 1) + 1)) bounds_ok = false;
+    if (double(upper - lower) > double(lower) / 127.0) bounds_ok = false;
+  }
+  check(bounds_ok, "buckets are contiguous, and under 1% wide");
+
+  // 1us to 1ms
+  LatencyHistogram hist;
+  for (int64_t micro = 1; micro <= 1000; ++micro) hist.record(micro * 1000);
+  check(hist.count() == 1000, "count");
+  check(hist.min() == 1000 and hist.max() == 1000000, "min and max are exact");
+  check(within(hist.percentile(50), 500000, 0.01), "p50 within 1%");
+  check(within(hist.percentile(99), 990000, 0.01), "p99 within 1%");
+  check(within(hist.percentile(99.9), 999000, 0.01), "p999 within 1%");
+  check(hist.percentile(100) == 1000000, "p100 is the max");
+
+  LatencyHistogram other;
+  other.record(5);
+  hist.merge(other);
+  check(hist.count() == 1001 and hist.min() == 5 and hist.percentile(0) == 5, "merge");
+
+  hist.clear();
+  check(hist.count() == 0 and hist.percentile(50) == 0, "clear");
+  return 0;
+}
@@ -0,0 +1,77 @@
+#include <algorithm>
+#include <iostream>
+#include <cstdio>
+#include <random>
+#include <stdexcept>
+#include <vector>
+#include "hdf5.h"
+#include "check_macros.h"
+#include "Dset.h"
+#include "Pedestal.h"
+#include "test_check.h"
+
+int main() {
+  // 4 frames of 3 x 37 pixels, an odd length leaves a tail past the SIMD lanes
+  std::vector<hsize_t> frame_dims = {3, 37};
+  const size_t frame_len = 3 * 37, num_frames = 4;
+  std::mt19937 rng(5);
+  std::uniform_int_distribution<int> level(1000, 1400), noise(-20, 20);
+  std::vector<int16_t> levels(frame_len), frames(num_frames * frame_len);
+  for (size_t idx = 0; idx < frame_len; ++idx) levels.at(idx) = int16_t(level(rng));
+  for (size_t idx = 0; idx < frames.size(); ++idx) frames.at(idx) = int16_t(levels.at(idx % frame_len) + noise(rng));
+
+  Pedestal pedestal = Pedestal::from_frames(frames.data(), num_frames, frame_dims);
+  check(pedestal.frame_len() == frame_len and pedestal.frame_dims() == frame_dims, "pedestal has the frame shape");
+  int64_t sum = 0;
+  for (size_t frame = 0; frame < num_frames; ++frame) sum += frames.at(frame * frame_len + 7);
+  check(pedestal.values().at(7) == int16_t((sum + 2) / 4), "pedestal is the rounded per pixel mean");
+
+  std::vector<int16_t> simd(frames.size()), scalar(frames.size());
+  pedestal.subtract(frames.data(), simd.data(), num_frames, true);
+  pedestal.subtract(frames.data(), scalar.data(), num_frames, false);
+  check(simd == scalar, Pedestal::simd_enabled() ? "SIMD subtract matches scalar" : "no SIMD, fallback used");
+  bool small = true;
+  for (auto value : simd) small = small and (value >= -40) and (value <= 40);
+  check(small, "subtracted frames are near 0");
+  pedestal.restore(simd.data(), num_frames, true);
+  pedestal.restore(scalar.data(), num_frames, false);
+  check(simd == frames and scalar == frames, "restore undoes subtract");
+
+  // values far from the pedestal wrap, and still come back
+  std::vector<int16_t> extremes(frame_len);
+  for (size_t idx = 0; idx < frame_len; ++idx) extremes.at(idx) = (idx % 2) ? int16_t(-32768) : int16_t(32767);
+  std::vector<int16_t> wrapped(frame_len);
+  pedestal.subtract(extremes.data(), wrapped.data(), 1);
+  pedestal.restore(wrapped.data(), 1);
+  check(wrapped == extremes, "restore undoes subtract at the int16 limits");
+
+  std::vector<int16_t> in_place(frames.begin(), frames.begin() + frame_len);
+  Pedestal().subtract(in_place.data(), in_place.data(), 1);
+  Pedestal().restore(in_place.data(), 1);
+  check(std::equal(in_place.begin(), in_place.end(), frames.begin()), "empty pedestal leaves frames alone");
+
+  // stored next to the data, read back through Dset
+  const char *fname = "test_pedestal.h5";
+  hid_t fid = NONNEG(H5Fcreate(fname, H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT));
+  std::vector<hsize_t> chunk = {2, 3, 37};
+  Dset dset = Dset::create(fid, "data", H5T_NATIVE_INT16, chunk);
+  check(not Pedestal::exists(fid, "pedestal") and Pedestal::load(fid, "pedestal").empty(), "no pedestal, empty load");
+  pedestal.write(fid, "pedestal");
+  std::vector<int16_t> subtracted(frames.size());
+  pedestal.subtract(frames.data(), subtracted.data(), num_frames);
+  dset.append(num_frames, subtracted.data(), subtracted.size());
+  dset.close();
+  NONNEG(H5Fclose(fid));
+
+  fid = NONNEG(H5Fopen(fname, H5F_ACC_RDONLY, H5P_DEFAULT));
+  dset = Dset::open(fid, "data", Dset::if_vds_first_missing);
+  Pedestal stored = Pedestal::load(fid, "pedestal");
+  check(stored.values() == pedestal.values() and stored.frame_dims() == frame_dims, "pedestal dataset reads back");
+  std::vector<int16_t> read_back(frames.size());
+  stored.read(dset, 0, num_frames, read_back.data(), read_back.size());
+  check(read_back == frames, "Pedestal::read gives the raw frames");
+  dset.close();
+  NONNEG(H5Fclose(fid));
+  remove(fname);
+  return 0;
+}
@@ -0,0 +1,111 @@
+#include <algorithm>
+#include <iostream>
+#include <cstdio>
+#include <stdexcept>
+#include <vector>
+#include "hdf5.h"
+#include "check_macros.h"
+#include "PixelSeries.h"
+#include "test_check.h"
+
+// a value no two pixels or events share
+int16_t pixel_value(size_t event, size_t panel, size_t y, size_t x) {
+  return int16_t(event * 100 + panel * 50 + y * 7 + x);
+}
+
+int main() {
+  const char *fname = "test_pixel_series.h5";
+  // tiles of 2 x 3 and chunks of 4 events leave partial tiles and chunks at the edges
+  const std::vector<hsize_t> frame_dims = {2, 5, 7};
+  const size_t num_events = 11, frame_len = 2 * 5 * 7;
+  std::vector<int16_t> frames(num_events * frame_len);
+  for (size_t event = 0; event < num_events; ++event)
+    for (size_t panel = 0; panel < 2; ++panel)
+      for (size_t y = 0; y < 5; ++y)
+        for (size_t x = 0; x < 7; ++x)
+          frames.at(event * frame_len + panel * 35 + y * 7 + x) = pixel_value(event, panel, y, x);
+
+  std::vector<int16_t> blocked(3 * 6 * num_events), naive(blocked.size());
+  PixelSeries::transpose_tile(frames.data(), num_events, frame_dims, 1, 2, 1, 3, 6, blocked.data(), true);
+  PixelSeries::transpose_tile(frames.data(), num_events, frame_dims, 1, 2, 1, 3, 6, naive.data(), false);
+  check(blocked == naive, "blocked and naive transpose agree");
+  check(blocked.at((2 * 6 + 5) * num_events + 9) == pixel_value(9, 1, 4, 6), "tile is [y, x, events]");
+
+  hid_t fapl = NONNEG(H5Pcreate(H5P_FILE_ACCESS));
+  NONNEG(H5Pset_libver_bounds(fapl, H5F_LIBVER_LATEST, H5F_LIBVER_LATEST));
+  hid_t fid = NONNEG(H5Fcreate(fname, H5F_ACC_TRUNC, H5P_DEFAULT, fapl));
+  NONNEG(H5Pclose(fapl));
+  PixelSeries series = PixelSeries::create(fid, "pixels", frame_dims, num_events, 2, 3, 4);
+  bool threw = false;
+  try {
+    series.write_frames(1, 4, frames.data());
+  } catch (const std::runtime_error &) {
+    threw = true;
+  }
+  check(threw, "write_frames only takes whole blocks of chunk_events");
+  for (size_t start = 0; start < num_events; start += 4) {
+    size_t count = std::min(size_t(4), num_events - start);
+    series.write_frames(start, count, frames.data() + start * frame_len);
+  }
+  series.close();
+  // chunks compressed before H5Dwrite_chunk, one block of all the events
+  series = PixelSeries::create(fid, "filtered", frame_dims, num_events, 2, 3, 100, filter_bitshuffle_lz4);
+  check(series.chunk_events() == num_events, "chunk_events is at most the events");
+  series.write_frames(0, num_events, frames.data());
+  series.close();
+  NONNEG(H5Fclose(fid));
+
+  fid = NONNEG(H5Fopen(fname, H5F_ACC_RDONLY, H5P_DEFAULT));
+  series = PixelSeries::open(fid, "pixels");
+  check((series.frame_dims() == frame_dims) and (series.num_events() == num_events), "open gets the frame dims and events");
+  check((series.tile_y() == 2) and (series.tile_x() == 3) and (series.chunk_events() == 4), "open gets the tiles from the chunk");
+
+  bool pixels_ok = true;
+  std::vector<int16_t> pixel(num_events);
+  for (size_t panel = 0; panel < 2; ++panel)
+    for (size_t y = 0; y < 5; ++y)
+      for (size_t x = 0; x < 7; ++x) {
+        series.read_pixel(panel, y, x, 0, num_events, pixel.data());
+        for (size_t event = 0; event < num_events; ++event) pixels_ok = pixels_ok and (pixel.at(event) == pixel_value(event, panel, y, x));
+      }
+  check(pixels_ok, "every pixel series reads back, edge tiles too");
+
+  // a box across tiles, for some of the events
+  std::vector<int16_t> box(3 * 4 * 6);
+  series.read_pixels(0, 1, 2, 3, 4, 3, 6, box.data());
+  bool box_ok = true;
+  for (size_t iy = 0; iy < 3; ++iy)
+    for (size_t ix = 0; ix < 4; ++ix)
+      for (size_t idx = 0; idx < 6; ++idx) box_ok = box_ok and (box.at((iy * 4 + ix) * 6 + idx) == pixel_value(3 + idx, 0, 1 + iy, 2 + ix));
+  check(box_ok, "read_pixels is [y, x, events] across tiles");
+  series.close();
+
+  // the bottom row tile of panel 0 has one row of pixels, the other row of
+  // its chunk is padding and must not be left from the tile before
+  hid_t dset = NONNEG(H5Dopen2(fid, "pixels", H5P_DEFAULT));
+  std::vector<int16_t> chunk(2 * 3 * 4, -1);
+  hsize_t offset[4] = {0, 4, 0, 0};
+  uint32_t filters = 0;
+  NONNEG(H5Dread_chunk(dset, H5P_DEFAULT, offset, &filters, chunk.data()));
+  NONNEG(H5Dclose(dset));
+  check((chunk.at(0) == pixel_value(0, 0, 4, 0)) and
+        std::all_of(chunk.begin() + 3 * 4, chunk.end(), [](int16_t value) { return value == 0; }),
+        "edge tiles are padded with zeros");
+
+  series = PixelSeries::open(fid, "filtered");
+  std::vector<int16_t> filtered(box.size());
+  series.read_pixels(0, 1, 2, 3, 4, 3, 6, filtered.data());
+  check(filtered == box, "bitshuffle_lz4 chunks written directly read back through the filter");
+
+  threw = false;
+  try {
+    series.read_pixel(0, 5, 0, 0, 1, pixel.data());
+  } catch (const std::runtime_error &) {
+    threw = true;
+  }
+  check(threw, "read_pixel checks the range");
+  series.close();
+  NONNEG(H5Fclose(fid));
+  remove(fname);
+  return 0;
+}
@@ -0,0 +1,55 @@
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+#include "ReorderBuffer.h"
+#include "test_check.h"
+
+bool throws_runtime_error(ReorderBuffer &buffer, int64_t fiducial, size_t part) {
+  try {
+    buffer.arrive(fiducial, part);
+  } catch (const std::runtime_error &) {
+    return true;
+  }
+  return false;
+}
+
+int main() {
+  // 3 parts, a window of 4 fiducials
+  ReorderBuffer buffer(10, 4, 3);
+  check((buffer.first() == 10) and (buffer.end() == 14), "the window starts at first");
+  check(buffer.fits(13) and (not buffer.fits(14)) and (not buffer.fits(9)), "fits is [first, first + capacity)");
+  check((buffer.slot(10) == 2) and (buffer.slot(13) == 1), "slot is the fiducial mod capacity");
+
+  // part 2 runs ahead, part 0 is late
+  check(buffer.arrive(13, 2) and buffer.arrive(12, 2) and buffer.arrive(10, 1), "parts arrive out of order");
+  check(throws_runtime_error(buffer, 14, 2), "a part past the window does not fit");
+  check(throws_runtime_error(buffer, 13, 2), "a part can not arrive twice");
+  check(throws_runtime_error(buffer, 11, 3), "no part past num_parts");
+  check((buffer.num_arrived(10) == 1) and buffer.arrived(10, 1) and (not buffer.arrived(10, 0)),
+        "arrivals are tracked by part");
+
+  buffer.arrive(10, 0);
+  buffer.arrive(10, 2);
+  check(buffer.num_arrived(10) == buffer.num_parts(), "the front is complete");
+  buffer.pop();
+  check((buffer.first() == 11) and (buffer.end() == 15), "pop moves the window on by one");
+  check(buffer.fits(14) and (buffer.num_arrived(14) == 0), "the popped slot is reused, cleared, by first + capacity");
+  check(buffer.num_arrived(13) == 1, "popping the front leaves the rest");
+
+  // give up on the late writer for 11
+  buffer.arrive(11, 2);
+  check(buffer.idle_seconds(0) > buffer.idle_seconds(2), "the part that arrived last is the least idle");
+  buffer.pop();
+  check(not buffer.arrive(11, 0) and (buffer.num_late() == 1), "a part of a popped event is late and dropped");
+  check(buffer.idle_seconds(0) < buffer.idle_seconds(1), "a late part is no longer idle");
+  check(buffer.arrive(15, 0) and (buffer.slot(15) == 3), "the window wraps around the slots, 15 is where 11 was");
+
+  bool threw = false;
+  try {
+    ReorderBuffer empty(0, 0, 3);
+  } catch (const std::runtime_error &) {
+    threw = true;
+  }
+  check(threw, "capacity can not be 0");
+  return 0;
+}
@@ -0,0 +1,133 @@
+#include <cstdio>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+#include "hdf5.h"
+#include "check_macros.h"
+#include "TypedDset.h"
+#include "test_check.h"
+
+template <class Call>
+bool throws(Call call) {
+  try {
+    call();
+  } catch (const std::runtime_error &) {
+    return true;
+  }
+  return false;
+}
+
+
+hid_t create_file(const char *fname) {
+  hid_t fapl = NONNEG(H5Pcreate(H5P_FILE_ACCESS));
+  NONNEG(H5Pset_libver_bounds(fapl, H5F_LIBVER_LATEST, H5F_LIBVER_LATEST));
+  hid_t fid = NONNEG(H5Fcreate(fname, H5F_ACC_TRUNC, H5P_DEFAULT, fapl));
+  NONNEG(H5Pclose(fapl));
+  return fid;
+}
+
+
+// event e of the rank 1 dataset is 10 * e
+void round_trip_1d(hid_t fid) {
+  typedef TypedDset<int64_t, 1> Typed;
+  Typed dset = Typed::create(fid, "counts", Typed::Dims{{4}});
+  check((dset.dim()[0] == 0) and (dset.event_len() == 1), "a created rank 1 dataset is empty");
+  std::vector<int64_t> data;
+  for (int64_t event = 0; event < 11; ++event) data.push_back(10 * event);
+  dset.append(&data.at(0), data.size(), 3);
+  dset.append(&data.at(3), data.size() - 3, 8);
+  check(dset.dim()[0] == 11, "appends grow the first dim");
+  check(throws([&] { dset.append(&data.at(0), 2, 3); }), "append with too little data throws");
+  dset.close();
+
+  Typed reader = Typed::open(fid, "counts", Dset::if_vds_first_missing);
+  check(reader.dim()[0] == 11, "an opened rank 1 dataset has the appended events");
+  std::vector<int64_t> buf(4, -1);
+  reader.read(5, 4, &buf.at(0), buf.size());
+  check((buf.at(0) == 50) and (buf.at(3) == 80), "read across a chunk boundary");
+  check(throws([&] { reader.read(9, 3, &buf.at(0), buf.size()); }), "read past the end throws");
+  check(throws([&] { reader.read(0, 4, &buf.at(0), 3); }), "read into a short buffer throws");
+  reader.close();
+}
+
+
+// event e of the 2 x 3 x 4 x 5 dataset is 1000 * e + the index in the event
+void round_trip_4d(hid_t fid) {
+  typedef TypedDset<int16_t, 4> Typed;
+  const size_t event_len = 3 * 4 * 5;
+  Typed dset = Typed::create(fid, "frames", Typed::Dims{{2, 3, 4, 5}});
+  check(dset.event_len() == event_len, "event_len is the product of the dims after the first");
+  std::vector<int16_t> data;
+  for (int event = 0; event < 7; ++event) {
+    for (size_t idx = 0; idx < event_len; ++idx) data.push_back(int16_t(1000 * event + idx));
+  }
+  dset.append(&data.at(0), data.size(), 7);
+
+  // a second handle sees the appends after a refresh
+  Typed reader = Typed::open(fid, "frames", Dset::if_vds_first_missing);
+  check(reader.dim()[0] == 7, "an opened rank 4 dataset has the appended events");
+  dset.append(&data.at(0), data.size(), 2);
+  reader.refresh();
+  check((reader.dim()[0] == 9) and (reader.dim()[3] == 5), "refresh picks up the new events");
+
+  std::vector<int16_t> buf(2 * event_len);
+  reader.read(6, 2, &buf.at(0), buf.size());
+  check((buf.at(0) == 6000) and (buf.at(event_len - 1) == 6000 + int(event_len) - 1) and (buf.at(event_len) == 0),
+        "rank 4 read back");
+
+  // strided, every third event
+  std::vector<hsize_t> strided = {0, 3, 6};
+  std::vector<int16_t> events(strided.size() * event_len);
+  reader.read_events(&strided.at(0), strided.size(), &events.at(0), events.size());
+  check((events.at(0) == 0) and (events.at(event_len) == 3000) and (events.at(2 * event_len + 7) == 6007),
+        "read_events on a strided list");
+
+  // irregular, within one chunk and across chunks
+  std::vector<hsize_t> irregular = {1, 2, 5, 8};
+  events.assign(irregular.size() * event_len, -1);
+  reader.read_events(&irregular.at(0), irregular.size(), &events.at(0), events.size());
+  bool same = true;
+  for (size_t idx = 0; idx < irregular.size(); ++idx) {
+    int first = (irregular.at(idx) < 7) ? 1000 * int(irregular.at(idx)) : 1000 * int(irregular.at(idx) - 7);
+    same = same and (events.at(idx * event_len) == first) and (events.at(idx * event_len + 59) == first + 59);
+  }
+  check(same, "read_events on an irregular list");
+  check(throws([&] { reader.read_events(&irregular.at(0), irregular.size(), &events.at(0), event_len); }),
+        "read_events into a short buffer throws");
+  std::vector<hsize_t> past_end = {3, 9};
+  check(throws([&] { reader.read_events(&past_end.at(0), past_end.size(), &events.at(0), events.size()); }),
+        "read_events past the end throws");
+  std::vector<hsize_t> decreasing = {4, 2};
+  check(throws([&] { reader.read_events(&decreasing.at(0), decreasing.size(), &events.at(0), events.size()); }),
+        "read_events on events not increasing throws");
+  reader.close();
+  dset.close();
+}
+
+
+// TypedDset(const Dset&) checks the element type and rank
+void mismatch(hid_t fid) {
+  Dset dset = Dset::open(fid, "counts", Dset::if_vds_first_missing);
+  check(throws([&] { TypedDset<int16_t, 1> typed(dset); }), "int16 over an int64 dataset throws");
+  check(throws([&] { TypedDset<int64_t, 2> typed(dset); }), "rank 2 over a rank 1 dataset throws");
+  TypedDset<int64_t, 1> typed(dset);
+  check(typed.dim()[0] == 11, "the matching type and rank is taken");
+  typed.close();
+
+  dset = Dset::open(fid, "frames", Dset::if_vds_first_missing);
+  check(throws([&] { TypedDset<int64_t, 4> typed(dset); }), "int64 over an int16 dataset throws");
+  check(throws([&] { TypedDset<int16_t, 3> typed(dset); }), "rank 3 over a rank 4 dataset throws");
+  dset.close();
+}
+
+
+int main() {
+  const char *fname = "test_typed_dset.h5";
+  hid_t fid = create_file(fname);
+  round_trip_1d(fid);
+  round_trip_4d(fid);
+  mismatch(fid);
+  NONNEG(H5Fclose(fid));
+  remove(fname);
+  return 0;
+}